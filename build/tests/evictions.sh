@@ -0,0 +1,33 @@
+#!/bin/bash
+# @author Luca Cirillo (545480)
+
+# * Confronta le espulsioni di due esecuzioni del server, dalle statistiche stampate alla chiusura:
+# *  <senza soglie> senza STORAGE_HIGH_WATERMARK, <con soglie> con il reclaimer attivo.
+# *  Con le soglie il reclaimer deve espellere dei file, ed i workers meno che senza
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <output without watermarks> <output with watermarks>"
+    exit 1
+fi
+
+# Espulsioni in primo piano (dai workers) ed in background (dal reclaimer) di un'esecuzione
+evictions() {
+    sed -n 's/^+ Files evicted: \([0-9]*\) (\([0-9]*\) in background).*/\1 \2/p' "$1"
+}
+
+read -r OFF_TOTAL OFF_BACKGROUND <<< "$(evictions "$1")"
+read -r ON_TOTAL ON_BACKGROUND <<< "$(evictions "$2")"
+if [ -z "$OFF_TOTAL" ] || [ -z "$ON_TOTAL" ]; then
+    echo "EVICTIONS CHECK FAILED: missing storage statistics"
+    exit 1
+fi
+OFF_FOREGROUND=$((OFF_TOTAL - OFF_BACKGROUND))
+ON_FOREGROUND=$((ON_TOTAL - ON_BACKGROUND))
+
+echo "Without watermarks: $OFF_FOREGROUND evicted by workers, $OFF_BACKGROUND in background"
+echo "With watermarks: $ON_FOREGROUND evicted by workers, $ON_BACKGROUND in background"
+if [ "$ON_BACKGROUND" -eq 0 ] || [ "$ON_FOREGROUND" -ge "$OFF_FOREGROUND" ]; then
+    echo "EVICTIONS CHECK FAILED"
+    exit 1
+fi
+echo "EVICTIONS CHECK PASSED"
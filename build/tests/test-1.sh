@@ -4,7 +4,7 @@
 # * TEST 1:
 # *  Configurazione del server (config-1.txt): 10000 files, 128 MB, 1 Thread Worker
 # *  Singole istanze del client testano tutte le APIs disponibili
-# *  con un ritardo di 200 ms ed il flag -p attivo
+# *  con un ritardo di 200 ms ed il flag -p attivo; un file da 70 MB inviato con -w deve essere memorizzato
 
 KILOBYTE=1024
 MEGABYTE=1048576 # 1024 * 1024
@@ -42,3 +42,20 @@ $CLIENT -l $DUMMY_DIR/dummy-1,$DUMMY_DIR/dummy-2 $DELAY -c $DUMMY_DIR/dummy-1 $D
 $CLIENT -W $DUMMY_DIR/dummy-1 -D $SAVES_DIR $DELAY
 # -R: leggo dal server tutti i file e li salvo 
 $CLIENT -R n=0 -d $SAVES_DIR $DELAY
+
+# -w: invio una cartella con un file più grande di una richiesta MULTI (64 MB), quindi lo rileggo e lo confronto
+# La cartella viene cancellata al termine, così da non essere inviata di nuovo dal primo -w di un'altra esecuzione
+BIG_DIR=$DUMMY_DIR/big
+mkdir -p $BIG_DIR
+base64 /dev/urandom | head -c $((70 * $MEGABYTE)) > $BIG_DIR/dummy-big
+$CLIENT -w $BIG_DIR $DELAY
+rm -f $SAVES_DIR/$BIG_DIR/dummy-big
+$CLIENT -r $BIG_DIR/dummy-big -d $SAVES_DIR $DELAY
+cmp -s $BIG_DIR/dummy-big $SAVES_DIR/$BIG_DIR/dummy-big
+BIG_WRITTEN=$?
+rm -rf $BIG_DIR
+if [ $BIG_WRITTEN -ne 0 ]; then
+    echo "TEST 1 FAILED: the 70 MB file sent with -w was not stored"
+    exit 1
+fi
+echo "TEST 1 PASSED"
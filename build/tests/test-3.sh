@@ -2,9 +2,10 @@
 # @author Luca Cirillo (545480)
 
 # * TEST 3:
-# *  Configurazione del server (config-3.txt): 100 files, 32 MB, 8 Thread Worker
+# *  Configurazione del server (config-3.txt): 100 files, 32 MB, 8 Thread Worker, espulsioni in background dall'80% al 60%
 # *  Multiple istanze contemporanee di clients testano tutte le APIs disponibili
 # *  con il flag -p disabilitato
+# *  make test3 lo ripete anche senza soglie di riempimento, e confronta le espulsioni con evictions.sh
 
 KILOBYTE=1024
 MEGABYTE=1048576 # 1024 * 1024
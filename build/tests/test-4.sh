@@ -0,0 +1,51 @@
+#!/bin/bash
+# @author Luca Cirillo (545480)
+
+# * TEST 4:
+# *  Configurazione del server (config-4.txt): 40 files, 32 MB, 4 Thread Worker, W-TinyLFU su 16 partizioni
+# *  Un insieme di file letti spesso sopravvive ad una scansione di readNFiles seguita da una raffica
+# *  di file nuovi, che costringe il server ad espellere più file di quanti ne contenga
+# *  make test4 lo ripete anche con ARC e 2Q, cambiando solamente la politica di rimpiazzo
+
+KILOBYTE=1024
+
+BUILD_DIR=./build
+TESTS_DIR=$BUILD_DIR/tests
+DUMMY_DIR=$TESTS_DIR/dummy
+SAVES_DIR=$TESTS_DIR/saves
+EJECTED_DIR=$SAVES_DIR/ejected
+
+SOCKET_FILE=$BUILD_DIR/fss.sk
+CLIENT="$BUILD_DIR/client -f $SOCKET_FILE"
+
+# Genero 8 file letti spesso (hot), 24 file scritti una sola volta (cold) e 48 file nuovi (stream), da 1 KB
+mkdir -p $DUMMY_DIR
+rm -rf $EJECTED_DIR
+mkdir -p $EJECTED_DIR
+echo "Generating dummy files, please wait..."
+for name in hot-{1..8} cold-{1..24} stream-{1..48}; do
+    base64 /dev/urandom | head -c $KILOBYTE > $DUMMY_DIR/$name
+done
+HOT=$(ls -d $DUMMY_DIR/hot-* | paste -sd ',')
+COLD=$(ls -d $DUMMY_DIR/cold-* | paste -sd ',')
+STREAM=$(ls -d $DUMMY_DIR/stream-* | paste -sd ',')
+
+# Memorizzo tutti i file, e leggo più volte i file hot
+$CLIENT -W $HOT,$COLD -D $EJECTED_DIR
+for i in {1..5}; do
+    $CLIENT -r $HOT
+done
+# Leggo tutti i file: la scansione non deve promuovere i file cold tra quelli riutilizzati
+$CLIENT -R n=0
+# Scrivo i file nuovi, salvando quelli espulsi
+$CLIENT -W $STREAM -D $EJECTED_DIR
+
+# Nessun file hot deve essere stato espulso
+EJECTED=$(find $EJECTED_DIR -type f | wc -l)
+EJECTED_HOT=$(find $EJECTED_DIR -type f -name 'hot-*' | wc -l)
+echo "Ejected files: $EJECTED, of which hot: $EJECTED_HOT"
+if [ $EJECTED -eq 0 ] || [ $EJECTED_HOT -ne 0 ]; then
+    echo "TEST 4 FAILED"
+    exit 1
+fi
+echo "TEST 4 PASSED"
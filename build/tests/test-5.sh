@@ -0,0 +1,54 @@
+#!/bin/bash
+# @author Luca Cirillo (545480)
+
+# * TEST 5:
+# *  Configurazione del server (config-5.txt): 10 files, 1 MB, 4 Thread Worker
+# *  Il client asincrono invia sulla stessa connessione, senza attendere le risposte, OPEN, WRITE, READ e CLOSE
+# *  di 32 file, una lettura di un file inesistente ed una READN, e controlla l'esito di ogni callback.
+# *  I file sono più di quelli che il server può contenere: ognuno deve essere stato espulso oppure letto dalla READN
+
+KILOBYTE=1024
+
+BUILD_DIR=./build
+TESTS_DIR=$BUILD_DIR/tests
+DUMMY_DIR=$TESTS_DIR/dummy/async
+SAVES_DIR=$TESTS_DIR/saves
+EJECTED_DIR=$SAVES_DIR/async-ejected
+READ_DIR=$SAVES_DIR/async-read
+
+SOCKET_FILE=$BUILD_DIR/fss.sk
+
+# Genero 32 file, da 8 KB a 256 KB
+rm -rf $DUMMY_DIR $EJECTED_DIR $READ_DIR
+mkdir -p $DUMMY_DIR $EJECTED_DIR $READ_DIR
+echo "Generating dummy files, please wait..."
+for i in {1..32}; do
+    base64 /dev/urandom | head -c $(($i * 8 * $KILOBYTE)) > $DUMMY_DIR/async-$i
+done
+
+# Invio tutte le richieste in un colpo solo
+if ! $BUILD_DIR/async_test -f $SOCKET_FILE -D $EJECTED_DIR -d $READ_DIR $DUMMY_DIR/async-*; then
+    echo "TEST 5 FAILED: unexpected completions"
+    exit 1
+fi
+
+# Ogni file deve essere stato salvato, intatto, come espulso oppure come letto dalla READN
+EJECTED=0
+for file in $DUMMY_DIR/async-*; do
+    if [ -f $EJECTED_DIR/$file ]; then
+        saved=$EJECTED_DIR/$file
+        EJECTED=$((EJECTED + 1))
+    else
+        saved=$READ_DIR/$file
+    fi
+    if ! cmp -s $file $saved; then
+        echo "TEST 5 FAILED: $file was neither ejected nor read back intact"
+        exit 1
+    fi
+done
+echo "Ejected files: $EJECTED"
+if [ $EJECTED -eq 0 ]; then
+    echo "TEST 5 FAILED: no file was ejected"
+    exit 1
+fi
+echo "TEST 5 PASSED"
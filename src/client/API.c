@@ -1,12 +1,20 @@
 // @author Luca Cirillo (545480)
 
+// memfd_create ed i sigilli dei memfd non fanno parte di POSIX
+#define _GNU_SOURCE
+
 #include <API.h>
 #include <constants.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <protocol.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -20,20 +28,297 @@ int client_socket = -1;
 char message_buffer[MESSAGE_LENGTH];
 // Modalità verbose
 bool VERBOSE = false;
+// Versione del protocollo richiesta all'apertura della connessione
+int PROTOCOL_VERSION = PROTOCOL_BINARY;
+// Dimensione della memoria condivisa offerta al server all'apertura della connessione
+size_t SHARED_MEMORY_SIZE = 0;
+
+// Versione del protocollo negoziata con il server
+static int protocol = PROTOCOL_LEGACY;
+// Identificativo dell'ultima richiesta inviata, che il server ripete nella risposta
+static uint32_t request_id = 0;
+// Memoria condivisa con il server, NULL se assente
+static char* shared = NULL;
+static size_t shared_size = 0;
+// Posizione, nella memoria condivisa, del prossimo contenuto della risposta in corso
+static size_t shared_cursor = 0;
+// Il contenuto che segue l'ultimo frame ricevuto si trova nella memoria condivisa
+static bool contents_shared = false;
+
+// * Crea la memoria condivisa da offrire al server, di <size> bytes, e ne ritorna il descrittore
+// Il memfd viene sigillato contro il ridimensionamento: il server può così mapparlo senza rischiare SIGBUS
+static int shared_create(size_t size) {
+    int fd = memfd_create("fss-shared", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) return -1;
+    if (ftruncate(fd, (off_t)size) == -1 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+        close(fd);
+        return -1;
+    }
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    shared = (char*)memory;
+    shared_size = size;
+    return fd;
+}
 
-int openConnection(const char* sockname, int msec, const struct timespec abstime) {
-    // Controllo la validità degli argomenti
-    if (!sockname || msec < 0 || abstime.tv_sec < 0 || abstime.tv_nsec < 0) {
-        errno = EINVAL;
+// * Rilascia la memoria condivisa con il server, se presente
+static void shared_release(void) {
+    if (shared) munmap(shared, shared_size);
+    shared = NULL;
+    shared_size = 0;
+}
+
+// * Invia il frame FRAME_HELLO <frame>, allegando il descrittore <fd> della memoria condivisa se diverso da -1
+static int send_hello(frame_t* frame, int fd) {
+    if (fd == -1) return writen((long)client_socket, (void*)frame, sizeof(frame_t));
+
+    struct iovec iov = {.iov_base = (void*)frame, .iov_len = sizeof(frame_t)};
+    union {
+        struct cmsghdr header;  // Garantisce l'allineamento del buffer
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t sent;
+    while ((sent = sendmsg(client_socket, &message, 0)) == -1 && errno == EINTR)
+        ;
+    if (sent == -1) return -1;
+    // Il descrittore viaggia con il primo byte: l'eventuale resto del frame può essere inviato normalmente
+    if ((size_t)sent < sizeof(frame_t)) return writen((long)client_socket, (char*)frame + sent, sizeof(frame_t) - sent);
+    return 1;
+}
+
+// * Riceve <size> bytes del contenuto che segue l'ultimo frame ricevuto, dalla memoria condivisa oppure dal socket
+static int receive_contents(void* buffer, size_t size) {
+    if (!contents_shared) return readn((long)client_socket, buffer, size);
+    // I contenuti di una risposta sono disposti uno dopo l'altro, nell'ordine dei frames
+    if (!shared || size > shared_size - shared_cursor) {
+        errno = EBADMSG;
         return -1;
     }
+    memcpy(buffer, shared + shared_cursor, size);
+    shared_cursor += size;
+    return 1;
+}
 
-    // Controllo che il client non abbia già instaurato una connessione al server
-    if (client_socket > -1) {
-        errno = EISCONN;
+// * Invia al server la richiesta <command>, con il pathname e l'argomento previsti dal comando,
+// *  seguita da <size> bytes di <payload> (writeFile, appendToFile)
+// <argument> contiene i flags di openFile, N di readNFiles oppure il numero di operazioni di MULTI
+// Un payload che entra nella memoria condivisa viene copiato al suo inizio, se non vi si trova già
+static int send_request(int command, const char* pathname, int argument, void* payload, size_t size) {
+    // La risposta precedente è stata letta per intero
+    shared_cursor = 0;
+
+    if (protocol == PROTOCOL_BINARY) {
+        // Intestazione e pathname viaggiano nello stesso messaggio
+        size_t path_length = pathname ? strlen(pathname) : 0;
+        if (path_length > MESSAGE_LENGTH - sizeof(frame_t)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        frame_t frame = {.opcode = (uint8_t)command,
+                         .flags = command == OPEN ? (uint8_t)argument : 0,
+                         .path_length = (uint16_t)path_length,
+                         .request_id = ++request_id,
+                         .payload_length = size,
+                         .value = command == READN || command == MULTI ? argument : 0};
+        if (shared && size > 0 && size <= shared_size) {
+            if (payload != shared) memcpy(shared, payload, size);
+            frame.flags |= FRAME_SHARED;
+            size = 0;
+        }
+        memcpy(message_buffer, &frame, sizeof(frame));
+        if (path_length > 0) memcpy(message_buffer + sizeof(frame), pathname, path_length);
+        if (writen((long)client_socket, (void*)message_buffer, sizeof(frame) + path_length) == -1) return -1;
+    } else {
+        // Ogni richiesta ha il suo formato testuale
+        memset(message_buffer, 0, MESSAGE_LENGTH);
+        switch (command) {
+            case OPEN:  // OPEN <str:pathname> <int:flags>
+                snprintf(message_buffer, MESSAGE_LENGTH, "%d %s %d", command, pathname, argument);
+                break;
+            case READN:  // READN <int:n>
+                snprintf(message_buffer, MESSAGE_LENGTH, "%d %d", command, argument);
+                break;
+            case WRITE:  // WRITE <str:pathname> <int:file_size>
+            case APPEND:
+                snprintf(message_buffer, MESSAGE_LENGTH, "%d %s %zu", command, pathname, size);
+                break;
+            case DISCONNECT:
+                snprintf(message_buffer, MESSAGE_LENGTH, "%d", command);
+                break;
+            default:  // <int:codice_richiesta> <str:pathname>
+                snprintf(message_buffer, MESSAGE_LENGTH, "%d %s", command, pathname);
+                break;
+        }
+        if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) return -1;
+    }
+
+    // Invio il contenuto del file, se previsto
+    if (size > 0 && writen((long)client_socket, payload, size) == -1) return -1;
+    return 0;
+}
+
+// * Riceve un frame di risposta alla richiesta <command> in corso, controllandone l'identificativo
+static int receive_frame(int command, frame_t* frame) {
+    if (readn((long)client_socket, (void*)frame, sizeof(frame_t)) == -1) return -1;
+    if (frame->opcode != (uint8_t)command || frame->request_id != request_id) {
+        errno = EBADMSG;
+        return -1;
+    }
+    contents_shared = (frame->flags & FRAME_SHARED) != 0;
+    return 0;
+}
+
+// * Riceve dal server l'esito <value> della richiesta <command> e, se richiesta, la dimensione <size>
+// *  del contenuto che lo segue (readFile)
+static int receive_reply(int command, int* value, size_t* size) {
+    if (protocol == PROTOCOL_BINARY) {
+        frame_t frame;
+        if (receive_frame(command, &frame) == -1) return -1;
+        if (frame.flags & FRAME_FILE) {
+            errno = EBADMSG;
+            return -1;
+        }
+        *value = frame.value;
+        if (size) *size = (size_t)frame.payload_length;
+        return 0;
+    }
+
+    contents_shared = false;
+    memset(message_buffer, 0, MESSAGE_LENGTH);
+    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) return -1;
+    // La dimensione segue l'esito solamente nella risposta a readFile
+    size_t size_from_server = 0;
+    if (sscanf(message_buffer, "%d %zu", value, &size_from_server) < (size ? 2 : 1)) {
+        errno = EBADMSG;
+        return -1;
+    }
+    if (size) *size = size_from_server;
+    return 0;
+}
+
+// * Riceve dal server il nome <pathname>, di almeno MESSAGE_LENGTH bytes, e la dimensione <size>
+// *  di un file in risposta alla richiesta <command>, seguiti dal suo contenuto
+static int receive_file_header(int command, char* pathname, size_t* size) {
+    memset(pathname, 0, MESSAGE_LENGTH);
+
+    if (protocol == PROTOCOL_BINARY) {
+        frame_t frame;
+        if (receive_frame(command, &frame) == -1) return -1;
+        if (!(frame.flags & FRAME_FILE) || frame.path_length >= MESSAGE_LENGTH) {
+            errno = EBADMSG;
+            return -1;
+        }
+        if (readn((long)client_socket, (void*)pathname, frame.path_length) == -1) return -1;
+        *size = (size_t)frame.payload_length;
+        return 0;
+    }
+
+    contents_shared = false;
+    memset(message_buffer, 0, MESSAGE_LENGTH);
+    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) return -1;
+
+    char* strtok_status = NULL;
+    // Pathname
+    char* token = strtok_r(message_buffer, " ", &strtok_status);
+    if (!token || sscanf(token, "%s", pathname) != 1) {
+        errno = EBADMSG;
+        return -1;
+    }
+    // Size
+    token = strtok_r(NULL, " ", &strtok_status);
+    if (!token || sscanf(token, "%zu", size) != 1) {
+        errno = EBADMSG;
         return -1;
     }
+    return 0;
+}
+
+// * Salva in <dirname> il contenuto <contents> di <size> bytes del file <pathname> ricevuto dal server
+static int save_file(const char* dirname, const char* pathname, const void* contents, size_t size) {
+    // Creo il path completo per il salvataggio del file
+    // Calcolo la lunghezza del path indicato da dirname
+    size_t dirname_length = strlen(dirname);
+    char abs_path[PATH_MAX];  // => dirname/pathname
+    memset(abs_path, 0, PATH_MAX);
+
+    // Controllo se dirname termina con '/' oppure pathname inizia con '/'
+    int slash = dirname[dirname_length - 1] == '/' || pathname[0] == '/';
+    // Se dirname non termina con '/', e pathname non inizia con '/', lo aggiungo tra i due
+    snprintf(abs_path, PATH_MAX, slash ? "%s%s" : "%s/%s", dirname, pathname);
+
+    // Per mantenere l'integrità del path assoluto del file che ho ricevuto dal server
+    //  ho eventualmente bisogno di creare all'interno di dirname una struttura di cartelle
+    //  per poter contenere il file, in maniera ricorsiva. Un comportamento simile al comando 'mkdir -p <path>'
+    mkdir_p(abs_path);
+
+    // Salvo il contenuto del file sul disco, così come ricevuto
+    FILE* output_file = fopen(abs_path, "w");
+    if (!output_file) return -1;
+    if (size > 0 && fwrite(contents, size, 1, output_file) != 1) {
+        fclose(output_file);
+        return -1;
+    }
+    if (fclose(output_file) == -1) return -1;
+    if (VERBOSE) printf("%zu bytes saved to '%s'!\n", size, abs_path);
+    return 0;
+}
+
+// * Riceve dal server i file espulsi in seguito alla richiesta <command>, da salvare eventualmente in <dirname>
+static int receive_victims(int command, const char* dirname) {
+    // Ricevo dal server il numero di file espulsi
+    int victims_no = 0;
+    if (receive_reply(command, &victims_no, NULL) == -1) return -1;
+    if (victims_no <= 0) return 0;
+
+    size_t victim_size = 0;
+    void* victim_contents = NULL;
+    char victim_pathname[MESSAGE_LENGTH];
+
+    if (VERBOSE) printf("%d file(s) have been ejected from the server\n", victims_no);
+    for (int i = 0; i < victims_no; i++) {
+        // Ricevo dal server il nome e la dimensione del file
+        if (receive_file_header(command, victim_pathname, &victim_size) == -1) return -1;
+
+        if (VERBOSE) printf("Receiving file n.%d (%zu bytes): '%s' \n", i + 1, victim_size, victim_pathname);
+
+        // Alloco spazio per il file
+        victim_contents = malloc(victim_size + 1);
+        if (!victim_contents) return -1;
+        if (receive_contents(victim_contents, victim_size) == -1) {
+            free(victim_contents);
+            return -1;
+        }
+
+        // Se il client ha specificato una cartella in cui salvare i file espulsi,
+        //  procedo a salvare i file ricreando l'albero delle directories specificato nel pathname
+        if (dirname && save_file(dirname, victim_pathname, victim_contents, victim_size) == -1) {
+            free(victim_contents);
+            return -1;
+        }
+
+        free(victim_contents);
+    }
+    return 0;
+}
 
+// * Crea un socket connesso al server al socket file <sockname>, riprovando ogni <msec> fino ad <abstime>
+static int connect_socket(const char* sockname, int msec, const struct timespec abstime) {
     struct sockaddr_un socket_address;
     // Inizializzo la struttura
     memset(&socket_address, '0', sizeof(socket_address));
@@ -42,9 +327,9 @@ int openConnection(const char* sockname, int msec, const struct timespec abstime
     strcpy(socket_address.sun_path, sockname);
 
     // Creo il socket lato client, che si connetterà al server
-    client_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
     // Controllo la buona riuscita dell'operazione
-    if (client_socket == -1) return -1;
+    if (fd == -1) return -1;
 
     // Struttura dati per la nanosleep
     struct timespec sleep_time = {
@@ -52,15 +337,72 @@ int openConnection(const char* sockname, int msec, const struct timespec abstime
         .tv_nsec = msec < 1000 ? msec * 1000000 : 0  // Altrimenti, uso i nanosecondi
     };
 
-    int connect_status = -1;
     // 'Aspetto e riprovo' finché la connessione non va a buon fine e non è ancora scaduto il timeout
-    while ((connect_status = connect(client_socket, (struct sockaddr*)&socket_address, sizeof(socket_address))) == -1 && time(NULL) < abstime.tv_sec) {
-        //printf("Connection failed, I'll try again ...\n");
+    while (connect(fd, (struct sockaddr*)&socket_address, sizeof(socket_address)) == -1) {
+        if (time(NULL) >= abstime.tv_sec) {
+            close(fd);
+            errno = ETIMEDOUT;
+            return -1;
+        }
         nanosleep(&sleep_time, NULL);  // Aspetto per msec
     }
+    return fd;
+}
+
+int openConnection(const char* sockname, int msec, const struct timespec abstime) {
+    // Controllo la validità degli argomenti
+    if (!sockname || msec < 0 || abstime.tv_sec < 0 || abstime.tv_nsec < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Controllo che il client non abbia già instaurato una connessione al server
+    if (client_socket > -1) {
+        errno = EISCONN;
+        return -1;
+    }
+
+    // Creo il socket e mi connetto al server
+    client_socket = connect_socket(sockname, msec, abstime);
+    if (client_socket == -1) return -1;
+
+    // * Negozio con il server la versione del protocollo
+    // Con il protocollo testuale non serve alcuna negoziazione: è il formato del primo messaggio a indicarlo
+    protocol = PROTOCOL_LEGACY;
+    request_id = 0;
+    if (PROTOCOL_VERSION >= PROTOCOL_BINARY) {
+        frame_t frame = {.opcode = FRAME_HELLO, .value = PROTOCOL_VERSION};
+        // Offro al server la memoria condivisa, se richiesta: in caso di errore proseguo senza
+        int memory_fd = SHARED_MEMORY_SIZE > 0 ? shared_create(SHARED_MEMORY_SIZE) : -1;
+        if (memory_fd != -1) {
+            frame.flags = FRAME_SHARED;
+            frame.payload_length = SHARED_MEMORY_SIZE;
+        }
+        int r = send_hello(&frame, memory_fd);
+        // Il server ha ricevuto una propria copia del descrittore, mentre la mappatura resta valida
+        if (memory_fd != -1) close(memory_fd);
+        if (r == 1) {
+            memset(&frame, 0, sizeof(frame));
+            r = readn((long)client_socket, (void*)&frame, sizeof(frame));
+        }
+        // Il server ha chiuso la connessione, oppure ha risposto con una versione che non conosco
+        if (r == 0 || (r > 0 && (frame.opcode != FRAME_HELLO || frame.value < PROTOCOL_LEGACY || frame.value > PROTOCOL_BINARY))) {
+            errno = EPROTO;
+            r = -1;
+        }
+        if (r == -1) {
+            shared_release();
+            close(client_socket);
+            client_socket = -1;
+            return -1;
+        }
+        protocol = frame.value;
+        // Il server potrebbe aver rifiutato la memoria condivisa
+        if (protocol != PROTOCOL_BINARY || !(frame.flags & FRAME_SHARED)) shared_release();
+        if (VERBOSE) printf("Using protocol version %d%s\n", protocol, shared ? " with shared memory" : "");
+    }
 
-    if (connect_status == -1) errno = ETIMEDOUT;
-    return connect_status;
+    return 0;
 }
 
 int closeConnection(const char* sockname) {
@@ -77,16 +419,12 @@ int closeConnection(const char* sockname) {
     }
 
     // Mando al server un messaggio di uscita
-    // Svuoto il buffer di comunicazione
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    // Scrivo nel buffer il comando per chiudere la connessione
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d", DISCONNECT);
-    // Invio il messaggio al server
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    if (send_request(DISCONNECT, NULL, 0, NULL, 0) == -1) {
         return -1;
     }
 
     // Non aspetto una risposta dal server, chiuso il socket
+    shared_release();
     if (close(client_socket) == -1) {
         client_socket = -1;
         return -1;
@@ -111,114 +449,21 @@ int openFile(const char* pathname, int flags, const char* dirname) {
         return -1;
     }
 
-    // Preparo la richiesta da inviare
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s %d", OPEN, pathname, flags);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    // Invio la richiesta
+    if (send_request(OPEN, pathname, flags, NULL, 0) == -1) {
         return -1;
     }
 
     if (VERBOSE) printf("Request to open '%s' file... \n", pathname);
 
     // Ricevo dal server eventuali file espulsi
-    int victims_no = 0;
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
-    }
-    if (sscanf(message_buffer, "%d", &victims_no) != 1) {
-        errno = EBADMSG;
+    if (receive_victims(OPEN, dirname) == -1) {
         return -1;
     }
 
-    if (victims_no > 0) {
-        int i = 0;
-        char* token = NULL;
-        char* strtok_status = NULL;
-
-        size_t victim_size = 0;
-        void* victim_contents = NULL;
-        char victim_pathname[MESSAGE_LENGTH];
-
-        if (VERBOSE) printf("%d file(s) have been ejected from the server\n", victims_no);
-        for (; i < victims_no; i++) {
-            // Ricevo dal server il nome e la dimensione del file
-            memset(message_buffer, 0, MESSAGE_LENGTH);
-            memset(victim_pathname, 0, MESSAGE_LENGTH);
-            if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-                return -1;
-            }
-
-            // Pathname
-            token = strtok_r(message_buffer, " ", &strtok_status);
-            if (!token || sscanf(token, "%s", victim_pathname) != 1) {
-                errno = EBADMSG;
-                return -1;
-            }
-            // Size
-            token = strtok_r(NULL, " ", &strtok_status);
-            if (!token || sscanf(token, "%zu", &victim_size) != 1) {
-                errno = EBADMSG;
-                return -1;
-            }
-
-            if (VERBOSE) printf("Receiving file n.%d (%zu bytes): '%s' \n", i + 1, victim_size, victim_pathname);
-
-            // Alloco spazio per il file
-            victim_contents = malloc(victim_size);
-            if (!victim_contents) return -1;
-
-            memset(victim_contents, 0, victim_size);
-            if (readn((long)client_socket, victim_contents, victim_size) == -1) {
-                return -1;
-            }
-
-            // Se il client ha specificato una cartella in cui salvare i file espulsi,
-            //  procedo a salvare i file ricreando l'albero delle directories specificato nel pathname
-            if (dirname) {
-                // Creo il path completo per il salvataggio del file
-                // Calcolo la lunghezza del path indicato da dirname
-                size_t dirname_length = strlen(dirname);
-                char abs_path[PATH_MAX];  // => dirname/victim_pathname
-                memset(abs_path, 0, PATH_MAX);
-
-                // Gestisco il caso in cui dirname termina con '/' e victim_pathname inizia con '/'
-                //if(dirname[dirname_length-1] == '/' && victim_pathname[0] == '/') dirname[dirname_length-1] = '\0';
-                // Controllo se dirname termina con '/' oppure victim_pathname inizia con '/'
-                int slash = dirname[dirname_length - 1] == '/' || victim_pathname[0] == '/';
-                // Se dirname non termina con '/', e victim_name non inizia con '/', lo aggiungo tra i due
-                snprintf(abs_path, PATH_MAX, slash ? "%s%s" : "%s/%s", dirname, victim_pathname);
-
-                // Per mantenere l'integrità del path assoluto del file che ho ricevuto dal server
-                //  ho eventualmente bisogno di creare all'interno di dirname una struttura di cartelle
-                //  per poter contenere il file, in maniera ricorsiva. Un comportamento simile al comando 'mkdir -p <path>'
-                mkdir_p(abs_path);
-
-                // Salvo il contenuto del file sul disco
-                FILE* output_file = fopen(abs_path, "w");
-                if (!output_file) return -1;
-                if (fputs(victim_contents, output_file) == EOF) {
-                    fclose(output_file);
-                    return -1;
-                }
-                if (fclose(output_file) == -1) return -1;
-                if (VERBOSE) printf("%zu bytes saved to '%s'!\n", victim_size, abs_path);
-            }
-
-            free(victim_contents);
-        }
-    }
-
     // Leggo la risposta
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
-    }
-
-    // Interpreto (il codice del)la risposta ricevuta
     int status;
-    if (sscanf(message_buffer, "%d", &status) != 1) {
-        errno = EBADMSG;
+    if (receive_reply(OPEN, &status, NULL) == -1) {
         return -1;
     }
 
@@ -245,26 +490,16 @@ int readFile(const char* pathname, void** buf, size_t* size, const char* dirname
     }
 
     // Invio al server la richiesta di READ
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s", READ, pathname);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    if (send_request(READ, pathname, 0, NULL, 0) == -1) {
         return -1;
     }
 
     if (VERBOSE) printf("Request to read '%s' file...\n", pathname);
 
     // Ricevo dal server un messaggio di conferma e, se il file è stato trovato, la sua dimensione
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
-    }
-
     int result = 0;
-    char* strtok_status = NULL;
-    char* token = strtok_r(message_buffer, " ", &strtok_status);
-
-    if (!token) return -1;
-    if (sscanf(token, "%d", &result) != 1) {
+    size_t size_from_server = 0;
+    if (receive_reply(READ, &result, &size_from_server) == -1) {
         return -1;
     }
 
@@ -279,49 +514,18 @@ int readFile(const char* pathname, void** buf, size_t* size, const char* dirname
     }
 
     // result = 1 => file trovata e permessi ok
-    token = strtok_r(NULL, " ", &strtok_status);
-    size_t size_from_server = 0;
-    if (sscanf(token, "%zu", &size_from_server) != 1) {
-        return -1;
-    }
     *size = size_from_server;
 
     // Ricevo il file dal server
     *buf = malloc(*size);  // Chiamare la free di questa memoria è compito del client
-    memset(*buf, 0, *size);
-    if (readn((long)client_socket, *buf, *size) == -1) {
+    if (!*buf) return -1;
+    if (receive_contents(*buf, *size) == -1) {
         return -1;
     }
 
     // Se <dirname> è stata specificata, salvo il file sul disco
-    if (dirname) {
-        // Creo il path completo per il salvataggio del file
-        // Calcolo la lunghezza del path indicato da dirname
-        size_t dirname_length = strlen(dirname);
-        char abs_path[PATH_MAX];  // => dirname/pathname
-        memset(abs_path, 0, PATH_MAX);
-
-        // Gestisco il caso in cui dirname termina con '/' e victim_pathname inizia con '/'
-        //if(dirname[dirname_length-1] == '/' && victim_pathname[0] == '/') dirname[dirname_length-1] = '\0';
-        // Controllo se dirname termina con '/' oppure victim_pathname inizia con '/'
-        int slash = dirname[dirname_length - 1] == '/' || pathname[0] == '/';
-        // Se dirname non termina con '/', e victim_name non inizia con '/', lo aggiungo tra i due
-        snprintf(abs_path, PATH_MAX, slash ? "%s%s" : "%s/%s", dirname, pathname);
-
-        // Per mantenere l'integrità del path assoluto del file che ho ricevuto dal server
-        //  ho eventualmente bisogno di creare all'interno di dirname una struttura di cartelle
-        //  per poter contenere il file, in maniera ricorsiva. Un comportamento simile al comando 'mkdir -p <path>'
-        mkdir_p(abs_path);
-
-        // Salvo il contenuto del file sul disco
-        FILE* output_file = fopen(abs_path, "w");
-        if (!output_file) return -1;
-        if (fputs(*buf, output_file) == EOF) {
-            fclose(output_file);
-            return -1;
-        }
-        if (fclose(output_file) == -1) return -1;
-        if (VERBOSE) printf("%zu bytes saved to '%s'!\n", *size, abs_path);
+    if (dirname && save_file(dirname, pathname, *buf, *size) == -1) {
+        return -1;
     }
 
     if (VERBOSE) printf("Successfully read %zu bytes!\n", *size);
@@ -336,9 +540,7 @@ int readNFiles(int N, const char* dirname) {
     }
 
     // Invio al server la richiesta di READN
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %d", READN, N);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    if (send_request(READN, NULL, N, NULL, 0) == -1) {
         return -1;
     }
 
@@ -346,12 +548,7 @@ int readNFiles(int N, const char* dirname) {
 
     // Ricevo dal server il numero di file effettivamente letti
     int files_no = 0;
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
-    }
-    if (sscanf(message_buffer, "%d", &files_no) != 1) {
-        errno = EBADMSG;
+    if (receive_reply(READN, &files_no, NULL) == -1) {
         return -1;
     }
 
@@ -370,32 +567,13 @@ int readNFiles(int N, const char* dirname) {
     // files_no > 0
     if (VERBOSE) printf("%d file(s) have been read from the server\n", files_no);
 
-    int i = 0;
-    char* token = NULL;          // Appoggio per strtok_r
-    char* strtok_status = NULL;  // Stato per strtok_r
-
     size_t file_size = 0;                // Dimensione del file da leggere
     void* file_contents = NULL;          // Contenuto del file da leggere
     char file_pathname[MESSAGE_LENGTH];  // Pathname del file da leggere
 
-    for (; i < files_no; i++) {
+    for (int i = 0; i < files_no; i++) {
         // Ricevo dal server il nome e la dimensione del file
-        memset(message_buffer, 0, MESSAGE_LENGTH);
-        memset(file_pathname, 0, MESSAGE_LENGTH);
-        if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-            return -1;
-        }
-
-        // Pathname
-        token = strtok_r(message_buffer, " ", &strtok_status);
-        if (!token || sscanf(token, "%s", file_pathname) != 1) {
-            errno = EBADMSG;
-            return -1;
-        }
-        // Size
-        token = strtok_r(NULL, " ", &strtok_status);
-        if (!token || sscanf(token, "%zu", &file_size) != 1) {
-            errno = EBADMSG;
+        if (receive_file_header(READN, file_pathname, &file_size) == -1) {
             return -1;
         }
 
@@ -404,10 +582,9 @@ int readNFiles(int N, const char* dirname) {
         // Alloco spazio per il file
         file_contents = malloc(file_size + 1);
         if (!file_contents) return -1;
-        memset(file_contents, 0, file_size + 1);
 
         // Ricevo il contenuto del file
-        if (readn((long)client_socket, file_contents, file_size) == -1) {
+        if (receive_contents(file_contents, file_size) == -1) {
             free(file_contents);
             return -1;
         }
@@ -415,46 +592,11 @@ int readNFiles(int N, const char* dirname) {
         // Se il client ha specificato una cartella in cui salvare i file letti,
         //  procedo a salvare i file ricreando l'albero delle directories specificato nel pathname
         if (dirname) {
-            // Creo il path completo per il salvataggio del file
-            // Calcolo la lunghezza del path indicato da dirname
-            size_t dirname_length = strlen(dirname);
-            char abs_path[PATH_MAX];  // => dirname/file_pathname
-            memset(abs_path, 0, PATH_MAX);
-
-            // Gestisco il caso in cui dirname termina con '/' e file_pathname inizia con '/'
-            //if(dirname[dirname_length-1] == '/' && file_pathname[0] == '/') dirname[dirname_length-1] = '\0';
-            // Controllo se dirname termina con '/' oppure file_pathname inizia con '/'
-            int slash = dirname[dirname_length - 1] == '/' || file_pathname[0] == '/';
-            // Se dirname non termina con '/', e victim_name non inizia con '/', lo aggiungo tra i due
-            snprintf(abs_path, PATH_MAX, slash ? "%s%s" : "%s/%s", dirname, file_pathname);
-
-            // Per mantenere l'integrità del path assoluto del file che ho ricevuto dal server
-            //  ho eventualmente bisogno di creare all'interno di dirname una struttura di cartelle
-            //  per poter contenere il file, in maniera ricorsiva. Un comportamento simile al comando 'mkdir -p <path>'
-            if (VERBOSE) printf("Saving file to '%s'\n", abs_path);
-            mkdir_p(abs_path);
-
-            // Apro il file in scrittura
-            FILE* output_file = fopen(abs_path, "w");
-            if (!output_file) {
-                free(file_contents);
-                return -1;
-            }
-
-            // Scrivo il contenuto del file su disco
-            if (fputs(file_contents, output_file) == EOF) {
-                fclose(output_file);
-                free(file_contents);
-                return -1;
-            }
-
-            // Chiudo il file
-            if (fclose(output_file) == -1) {
+            if (VERBOSE) printf("Saving file '%s'\n", file_pathname);
+            if (save_file(dirname, file_pathname, file_contents, file_size) == -1) {
                 free(file_contents);
                 return -1;
             }
-
-            if (VERBOSE) printf("%zu bytes saved to '%s'\n", file_size, abs_path);
         }
         free(file_contents);
     }
@@ -492,18 +634,10 @@ int writeFile(const char* pathname, const char* dirname) {
         return -1;
     }
 
-    // Invio al server la richiesta di WRITE, il pathname e la dimensione del file
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s %zu", WRITE, pathname, file_stat.st_size);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        fclose(file);
-        return -1;
-    }
-
-    if (VERBOSE) printf("Request to write %zu bytes in '%s' file...\n", file_stat.st_size, pathname);
-
-    // Alloco la memoria necessaria per leggere il file
-    void* contents = malloc(file_stat.st_size);
+    // Se il file entra nella memoria condivisa lo leggo direttamente al suo interno, evitando una copia,
+    //  altrimenti alloco la memoria necessaria per leggerlo
+    bool in_shared = shared && file_stat.st_size > 0 && (size_t)file_stat.st_size <= shared_size;
+    void* contents = in_shared ? shared : malloc(file_stat.st_size > 0 ? file_stat.st_size : 1);
     if (!contents) {
         fclose(file);
         return -1;
@@ -512,118 +646,26 @@ int writeFile(const char* pathname, const char* dirname) {
     fread(contents, file_stat.st_size, 1, file);
     // Chiudo il file
     if (fclose(file) == -1) {
-        free(contents);
-        return -1;
-    }
-
-    // Invio il contenuto del file al server
-    if (writen((long)client_socket, contents, file_stat.st_size) == -1) {
-        free(contents);
+        if (!in_shared) free(contents);
         return -1;
     }
 
+    // Invio al server la richiesta di WRITE, il pathname e la dimensione del file, seguiti dal suo contenuto
+    int sent = send_request(WRITE, pathname, 0, contents, file_stat.st_size);
     // Libero la memoria dal file letto
-    free(contents);
+    if (!in_shared) free(contents);
+    if (sent == -1) return -1;
+
+    if (VERBOSE) printf("Request to write %zu bytes in '%s' file...\n", file_stat.st_size, pathname);
 
     // Ricevo dal server eventuali file espulsi
-    int victims_no = 0;
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    if (receive_victims(WRITE, dirname) == -1) {
         return -1;
     }
-    if (sscanf(message_buffer, "%d", &victims_no) != 1) {
-        errno = EBADMSG;
-        return -1;
-    }
-
-    if (victims_no > 0) {
-        int i = 0;
-        char* token = NULL;
-        char* strtok_status = NULL;
-
-        size_t victim_size = 0;
-        void* victim_contents = NULL;
-        char victim_pathname[MESSAGE_LENGTH];
-
-        if (VERBOSE) printf("%d file(s) have been ejected from the server\n", victims_no);
-        for (; i < victims_no; i++) {
-            // Ricevo dal server il nome e la dimensione del file
-            memset(message_buffer, 0, MESSAGE_LENGTH);
-            memset(victim_pathname, 0, MESSAGE_LENGTH);
-            if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-                return -1;
-            }
-
-            // Pathname
-            token = strtok_r(message_buffer, " ", &strtok_status);
-            if (!token || sscanf(token, "%s", victim_pathname) != 1) {
-                errno = EBADMSG;
-                return -1;
-            }
-            // Size
-            token = strtok_r(NULL, " ", &strtok_status);
-            if (!token || sscanf(token, "%zu", &victim_size) != 1) {
-                errno = EBADMSG;
-                return -1;
-            }
-
-            if (VERBOSE) printf("Receiving file n.%d (%zu bytes): '%s' \n", i + 1, victim_size, victim_pathname);
-
-            // Alloco spazio per il file
-            victim_contents = malloc(victim_size);
-            if (!victim_contents) return -1;
-
-            memset(victim_contents, 0, victim_size);
-            if (readn((long)client_socket, victim_contents, victim_size) == -1) {
-                return -1;
-            }
-
-            // Se il client ha specificato una cartella in cui salvare i file espulsi,
-            //  procedo a salvare i file ricreando l'albero delle directories specificato nel pathname
-            if (dirname) {
-                // Creo il path completo per il salvataggio del file
-                // Calcolo la lunghezza del path indicato da dirname
-                size_t dirname_length = strlen(dirname);
-                char abs_path[PATH_MAX];  // => dirname/victim_pathname
-                memset(abs_path, 0, PATH_MAX);
-
-                // Gestisco il caso in cui dirname termina con '/' e victim_pathname inizia con '/'
-                //if(dirname[dirname_length-1] == '/' && victim_pathname[0] == '/') dirname[dirname_length-1] = '\0';
-                // Controllo se dirname termina con '/' oppure victim_pathname inizia con '/'
-                int slash = dirname[dirname_length - 1] == '/' || victim_pathname[0] == '/';
-                // Se dirname non termina con '/', e victim_name non inizia con '/', lo aggiungo tra i due
-                snprintf(abs_path, PATH_MAX, slash ? "%s%s" : "%s/%s", dirname, victim_pathname);
-
-                // Per mantenere l'integrità del path assoluto del file che ho ricevuto dal server
-                //  ho eventualmente bisogno di creare all'interno di dirname una struttura di cartelle
-                //  per poter contenere il file, in maniera ricorsiva. Un comportamento simile al comando 'mkdir -p <path>'
-                mkdir_p(abs_path);
-
-                // Salvo il contenuto del file sul disco
-                FILE* output_file = fopen(abs_path, "w");
-                if (!output_file) return -1;
-                if (fputs(victim_contents, output_file) == EOF) {
-                    fclose(output_file);
-                    return -1;
-                }
-                if (fclose(output_file) == -1) return -1;
-                if (VERBOSE) printf("%zu bytes saved to '%s'!\n", victim_size, abs_path);
-            }
-
-            free(victim_contents);
-        }
-    }
 
     // Leggo la risposta
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
-    }
-
-    // Interpreto (il codice del)la risposta ricevuta
     int status;
-    if (sscanf(message_buffer, "%d", &status) != 1) {
-        errno = EBADMSG;
+    if (receive_reply(WRITE, &status, NULL) == -1) {
         return -1;
     }
 
@@ -649,123 +691,105 @@ int appendToFile(const char* pathname, void* buf, size_t size, const char* dirna
         return -1;
     }
 
-    // Invio al server la richiesta di APPEND, il pathname e la dimensione del file
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s %zu", APPEND, pathname, size);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    // Invio al server la richiesta di APPEND, il pathname e la dimensione del file, seguiti dal contenuto
+    if (send_request(APPEND, pathname, 0, buf, size) == -1) {
         return -1;
     }
 
     if (VERBOSE) printf("Request to append %zu bytes to '%s' file...\n", size, pathname);
 
-    // Invio il contenuto del file che voglio scrivere
-    if (writen((long)client_socket, buf, size) == -1) {
-        return -1;
-    }
-
     // Ricevo dal server eventuali file espulsi
-    int victims_no = 0;
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    if (receive_victims(APPEND, dirname) == -1) {
         return -1;
     }
-    if (sscanf(message_buffer, "%d", &victims_no) != 1) {
-        errno = EBADMSG;
+
+    // Leggo la risposta
+    int status;
+    if (receive_reply(APPEND, &status, NULL) == -1) {
         return -1;
     }
 
-    if (victims_no > 0) {
-        int i = 0;
-        char* token = NULL;
-        char* strtok_status = NULL;
+    if (status >= 0) {
+        if (VERBOSE) printf("%zu bytes added successfully!\n", size);
+        return status;
+    }
 
-        size_t victim_size = 0;
-        void* victim_contents = NULL;
-        char victim_pathname[MESSAGE_LENGTH];
+    if (VERBOSE) printf("Something went wrong!\n");
+    return status;
+}
 
-        if (VERBOSE) printf("%d file(s) have been ejected from the server\n", victims_no);
-        for (; i < victims_no; i++) {
-            // Ricevo dal server il nome e la dimensione del file
-            memset(message_buffer, 0, MESSAGE_LENGTH);
-            memset(victim_pathname, 0, MESSAGE_LENGTH);
-            if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-                return -1;
-            }
+// Invia la richiesta <command> sul file <pathname>, che prevede come risposta un solo esito
+static int simple_request(int command, const char* pathname) {
+    // Controllo la validità degli argomenti
+    if (!pathname) {
+        errno = EINVAL;
+        return -1;
+    }
 
-            // Pathname
-            token = strtok_r(message_buffer, " ", &strtok_status);
-            if (!token || sscanf(token, "%s", victim_pathname) != 1) {
-                errno = EBADMSG;
-                return -1;
-            }
-            // Size
-            token = strtok_r(NULL, " ", &strtok_status);
-            if (!token || sscanf(token, "%zu", &victim_size) != 1) {
-                errno = EBADMSG;
-                return -1;
-            }
+    // Controllo che sia stata instaurata una connessione con il server
+    if (client_socket == -1) {
+        errno = ENOTCONN;
+        return -1;
+    }
 
-            if (VERBOSE) printf("Receiving file n.%d (%zu bytes): '%s' \n", i + 1, victim_size, victim_pathname);
+    // Invio la richiesta
+    if (send_request(command, pathname, 0, NULL, 0) == -1) {
+        return -1;
+    }
 
-            // Alloco spazio per il file
-            victim_contents = malloc(victim_size);
-            if (!victim_contents) return -1;
-            memset(victim_contents, 0, victim_size);
-            if (readn((long)client_socket, victim_contents, victim_size) == -1) {
-                return -1;
-            }
+    // Leggo la risposta
+    int status;
+    if (receive_reply(command, &status, NULL) == -1) {
+        return -1;
+    }
+    return status;
+}
 
-            // Se il client ha specificato una cartella in cui salvare i file espulsi,
-            //  procedo a salvare i file ricreando l'albero delle directories specificato nel pathname
-            if (dirname) {
-                // Creo il path completo per il salvataggio del file
-                // Calcolo la lunghezza del path indicato da dirname
-                size_t dirname_length = strlen(dirname);
-                char abs_path[PATH_MAX];  // => dirname/victim_pathname
-                memset(abs_path, 0, PATH_MAX);
-
-                // Gestisco il caso in cui dirname termina con '/' e victim_pathname inizia con '/'
-                //if(dirname[dirname_length-1] == '/' && victim_pathname[0] == '/') dirname[dirname_length-1] = '\0';
-                // Controllo se dirname termina con '/' oppure victim_pathname inizia con '/'
-                int slash = dirname[dirname_length - 1] == '/' || victim_pathname[0] == '/';
-                // Se dirname non termina con '/', e victim_name non inizia con '/', lo aggiungo tra i due
-                snprintf(abs_path, PATH_MAX, slash ? "%s%s" : "%s/%s", dirname, victim_pathname);
-
-                // Per mantenere l'integrità del path assoluto del file che ho ricevuto dal server
-                //  ho eventualmente bisogno di creare all'interno di dirname una struttura di cartelle
-                //  per poter contenere il file, in maniera ricorsiva. Un comportamento simile al comando 'mkdir -p <path>'
-                mkdir_p(abs_path);
-
-                // Salvo il contenuto del file sul disco
-                FILE* output_file = fopen(abs_path, "w");
-                if (!output_file) return -1;
-                if (fputs(victim_contents, output_file) == EOF) {
-                    fclose(output_file);
-                    return -1;
-                }
-                if (fclose(output_file) == -1) return -1;
-                if (VERBOSE) printf("%zu bytes saved to '%s'!\n", victim_size, abs_path);
-            }
+int lockFile(const char* pathname) {
+    if (VERBOSE && pathname) printf("Request to lock '%s' file...\n", pathname);
 
-            free(victim_contents);
-        }
+    int status = simple_request(LOCK, pathname);
+    if (status >= 0) {
+        if (VERBOSE) printf("File locked successfully!\n");
+        return status;
     }
 
-    // Leggo la risposta
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
+    if (VERBOSE) printf("Something went wrong!\n");
+    return status;
+}
+
+int unlockFile(const char* pathname) {
+    if (VERBOSE && pathname) printf("Request to unlock '%s' file...\n", pathname);
+
+    int status = simple_request(UNLOCK, pathname);
+    if (status >= 0) {
+        if (VERBOSE) printf("File unlocked successfully!\n");
+        return status;
     }
 
-    // Interpreto (il codice del)la risposta ricevuta
-    int status;
-    if (sscanf(message_buffer, "%d", &status) != 1) {
-        errno = EBADMSG;
-        return -1;
+    if (VERBOSE) printf("Something went wrong!\n");
+    return status;
+}
+
+int closeFile(const char* pathname) {
+    if (VERBOSE && pathname) printf("Request to close '%s' file... \n", pathname);
+
+    int status = simple_request(CLOSE, pathname);
+    if (status >= 0) {
+        if (VERBOSE) printf("File closed successfully!\n");
+        return status;
     }
 
+    if (VERBOSE) printf("Something went wrong!\n");
+    return status;
+}
+
+int removeFile(const char* pathname) {
+    if (VERBOSE && pathname) printf("Request to remove '%s' file... \n", pathname);
+
+    int status = simple_request(REMOVE, pathname);
     if (status >= 0) {
-        if (VERBOSE) printf("%zu bytes added successfully!\n", size);
+        if (VERBOSE) printf("File removed successfully!\n");
         return status;
     }
 
@@ -773,53 +797,269 @@ int appendToFile(const char* pathname, void* buf, size_t size, const char* dirna
     return status;
 }
 
-int lockFile(const char* pathname) {
+// Dimensione oltre la quale writeDirectory invia le operazioni accumulate
+#define BATCH_FLUSH_SIZE (4 * MEGABYTES)
+
+// Sequenza di operazioni, codificate come nel contenuto di una richiesta MULTI:
+//  per ognuna un frame, seguito dal pathname e dall'eventuale contenuto
+struct Batch {
+    char* operations;  // Operazioni codificate
+    size_t size;       // Bytes occupati
+    size_t capacity;   // Bytes allocati
+    int count;         // Numero di operazioni
+};
+
+batch_t* createBatch(void) {
+    return (batch_t*)calloc(1, sizeof(batch_t));
+}
+
+void destroyBatch(batch_t* batch) {
+    if (!batch) return;
+    if (batch->operations) free(batch->operations);
+    free(batch);
+}
+
+int batchLength(const batch_t* batch) {
+    return batch ? batch->count : 0;
+}
+
+// Accoda a <batch> l'operazione <command> sul file <pathname>, riservando <size> bytes per il suo contenuto
+// Ritorna il puntatore al contenuto da riempire, oppure NULL in caso di errore
+static char* batch_append(batch_t* batch, int command, const char* pathname, int flags, size_t size) {
+    if (!batch || !pathname) {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t path_length = strlen(pathname);
+    if (path_length == 0 || path_length > MESSAGE_LENGTH - sizeof(frame_t)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    // Amplio il buffer se necessario
+    size_t needed = batch->size + sizeof(frame_t) + path_length + size;
+    if (needed > batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity : BUFFER_SIZE;
+        while (capacity < needed) capacity *= 2;
+        char* operations = (char*)realloc(batch->operations, capacity);
+        if (!operations) return NULL;
+        batch->operations = operations;
+        batch->capacity = capacity;
+    }
+
+    frame_t frame = {.opcode = (uint8_t)command,
+                     .flags = command == OPEN ? (uint8_t)flags : 0,
+                     .path_length = (uint16_t)path_length,
+                     .payload_length = size};
+    char* cursor = batch->operations + batch->size;
+    memcpy(cursor, &frame, sizeof(frame));
+    memcpy(cursor + sizeof(frame), pathname, path_length);
+    batch->size = needed;
+    batch->count++;
+    return cursor + sizeof(frame) + path_length;
+}
+
+int addToBatch(batch_t* batch, int command, const char* pathname, int flags) {
+    // Le scritture vengono aggiunte con addFileToBatch, che ne legge il contenuto
+    if (command != OPEN && command != READ && command != LOCK && command != UNLOCK && command != CLOSE && command != REMOVE) {
+        errno = EINVAL;
+        return -1;
+    }
+    return batch_append(batch, command, pathname, flags, 0) ? 0 : -1;
+}
+
+int addFileToBatch(batch_t* batch, const char* pathname) {
     // Controllo la validità degli argomenti
-    if (!pathname) {
+    if (!batch || !pathname) {
         errno = EINVAL;
         return -1;
     }
 
-    // Controllo che sia stata instaurata una connessione con il server
-    if (client_socket == -1) {
-        errno = ENOTCONN;
+    // Controllo che il file esista e che dispongo dei permessi necessari per poterlo leggere
+    struct stat file_stat;
+    if (access(pathname, R_OK) == -1 || stat(pathname, &file_stat) == -1) {
+        errno = EPERM;
         return -1;
     }
+    FILE* file = fopen(pathname, "r");
+    if (!file) return -1;
 
-    // Preparo la richiesta da inviare
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s", LOCK, pathname);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    // Leggo il contenuto del file direttamente nella sequenza
+    size_t size = batch->size;
+    char* contents = batch_append(batch, WRITE, pathname, 0, file_stat.st_size);
+    if (!contents || (file_stat.st_size > 0 && fread(contents, file_stat.st_size, 1, file) != 1)) {
+        // Annullo l'aggiunta dell'operazione
+        if (contents) {
+            batch->size = size;
+            batch->count--;
+        }
+        fclose(file);
         return -1;
     }
+    return fclose(file) == -1 ? -1 : 0;
+}
+
+// * Riceve la risposta all'operazione <command> sul file <pathname>, memorizzandone l'esito in <status>
+// I file letti ed espulsi vengono salvati in <dirname>, se specificata
+static int receive_operation(int command, const char* pathname, const char* dirname, int* status) {
+    switch (command) {
+        case OPEN:
+        case WRITE:
+        case APPEND:
+            // Eventuali file espulsi precedono l'esito
+            if (receive_victims(command, dirname) == -1) return -1;
+            return receive_reply(command, status, NULL);
+
+        case READ: {
+            int result = 0;
+            size_t size = 0;
+            if (receive_reply(READ, &result, &size) == -1) return -1;
+            *status = result == 1 ? 0 : -1;
+            if (result != 1) return 0;
+
+            // Ricevo il contenuto anche se non devo salvarlo, per restare allineato con le risposte
+            void* contents = malloc(size > 0 ? size : 1);
+            if (!contents) return -1;
+            if (receive_contents(contents, size) == -1) {
+                free(contents);
+                return -1;
+            }
+            if (dirname && save_file(dirname, pathname, contents, size) == -1) *status = -1;
+            free(contents);
+            return 0;
+        }
 
-    if (VERBOSE) printf("Request to lock '%s' file...\n", pathname);
+        default:
+            return receive_reply(command, status, NULL);
+    }
+}
 
-    // Leggo la risposta
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+int executeBatch(batch_t* batch, int* results, const char* dirname) {
+    // Controllo la validità degli argomenti
+    if (!batch || (!results && batch->count > 0)) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Interpreto (il codice del)la risposta ricevuta
-    int status;
-    if (sscanf(message_buffer, "%d", &status) != 1) {
-        errno = EBADMSG;
+    // Controllo che sia stata instaurata una connessione con il server
+    if (client_socket == -1) {
+        errno = ENOTCONN;
         return -1;
     }
 
-    if (status >= 0) {
-        if (VERBOSE) printf("File locked successfully!\n");
-        return status;
+    int count = batch->count;
+    int result = count;
+    if (count == 0) return 0;
+
+    // * Protocollo binario: invio tutte le operazioni con un'unica richiesta
+    if (protocol == PROTOCOL_BINARY) {
+        if (VERBOSE) printf("Request to execute %d operation(s)...\n", count);
+        int accepted = 0;
+        if (send_request(MULTI, NULL, count, batch->operations, batch->size) == -1 || receive_reply(MULTI, &accepted, NULL) == -1) {
+            result = -1;
+            goto reset;
+        }
+        // Il server ha rifiutato la sequenza, senza eseguire alcuna operazione
+        if (accepted != count) {
+            errno = EBADMSG;
+            result = -1;
+            goto reset;
+        }
     }
 
-    if (VERBOSE) printf("Something went wrong!\n");
-    return status;
+    // * Ricevo le risposte alle operazioni, nello stesso ordine
+    // Con il protocollo testuale, ogni operazione viene inviata prima di riceverne la risposta
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        frame_t operation;
+        char pathname[MESSAGE_LENGTH];
+        memcpy(&operation, batch->operations + offset, sizeof(frame_t));
+        offset += sizeof(frame_t);
+        memset(pathname, 0, MESSAGE_LENGTH);
+        memcpy(pathname, batch->operations + offset, operation.path_length);
+        offset += operation.path_length;
+        void* contents = batch->operations + offset;
+        offset += (size_t)operation.payload_length;
+
+        if (protocol != PROTOCOL_BINARY && send_request(operation.opcode, pathname, operation.flags, contents, (size_t)operation.payload_length) == -1) {
+            result = -1;
+            goto reset;
+        }
+        if (receive_operation(operation.opcode, pathname, dirname, &results[i]) == -1) {
+            result = -1;
+            goto reset;
+        }
+        if (VERBOSE) printf("Operation %d on '%s' %s\n", operation.opcode, pathname, results[i] == 0 ? "succeeded" : "failed");
+    }
+
+reset:
+    // La sequenza viene svuotata, così da poter essere riutilizzata
+    batch->size = 0;
+    batch->count = 0;
+    return result;
 }
 
-int unlockFile(const char* pathname) {
-    // Controllo la validità degli argomenti
-    if (!pathname) {
+// Invia le operazioni accumulate in <batch> da writeDirectory, ignorandone l'esito come per le singole API
+static int write_directory_flush(batch_t* batch, const char* dirname) {
+    if (batch->count == 0) return 0;
+    int* results = (int*)malloc(sizeof(int) * batch->count);
+    if (!results) return -1;
+    int result = executeBatch(batch, results, dirname);
+    free(results);
+    return result == -1 ? -1 : 0;
+}
+
+// Accoda a <batch> la creazione, la scrittura e la chiusura dei file contenuti nella cartella <dir> di percorso <pathname>,
+//  ricorsivamente, inviando le operazioni accumulate quando necessario
+static int write_directory(batch_t* batch, DIR* dir, const char* pathname, int upperbound, const char* dirname) {
+    char path[PATH_MAX];    // Percorso completo
+    struct dirent* entry;   // Entry all'interno della cartella
+    struct stat file_stat;  // Discrimino tra file e cartelle
+
+    // Le operazioni accumulate vengono inviate prima di superare la memoria condivisa, se presente
+    size_t flush_size = shared && shared_size < BATCH_FLUSH_SIZE ? shared_size : BATCH_FLUSH_SIZE;
+
+    while ((entry = readdir(dir)) != NULL) {
+        snprintf(path, sizeof(path), "%s/%s", pathname, entry->d_name);
+        if (stat(path, &file_stat) == -1) continue;
+
+        if (S_ISREG(file_stat.st_mode)) {
+            // E' un file, lo carico sul server se non ho raggiunto il limite superiore
+            if (upperbound > 0) {
+                size_t needed = 3 * (sizeof(frame_t) + strlen(path)) + (size_t)file_stat.st_size;
+                if (batch->count > 0 && batch->size + needed > flush_size && write_directory_flush(batch, dirname) == -1) return -1;
+                if (needed > flush_size) {
+                    // Un file che da solo supera il limite di una sequenza (e quindi, eventualmente, MULTI_MAX_SIZE)
+                    //  viene inviato con le singole API: il server ne riceve il contenuto direttamente nello storage
+                    openFile(path, O_CREATE | O_LOCK, dirname);
+                    writeFile(path, dirname);
+                    closeFile(path);
+                } else if (addToBatch(batch, OPEN, path, O_CREATE | O_LOCK) == 0) {
+                    // Creo il file sul server e lo apro in scrittura, carico il suo contenuto ed infine lo chiudo
+                    addFileToBatch(batch, path);
+                    addToBatch(batch, CLOSE, path, 0);
+                }
+                upperbound--;
+            }
+        } else if (S_ISDIR(file_stat.st_mode)) {
+            // E' una directory
+            // Se corrisponde a '.' oppure '..', salto
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            // Analizzo il suo contenuto ricorsivamente, saltandola se non posso aprirla
+            DIR* subdir = opendir(path);
+            if (!subdir) continue;
+            int result = write_directory(batch, subdir, path, upperbound, dirname);
+            closedir(subdir);
+            if (result == -1) return -1;
+        }
+    }
+
+    return 0;
+}
+
+int writeDirectory(const char* pathname, int upperbound, const char* dirname) {
+    // Controllo la validità dei parametri
+    if (!pathname || upperbound <= 0) {
         errno = EINVAL;
         return -1;
     }
@@ -830,165 +1070,502 @@ int unlockFile(const char* pathname) {
         return -1;
     }
 
-    // Preparo la richiesta da inviare
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s", UNLOCK, pathname);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    // Apro la cartella
+    DIR* dir = opendir(pathname);
+    if (!dir) return -1;
+    batch_t* batch = createBatch();
+    if (!batch) {
+        closedir(dir);
         return -1;
     }
 
-    if (VERBOSE) printf("Request to unlock '%s' file...\n", pathname);
+    // Accumulo le operazioni sui file della cartella, quindi invio quelle rimaste
+    int result = write_directory(batch, dir, pathname, upperbound, dirname);
+    if (result == 0) result = write_directory_flush(batch, dirname);
 
-    // Leggo la risposta
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
-    }
+    destroyBatch(batch);
+    closedir(dir);
+    return result;
+}
 
-    // Interpreto (il codice del)la risposta ricevuta
-    int status;
-    if (sscanf(message_buffer, "%d", &status) != 1) {
+// == Richieste asincrone
+
+// Spazio libero minimo del buffer di ricezione di un contesto asincrono, ad ogni lettura dal socket
+#define ASYNC_CHUNK (64 * 1024)
+
+// Parte della risposta attesa da una richiesta asincrona
+#define ASYNC_REPLY 0  // Esito
+#define ASYNC_COUNT 1  // Numero dei file che seguono: espulsi (OPEN, WRITE, APPEND) oppure letti (READN)
+#define ASYNC_FILES 2  // Frames FRAME_FILE
+
+// Richiesta asincrona inviata, o in coda per l'invio, e non ancora completata
+typedef struct FssRequest {
+    int id;                   // Identificativo ripetuto dal server nella risposta
+    int command;              // Codice della richiesta
+    int stage;                // Parte della risposta attesa
+    int files;                // File ancora da ricevere
+    int status;               // READN: numero di file letti
+    int error;                // Errore nel salvataggio dei file ricevuti, 0 se assente
+    char* pathname;           // File della richiesta, NULL per READN
+    char* dirname;            // Cartella in cui salvare i file ricevuti, NULL se assente
+    fss_callback_t callback;  // Callback da invocare al completamento
+    void* arg;                // Argomento della callback
+    struct FssRequest* next;
+} fss_request_t;
+
+struct FssContext {
+    int socket;            // Connessione dedicata, non bloccante; -1 dopo un errore
+    int last_id;           // Identificativo dell'ultima richiesta accodata
+    fss_request_t* head;   // Richieste non completate, nell'ordine di invio
+    fss_request_t* tail;   // Ultima richiesta accodata
+    size_t pending;        // Numero di richieste non completate
+    size_t completed;      // Numero di richieste completate dalla creazione del contesto
+    char* output;          // Richieste codificate, inviate a partire da output_start
+    size_t output_start;   // Bytes di output già inviati
+    size_t output_length;  // Bytes di output occupati
+    size_t output_capacity;
+    char* input;           // Bytes ricevuti, elaborati a partire da input_start
+    size_t input_start;    // Bytes di input già elaborati
+    size_t input_length;   // Bytes di input occupati
+    size_t input_capacity;
+};
+
+// Garantisce lo spazio per altri <size> bytes in fondo a <buffer>, spostando all'inizio i bytes non ancora consumati
+static int async_reserve(char** buffer, size_t* start, size_t* length, size_t* capacity, size_t size) {
+    if (*capacity - *length >= size) return 0;
+    if (*start > 0) {
+        memmove(*buffer, *buffer + *start, *length - *start);
+        *length -= *start;
+        *start = 0;
+        if (*capacity - *length >= size) return 0;
+    }
+    size_t new_capacity = *capacity ? *capacity : BUFFER_SIZE;
+    while (new_capacity - *length < size) new_capacity *= 2;
+    char* new_buffer = (char*)realloc(*buffer, new_capacity);
+    if (!new_buffer) return -1;
+    *buffer = new_buffer;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Rimuove dal contesto la richiesta <request>, che segue <previous>, e ne invoca la callback
+static void async_complete(fss_context_t* ctx, fss_request_t* previous, fss_request_t* request, int status, int error, const void* contents, size_t size) {
+    if (previous) previous->next = request->next;
+    else ctx->head = request->next;
+    if (ctx->tail == request) ctx->tail = previous;
+    ctx->pending--;
+    ctx->completed++;
+
+    // Un errore nel salvataggio dei file ricevuti fa fallire la richiesta, come per le funzioni sincrone
+    if (status != -1 && request->error != 0) {
+        status = -1;
+        error = request->error;
+    }
+    if (VERBOSE) printf("Request %d on '%s' %s\n", request->id, request->pathname ? request->pathname : "", status == -1 ? "failed" : "completed");
+    if (request->callback) {
+        fss_completion_t completion = {.id = request->id,
+                                       .command = request->command,
+                                       .pathname = request->pathname,
+                                       .status = status,
+                                       .error = status == -1 ? error : 0,
+                                       .contents = contents,
+                                       .size = size};
+        request->callback(&completion, request->arg);
+    }
+    free(request->pathname);
+    free(request->dirname);
+    free(request);
+}
+
+// Chiude la connessione del contesto, completando le richieste rimaste con l'errore <error>
+static void async_fail(fss_context_t* ctx, int error) {
+    if (ctx->socket != -1) close(ctx->socket);
+    ctx->socket = -1;
+    ctx->output_start = ctx->output_length = 0;
+    while (ctx->head) async_complete(ctx, NULL, ctx->head, -1, error, NULL, 0);
+}
+
+// Elabora il frame di risposta <frame>, seguito dal pathname <path> e dal payload <payload>
+static int async_frame(fss_context_t* ctx, const frame_t* frame, const char* path, const void* payload) {
+    // Le risposte arrivano di norma nell'ordine di invio, quindi la richiesta cercata è quasi sempre la prima
+    fss_request_t* previous = NULL;
+    fss_request_t* request = ctx->head;
+    while (request && request->id != (int)frame->request_id) {
+        previous = request;
+        request = request->next;
+    }
+    bool is_file = (frame->flags & FRAME_FILE) != 0;
+    if (!request || frame->opcode != (uint8_t)request->command || is_file != (request->stage == ASYNC_FILES)) {
         errno = EBADMSG;
         return -1;
     }
 
-    if (status >= 0) {
-        if (VERBOSE) printf("File unlocked successfully!\n");
-        return status;
+    switch (request->stage) {
+        case ASYNC_COUNT:
+            request->files = MAX(frame->value, 0);
+            if (request->command == READN) {
+                // Il numero di file letti è anche l'esito della richiesta
+                request->status = frame->value < 0 ? -1 : frame->value;
+                if (request->files == 0) async_complete(ctx, previous, request, request->status, EPERM, NULL, 0);
+                else request->stage = ASYNC_FILES;
+            } else {
+                request->stage = request->files > 0 ? ASYNC_FILES : ASYNC_REPLY;
+            }
+            return 0;
+
+        case ASYNC_FILES: {
+            // Salvo il file se richiesto; un errore non interrompe la ricezione dei file successivi
+            char pathname[MESSAGE_LENGTH];
+            memcpy(pathname, path, frame->path_length);
+            pathname[frame->path_length] = '\0';
+            if (request->dirname && save_file(request->dirname, pathname, payload, (size_t)frame->payload_length) == -1 && request->error == 0) request->error = errno;
+            if (--request->files > 0) return 0;
+            if (request->command == READN) async_complete(ctx, previous, request, request->status, 0, NULL, 0);
+            else request->stage = ASYNC_REPLY;
+            return 0;
+        }
+
+        default:
+            if (request->command != READ) {
+                async_complete(ctx, previous, request, frame->value, EPERM, NULL, 0);
+                return 0;
+            }
+            // READ: 1 se il file è stato letto, 0 se non esiste, -1 se non si dispone dei permessi
+            if (frame->value != 1) {
+                async_complete(ctx, previous, request, -1, frame->value == 0 ? ENOENT : EPERM, NULL, 0);
+                return 0;
+            }
+            if (request->dirname && save_file(request->dirname, request->pathname, payload, (size_t)frame->payload_length) == -1) request->error = errno;
+            async_complete(ctx, previous, request, 0, 0, payload, (size_t)frame->payload_length);
+            return 0;
     }
+}
 
-    if (VERBOSE) printf("Something went wrong!\n");
-    return status;
+// Elabora i frames ricevuti per intero
+static int async_dispatch(fss_context_t* ctx) {
+    while (ctx->input_length - ctx->input_start >= sizeof(frame_t)) {
+        frame_t frame;
+        char* cursor = ctx->input + ctx->input_start;
+        memcpy(&frame, cursor, sizeof(frame));
+        // Senza memoria condivisa, il contenuto segue sempre il frame sul socket
+        if ((frame.flags & FRAME_SHARED) || frame.path_length >= MESSAGE_LENGTH) {
+            errno = EBADMSG;
+            return -1;
+        }
+        size_t size = sizeof(frame) + frame.path_length + (size_t)frame.payload_length;
+        if (ctx->input_length - ctx->input_start < size) break;
+        ctx->input_start += size;
+        if (async_frame(ctx, &frame, cursor + sizeof(frame), cursor + sizeof(frame) + frame.path_length) == -1) return -1;
+    }
+    if (ctx->input_start == ctx->input_length) ctx->input_start = ctx->input_length = 0;
+    return 0;
 }
 
-int closeFile(const char* pathname) {
-    // Controllo la validità degli argomenti
-    if (!pathname) {
-        errno = EINVAL;
-        return -1;
+// Riceve ed elabora le risposte disponibili sul socket, senza bloccarsi
+static int async_receive(fss_context_t* ctx) {
+    while (ctx->socket != -1) {
+        if (async_reserve(&ctx->input, &ctx->input_start, &ctx->input_length, &ctx->input_capacity, ASYNC_CHUNK) == -1) return -1;
+        ssize_t received = recv(ctx->socket, ctx->input + ctx->input_length, ctx->input_capacity - ctx->input_length, 0);
+        if (received == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (received == -1) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        ctx->input_length += (size_t)received;
+        if (async_dispatch(ctx) == -1) return -1;
     }
+    return 0;
+}
 
-    // Controllo che sia stata instaurata una connessione con il server
-    if (client_socket == -1) {
+// Invia le richieste in coda finché il socket lo consente, senza bloccarsi
+static int async_flush(fss_context_t* ctx) {
+    while (ctx->output_start < ctx->output_length) {
+        ssize_t sent = send(ctx->socket, ctx->output + ctx->output_start, ctx->output_length - ctx->output_start, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        ctx->output_start += (size_t)sent;
+    }
+    ctx->output_start = ctx->output_length = 0;
+    return 0;
+}
+
+// Codifica in coda al contesto la richiesta <command>, riservando <size> bytes per il suo contenuto
+// Ritorna la richiesta, da accodare con async_commit dopo averne riempito il contenuto <payload>
+static fss_request_t* async_prepare(fss_context_t* ctx, int command, const char* pathname, int argument, size_t size, const char* dirname, char** payload) {
+    if (!ctx) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (ctx->socket == -1) {
         errno = ENOTCONN;
-        return -1;
+        return NULL;
+    }
+    size_t path_length = pathname ? strlen(pathname) : 0;
+    if (path_length > MESSAGE_LENGTH - sizeof(frame_t)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    fss_request_t* request = (fss_request_t*)calloc(1, sizeof(fss_request_t));
+    if (!request) return NULL;
+    request->command = command;
+    request->stage = command == OPEN || command == WRITE || command == APPEND || command == READN ? ASYNC_COUNT : ASYNC_REPLY;
+    if ((pathname && !(request->pathname = strdup(pathname))) || (dirname && !(request->dirname = strdup(dirname))) ||
+        async_reserve(&ctx->output, &ctx->output_start, &ctx->output_length, &ctx->output_capacity, sizeof(frame_t) + path_length + size) == -1) {
+        free(request->pathname);
+        free(request->dirname);
+        free(request);
+        return NULL;
+    }
+    // Gli identificativi restano positivi, così da poter essere ritornati insieme a -1
+    request->id = ctx->last_id = ctx->last_id == INT_MAX ? 1 : ctx->last_id + 1;
+
+    frame_t frame = {.opcode = (uint8_t)command,
+                     .flags = command == OPEN ? (uint8_t)argument : 0,
+                     .path_length = (uint16_t)path_length,
+                     .request_id = (uint32_t)request->id,
+                     .payload_length = size,
+                     .value = command == READN ? argument : 0};
+    char* cursor = ctx->output + ctx->output_length;
+    memcpy(cursor, &frame, sizeof(frame));
+    if (path_length > 0) memcpy(cursor + sizeof(frame), pathname, path_length);
+    *payload = cursor + sizeof(frame) + path_length;
+    return request;
+}
+
+// Accoda la richiesta <request> preparata con async_prepare, ed inizia ad inviarla
+static int async_commit(fss_context_t* ctx, fss_request_t* request, size_t size) {
+    ctx->output_length += sizeof(frame_t) + (request->pathname ? strlen(request->pathname) : 0) + size;
+    if (ctx->tail) ctx->tail->next = request;
+    else ctx->head = request;
+    ctx->tail = request;
+    ctx->pending++;
+    // Un errore della connessione viene rilevato e segnalato dalla successiva fss_poll
+    async_flush(ctx);
+    return request->id;
+}
+
+// Accoda la richiesta <command> sul file <pathname>, senza contenuto
+static int async_submit(fss_context_t* ctx, int command, const char* pathname, int argument, const char* dirname, fss_callback_t callback, void* arg) {
+    char* payload;
+    fss_request_t* request = async_prepare(ctx, command, pathname, argument, 0, dirname, &payload);
+    if (!request) return -1;
+    request->callback = callback;
+    request->arg = arg;
+    return async_commit(ctx, request, 0);
+}
+
+fss_context_t* fss_connect(const char* sockname, int msec, const struct timespec abstime) {
+    // Controllo la validità degli argomenti
+    if (!sockname || msec < 0 || abstime.tv_sec < 0 || abstime.tv_nsec < 0) {
+        errno = EINVAL;
+        return NULL;
     }
 
-    // Preparo la richiesta da inviare
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s", CLOSE, pathname);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
-        return -1;
+    fss_context_t* ctx = (fss_context_t*)calloc(1, sizeof(fss_context_t));
+    if (!ctx) return NULL;
+    ctx->socket = connect_socket(sockname, msec, abstime);
+    if (ctx->socket == -1) {
+        free(ctx);
+        return NULL;
     }
 
-    if (VERBOSE) printf("Request to close '%s' file... \n", pathname);
+    // Gli identificativi richiedono il protocollo binario; la memoria condivisa non viene offerta,
+    //  perché il server vi dispone la risposta di una sola richiesta alla volta
+    frame_t frame = {.opcode = FRAME_HELLO, .value = PROTOCOL_BINARY};
+    int r = writen((long)ctx->socket, (void*)&frame, sizeof(frame));
+    if (r == 1) {
+        memset(&frame, 0, sizeof(frame));
+        r = readn((long)ctx->socket, (void*)&frame, sizeof(frame));
+    }
+    if (r == 0 || (r > 0 && (frame.opcode != FRAME_HELLO || frame.value != PROTOCOL_BINARY))) {
+        errno = EPROTONOSUPPORT;
+        r = -1;
+    }
+    // Da qui in poi il socket non si blocca: fss_poll attende che sia pronto
+    int flags = r == -1 ? -1 : fcntl(ctx->socket, F_GETFL);
+    if (flags == -1 || fcntl(ctx->socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+        close(ctx->socket);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
 
-    // Leggo la risposta
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+int fss_disconnect(fss_context_t* ctx) {
+    // Controllo la validità degli argomenti
+    if (!ctx) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Interpreto (il codice del)la risposta ricevuta
-    int status;
-    if (sscanf(message_buffer, "%d", &status) != 1) {
-        errno = EBADMSG;
+    int result = 0;
+    frame_t frame = {.opcode = DISCONNECT};
+    if (ctx->socket != -1 && async_reserve(&ctx->output, &ctx->output_start, &ctx->output_length, &ctx->output_capacity, sizeof(frame)) == 0) {
+        memcpy(ctx->output + ctx->output_length, &frame, sizeof(frame));
+        ctx->output_length += sizeof(frame);
+    }
+    // Invio le richieste in coda seguite da DISCONNECT, ricevendo nel frattempo le risposte:
+    //  il server non legge nuove richieste finché non ha inviato le risposte precedenti
+    while (ctx->socket != -1 && ctx->output_start < ctx->output_length) {
+        struct pollfd descriptor = {.fd = ctx->socket, .events = POLLIN | POLLOUT};
+        if (poll(&descriptor, 1, -1) == -1) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        if (((descriptor.revents & POLLOUT) && async_flush(ctx) == -1) || ((descriptor.revents & (POLLIN | POLLHUP | POLLERR)) && async_receive(ctx) == -1)) {
+            result = -1;
+            break;
+        }
+    }
+    async_fail(ctx, ECANCELED);
+
+    free(ctx->output);
+    free(ctx->input);
+    free(ctx);
+    return result;
+}
+
+int fss_submit_open(fss_context_t* ctx, const char* pathname, int flags, const char* dirname, fss_callback_t callback, void* arg) {
+    // Controllo la validità degli argomenti
+    if (!pathname || flags < 0) {
+        errno = EINVAL;
         return -1;
     }
+    return async_submit(ctx, OPEN, pathname, flags, dirname, callback, arg);
+}
 
-    if (status >= 0) {
-        if (VERBOSE) printf("File closed successfully!\n");
-        return status;
+int fss_submit_read(fss_context_t* ctx, const char* pathname, const char* dirname, fss_callback_t callback, void* arg) {
+    // Controllo la validità degli argomenti
+    if (!pathname) {
+        errno = EINVAL;
+        return -1;
     }
+    return async_submit(ctx, READ, pathname, 0, dirname, callback, arg);
+}
 
-    if (VERBOSE) printf("Something went wrong!\n");
-    return status;
+int fss_submit_readn(fss_context_t* ctx, int N, const char* dirname, fss_callback_t callback, void* arg) {
+    return async_submit(ctx, READN, NULL, N, dirname, callback, arg);
 }
 
-int removeFile(const char* pathname) {
+int fss_submit_write(fss_context_t* ctx, const char* pathname, const char* dirname, fss_callback_t callback, void* arg) {
     // Controllo la validità degli argomenti
     if (!pathname) {
         errno = EINVAL;
         return -1;
     }
 
-    // Controllo che sia stata instaurata una connessione con il server
-    if (client_socket == -1) {
-        errno = ENOTCONN;
+    // Controllo che il file esista e che dispongo dei permessi necessari per poterlo leggere
+    struct stat file_stat;
+    if (access(pathname, R_OK) == -1 || stat(pathname, &file_stat) == -1) {
+        errno = EPERM;
         return -1;
     }
+    FILE* file = fopen(pathname, "r");
+    if (!file) return -1;
 
-    // Preparo la richiesta da inviare
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    snprintf(message_buffer, MESSAGE_LENGTH, "%d %s", REMOVE, pathname);
-    if (writen((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+    // Leggo il contenuto del file direttamente nella coda di invio
+    size_t size = (size_t)file_stat.st_size;
+    char* payload;
+    fss_request_t* request = async_prepare(ctx, WRITE, pathname, 0, size, dirname, &payload);
+    if (!request || (size > 0 && fread(payload, size, 1, file) != 1)) {
+        // La richiesta non è stata accodata: basta liberarla
+        if (request) {
+            free(request->pathname);
+            free(request->dirname);
+            free(request);
+            errno = EIO;
+        }
+        fclose(file);
         return -1;
     }
+    fclose(file);
+    request->callback = callback;
+    request->arg = arg;
+    return async_commit(ctx, request, size);
+}
 
-    if (VERBOSE) printf("Request to remove '%s' file... \n", pathname);
-
-    // Leggo la risposta
-    memset(message_buffer, 0, MESSAGE_LENGTH);
-    if (readn((long)client_socket, (void*)message_buffer, MESSAGE_LENGTH) == -1) {
+int fss_submit_append(fss_context_t* ctx, const char* pathname, const void* buf, size_t size, const char* dirname, fss_callback_t callback, void* arg) {
+    // Controllo la validità degli argomenti
+    if (!pathname || !buf || size == 0) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Interpreto (il codice del)la risposta ricevuta
-    int status;
-    if (sscanf(message_buffer, "%d", &status) != 1) {
-        errno = EBADMSG;
+    char* payload;
+    fss_request_t* request = async_prepare(ctx, APPEND, pathname, 0, size, dirname, &payload);
+    if (!request) return -1;
+    memcpy(payload, buf, size);
+    request->callback = callback;
+    request->arg = arg;
+    return async_commit(ctx, request, size);
+}
+
+int fss_submit_lock(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg) {
+    if (!pathname) {
+        errno = EINVAL;
         return -1;
     }
+    return async_submit(ctx, LOCK, pathname, 0, NULL, callback, arg);
+}
 
-    if (status >= 0) {
-        if (VERBOSE) printf("File removed successfully!\n");
-        return status;
+int fss_submit_unlock(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg) {
+    if (!pathname) {
+        errno = EINVAL;
+        return -1;
     }
-
-    if (VERBOSE) printf("Something went wrong!\n");
-    return status;
+    return async_submit(ctx, UNLOCK, pathname, 0, NULL, callback, arg);
 }
 
-int writeDirectory(const char* pathname, int upperbound, const char* dirname) {
-    // Controllo la validità dei parametri
-    if (!pathname || upperbound <= 0) {
+int fss_submit_close(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg) {
+    if (!pathname) {
         errno = EINVAL;
         return -1;
     }
+    return async_submit(ctx, CLOSE, pathname, 0, NULL, callback, arg);
+}
 
-    DIR* dir;               // Directory corrente
-    char path[PATH_MAX];    // Percorso completo
-    struct dirent* entry;   // Entry all'interno della cartella
-    struct stat file_stat;  // Discrimino tra file e cartelle
+int fss_submit_remove(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg) {
+    if (!pathname) {
+        errno = EINVAL;
+        return -1;
+    }
+    return async_submit(ctx, REMOVE, pathname, 0, NULL, callback, arg);
+}
 
-    // Apro la cartella
-    if (!(dir = opendir(pathname))) return -1;
+int fss_poll(fss_context_t* ctx, int timeout) {
+    // Controllo la validità degli argomenti
+    if (!ctx) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ctx->socket == -1) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    // Senza richieste in volo non c'è nulla da attendere
+    if (ctx->pending == 0) return 0;
 
-    while ((entry = readdir(dir)) != NULL) {
-        snprintf(path, sizeof(path), "%s/%s", pathname, entry->d_name);
-        if (stat(path, &file_stat) == -1) continue;
+    size_t completed = ctx->completed;
+    struct pollfd descriptor = {.fd = ctx->socket, .events = POLLIN};
+    if (ctx->output_start < ctx->output_length) descriptor.events |= POLLOUT;
+    if (poll(&descriptor, 1, timeout) == -1) return errno == EINTR ? 0 : -1;
 
-        if (S_ISREG(file_stat.st_mode)) {
-            // E' un file, lo carico sul server se non ho raggiunto il limite superiore
-            if (upperbound > 0) {
-                // Creo il file sul server e lo apro in scrittura
-                openFile(path, O_CREATE | O_LOCK, dirname);
-                // Carico il contenuto del file
-                writeFile(path, dirname);
-                // Infine, chiudo il file
-                closeFile(path);
-                upperbound--;
-            }
-        } else if (S_ISDIR(file_stat.st_mode)) {
-            // E' una directory
-            // Se corrisponde a '.' oppure '..', salto
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-            // Analizzo il suo contenuto ricorsivamente
-            writeDirectory(path, upperbound, dirname);
-        }
+    if (((descriptor.revents & POLLOUT) && async_flush(ctx) == -1) || ((descriptor.revents & (POLLIN | POLLHUP | POLLERR)) && async_receive(ctx) == -1)) {
+        int error = errno;
+        async_fail(ctx, error);
+        errno = error;
+        return -1;
     }
-    // Chiudo la cartella
-    closedir(dir);
+    return (int)(ctx->completed - completed);
+}
 
-    return 0;
+size_t fss_pending(const fss_context_t* ctx) {
+    return ctx ? ctx->pending : 0;
 }
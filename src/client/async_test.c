@@ -0,0 +1,210 @@
+// @author Luca Cirillo (545480)
+
+// * Client di prova delle richieste asincrone (fss_*)
+// Per ogni file indicato accoda, senza attendere alcuna risposta, OPEN (creazione con lock), WRITE, READ e CLOSE,
+//  seguite dalla lettura di un file inesistente e da una READN di tutti i file: le richieste restano in volo
+//  contemporaneamente sulla stessa connessione, e vengono completate da fss_poll.
+// Ogni callback controlla di essere invocata una sola volta, con l'identificativo, il comando ed il file della
+//  propria richiesta, e con l'esito atteso; le READ confrontano il contenuto ricevuto con quello del file su disco.
+// I file espulsi vengono salvati nella cartella di -D, quelli letti dalla READN nella cartella di -d
+
+#include <API.h>
+#include <constants.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// File che non viene mai scritto sul server, letto per controllare la callback di una richiesta fallita
+#define MISSING_FILE "/fss/async-test/missing"
+
+// * Richiesta accodata, con l'esito atteso dalla sua callback
+typedef struct AsyncCheck {
+    int id;                // Identificativo ritornato da fss_submit_*
+    int command;           // Codice della richiesta
+    const char* pathname;  // File della richiesta, NULL per READN
+    int error;             // Codice errno atteso, 0 se la richiesta deve riuscire
+    const char* contents;  // READ: contenuto atteso
+    size_t size;           // READ: dimensione del contenuto atteso
+    int completions;       // Numero di invocazioni della callback
+    int status;            // Esito ricevuto
+} async_check_t;
+
+// Numero di controlli falliti
+static int failures = 0;
+
+static void check_failed(const async_check_t* check, const char* reason) {
+    fprintf(stderr, "Error: request %d (command %d) on '%s': %s\n", check->id, check->command, check->pathname ? check->pathname : "", reason);
+    failures++;
+}
+
+// * Callback di tutte le richieste: confronta l'esito con quello atteso dalla richiesta <arg>
+static void on_completion(const fss_completion_t* completion, void* arg) {
+    async_check_t* check = (async_check_t*)arg;
+    check->completions++;
+    check->status = completion->status;
+
+    if (check->completions > 1)
+        check_failed(check, "completed more than once");
+    else if (completion->id != check->id)
+        check_failed(check, "completed with another request id");
+    else if (completion->command != check->command)
+        check_failed(check, "completed with another command");
+    else if ((completion->pathname == NULL) != (check->pathname == NULL) || (check->pathname && strcmp(completion->pathname, check->pathname) != 0))
+        check_failed(check, "completed with another pathname");
+    else if (check->error != 0) {
+        if (completion->status != -1 || completion->error != check->error) check_failed(check, "did not fail as expected");
+    } else if (completion->status == -1) {
+        fprintf(stderr, "Error: %s\n", strerror(completion->error));
+        check_failed(check, "failed");
+    } else if (check->command == READ && (completion->size != check->size || (check->size > 0 && memcmp(completion->contents, check->contents, check->size) != 0)))
+        check_failed(check, "read contents differ from the local file");
+}
+
+// Legge l'intero contenuto del file <pathname>, salvandone la dimensione in <size>
+static char* load_file(const char* pathname, size_t* size) {
+    struct stat file_stat;
+    if (stat(pathname, &file_stat) == -1) return NULL;
+    FILE* file = fopen(pathname, "r");
+    if (!file) return NULL;
+    *size = (size_t)file_stat.st_size;
+    char* contents = malloc(*size > 0 ? *size : 1);
+    if (contents && *size > 0 && fread(contents, *size, 1, file) != 1) {
+        free(contents);
+        contents = NULL;
+    }
+    fclose(file);
+    return contents;
+}
+
+int main(int argc, char* argv[]) {
+    char* SOCKET_PATH = NULL;   // Percorso al socket file del server
+    char* EJECTED_DIR = NULL;   // Cartella dei file espulsi
+    char* READ_DIR = NULL;      // Cartella dei file letti dalla READN
+
+    int option;
+    while ((option = getopt(argc, argv, ":pf:D:d:")) != -1) {
+        switch (option) {
+            case 'p':
+                VERBOSE = true;
+                break;
+            case 'f':
+                SOCKET_PATH = optarg;
+                break;
+            case 'D':
+                EJECTED_DIR = optarg;
+                break;
+            case 'd':
+                READ_DIR = optarg;
+                break;
+            default:
+                SOCKET_PATH = NULL;
+                optind = argc;
+                break;
+        }
+    }
+    if (!SOCKET_PATH || optind == argc) {
+        printf("Usage: %s -f socketname [-p] [-D dirname] [-d dirname] file1 [file2 ...]\n", argv[0]);
+        return EINVAL;
+    }
+
+    // Ogni file richiede OPEN, WRITE, READ e CLOSE; seguono la lettura del file inesistente e la READN
+    size_t files_no = (size_t)(argc - optind);
+    size_t checks_no = 4 * files_no + 2;
+    async_check_t* checks = calloc(checks_no, sizeof(async_check_t));
+    char** contents = calloc(files_no, sizeof(char*));
+    if (!checks || !contents) {
+        perror("Error: failed to allocate the requests");
+        free(checks);
+        free(contents);
+        return errno;
+    }
+    int EXIT_CODE = EXIT_SUCCESS;
+    for (size_t i = 0; i < files_no; i++) {
+        const char* pathname = argv[optind + i];
+        size_t size = 0;
+        if (!(contents[i] = load_file(pathname, &size))) {
+            fprintf(stderr, "Error: failed to read '%s'\n", pathname);
+            EXIT_CODE = EIO;
+            goto free_and_exit;
+        }
+        const int commands[] = {OPEN, WRITE, READ, CLOSE};
+        for (size_t j = 0; j < 4; j++) {
+            async_check_t* check = &checks[4 * i + j];
+            check->command = commands[j];
+            check->pathname = pathname;
+            check->contents = contents[i];
+            check->size = size;
+        }
+    }
+    checks[checks_no - 2] = (async_check_t){.command = READ, .pathname = MISSING_FILE, .error = ENOENT};
+    checks[checks_no - 1] = (async_check_t){.command = READN};
+
+    // Effettua nuovi tentativi di connessione ogni secondo, per al più 10 secondi
+    struct timespec abstime = {.tv_sec = time(NULL) + 10, .tv_nsec = 0};
+    fss_context_t* ctx = fss_connect(SOCKET_PATH, 1000, abstime);
+    if (!ctx) {
+        perror("Error: failed to initiate socket connection");
+        EXIT_CODE = errno;
+        goto free_and_exit;
+    }
+
+    // * Accodo tutte le richieste, senza attendere le risposte
+    for (size_t i = 0; i < checks_no; i++) {
+        async_check_t* check = &checks[i];
+        switch (check->command) {
+            case OPEN:
+                check->id = fss_submit_open(ctx, check->pathname, O_CREATE | O_LOCK, EJECTED_DIR, on_completion, check);
+                break;
+            case WRITE:
+                check->id = fss_submit_write(ctx, check->pathname, EJECTED_DIR, on_completion, check);
+                break;
+            case READ:
+                check->id = fss_submit_read(ctx, check->pathname, NULL, on_completion, check);
+                break;
+            case CLOSE:
+                check->id = fss_submit_close(ctx, check->pathname, on_completion, check);
+                break;
+            case READN:
+                check->id = fss_submit_readn(ctx, 0, READ_DIR, on_completion, check);
+                break;
+        }
+        if (check->id == -1) {
+            perror("Error: failed to submit a request");
+            EXIT_CODE = errno;
+            fss_disconnect(ctx);
+            goto free_and_exit;
+        }
+    }
+    size_t in_flight = fss_pending(ctx);
+
+    // * Attendo il completamento di tutte le richieste
+    while (fss_pending(ctx) > 0) {
+        if (fss_poll(ctx, -1) == -1) {
+            perror("Error: connection failed");
+            failures++;
+            break;
+        }
+    }
+    if (fss_disconnect(ctx) == -1) {
+        perror("Error: failed to close the connection");
+        failures++;
+    }
+
+    // Ogni callback deve essere stata invocata
+    for (size_t i = 0; i < checks_no; i++)
+        if (checks[i].completions == 0) check_failed(&checks[i], "never completed");
+
+    printf("Requests in flight: %zu, completed: %zu, failed checks: %d, files read by READN: %d\n", in_flight, checks_no, failures, checks[checks_no - 1].status);
+    if (failures > 0) EXIT_CODE = EXIT_FAILURE;
+
+free_and_exit:
+    for (size_t i = 0; i < files_no; i++) free(contents[i]);
+    free(contents);
+    free(checks);
+    return EXIT_CODE;
+}
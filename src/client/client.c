@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <protocol.h>
 #include <request_queue.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -18,6 +19,8 @@ void print_help() {
     printf(
         "-h                Print this message and exit\n"
         "-p                Enable verbose mode\n"
+        "-P                Use the legacy text protocol\n"
+        "-m size           Shares <size> MB of memory with the server to transfer file contents\n"
         "-f socketname     Specifies the socket name used by the server\n"
         "-w dirname[,n=0]  Sends the files in the <dirname> folder to the server; <n> specifies an upper limit\n"
         "-W file1[,file2]  Sends the specified file list to the server\n"
@@ -31,6 +34,53 @@ void print_help() {
         "-t time           Time in milliseconds between two consecutive requests (optional)\n");
 }
 
+// Operazioni eseguite su ogni file delle liste -r, -l, -u e -c
+static const int read_operations[][2] = {{OPEN, O_READ}, {READ, 0}, {CLOSE, 0}};
+static const int lock_operations[][2] = {{OPEN, O_READ}, {LOCK, 0}};
+static const int unlock_operations[][2] = {{UNLOCK, 0}};
+static const int remove_operations[][2] = {{OPEN, O_LOCK}, {REMOVE, 0}};
+
+// Divide la lista di file separati da virgola <list>, modificandola
+// Ritorna l'array dei nomi, terminato da NULL, oppure NULL in caso di errore
+static char** split_list(char* list) {
+    size_t count = 1;
+    for (const char* c = list; *c; c++)
+        if (*c == ',') count++;
+    char** files = (char**)malloc(sizeof(char*) * (count + 1));
+    if (!files) return NULL;
+
+    size_t i = 0;
+    char* strtok_status = NULL;
+    for (char* file = strtok_r(list, ",", &strtok_status); file; file = strtok_r(NULL, ",", &strtok_status)) files[i++] = file;
+    files[i] = NULL;
+    return files;
+}
+
+// Esegue con un'unica richiesta, su ogni file di <files>, le <operations_no> operazioni <operations> (comando, flags)
+// I file letti vengono salvati in <dirname>, se specificata
+// Ritorna gli esiti delle operazioni, nell'ordine in cui sono state eseguite, oppure NULL in caso di errore
+static int* batch_files(char** files, const int (*operations)[2], size_t operations_no, const char* dirname) {
+    batch_t* batch = createBatch();
+    if (!batch) return NULL;
+    for (size_t i = 0; files[i]; i++) {
+        for (size_t j = 0; j < operations_no; j++) {
+            if (addToBatch(batch, operations[j][0], files[i], operations[j][1]) == -1) {
+                destroyBatch(batch);
+                return NULL;
+            }
+        }
+    }
+
+    int* results = (int*)malloc(sizeof(int) * (batchLength(batch) + 1));
+    if (!results || executeBatch(batch, results, dirname) == -1) {
+        if (results) free(results);
+        destroyBatch(batch);
+        return NULL;
+    }
+    destroyBatch(batch);
+    return results;
+}
+
 // ! MAIN
 int main(int argc, char* argv[]) {
     // Se non viene specificato alcun parametro, stampo l'usage ed esco
@@ -56,7 +106,7 @@ int main(int argc, char* argv[]) {
     }
 
     int option;  // Carattere del parametro appena letto da getopt
-    while ((option = getopt(argc, argv, ":hpf:w:W:D:r:R:d:t:l:u:c:")) != -1) {
+    while ((option = getopt(argc, argv, ":hpPm:f:w:W:D:r:R:d:t:l:u:c:")) != -1) {
         switch (option) {
             // * Path del socket
             case 'f':
@@ -184,6 +234,23 @@ int main(int argc, char* argv[]) {
                 VERBOSE = true;
                 break;
 
+            // * Protocollo testuale
+            case 'P':
+                PROTOCOL_VERSION = PROTOCOL_LEGACY;
+                break;
+
+            // * Memoria condivisa
+            case 'm': {
+                long megabytes = 0;
+                if (!is_number(optarg, &megabytes) || megabytes <= 0) {
+                    fprintf(stderr, "Error: shared memory size is invalid\n");
+                    EXIT_CODE = EINVAL;
+                    goto free_and_exit;
+                }
+                SHARED_MEMORY_SIZE = (size_t)megabytes * 1024 * 1024;
+                break;
+            }
+
             // * Messaggio di help
             case 'h':
                 // Stampo l'help ed esco
@@ -253,9 +320,9 @@ int main(int argc, char* argv[]) {
     char* token = NULL;
     char* filename = NULL;
     char* strtok_status = NULL;
-    // readFile (-r)
-    void* buffer = NULL;
-    size_t size = 0;
+    // Liste di file (-r, -l, -u, -c) ed esito delle operazioni su ognuno
+    char** files = NULL;
+    int* results = NULL;
     // readNFiles (-R)
     long N = 0;
     // writeDirectory (-w)
@@ -322,25 +389,20 @@ int main(int argc, char* argv[]) {
                 break;
 
             case 'r':  // Leggo dal server un(a lista di) file
-                // Possono essere specificati più file separati da virgola
-                filename = strtok_r(request->arguments, ",", &strtok_status);
-                while (filename) {
-                    if (openFile(filename, O_READ, NULL) == -1) {
-                        perror("Error: can't open the file, skip it");
-                        // Non avendo aperto correttamente il file, evito di proseguire
-                        filename = strtok_r(NULL, ",", &strtok_status);
+                // Possono essere specificati più file separati da virgola, letti con un'unica richiesta
+                if (!(files = split_list(request->arguments)) || !(results = batch_files(files, read_operations, 3, request->dirname))) {
+                    perror("Error: cannot read the files");
+                    break;
+                }
+                for (size_t i = 0; files[i]; i++) {
+                    const int* result = results + i * 3;
+                    if (result[0] == -1) {
+                        // Non avendo aperto correttamente il file, ignoro gli esiti successivi
+                        fprintf(stderr, "Error: can't open the file '%s', skip it\n", files[i]);
                         continue;
                     }
-
-                    if (readFile(filename, &buffer, &size, request->dirname) == -1) {
-                        perror("Error: cannot read the file");
-                    }
-
-                    if (closeFile(filename) == -1) {
-                        perror("Error: something went wrong while closing the file");
-                    }
-
-                    filename = strtok_r(NULL, ",", &strtok_status);
+                    if (result[1] == -1) fprintf(stderr, "Error: cannot read the file '%s'\n", files[i]);
+                    if (result[2] == -1) fprintf(stderr, "Error: something went wrong while closing the file '%s'\n", files[i]);
                 }
                 break;
 
@@ -367,52 +429,52 @@ int main(int argc, char* argv[]) {
                 break;
 
             case 'l':  // Acquisisco la mutua esclusione su un(a lista di) file
-                // Possono essere specificati più file separati da virgola
-                filename = strtok_r(request->arguments, ",", &strtok_status);
-                while (filename) {
-                    // Si suppone che il file sia già stato aperto in lettura dal client
-                    openFile(filename, O_READ, NULL);
-                    if (lockFile(filename) == -1) {
-                        perror("Error: cannot lock file");
-                    }
-
-                    filename = strtok_r(NULL, ",", &strtok_status);
+                // Possono essere specificati più file separati da virgola, con un'unica richiesta
+                // Si suppone che il file sia già stato aperto in lettura dal client, quindi ignoro l'esito di openFile
+                if (!(files = split_list(request->arguments)) || !(results = batch_files(files, lock_operations, 2, NULL))) {
+                    perror("Error: cannot lock the files");
+                    break;
+                }
+                for (size_t i = 0; files[i]; i++) {
+                    if (results[i * 2 + 1] == -1) fprintf(stderr, "Error: cannot lock file '%s'\n", files[i]);
                 }
                 break;
 
             case 'u':  // Rilascio la mutua esclusione su un(a lista di) file
-                // Possono essere specificati più file separati da virgola
-                filename = strtok_r(request->arguments, ",", &strtok_status);
-                while (filename) {
-                    // Si suppone che il file sia già stato aperto in scrittura dal client
-                    if (unlockFile(filename) == -1) {
-                        perror("Error: cannot unlock file");
-                    }
-                    filename = strtok_r(NULL, ",", &strtok_status);
+                // Possono essere specificati più file separati da virgola, con un'unica richiesta
+                // Si suppone che il file sia già stato aperto in scrittura dal client
+                if (!(files = split_list(request->arguments)) || !(results = batch_files(files, unlock_operations, 1, NULL))) {
+                    perror("Error: cannot unlock the files");
+                    break;
+                }
+                for (size_t i = 0; files[i]; i++) {
+                    if (results[i] == -1) fprintf(stderr, "Error: cannot unlock file '%s'\n", files[i]);
                 }
                 break;
 
             case 'c':  // Rimuovo dallo storage un(a lista di) file
-                // Possono essere specificati più file separati da virgola
-                filename = strtok_r(request->arguments, ",", &strtok_status);
-                while (filename) {
-                    if (openFile(filename, O_LOCK, NULL) == -1) {
-                        // Il file potrebbe essere stato aperto in lettura
-                        // Provo a richiedere l'accesso in scrittura tramite lockFile
-                        if (lockFile(filename) == -1) {
-                            perror("Error: cannot open file in write mode to delete it");
-                        }
-                    } else {
-                        if (removeFile(filename) == -1) {
-                            perror("Error: cannot delete file from storage");
-                        }
-                    }
-                    // Passo al file successivo
-                    filename = strtok_r(NULL, ",", &strtok_status);
+                // Possono essere specificati più file separati da virgola, con un'unica richiesta
+                // La rimozione riesce anche se il file era già stato aperto e bloccato dal client
+                if (!(files = split_list(request->arguments)) || !(results = batch_files(files, remove_operations, 2, NULL))) {
+                    perror("Error: cannot delete the files");
+                    break;
+                }
+                for (size_t i = 0; files[i]; i++) {
+                    if (results[i * 2 + 1] == 0) continue;
+                    if (results[i * 2] == -1)
+                        fprintf(stderr, "Error: cannot open file '%s' in write mode to delete it\n", files[i]);
+                    else
+                        fprintf(stderr, "Error: cannot delete file '%s' from storage\n", files[i]);
                 }
                 break;
         }
 
+        // Libero gli esiti delle operazioni su una lista di file
+        if (files) free(files);
+        if (results) free(results);
+        files = NULL;
+        results = NULL;
+
         // Se -t è stato specificato, mi fermo per il tempo specificato tra una richiesta e la successiva
         if (request->time > 0 && request_queue->length != 0) {  // Tuttavia, non aspetto se non ci sono ci sono più richieste da elaborare
             // Struttura dati per la nanosleep
@@ -4,12 +4,19 @@
 #define _API_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
 // Modalità verbose
-bool VERBOSE;
+extern bool VERBOSE;
 // Socket del client
-int client_socket;
+extern int client_socket;
+// Versione del protocollo richiesta in openConnection (PROTOCOL_BINARY di default)
+// PROTOCOL_LEGACY non prevede negoziazione, ed è quindi compatibile con qualsiasi server
+extern int PROTOCOL_VERSION;
+// Dimensione in bytes della memoria condivisa offerta al server in openConnection, 0 per non offrirla
+// I contenuti dei file che vi entrano non vengono più copiati attraverso il socket
+extern size_t SHARED_MEMORY_SIZE;
 
 // * Apre una connessione con il server al socket file sockname
 int openConnection(const char* sockname, int msec, const struct timespec abstime);
@@ -45,7 +52,83 @@ int closeFile(const char* pathname);
 int removeFile(const char* pathname);
 
 // * Wrapper utilizzato per caricare il contenuto di una cartella sul server
-// * Utilizza le API: openFile, writeFile, closeFile.
+// * Utilizza le operazioni openFile, writeFile, closeFile, inviate a gruppi con executeBatch
 int writeDirectory(const char* pathname, int upperbound, const char* dirname);
 
+// * Sequenza di operazioni da inviare al server con un'unica richiesta
+// Come per RWLock, la definizione della struttura è omessa dall'header
+typedef struct Batch batch_t;
+
+// * Crea una sequenza di operazioni vuota
+batch_t* createBatch(void);
+
+// * Aggiunge alla sequenza <batch> la richiesta <command> sul file <pathname>
+// <command> è uno tra OPEN (con i flags <flags>), READ, LOCK, UNLOCK, CLOSE e REMOVE
+int addToBatch(batch_t* batch, int command, const char* pathname, int flags);
+
+// * Aggiunge alla sequenza <batch> la scrittura del file <pathname>, il cui contenuto viene letto subito dal disco
+int addFileToBatch(batch_t* batch, const char* pathname);
+
+// * Ritorna il numero di operazioni nella sequenza <batch>
+int batchLength(const batch_t* batch);
+
+// * Esegue in ordine le operazioni della sequenza <batch>, salvando in <dirname> i file letti ed espulsi
+// <results>, di batchLength(batch) elementi, riceve l'esito di ogni operazione (0 oppure -1)
+// Con il protocollo testuale le operazioni vengono inviate una alla volta; in ogni caso la sequenza viene svuotata
+int executeBatch(batch_t* batch, int* results, const char* dirname);
+
+// * Cancella una sequenza creata con createBatch
+void destroyBatch(batch_t* batch);
+
+// * Contesto asincrono: una connessione dedicata, sulla quale più richieste restano in volo contemporaneamente
+// Ogni richiesta riceve un identificativo, ripetuto dal server nella risposta: le risposte vengono associate
+//  alle richieste tramite l'identificativo, e possono quindi arrivare in qualsiasi ordine
+// Il contesto è indipendente dalla connessione di openConnection, e non va usato da più threads contemporaneamente
+typedef struct FssContext fss_context_t;
+
+// * Esito di una richiesta asincrona, passato alla sua callback
+typedef struct FssCompletion {
+    int id;                // Identificativo ritornato da fss_submit_*
+    int command;           // Codice della richiesta
+    const char* pathname;  // File della richiesta, NULL per READN
+    int status;            // Esito, come il valore di ritorno della corrispondente funzione sincrona
+    int error;             // Con status -1, il codice errno che descrive l'errore
+    const void* contents;  // READ: contenuto del file, valido solamente durante la callback
+    size_t size;           // READ: dimensione del contenuto
+} fss_completion_t;
+
+// * Callback invocata da fss_poll al completamento di una richiesta, con l'argomento <arg> passato a fss_submit_*
+// Può inviare nuove richieste, ma non deve chiamare fss_poll né fss_disconnect
+typedef void (*fss_callback_t)(const fss_completion_t* completion, void* arg);
+
+// * Crea un contesto asincrono connesso al server al socket file <sockname>, con il protocollo binario
+fss_context_t* fss_connect(const char* sockname, int msec, const struct timespec abstime);
+
+// * Chiude il contesto <ctx>, dopo aver inviato le richieste in coda
+// Le richieste ancora in volo vengono completate con errore ECANCELED: per attenderne l'esito,
+//  chiamare fss_poll finché fss_pending non ritorna 0
+int fss_disconnect(fss_context_t* ctx);
+
+// * Richieste asincrone, con la stessa semantica delle corrispondenti funzioni sincrone
+// Ritornano l'identificativo della richiesta, accodata per l'invio, oppure -1 in caso di errore
+// I file espulsi e quelli letti vengono salvati in <dirname>, se specificata
+int fss_submit_open(fss_context_t* ctx, const char* pathname, int flags, const char* dirname, fss_callback_t callback, void* arg);
+int fss_submit_read(fss_context_t* ctx, const char* pathname, const char* dirname, fss_callback_t callback, void* arg);
+int fss_submit_readn(fss_context_t* ctx, int N, const char* dirname, fss_callback_t callback, void* arg);
+int fss_submit_write(fss_context_t* ctx, const char* pathname, const char* dirname, fss_callback_t callback, void* arg);
+int fss_submit_append(fss_context_t* ctx, const char* pathname, const void* buf, size_t size, const char* dirname, fss_callback_t callback, void* arg);
+int fss_submit_lock(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg);
+int fss_submit_unlock(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg);
+int fss_submit_close(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg);
+int fss_submit_remove(fss_context_t* ctx, const char* pathname, fss_callback_t callback, void* arg);
+
+// * Invia le richieste in coda e riceve le risposte disponibili, invocando le callback delle richieste completate
+// Attende al più <timeout> millisecondi (-1 senza limite) che la connessione sia pronta, come poll
+// Ritorna il numero di richieste completate; in caso di errore della connessione, le richieste in volo
+//  vengono completate con il suo codice di errore e ritorna -1
+int fss_poll(fss_context_t* ctx, int timeout);
+
+// * Ritorna il numero di richieste del contesto <ctx> non ancora completate
+size_t fss_pending(const fss_context_t* ctx);
+
 #endif
@@ -13,13 +13,14 @@
 #define IS_O_LOCK(mask) ((mask >> 1) & 1)
 
 // Lunghezza massima di un qualsiasi messaggio scambiato tra client e server
-#define PIPE_LEN 16
 #define PATH_MAX 4096
-#define CLIENT_LEFT 0
 #define BUFFER_SIZE 1024
 #define MEGABYTES 1048576  // 1024 * 1024
 #define MESSAGE_LENGTH 2048
 #define CONCURRENT_CONNECTIONS 8
+#define EPOLL_MAX_EVENTS 64
+#define TASK_QUEUE_CAPACITY 1024
+#define URING_ENTRIES 8
 
 #define FSS_CLIENT_BANNER "\n" \
 "  ███████╗███████╗███████╗\n" \
@@ -42,20 +43,25 @@
 typedef enum ReplacementPolicy {
     FIFO,
     LRU,
-    LFU
+    LFU,
+    ARC,        // Adaptive Replacement Cache
+    TWO_QUEUE,  // 2Q
+    W_TINYLFU,  // Window TinyLFU
+    GDSF        // GreedyDual-Size with Frequency
 } replacement_policy_t;
 
 typedef enum RequestCode {
-    OPEN,       // openFile
-    READ,       // readFile
-    READN,      // readNFiles
-    WRITE,      // writeFile
-    APPEND,     // appendToFile
-    LOCK,       // lockFile
-    UNLOCK,     // unlockFile
-    CLOSE,      // closeFile
-    REMOVE,     // removeFile
-    DISCONNECT  // closeConnection
+    OPEN,        // openFile
+    READ,        // readFile
+    READN,       // readNFiles
+    WRITE,       // writeFile
+    APPEND,      // appendToFile
+    LOCK,        // lockFile
+    UNLOCK,      // unlockFile
+    CLOSE,       // closeFile
+    REMOVE,      // removeFile
+    DISCONNECT,  // closeConnection
+    MULTI        // executeBatch, solamente con il protocollo binario
 } request_code;
 
 #endif
@@ -28,6 +28,12 @@ linked_list_t* linked_list_create();
 // * Cancella una lista creata con linked_list_create
 void linked_list_destroy(linked_list_t* llist);
 
+// * Inizializza una lista vuota <llist>, contenuta in un'altra struttura dati
+void linked_list_init(linked_list_t* llist);
+
+// * Cancella tutti i nodi della lista, che resta vuota ma utilizzabile
+void linked_list_clear(linked_list_t* llist);
+
 // * Inserisce un nuovo nodo in coda alla lista, che conterrà <data>
 // Ritorna true in caso di successo, false in caso di fallimento, setta errno
 bool linked_list_insert(linked_list_t* llist, int data);
@@ -0,0 +1,47 @@
+// @author Luca Cirillo (545480)
+// * Protocollo binario (versione 2) condiviso tra client e server
+
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+
+#include <stdint.h>
+
+// Versioni del protocollo
+// 1: messaggi testuali di MESSAGE_LENGTH bytes, completati con '\0'
+// 2: frames binari di dimensione minima, negoziati all'apertura della connessione
+#define PROTOCOL_LEGACY 1
+#define PROTOCOL_BINARY 2
+
+// Codice del frame di negoziazione, inviato dal client come primo messaggio della connessione
+// Un messaggio testuale inizia sempre con una cifra, quindi il server distingue i due protocolli dal primo byte
+#define FRAME_HELLO 0xF5
+
+// Flags dei frames
+#define FRAME_FILE 1    // Risposta: il frame descrive un file, <path> è il suo nome ed il payload il suo contenuto
+#define FRAME_SHARED 2  // Il payload si trova nella memoria condivisa invece che sul socket (vedi sotto)
+
+// * Memoria condivisa
+// Il client può inviare, insieme al frame FRAME_HELLO con flag FRAME_SHARED, un memfd sigillato con F_SEAL_SHRINK
+//  tramite SCM_RIGHTS, di <payload_length> bytes; il server accetta ripetendo il flag nella risposta.
+// Il contenuto di una richiesta con FRAME_SHARED si trova all'inizio della memoria; quelli della risposta sono
+//  disposti uno dopo l'altro, nell'ordine dei frames. Solamente i frames viaggiano sul socket.
+
+// Dimensione massima in bytes delle operazioni di una richiesta MULTI inviate sul socket: il server le riceve per intero
+//  in memoria, quindi rifiuta una richiesta più grande, scartandone il contenuto, con esito -1
+// Le operazioni nella memoria condivisa sono già limitate dalla sua dimensione
+#define MULTI_MAX_SIZE (64 * 1024 * 1024)
+
+// * Intestazione di un frame, in richiesta ed in risposta
+// Il frame è seguito da <path_length> bytes di pathname (senza '\0') e da <payload_length> bytes di payload
+// Client e server sono sulla stessa macchina (socket AF_UNIX), quindi i campi sono in ordine di byte nativo
+typedef struct Frame {
+    uint8_t opcode;           // Codice della richiesta (request_code), ripetuto nella risposta
+    uint8_t flags;            // Flags di openFile in richiesta, FRAME_FILE in risposta, FRAME_SHARED
+    uint16_t path_length;     // Lunghezza del pathname che segue l'intestazione
+    uint32_t request_id;      // Identificativo della richiesta, ripetuto nella risposta
+    uint64_t payload_length;  // Lunghezza del contenuto che segue il pathname
+    int32_t value;            // Richiesta: N di readNFiles, versione in FRAME_HELLO; risposta: esito
+    uint32_t reserved;        // Sempre 0
+} frame_t;
+
+#endif
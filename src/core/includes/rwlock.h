@@ -5,18 +5,28 @@
 #ifndef _RWLOCK_H_
 #define _RWLOCK_H_
 
-#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 
-// Per evitare l'accesso alla struttura dati che controlla il lock,
-//  la definizione della stessa è stata omessa dall'header di RWLock.
-//  E' riportata solo la definizione del tipo, così che possa essere utilizzata all'esterno
+// La definizione della struttura dati è riportata nell'header così che un RWLock possa essere contenuto
+//  direttamente in un'altra struttura dati (rwlock_init), senza un'allocazione dedicata:
+//  i suoi campi vanno comunque letti e modificati solamente tramite le funzioni di RWLock
+struct RWLock {
+    // Il comportamento del RWLock è completamente determinato dal numero di threads che leggono, dalla presenza
+    //  di uno scrittore attivo e dal numero di scrittori in attesa, raccolti in una sola parola: un RWLock occupa 4 bytes
+    // I threads che devono aspettare si fermano su una tabella di condition variables condivisa da tutti i RWLock
+    atomic_uint state;
+};
 typedef struct RWLock rwlock_t;
 
 // * Crea un nuovo RWLock e restituisce un puntatore ad esso
 rwlock_t* rwlock_create();
 // * Elimina un RWLock esistente, creato con rwlock_create
 void rwlock_destroy(rwlock_t* rwlock);
+// * Inizializza il RWLock <rwlock>, contenuto in un'altra struttura dati
+bool rwlock_init(rwlock_t* rwlock);
+// * Cancella un RWLock inizializzato con rwlock_init, senza liberarne la memoria
+void rwlock_deinit(rwlock_t* rwlock);
 // * Acquisisce il lock in lettura
 bool rwlock_start_read(rwlock_t* rwlock);
 // * Rilascia il lock in lettura
@@ -10,27 +10,41 @@
 linked_list_t* linked_list_create() {
     linked_list_t* llist = malloc(sizeof(linked_list_t));
     if (!llist) return NULL;
+    linked_list_init(llist);
+    return llist;
+}
+
+void linked_list_init(linked_list_t* llist) {
+    if (!llist) return;
     llist->first = NULL;
     llist->last = NULL;
     llist->size = 0;
-    return llist;
 }
 
-void linked_list_destroy(linked_list_t* llist) {
+void linked_list_clear(linked_list_t* llist) {
     // Controllo la validità degli argomenti
     if (!llist) {
         errno = EINVAL;
         return;
     }
     // Scorro la lista per cancellare tutti i nodi
-    while (llist->first != llist->last) {
+    while (llist->first) {
         list_node_t* node = llist->first;
         llist->first = llist->first->next;
         free(node);
     }
-    // Cancello la testa della lista
-    if (llist->first) free(llist->first);
-    // Cancello la lista
+    llist->last = NULL;
+    llist->size = 0;
+}
+
+void linked_list_destroy(linked_list_t* llist) {
+    // Controllo la validità degli argomenti
+    if (!llist) {
+        errno = EINVAL;
+        return;
+    }
+    // Cancello tutti i nodi, e poi la lista
+    linked_list_clear(llist);
     free(llist);
 }
 
@@ -4,9 +4,10 @@
 
 #include <pthread.h>
 #include <rwlock.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
 
 // * Questa implementazione di Readers/Writers Lock adotta una politica "writers preferred", ovvero
 //  un lettore deve aspettare se ci sono scrittori attivi o in attesa, mentre
@@ -14,176 +15,185 @@
 // Questa politica previene il caso in cui un flusso continuo di lettori in arrivo "taglia fuori"
 //  tutte le richieste provenienti da scrittori, che rimarrebbero in attesa per un tempo indefinito
 
-struct RWLock {
-    // Variabili di sincronizzazione
-    pthread_mutex_t mutex;    // Accesso mutualmente esclusivo
-    pthread_cond_t read_go;   // Attesa per start_read()
-    pthread_cond_t write_go;  // Attesa per start_write()
-
-    // Variabili di stato
-    // Il comportamento del RWLock è completamente determinato
-    //  dal numero di threads che leggono o scrivono, e
-    //  dal numero di threads che vogliono leggere o scrivere
-    int active_readers;
-    int active_writers;
-    int waiting_readers;
-    int waiting_writers;
-};
-
-rwlock_t* rwlock_create() {
-    rwlock_t* rwlock = malloc(sizeof(rwlock_t));
-    if (!rwlock) return NULL;
-
-    // Azzero la memoria allocata
-    memset(rwlock, 0, sizeof(rwlock_t));
+// * Lo stato del lock è una sola parola, aggiornata con compare-and-swap: senza contesa acquisire e rilasciare
+//  il lock costa una sola operazione atomica. Chi deve aspettare si ferma sulla condition variable di un bucket,
+//  scelto in base all'indirizzo del lock, dopo aver segnalato nello stato la presenza di threads fermi (PARKED):
+//  chi rilascia il lock risveglia i threads del bucket solamente se il bit è presente, azzerandolo.
+// Bucket e bit sono condivisi da più locks e threads, quindi un thread risvegliato ricontrolla sempre lo stato
+
+// Campi dello stato: lettori attivi, scrittori in attesa, scrittore attivo e threads fermi
+#define RWLOCK_READER 1u
+#define RWLOCK_READERS 0xFFFFu
+#define RWLOCK_WAITING_WRITER (1u << 16)
+#define RWLOCK_WAITING_WRITERS (0x3FFFu << 16)
+#define RWLOCK_WRITER (1u << 30)
+#define RWLOCK_PARKED (1u << 31)
+
+// Numero di buckets su cui si fermano i threads in attesa, potenza di 2
+#define RWLOCK_BUCKETS 64
+
+// * Bucket su cui si fermano i threads in attesa dei locks associati
+typedef struct RWLockBucket {
+    pthread_mutex_t mutex;  // Protegge l'attesa, così che un risveglio non vada perso
+    pthread_cond_t wake;    // Attesa dei threads fermi
+} rwlock_bucket_t;
+
+static rwlock_bucket_t buckets[RWLOCK_BUCKETS];
+static pthread_once_t buckets_once = PTHREAD_ONCE_INIT;
+
+static void buckets_init(void) {
+    for (size_t i = 0; i < RWLOCK_BUCKETS; i++) {
+        pthread_mutex_init(&buckets[i].mutex, NULL);
+        pthread_cond_init(&buckets[i].wake, NULL);
+    }
+}
 
-    // Inizializzo i parametri relativi a lettori e scrittori
-    rwlock->active_readers = 0;
-    rwlock->active_writers = 0;
-    rwlock->waiting_readers = 0;
-    rwlock->waiting_readers = 0;
+// Bucket del lock <rwlock>
+static rwlock_bucket_t* bucket_of(rwlock_t* rwlock) {
+    uintptr_t address = (uintptr_t)rwlock / sizeof(rwlock_t);
+    return &buckets[(address * 2654435769u) % RWLOCK_BUCKETS];
+}
 
-    // Inizializzo l'accesso esclusivo
-    if (pthread_mutex_init(&rwlock->mutex, NULL) != 0) {
-        //perror("Error: unable to init lock mutex");
-        free(rwlock);
-        return NULL;
+// * Ferma il thread finché lo stato di <rwlock> contiene uno dei bits di <busy>, o fino ad un risveglio
+// Il chiamante ricontrolla lo stato al ritorno
+static bool rwlock_park(rwlock_t* rwlock, unsigned int busy) {
+    if (pthread_once(&buckets_once, buckets_init) != 0) return false;
+    rwlock_bucket_t* bucket = bucket_of(rwlock);
+    if (pthread_mutex_lock(&bucket->mutex) != 0) return false;
+
+    // Segnalo di essere fermo con il mutex del bucket: chi rilascia il lock dopo averlo visto acquisisce lo stesso mutex,
+    //  quindi il risveglio arriva solamente quando sono già in attesa sulla condition variable
+    unsigned int state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
+    while (state & busy) {
+        if ((state & RWLOCK_PARKED) || atomic_compare_exchange_weak_explicit(&rwlock->state, &state, state | RWLOCK_PARKED, memory_order_relaxed, memory_order_relaxed)) {
+            if (pthread_cond_wait(&bucket->wake, &bucket->mutex) != 0) {
+                pthread_mutex_unlock(&bucket->mutex);
+                return false;
+            }
+            break;
+        }
     }
 
-    // Inizializzo la condizione di attesa per i lettori
-    if (pthread_cond_init(&rwlock->read_go, NULL) != 0) {
-        //perror("Error: unable to init lock read_go condition variable");
-        pthread_mutex_destroy(&rwlock->mutex);
-        free(rwlock);
-        return NULL;
+    if (pthread_mutex_unlock(&bucket->mutex) != 0) return false;
+    return true;
+}
+
+// * Risveglia i threads fermi sul bucket di <rwlock>
+static bool rwlock_wake(rwlock_t* rwlock) {
+    if (pthread_once(&buckets_once, buckets_init) != 0) return false;
+    rwlock_bucket_t* bucket = bucket_of(rwlock);
+    if (pthread_mutex_lock(&bucket->mutex) != 0) return false;
+    if (pthread_cond_broadcast(&bucket->wake) != 0) {
+        pthread_mutex_unlock(&bucket->mutex);
+        return false;
     }
+    if (pthread_mutex_unlock(&bucket->mutex) != 0) return false;
+    return true;
+}
 
-    // Inizializzo la condizione di attesa per gli scrittori
-    if (pthread_cond_init(&rwlock->write_go, NULL) != 0) {
-        //perror("Error: unable to init lock write_go condition variable");
-        pthread_mutex_destroy(&rwlock->mutex);
-        pthread_cond_destroy(&rwlock->read_go);
+rwlock_t* rwlock_create() {
+    rwlock_t* rwlock = malloc(sizeof(rwlock_t));
+    if (!rwlock) return NULL;
+    if (!rwlock_init(rwlock)) {
         free(rwlock);
         return NULL;
     }
-
     // Ritorno il RWLock
     return rwlock;
 }
 
 void rwlock_destroy(rwlock_t* rwlock) {
     if (!rwlock) return;
-    pthread_mutex_destroy(&rwlock->mutex);
-    pthread_cond_destroy(&rwlock->read_go);
-    pthread_cond_destroy(&rwlock->write_go);
+    rwlock_deinit(rwlock);
     free(rwlock);
 }
 
-bool read_should_wait(rwlock_t* rwlock) {
+bool rwlock_init(rwlock_t* rwlock) {
     if (!rwlock) return false;
+    // Nessun lettore o scrittore, né attivo né in attesa
+    atomic_init(&rwlock->state, 0);
+    return true;
+}
+
+void rwlock_deinit(rwlock_t* rwlock) {
+    // Il lock non possiede risorse: i buckets sono condivisi da tutti i RWLock
+}
+
+static bool read_should_wait(unsigned int state) {
     // * Un lettore deve aspettare se sono presenti scrittori attivi oppure in attesa
-    return (rwlock->active_writers > 0 || rwlock->waiting_writers > 0);
+    return (state & (RWLOCK_WRITER | RWLOCK_WAITING_WRITERS)) != 0;
 }
 
-bool write_should_wait(rwlock_t* rwlock) {
-    if (!rwlock) return false;
+static bool write_should_wait(unsigned int state) {
     // * Uno scrittore deve aspettare se sono presenti scrittori attivi oppure lettori attivi
-    return (rwlock->active_writers > 0 || rwlock->active_readers > 0);
+    return (state & (RWLOCK_WRITER | RWLOCK_READERS)) != 0;
 }
 
 bool rwlock_start_read(rwlock_t* rwlock) {
     if (!rwlock) return false;
-    if (pthread_mutex_lock(&rwlock->mutex) != 0)  // lock.acquire()
-        return false;
-
-    // Incremento il numero di lettori in attesa
-    rwlock->waiting_readers++;
 
-    // Potrebbe dover aspettare prima di continuare
-    while (read_should_wait(rwlock)) {
-        if (pthread_cond_wait(&rwlock->read_go, &rwlock->mutex) != 0)
-            return false;
+    unsigned int state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
+    while (true) {
+        // Potrebbe dover aspettare prima di continuare
+        if (read_should_wait(state)) {
+            if (!rwlock_park(rwlock, RWLOCK_WRITER | RWLOCK_WAITING_WRITERS)) return false;
+            state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
+            continue;
+        }
+        // Superato il controllo, il lettore diventa attivo
+        if (atomic_compare_exchange_weak_explicit(&rwlock->state, &state, state + RWLOCK_READER, memory_order_acquire, memory_order_relaxed))
+            return true;
     }
-
-    // Superato il controllo, il lettore passa da 'in attesa' a 'attivo
-    rwlock->waiting_readers--;
-    rwlock->active_readers++;
-
-    if (pthread_mutex_unlock(&rwlock->mutex) != 0)  // lock.release()
-        return false;
-
-    return true;
 }
 
 bool rwlock_done_read(rwlock_t* rwlock) {
     if (!rwlock) return false;
-    if (pthread_mutex_lock(&rwlock->mutex) != 0)  // lock.acquire()
-        return false;
 
     // Il lettore ha terminato, non è più attivo
-    rwlock->active_readers--;
-
-    // A questo punto, si possono verificare due scenari:
-    //  (a) non ci sono scrittori in attesa, quindi non faccio nulla in quanto
-    //      la presenza di un lettore attivo non toglie la possibilità ad altri lettori di lavorare, oppure
-    //  (b) c'è (almeno) uno scrittore in attesa e io sono l'ultimo lettore attivo,
-    //      quindi posso risvegliare uno degli scrittori in modo che possa procedere
-    if (rwlock->active_readers == 0 && rwlock->waiting_writers > 0) {
-        if (pthread_cond_signal(&rwlock->write_go) != 0)
-            return false;
-    }
-
-    if (pthread_mutex_unlock(&rwlock->mutex) != 0)  // lock.release()
-        return false;
-
+    // Se sono l'ultimo lettore attivo, uno scrittore in attesa potrebbe procedere: risveglio i threads fermi
+    unsigned int state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
+    unsigned int next;
+    do {
+        next = state - RWLOCK_READER;
+        if ((next & RWLOCK_READERS) == 0) next &= ~RWLOCK_PARKED;
+    } while (!atomic_compare_exchange_weak_explicit(&rwlock->state, &state, next, memory_order_release, memory_order_relaxed));
+
+    if ((state & RWLOCK_PARKED) && !(next & RWLOCK_PARKED)) return rwlock_wake(rwlock);
     return true;
 }
 
 bool rwlock_start_write(rwlock_t* rwlock) {
     if (!rwlock) return false;
-    if (pthread_mutex_lock(&rwlock->mutex) != 0)  // lock.acquire()
-        return false;
-
-    // Incremento il numero di scrittori in attesa
-    rwlock->waiting_writers++;
 
-    // Potrebbe dover aspettare prima di continuare
-    while (write_should_wait(rwlock)) {
-        if (pthread_cond_wait(&rwlock->write_go, &rwlock->mutex) != 0)
-            return false;
+    // Senza lettori né scrittori attivi, lo scrittore diventa subito attivo
+    unsigned int state = 0;
+    if (atomic_compare_exchange_strong_explicit(&rwlock->state, &state, RWLOCK_WRITER, memory_order_acquire, memory_order_relaxed))
+        return true;
+
+    // Incremento il numero di scrittori in attesa, così che nuovi lettori non lo superino
+    state = atomic_fetch_add_explicit(&rwlock->state, RWLOCK_WAITING_WRITER, memory_order_relaxed) + RWLOCK_WAITING_WRITER;
+    while (true) {
+        // Potrebbe dover aspettare prima di continuare
+        if (write_should_wait(state)) {
+            if (!rwlock_park(rwlock, RWLOCK_WRITER | RWLOCK_READERS)) return false;
+            state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
+            continue;
+        }
+        // Superato il controllo, lo scrittore passa da 'in attesa' a 'attivo'
+        unsigned int next = (state - RWLOCK_WAITING_WRITER) | RWLOCK_WRITER;
+        if (atomic_compare_exchange_weak_explicit(&rwlock->state, &state, next, memory_order_acquire, memory_order_relaxed))
+            return true;
     }
-
-    // Superato il controllo, lo scrittore passa da 'in attesa' a 'attivo
-    rwlock->waiting_writers--;
-    rwlock->active_writers++;
-
-    if (pthread_mutex_unlock(&rwlock->mutex) != 0)  // lock.release()
-        return false;
-
-    return true;
 }
 
 bool rwlock_done_write(rwlock_t* rwlock) {
     if (!rwlock) return false;
-    if (pthread_mutex_lock(&rwlock->mutex) != 0)  // lock.acquire()
-        return false;
 
     // Lo scrittore ha terminato, non è più attivo
-    rwlock->active_writers--;
-
-    // A questo punto, si possono verificare due scenari:
-    // (a) c'è (almeno) uno scrittore in attesa, quindi lo risveglio così che possa procedere
-    // (b) non c'è nessuno scrittore in attesa, quindi risveglio tutti i lettori in attesa
-    if (rwlock->waiting_writers == 0) {
-        if (pthread_cond_signal(&rwlock->write_go) != 0)
-            return false;
-    } else {
-        if (pthread_cond_broadcast(&rwlock->read_go) != 0)
-            return false;
-    }
-
-    if (pthread_mutex_unlock(&rwlock->mutex) != 0)  // lock.release()
-        return false;
+    unsigned int state = atomic_fetch_and_explicit(&rwlock->state, ~(RWLOCK_WRITER | RWLOCK_PARKED), memory_order_release);
 
+    // Risveglio i threads fermi: uno scrittore in attesa procede per primo, perché i lettori aspettano
+    //  finché ci sono scrittori in attesa; senza scrittori in attesa procedono tutti i lettori
+    if (state & RWLOCK_PARKED) return rwlock_wake(rwlock);
     return true;
 }
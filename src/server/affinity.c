@@ -0,0 +1,190 @@
+// @author Luca Cirillo (545480)
+
+// cpu_set_t, pthread_setaffinity_np e syscall non fanno parte di POSIX
+#define _GNU_SOURCE
+
+#include <affinity.h>
+#include <constants.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Percorso della lista di CPU di un nodo NUMA
+#define NODE_CPULIST_PATH "/sys/devices/system/node/node%ld/cpulist"
+
+// Aggiunge la CPU <cpu> all'insieme, ampliandolo se necessario
+static int append(cpu_list_t* list, size_t* capacity, int cpu) {
+    if (list->count == *capacity) {
+        size_t size = *capacity ? *capacity * 2 : 16;
+        int* cpus = (int*)realloc(list->cpus, sizeof(int) * size);
+        if (!cpus) return -1;
+        list->cpus = cpus;
+        *capacity = size;
+    }
+    list->cpus[list->count++] = cpu;
+    return 0;
+}
+
+// Legge un indice di CPU, spostando <cursor> dopo l'ultima cifra letta
+static int parse_cpu(const char** cursor, long* cpu) {
+    char* end;
+    errno = 0;
+    *cpu = strtol(*cursor, &end, 10);
+    if (end == *cursor || errno != 0 || *cpu < 0 || *cpu >= CPU_SETSIZE) return -1;
+    *cursor = end;
+    return 0;
+}
+
+cpu_list_t* affinity_parse(const char* list) {
+    // Controllo la validità degli argomenti
+    if (!list) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    cpu_list_t* cpus = (cpu_list_t*)calloc(1, sizeof(cpu_list_t));
+    if (!cpus) return NULL;
+    size_t capacity = 0;
+
+    // La lista è una sequenza di CPU singole o di intervalli, separati da virgole
+    const char* cursor = list;
+    while (*cursor && *cursor != '\n') {
+        long first, last;
+        if (parse_cpu(&cursor, &first) == -1) goto invalid;
+        last = first;
+        if (*cursor == '-') {
+            cursor++;
+            if (parse_cpu(&cursor, &last) == -1 || last < first) goto invalid;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (append(cpus, &capacity, (int)cpu) == -1) {
+                affinity_destroy(cpus);
+                return NULL;
+            }
+        }
+        if (*cursor == ',') cursor++;
+        else if (*cursor && *cursor != '\n') goto invalid;
+    }
+    if (cpus->count == 0) goto invalid;
+
+    return cpus;
+
+invalid:
+    affinity_destroy(cpus);
+    errno = EINVAL;
+    return NULL;
+}
+
+cpu_list_t* affinity_node_cpus(long node) {
+    // Controllo la validità degli argomenti
+    if (node < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    char path[BUFFER_SIZE];
+    snprintf(path, sizeof(path), NODE_CPULIST_PATH, node);
+    FILE* file = fopen(path, "r");
+    if (!file) return NULL;
+
+    char buffer[BUFFER_SIZE];
+    char* line = fgets(buffer, sizeof(buffer), file);
+    fclose(file);
+    // Un nodo senza CPU, ad esempio di sola memoria, ha una lista vuota
+    if (!line || buffer[0] == '\n') {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    return affinity_parse(buffer);
+}
+
+cpu_list_t* affinity_current(void) {
+    cpu_set_t set;
+    int error = pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        errno = error;
+        return NULL;
+    }
+
+    cpu_list_t* cpus = (cpu_list_t*)calloc(1, sizeof(cpu_list_t));
+    if (!cpus) return NULL;
+    size_t capacity = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set) && append(cpus, &capacity, cpu) == -1) {
+            affinity_destroy(cpus);
+            return NULL;
+        }
+    }
+    return cpus;
+}
+
+void affinity_destroy(cpu_list_t* list) {
+    if (!list) return;
+    free(list->cpus);
+    free(list);
+}
+
+bool affinity_contains(const cpu_list_t* list, int cpu) {
+    if (!list) return false;
+    for (size_t i = 0; i < list->count; i++)
+        if (list->cpus[i] == cpu) return true;
+    return false;
+}
+
+int affinity_pin_cpu(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // pthread_setaffinity_np ritorna il codice di errore invece di impostare errno
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int affinity_pin_list(const cpu_list_t* list) {
+    if (!list || list->count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < list->count; i++) CPU_SET(list->cpus[i], &set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int affinity_prefer_node(long node) {
+    // La maschera dei nodi è una bitmask di unsigned long
+    if (node < 0 || node >= (long)(sizeof(unsigned long) * 8)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Chiamo direttamente la system call, così da non dipendere da libnuma
+    unsigned long mask = 1UL << node;
+    return syscall(__NR_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1) == -1 ? -1 : 0;
+}
+
+int affinity_local_node(void) {
+    return syscall(__NR_set_mempolicy, MPOL_LOCAL, NULL, 0) == -1 ? -1 : 0;
+}
@@ -0,0 +1,600 @@
+// @author Luca Cirillo (545480)
+
+// I sigilli dei memfd (F_GET_SEALS) e MSG_CMSG_CLOEXEC non fanno parte di POSIX
+#define _GNU_SOURCE
+
+#include <connection.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <linux/fs.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils.h>
+
+// Numero massimo di descrittori gestiti, nel caso in cui il limite del processo non sia definito
+#define CONNECTION_TABLE_MAX_SIZE 1048576
+
+connection_table_t* connection_table_create(void) {
+    // Dimensiono la tabella sul limite di descrittori aperti del processo
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) return NULL;
+    size_t size = (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > CONNECTION_TABLE_MAX_SIZE)
+                      ? CONNECTION_TABLE_MAX_SIZE
+                      : (size_t)limit.rlim_cur;
+
+    // Alloco memoria per la tabella
+    connection_table_t* table = (connection_table_t*)malloc(sizeof(connection_table_t));
+    if (!table) return NULL;
+
+    // Inizialmente nessun descrittore è associato ad una connessione
+    if ((table->connections = (connection_t**)calloc(size, sizeof(connection_t*))) == NULL) {
+        free(table);
+        return NULL;
+    }
+    table->size = size;
+
+    return table;
+}
+
+void connection_table_destroy(connection_table_t* table) {
+    if (!table) return;
+    for (size_t fd = 0; fd < table->size; fd++) {
+        if (table->connections[fd]) connection_close(table, (int)fd);
+    }
+    free(table->connections);
+    free(table);
+}
+
+connection_t* connection_open(connection_table_t* table, int fd) {
+    // Controllo la validità degli argomenti
+    if (!table || fd < 0 || (size_t)fd >= table->size || table->connections[fd]) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Imposto il socket in modalità non bloccante
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) return NULL;
+
+    // Alloco ed inizializzo la connessione
+    connection_t* connection = (connection_t*)malloc(sizeof(connection_t));
+    if (!connection) return NULL;
+    connection->fd = fd;
+    connection->protocol = 0;
+    connection->shared_fd = -1;
+    connection->shared = NULL;
+    connection->shared_size = 0;
+    connection->body = NULL;
+    connection->input_empty = false;
+    connection->pending = NULL;
+    connection->output_head = NULL;
+    connection->output_tail = NULL;
+    connection_reset(connection);
+
+    table->connections[fd] = connection;
+    return connection;
+}
+
+connection_t* connection_get(connection_table_t* table, int fd) {
+    if (!table || fd < 0 || (size_t)fd >= table->size) return NULL;
+    return table->connections[fd];
+}
+
+void connection_close(connection_table_t* table, int fd) {
+    connection_t* connection = connection_get(table, fd);
+    if (connection) {
+        // Libero i segmenti della risposta non ancora inviati
+        segment_t* segment = connection->output_head;
+        while (segment) {
+            segment_t* next = segment->next;
+            if (segment->release) segment->release(segment->owner);
+            free(segment);
+            segment = next;
+        }
+        // Ed il contenuto di un file ricevuto solo in parte
+        if (connection->body && connection->body_owned) free(connection->body);
+        if (connection->pending) connection->pending_release(connection->pending);
+        // Rilascio la memoria condivisa con il client
+        if (connection->shared) munmap(connection->shared, connection->shared_size);
+        if (connection->shared_fd != -1) close(connection->shared_fd);
+        free(connection);
+        // ! Libero il posto nella tabella prima di chiudere il descrittore,
+        // !  che altrimenti potrebbe essere riassegnato ad un nuovo client
+        table->connections[fd] = NULL;
+    }
+    close(fd);
+}
+
+// Recupera da <message> il primo descrittore ricevuto tramite SCM_RIGHTS, se <passed_fd> non ne contiene già uno
+// Gli altri descrittori eventualmente ricevuti vengono chiusi
+static void take_fd(struct msghdr* message, int* passed_fd) {
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(message); cmsg; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (*passed_fd == -1)
+                *passed_fd = fd;
+            else
+                close(fd);
+        }
+    }
+}
+
+// Legge dal socket fino a completare <size> bytes a partire da <offset>, oppure finché ci sono dati disponibili
+// Se <passed_fd> non è NULL, vi memorizza l'eventuale descrittore inviato dal client insieme ai dati
+static int receive(int fd, char* buffer, size_t size, size_t* offset, int* passed_fd) {
+    while (*offset < size) {
+        ssize_t r;
+        if (passed_fd) {
+            struct iovec iov = {.iov_base = buffer + *offset, .iov_len = size - *offset};
+            union {
+                struct cmsghdr header;  // Garantisce l'allineamento del buffer
+                char buffer[CMSG_SPACE(sizeof(int))];
+            } control;
+            struct msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = control.buffer;
+            message.msg_controllen = sizeof(control.buffer);
+            if ((r = recvmsg(fd, &message, MSG_CMSG_CLOEXEC)) > 0) take_fd(&message, passed_fd);
+        } else {
+            r = read(fd, buffer + *offset, size - *offset);
+        }
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        if (r == 0) return -1;  // EOF
+        *offset += (size_t)r;
+    }
+    return 1;
+}
+
+// Controlla se il messaggio di richiesta ricevuto fin qui è completo, altrimenti aggiorna i bytes attesi
+// Ritorna 1 se completo, 0 se sono attesi altri bytes, -1 se il messaggio non è valido
+static int header_complete(connection_t* connection) {
+    // * Primo messaggio della connessione: ho ricevuto solamente la dimensione di un frame
+    if (connection->protocol == 0) {
+        if ((unsigned char)connection->header[0] == FRAME_HELLO) return 1;
+        // Un messaggio testuale, di cui ricevo il resto
+        connection->protocol = PROTOCOL_LEGACY;
+        // Solamente la negoziazione può trasferire la memoria condivisa
+        if (connection->shared_fd != -1) {
+            close(connection->shared_fd);
+            connection->shared_fd = -1;
+        }
+        connection->header_size = MESSAGE_LENGTH;
+        return 0;
+    }
+
+    // * Frame binario: dopo l'intestazione, ricevo il pathname
+    if (connection->protocol == PROTOCOL_BINARY && connection->header_size == sizeof(frame_t)) {
+        frame_t frame;
+        connection_frame(connection, &frame);
+        if (frame.path_length == 0) return 1;
+        // Il pathname deve entrare nel buffer del messaggio di richiesta
+        if (frame.path_length > MESSAGE_LENGTH - sizeof(frame_t)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        connection->header_size += frame.path_length;
+        return 0;
+    }
+
+    return 1;
+}
+
+int connection_receive(connection_t* connection) {
+    if (!connection) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (connection->state) {
+        case CONNECTION_HEADER:
+            while (1) {
+                // Il primo messaggio della connessione può portare con sé il descrittore della memoria condivisa
+                int r = receive(connection->fd, connection->header, connection->header_size, &connection->header_read,
+                                connection->protocol == 0 ? &connection->shared_fd : NULL);
+                if (r != 1) return r;
+                if ((r = header_complete(connection)) != 0) return r;
+            }
+        case CONNECTION_BODY:
+            if (connection->body) return receive(connection->fd, (char*)connection->body, connection->body_size, &connection->body_read, NULL);
+            // Il contenuto da scartare viene ricevuto a blocchi, senza allocarlo
+            while (connection->body_read < connection->body_size) {
+                char chunk[CONNECTION_CHUNK];
+                size_t received = 0;
+                size_t remaining = connection->body_size - connection->body_read;
+                int r = receive(connection->fd, chunk, remaining < CONNECTION_CHUNK ? remaining : CONNECTION_CHUNK, &received, NULL);
+                connection->body_read += received;
+                if (r != 1) return r;
+            }
+            return 1;
+        default:
+            // Durante l'invio della risposta non ricevo nuove richieste
+            return 0;
+    }
+}
+
+void connection_frame(connection_t* connection, frame_t* frame) {
+    // Il buffer del messaggio non è allineato ad un frame, quindi copio l'intestazione
+    memcpy(frame, connection->header, sizeof(frame_t));
+}
+
+int connection_expect_body(connection_t* connection, size_t size) {
+    if (!connection) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Alloco almeno un byte, così che anche un file vuoto abbia un contenuto valido
+    if ((connection->body = malloc(size > 0 ? size : 1)) == NULL) return -1;
+    connection->body_owned = true;
+    connection->body_size = size;
+    connection->body_read = 0;
+    connection->state = CONNECTION_BODY;
+    return 0;
+}
+
+int connection_expect_body_into(connection_t* connection, void* destination, size_t size, bool shared) {
+    if (!connection || (shared && (!connection->shared || size > connection->shared_size))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    connection->body = destination;
+    connection->body_owned = false;
+    connection->body_size = size;
+    connection->body_read = 0;
+    connection->state = CONNECTION_BODY;
+    // Il contenuto nella memoria condivisa è già disponibile per intero
+    if (shared) {
+        if (destination) memcpy(destination, connection->shared, size);
+        connection->body_read = size;
+    }
+    return 0;
+}
+
+int connection_expect_shared_body(connection_t* connection, size_t size) {
+    if (!connection || !connection->shared || size > connection->shared_size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Il client ha scritto il contenuto all'inizio della memoria condivisa, lo copio in un buffer del server
+    if (connection_expect_body(connection, size) == -1) return -1;
+    memcpy(connection->body, connection->shared, size);
+    connection->body_read = size;
+    return 0;
+}
+
+int connection_attach_shared(connection_t* connection, size_t size, size_t max_size) {
+    if (!connection) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Il descrittore viene comunque chiuso: se la mappatura va a buon fine, la memoria resta accessibile
+    int fd = connection->shared_fd;
+    connection->shared_fd = -1;
+    if (fd == -1 || connection->shared || size == 0 || size > max_size) {
+        if (fd != -1) close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // ! Il client non deve poter ridurre la dimensione della memoria, altrimenti un accesso oltre la fine
+    // !  terminerebbe il server con SIGBUS: accetto solamente memfd sigillati contro la riduzione
+    struct stat info;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals == -1 || !(seals & F_SEAL_SHRINK) || fstat(fd, &info) == -1 || (size_t)info.st_size < size) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+
+    void* shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) return -1;
+
+    connection->shared = (char*)shared;
+    connection->shared_size = size;
+    connection->shared_used = 0;
+    return 0;
+}
+
+void* connection_shared_reserve(connection_t* connection, size_t size) {
+    if (!connection || !connection->shared || size > connection->shared_size - connection->shared_used) return NULL;
+    void* region = connection->shared + connection->shared_used;
+    connection->shared_used += size;
+    return region;
+}
+
+void connection_reset(connection_t* connection) {
+    if (!connection) return;
+    // Il contenuto del file, se presente, è stato consegnato a chi ha servito la richiesta
+    // Il messaggio di richiesta è già stato eseguito, quindi il buffer può accogliere quello successivo
+    //  anche mentre la risposta è ancora in corso di invio
+    connection->state = connection->output_head ? CONNECTION_SEND : CONNECTION_HEADER;
+    memset(connection->header, 0, sizeof(connection->header));
+    // Finché il protocollo non è noto, attendo solamente la dimensione di un frame
+    connection->header_size = connection->protocol == PROTOCOL_LEGACY ? MESSAGE_LENGTH : sizeof(frame_t);
+    connection->header_read = 0;
+    connection->body = NULL;
+    connection->body_owned = false;
+    connection->body_size = 0;
+    connection->body_read = 0;
+    // Una richiesta scartata prima dell'esecuzione non ha consumato il proprio stato
+    if (connection->pending) connection->pending_release(connection->pending);
+    connection->pending = NULL;
+    // Il client ha letto i contenuti della risposta precedente prima di inviare questa richiesta
+    connection->shared_used = 0;
+}
+
+int connection_send_data(connection_t* connection, const void* data, size_t size, void (*release)(void*), void* owner) {
+    if (!connection || (!data && size > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    segment_t* segment = (segment_t*)malloc(sizeof(segment_t));
+    if (!segment) {
+        if (release) release(owner);
+        return -1;
+    }
+    segment->data = data;
+    segment->size = size;
+    segment->sent = 0;
+    segment->release = release;
+    segment->owner = owner;
+    segment->next = NULL;
+
+    // Accodo il segmento in fondo alla risposta
+    if (connection->output_tail)
+        connection->output_tail->next = segment;
+    else
+        connection->output_head = segment;
+    connection->output_tail = segment;
+
+    connection->state = CONNECTION_SEND;
+    return 0;
+}
+
+int connection_send_frame(connection_t* connection, const frame_t* frame, const char* path) {
+    if (!connection || !frame || (!path && frame->path_length > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Intestazione e pathname viaggiano nello stesso segmento
+    size_t size = sizeof(frame_t) + frame->path_length;
+    char* message = (char*)malloc(size);
+    if (!message) return -1;
+    memcpy(message, frame, sizeof(frame_t));
+    if (frame->path_length > 0) memcpy(message + sizeof(frame_t), path, frame->path_length);
+
+    return connection_send_data(connection, message, size, free, message);
+}
+
+int connection_send_message(connection_t* connection, const char* format, ...) {
+    if (!connection || !format) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // I messaggi hanno dimensione fissa, i bytes non utilizzati valgono 0
+    char* message = (char*)calloc(MESSAGE_LENGTH, sizeof(char));
+    if (!message) return -1;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, MESSAGE_LENGTH, format, args);
+    va_end(args);
+
+    return connection_send_data(connection, message, MESSAGE_LENGTH, free, message);
+}
+
+// Raccoglie in <iov> al più CONNECTION_IOV_MAX segmenti della risposta, a partire dal primo non ancora inviato
+// Ritorna il numero di segmenti raccolti, la loro dimensione totale in <total>
+//  e, in <more>, se restano altri segmenti oltre quelli raccolti
+static int gather(connection_t* connection, struct iovec* iov, size_t* total, bool* more) {
+    int count = 0;
+    segment_t* segment = connection->output_head;
+    *total = 0;
+    for (; segment && count < CONNECTION_IOV_MAX; segment = segment->next) {
+        if (segment->size == segment->sent) continue;
+        iov[count].iov_base = (char*)segment->data + segment->sent;
+        iov[count].iov_len = segment->size - segment->sent;
+        *total += iov[count].iov_len;
+        count++;
+    }
+    *more = segment != NULL;
+    return count;
+}
+
+// Avanza la risposta di <sent> bytes, liberando i segmenti inviati per intero
+static void advance(connection_t* connection, size_t sent) {
+    while (connection->output_head) {
+        segment_t* segment = connection->output_head;
+        size_t left = segment->size - segment->sent;
+        if (sent < left) {
+            segment->sent += sent;
+            return;
+        }
+        sent -= left;
+        connection->output_head = segment->next;
+        if (!connection->output_head) connection->output_tail = NULL;
+        if (segment->release) segment->release(segment->owner);
+        free(segment);
+    }
+}
+
+int connection_flush(connection_t* connection) {
+    if (!connection) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct iovec iov[CONNECTION_IOV_MAX];
+    struct msghdr message;
+
+    while (connection->output_head) {
+        // * Invio con un'unica system call intestazioni e contenuti di più file
+        size_t total;
+        bool more;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = gather(connection, iov, &total, &more);
+
+        // Se restano altri segmenti, con MSG_MORE il kernel può accorparli a questi nello stesso invio
+        ssize_t w = sendmsg(connection->fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        advance(connection, (size_t)w);
+
+        // Invio parziale: il socket non accetta altri dati, evito una system call destinata a fallire
+        if ((size_t)w < total) return 0;
+    }
+
+    connection->state = CONNECTION_HEADER;
+    return 1;
+}
+
+// Dopo un errore di <ring>, attende i completamenti delle <outstanding> richieste già prese in carico dal kernel,
+//  e ritira quelle non ancora consumate: nessuna può più leggere il messaggio sullo stack di chi le ha preparate,
+//  ed i loro completamenti non vengono scambiati per quelli della prossima connessione servita sulla stessa istanza
+// Le richieste sono non bloccanti (MSG_DONTWAIT, RWF_NOWAIT), quindi i completamenti arrivano in breve tempo
+static void uring_drain(uring_t* ring, unsigned outstanding) {
+    outstanding -= MIN(outstanding, uring_withdraw(ring));
+    struct io_uring_cqe cqe;
+    while (outstanding > 0) {
+        if (uring_pop_cqe(ring, &cqe) == 0)
+            outstanding--;
+        else
+            uring_submit_and_wait(ring, outstanding);
+    }
+}
+
+int connection_flush_uring(connection_t* connection, uring_t* ring, char* staging) {
+    if (!connection || !ring || !staging) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct iovec iov[CONNECTION_IOV_MAX];
+    struct msghdr message;
+    // Ricevo in anticipo il messaggio di richiesta successivo solamente una volta per chiamata
+    bool prefetch = connection->header_read < connection->header_size;
+    connection->input_empty = false;
+
+    while (connection->output_head) {
+        // * Raccolgo i segmenti da inviare in un'unica richiesta SENDMSG
+        size_t total;
+        bool more;
+        int count = gather(connection, iov, &total, &more);
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+
+        unsigned requests = 0;
+        if (count > 0) {
+            // Con la submission queue piena, invio con una normale sendmsg
+            struct io_uring_sqe* sqe = uring_get_sqe(ring);
+            if (!sqe) return connection_flush(connection);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = connection->fd;
+            sqe->addr = (unsigned long)&message;
+            sqe->len = 1;
+            sqe->msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL | (more ? MSG_MORE : 0);  // Il worker non deve mai bloccarsi
+            sqe->user_data = 1;
+            requests++;
+        }
+
+        // * Nella stessa system call leggo, dal buffer registrato, l'eventuale richiesta successiva
+        // La lettura anticipata è facoltativa: senza una richiesta libera, la richiesta successiva arriva con connection_receive
+        struct io_uring_sqe* sqe = prefetch ? uring_get_sqe(ring) : NULL;
+        if (sqe) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->fd = connection->fd;
+            sqe->addr = (unsigned long)staging;
+            sqe->len = connection->header_size - connection->header_read;
+            sqe->off = (unsigned long long)-1;  // I socket non hanno una posizione
+            sqe->buf_index = 0;
+            sqe->rw_flags = RWF_NOWAIT;  // Se non ci sono dati, la lettura fallisce con EAGAIN
+            sqe->user_data = 2;
+            requests++;
+        }
+        prefetch = false;
+
+        if (uring_submit_and_wait(ring, requests) == -1) {
+            int error = errno;
+            uring_drain(ring, requests);
+            errno = error;
+            return -1;
+        }
+
+        // * Elaboro i completamenti
+        int error = 0;
+        bool blocked = false;
+        struct io_uring_cqe cqe;
+        for (unsigned completed = 0; completed < requests;) {
+            if (uring_pop_cqe(ring, &cqe) == -1) {
+                // Completamenti non ancora disponibili, ad esempio per un segnale durante l'attesa
+                if (uring_submit_and_wait(ring, requests - completed) == -1) {
+                    int error = errno;
+                    uring_drain(ring, requests - completed);
+                    errno = error;
+                    return -1;
+                }
+                continue;
+            }
+            completed++;
+
+            if (cqe.user_data == 1) {
+                if (cqe.res >= 0) {
+                    advance(connection, (size_t)cqe.res);
+                    if ((size_t)cqe.res < total) blocked = true;
+                } else if (cqe.res == -EAGAIN || cqe.res == -EWOULDBLOCK) {
+                    blocked = true;
+                } else if (cqe.res != -EINTR) {
+                    error = -cqe.res;
+                }
+            } else if (cqe.res > 0) {
+                // Il messaggio di richiesta ricevuto in anticipo è completato da connection_receive
+                memcpy(connection->header + connection->header_read, staging, (size_t)cqe.res);
+                connection->header_read += (size_t)cqe.res;
+            } else if (cqe.res == -EAGAIN || cqe.res == -EWOULDBLOCK) {
+                // Il client attende la risposta prima di inviare la richiesta successiva: chi serve la connessione
+                //  può attendere nuovi dati senza un'altra lettura destinata a fallire
+                connection->input_empty = true;
+            }
+            // Un errore o EOF in lettura viene rilevato dalla successiva connection_receive
+        }
+
+        if (error) {
+            errno = error;
+            return -1;
+        }
+        // Il socket non accetta altri dati
+        if (blocked) return 0;
+    }
+
+    connection->state = CONNECTION_HEADER;
+    return 1;
+}
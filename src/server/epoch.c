@@ -0,0 +1,199 @@
+// @author Luca Cirillo (545480)
+
+#include <epoch.h>
+#include <errno.h>
+#include <pthread.h>
+#include <queue.h>  // CACHE_LINE_SIZE
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils.h>
+
+// Stato di un partecipante fuori da ogni sezione critica
+#define QUIESCENT 0
+
+// * Partecipante al dominio, uno per thread; il record di un thread terminato viene riutilizzato
+// <state> è scritto solamente dal proprio thread e letto da chi tenta di far avanzare l'epoca
+typedef struct EpochRecord {
+    atomic_size_t state;       // QUIESCENT, oppure (epoca osservata << 1) | 1 durante una sezione critica
+    atomic_bool used;          // Il record appartiene ad un thread
+    size_t depth;              // Livello di annidamento delle sezioni critiche
+    struct EpochRecord* next;  // Record successivo, immutabile dopo l'inserimento
+} epoch_record_t;
+
+// Ogni record occupa un numero intero di linee di cache, così che i threads non si contendano la stessa linea
+#define EPOCH_RECORD_SIZE (((sizeof(epoch_record_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE)
+
+// * Oggetto ritirato, in attesa del periodo di grazia
+typedef struct EpochRetired {
+    void* object;               // Oggetto da cancellare
+    void (*destroy)(void*);     // Funzione di cancellazione
+    size_t epoch;               // Epoca globale al momento del ritiro
+    struct EpochRetired* next;  // Oggetto ritirato in precedenza
+} epoch_retired_t;
+
+struct Epoch {
+    atomic_size_t global;              // Epoca globale
+    _Atomic(epoch_record_t*) records;  // Partecipanti, in una lista a cui si aggiunge solamente in testa
+    pthread_key_t key;                 // Record del thread chiamante
+    pthread_mutex_t limbo_lock;        // Protegge la lista degli oggetti ritirati
+    epoch_retired_t* limbo;            // Oggetti ritirati, dal più recente: le epoche sono quindi non crescenti
+};
+
+// Alla terminazione di un thread, il suo record torna disponibile
+static void epoch_thread_exit(void* data) {
+    epoch_record_t* record = (epoch_record_t*)data;
+    record->depth = 0;
+    atomic_store(&record->state, QUIESCENT);
+    atomic_store(&record->used, false);
+}
+
+// Ritorna il record del thread chiamante, registrandolo nel dominio al primo utilizzo
+static epoch_record_t* epoch_record(epoch_t* epoch) {
+    epoch_record_t* record = (epoch_record_t*)pthread_getspecific(epoch->key);
+    if (record) return record;
+
+    // Riutilizzo il record di un thread terminato, se presente
+    for (record = atomic_load(&epoch->records); record; record = record->next) {
+        bool expected = false;
+        if (!atomic_load_explicit(&record->used, memory_order_relaxed) && atomic_compare_exchange_strong(&record->used, &expected, true)) break;
+    }
+
+    // Altrimenti ne aggiungo uno nuovo in testa alla lista
+    if (!record) {
+        void* memory = NULL;
+        int error = posix_memalign(&memory, CACHE_LINE_SIZE, EPOCH_RECORD_SIZE);
+        if (error != 0) {
+            errno = error;
+            return NULL;
+        }
+        record = (epoch_record_t*)memory;
+        memset(record, 0, EPOCH_RECORD_SIZE);
+        atomic_init(&record->state, QUIESCENT);
+        atomic_init(&record->used, true);
+        record->next = atomic_load(&epoch->records);
+        while (!atomic_compare_exchange_weak(&epoch->records, &record->next, record))
+            ;
+    }
+
+    int error = pthread_setspecific(epoch->key, record);
+    if (error != 0) {
+        atomic_store(&record->used, false);
+        errno = error;
+        return NULL;
+    }
+    return record;
+}
+
+// Fa avanzare l'epoca globale se tutti i partecipanti in una sezione critica l'hanno osservata
+// Ritorna l'epoca globale corrente
+static size_t epoch_try_advance(epoch_t* epoch) {
+    size_t global = atomic_load(&epoch->global);
+    for (epoch_record_t* record = atomic_load(&epoch->records); record; record = record->next) {
+        size_t state = atomic_load(&record->state);
+        if (state != QUIESCENT && (state >> 1) != global) return global;
+    }
+    // Se un altro thread l'ha già fatta avanzare, <global> riceve l'epoca corrente
+    if (atomic_compare_exchange_strong(&epoch->global, &global, global + 1)) global++;
+    return global;
+}
+
+// Cancella gli oggetti della lista <retired>
+static void epoch_destroy_list(epoch_retired_t* retired) {
+    while (retired) {
+        epoch_retired_t* next = retired->next;
+        retired->destroy(retired->object);
+        free(retired);
+        retired = next;
+    }
+}
+
+epoch_t* epoch_create(void) {
+    epoch_t* epoch = (epoch_t*)malloc(sizeof(epoch_t));
+    if (!epoch) return NULL;
+
+    int error = pthread_key_create(&epoch->key, epoch_thread_exit);
+    if (error != 0) {
+        free(epoch);
+        errno = error;
+        return NULL;
+    }
+    if ((error = pthread_mutex_init(&epoch->limbo_lock, NULL)) != 0) {
+        pthread_key_delete(epoch->key);
+        free(epoch);
+        errno = error;
+        return NULL;
+    }
+
+    atomic_init(&epoch->global, 0);
+    atomic_init(&epoch->records, NULL);
+    epoch->limbo = NULL;
+    return epoch;
+}
+
+void epoch_destroy(epoch_t* epoch) {
+    if (!epoch) return;
+
+    // Da qui in poi, la terminazione di un thread non tocca più i records
+    pthread_key_delete(epoch->key);
+    epoch_record_t* record = atomic_load(&epoch->records);
+    while (record) {
+        epoch_record_t* next = record->next;
+        free(record);
+        record = next;
+    }
+
+    // Nessun thread è più in una sezione critica: tutti gli oggetti ritirati possono essere cancellati
+    epoch_destroy_list(epoch->limbo);
+    pthread_mutex_destroy(&epoch->limbo_lock);
+    free(epoch);
+}
+
+int epoch_enter(epoch_t* epoch) {
+    // Senza un record, il thread non sarebbe visibile a chi cancella gli oggetti ritirati: non può entrare
+    epoch_record_t* record = epoch_record(epoch);
+    if (!record) return -1;
+    if (record->depth++ > 0) return 0;
+
+    // Annuncio l'epoca osservata; l'annuncio deve precedere qualsiasi lettura della struttura condivisa
+    atomic_store(&record->state, (atomic_load(&epoch->global) << 1) | 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    return 0;
+}
+
+void epoch_exit(epoch_t* epoch) {
+    epoch_record_t* record = (epoch_record_t*)pthread_getspecific(epoch->key);
+    if (!record || record->depth == 0) return;
+    if (--record->depth == 0) atomic_store_explicit(&record->state, QUIESCENT, memory_order_release);
+}
+
+void epoch_retire(epoch_t* epoch, void* object, void (*destroy)(void*)) {
+    if (!epoch || !object || !destroy) return;
+
+    // Senza memoria per rimandarne la cancellazione l'oggetto non viene mai liberato:
+    //  attendere il periodo di grazia all'interno di una sezione critica non terminerebbe mai
+    epoch_retired_t* retired = (epoch_retired_t*)malloc(sizeof(epoch_retired_t));
+    if (!retired) return;
+    retired->object = object;
+    retired->destroy = destroy;
+
+    LOCK(&epoch->limbo_lock);
+    retired->epoch = atomic_load(&epoch->global);
+    retired->next = epoch->limbo;
+    epoch->limbo = retired;
+
+    // Un oggetto ritirato nell'epoca <e> non è più visibile ad alcun lettore dall'epoca <e + 2>
+    // La lista è ordinata per epoca, quindi gli oggetti scaduti sono tutti in fondo
+    size_t global = epoch_try_advance(epoch);
+    epoch_retired_t* expired = NULL;
+    epoch_retired_t** cursor = &epoch->limbo;
+    while (*cursor && (*cursor)->epoch + 2 > global) cursor = &(*cursor)->next;
+    expired = *cursor;
+    *cursor = NULL;
+    UNLOCK(&epoch->limbo_lock);
+
+    // Cancello gli oggetti scaduti fuori dalla sezione protetta
+    epoch_destroy_list(expired);
+}
@@ -0,0 +1,332 @@
+// @author Luca Cirillo (545480)
+
+#include <errno.h>
+#include <hashtable.h>
+#include <queue.h>  // CACHE_LINE_SIZE
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Slots per gruppo, confrontati insieme
+#define GROUP_SIZE 16
+// Bytes di controllo: gli slots occupati contengono i 7 bits bassi dell'hash, quindi hanno il bit alto a 0
+#define CTRL_EMPTY 0x80    // Slot mai utilizzato: una ricerca che lo incontra può fermarsi
+#define CTRL_DELETED 0xFE  // Slot rimosso (tombstone): una ricerca deve proseguire
+// Parola di controllo di un gruppo ancora vuoto
+#define CTRL_EMPTY_WORD 0x8080808080808080ull
+// Slots occupati, compresi quelli rimossi, oltre i quali la tabella viene ridimensionata: 7/8 degli slots
+#define MAX_LOAD(slots) ((slots) - (slots) / 8)
+// Gruppi della tabella precedente spostati ad ogni inserimento, durante un ridimensionamento
+#define MIGRATE_GROUPS 4
+
+// * Elemento della tabella, scritto una sola volta prima di pubblicarne il byte di controllo
+typedef struct HashtableSlot {
+    uint64_t hash;    // Hash completo della chiave, confrontato prima della chiave stessa
+    const char* key;  // Chiave, non copiata
+    void* value;      // Valore
+} hashtable_slot_t;
+
+// * Tabella di una certa dimensione; più tabelle coesistono durante un ridimensionamento
+typedef struct HashtableArray {
+    size_t mask;                                // Numero di gruppi - 1, potenza di 2
+    size_t live;                                // Elementi presenti
+    size_t used;                                // Slots occupati da elementi e tombstones
+    size_t migrated;                            // Gruppi già spostati nella tabella successiva
+    _Atomic(struct HashtableArray*) previous;   // Tabella i cui elementi vengono spostati in questa, NULL se nessuna
+    _Atomic(uint64_t)* ctrl;                    // Bytes di controllo, 8 per parola: il byte i è (parola >> 8 * i) & 0xFF
+    hashtable_slot_t* slots;                    // Elementi
+} hashtable_array_t;
+
+struct Hashtable {
+    _Atomic(hashtable_array_t*) current;  // Tabella in cui vengono inseriti gli elementi
+    epoch_t* epoch;                       // Dominio che cancella le tabelle sostituite
+};
+
+// ! Hash
+
+// Moltiplica e ripiega i bits alti su quelli bassi, così che ogni byte influenzi tutto il risultato
+static uint64_t hashtable_mix(uint64_t value) {
+    value *= 0x9E3779B97F4A7C15ull;
+    return value ^ (value >> 29);
+}
+
+uint64_t hashtable_hash(const char* key) {
+    size_t length = strlen(key);
+    uint64_t hash = length * 0xC2B2AE3D27D4EB4Full;
+    uint64_t word;
+    for (; length >= sizeof(word); key += sizeof(word), length -= sizeof(word)) {
+        memcpy(&word, key, sizeof(word));
+        hash = hashtable_mix(hash ^ word);
+    }
+    word = 0;
+    memcpy(&word, key, length);
+    hash = hashtable_mix(hash ^ word);
+    // Finalizzatore di MurmurHash3: i bits alti, da cui dipende la partizione, ed i bassi, da cui dipendono gruppo e tag
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    return hash ^ (hash >> 33);
+}
+
+// Tag dell'hash <hash>, memorizzato nel byte di controllo
+#define HASH_TAG(hash) ((uint8_t)((hash) & 0x7F))
+// Primo gruppo in cui cercare l'hash <hash>
+#define HASH_GROUP(array, hash) (((hash) >> 7) & (array)->mask)
+
+// ! Gruppi
+
+// Maschera degli slots del gruppo <ctrl> il cui byte di controllo vale <byte>: il bit i corrisponde allo slot i
+static unsigned int group_match(const uint64_t ctrl[2], uint8_t byte) {
+#ifdef __SSE2__
+    __m128i group = _mm_set_epi64x((long long)ctrl[1], (long long)ctrl[0]);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < GROUP_SIZE; i++)
+        if ((uint8_t)(ctrl[i / 8] >> (8 * (i % 8))) == byte) mask |= 1u << i;
+    return mask;
+#endif
+}
+
+// Indice del primo slot della maschera <mask>, non vuota
+static int group_first(unsigned int mask) {
+    return __builtin_ctz(mask);
+}
+
+// Legge i bytes di controllo del gruppo <group>; gli slots pubblicati sono visibili dopo la lettura
+static void group_load(hashtable_array_t* array, size_t group, uint64_t ctrl[2]) {
+    ctrl[0] = atomic_load_explicit(&array->ctrl[2 * group], memory_order_acquire);
+    ctrl[1] = atomic_load_explicit(&array->ctrl[2 * group + 1], memory_order_acquire);
+}
+
+// Imposta a <byte> il byte di controllo dello slot <index>, pubblicando quanto scritto prima; solo per chi modifica la tabella
+static void ctrl_store(hashtable_array_t* array, size_t index, uint8_t byte) {
+    _Atomic(uint64_t)* word = &array->ctrl[index / 8];
+    unsigned int shift = 8 * (index % 8);
+    uint64_t value = atomic_load_explicit(word, memory_order_relaxed);
+    value = (value & ~((uint64_t)0xFF << shift)) | ((uint64_t)byte << shift);
+    atomic_store_explicit(word, value, memory_order_release);
+}
+
+// ! Tabelle
+
+// Crea una tabella vuota di <groups> gruppi, potenza di 2, allocata in un solo blocco
+static hashtable_array_t* array_create(size_t groups) {
+    size_t header = (sizeof(hashtable_array_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    size_t ctrl = groups * GROUP_SIZE;
+    void* memory = NULL;
+    if (posix_memalign(&memory, CACHE_LINE_SIZE, header + ctrl + groups * GROUP_SIZE * sizeof(hashtable_slot_t)) != 0) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    hashtable_array_t* array = (hashtable_array_t*)memory;
+    array->mask = groups - 1;
+    array->live = 0;
+    array->used = 0;
+    array->migrated = 0;
+    atomic_init(&array->previous, NULL);
+    array->ctrl = (_Atomic(uint64_t)*)((char*)memory + header);
+    array->slots = (hashtable_slot_t*)((char*)memory + header + ctrl);
+    for (size_t i = 0; i < 2 * groups; i++) atomic_init(&array->ctrl[i], CTRL_EMPTY_WORD);
+    return array;
+}
+
+// Numero minimo di gruppi, potenza di 2, per contenere <capacity> elementi
+static size_t array_groups(size_t capacity) {
+    size_t groups = 1;
+    while (MAX_LOAD(groups * GROUP_SIZE) < capacity) groups *= 2;
+    return groups;
+}
+
+// Cerca la chiave <key>, di hash <hash>, e ritorna l'indice del suo slot, oppure -1
+static long array_find(hashtable_array_t* array, const char* key, uint64_t hash) {
+    uint8_t tag = HASH_TAG(hash);
+    size_t group = HASH_GROUP(array, hash);
+    // Sondaggio triangolare: con un numero di gruppi potenza di 2, visita ogni gruppo una volta
+    for (size_t step = 0; step <= array->mask; group = (group + ++step) & array->mask) {
+        uint64_t ctrl[2];
+        group_load(array, group, ctrl);
+        for (unsigned int match = group_match(ctrl, tag); match; match &= match - 1) {
+            size_t index = group * GROUP_SIZE + group_first(match);
+            hashtable_slot_t* slot = &array->slots[index];
+            if (slot->hash == hash && strcmp(slot->key, key) == 0) return (long)index;
+        }
+        // Un gruppo con uno slot mai utilizzato chiude la sequenza di sondaggio
+        if (group_match(ctrl, CTRL_EMPTY)) return -1;
+    }
+    return -1;
+}
+
+// Inserisce un elemento nel primo slot mai utilizzato della sua sequenza di sondaggio; la tabella non deve essere piena
+static void array_put(hashtable_array_t* array, const char* key, uint64_t hash, void* value) {
+    size_t group = HASH_GROUP(array, hash);
+    for (size_t step = 0;; group = (group + ++step) & array->mask) {
+        uint64_t ctrl[2];
+        group_load(array, group, ctrl);
+        unsigned int empty = group_match(ctrl, CTRL_EMPTY);
+        if (!empty) continue;
+        // Scrivo lo slot, quindi lo pubblico: chi ne legge il byte di controllo vede lo slot completo
+        size_t index = group * GROUP_SIZE + group_first(empty);
+        array->slots[index].hash = hash;
+        array->slots[index].key = key;
+        array->slots[index].value = value;
+        ctrl_store(array, index, HASH_TAG(hash));
+        array->live++;
+        array->used++;
+        return;
+    }
+}
+
+// Visita gli elementi della tabella <array> finché <visit> non ritorna false; ritorna false se interrotta
+static bool array_foreach(hashtable_array_t* array, bool (*visit)(void* value, void* arg), void* arg) {
+    for (size_t group = 0; group <= array->mask; group++) {
+        uint64_t ctrl[2];
+        group_load(array, group, ctrl);
+        for (int i = 0; i < GROUP_SIZE; i++) {
+            if ((uint8_t)(ctrl[i / 8] >> (8 * (i % 8))) & 0x80) continue;
+            if (!visit(array->slots[group * GROUP_SIZE + i].value, arg)) return false;
+        }
+    }
+    return true;
+}
+
+// Sposta fino a <groups> gruppi della tabella precedente di <current> in <current>
+// Ogni elemento viene prima copiato e poi rimosso: chi cerca nella precedente e poi nell'attuale lo trova sempre
+static void hashtable_migrate(hashtable_t* table, hashtable_array_t* current, size_t groups) {
+    hashtable_array_t* previous = atomic_load_explicit(&current->previous, memory_order_relaxed);
+    if (!previous) return;
+
+    for (; groups > 0 && previous->migrated <= previous->mask; groups--, previous->migrated++) {
+        size_t group = previous->migrated;
+        uint64_t ctrl[2];
+        group_load(previous, group, ctrl);
+        for (int i = 0; i < GROUP_SIZE; i++) {
+            if ((uint8_t)(ctrl[i / 8] >> (8 * (i % 8))) & 0x80) continue;
+            size_t index = group * GROUP_SIZE + i;
+            hashtable_slot_t* slot = &previous->slots[index];
+            array_put(current, slot->key, slot->hash, slot->value);
+            ctrl_store(previous, index, CTRL_DELETED);
+            previous->live--;
+        }
+    }
+
+    // Spostati tutti i gruppi, le ricerche non hanno più bisogno della tabella precedente
+    if (previous->migrated > previous->mask) {
+        atomic_store_explicit(&current->previous, NULL, memory_order_release);
+        epoch_retire(table->epoch, previous, free);
+    }
+}
+
+// ! APIs
+
+hashtable_t* hashtable_create(size_t capacity, epoch_t* epoch) {
+    if (!epoch) {
+        errno = EINVAL;
+        return NULL;
+    }
+    hashtable_t* table = malloc(sizeof(hashtable_t));
+    if (!table) return NULL;
+    hashtable_array_t* array = array_create(array_groups(capacity));
+    if (!array) {
+        free(table);
+        return NULL;
+    }
+    atomic_init(&table->current, array);
+    table->epoch = epoch;
+    return table;
+}
+
+void hashtable_destroy(hashtable_t* table, void (*destroy)(void*)) {
+    if (!table) return;
+    hashtable_array_t* current = atomic_load(&table->current);
+    hashtable_array_t* arrays[2] = {atomic_load(&current->previous), current};
+    for (int i = 0; i < 2; i++) {
+        if (!arrays[i]) continue;
+        for (size_t index = 0; destroy && index < (arrays[i]->mask + 1) * GROUP_SIZE; index++) {
+            uint8_t byte = (uint8_t)(atomic_load_explicit(&arrays[i]->ctrl[index / 8], memory_order_relaxed) >> (8 * (index % 8)));
+            if (!(byte & 0x80)) destroy(arrays[i]->slots[index].value);
+        }
+        free(arrays[i]);
+    }
+    free(table);
+}
+
+void* hashtable_find(hashtable_t* table, const char* key, uint64_t hash) {
+    if (!table || !key) return NULL;
+
+    while (true) {
+        // Durante un ridimensionamento cerco prima nella tabella precedente, da cui gli elementi vengono spostati
+        hashtable_array_t* current = atomic_load_explicit(&table->current, memory_order_acquire);
+        hashtable_array_t* previous = atomic_load_explicit(&current->previous, memory_order_acquire);
+        long index;
+        if (previous && (index = array_find(previous, key, hash)) != -1) return previous->slots[index].value;
+        if ((index = array_find(current, key, hash)) != -1) return current->slots[index].value;
+        // Se nel frattempo è iniziato un ridimensionamento, l'elemento potrebbe essere stato spostato: ripeto la ricerca
+        if (atomic_load_explicit(&table->current, memory_order_acquire) == current) return NULL;
+    }
+}
+
+int hashtable_insert(hashtable_t* table, const char* key, uint64_t hash, void* value) {
+    if (!table || !key) {
+        errno = EINVAL;
+        return -1;
+    }
+    hashtable_array_t* current = atomic_load_explicit(&table->current, memory_order_relaxed);
+    hashtable_array_t* previous = atomic_load_explicit(&current->previous, memory_order_relaxed);
+    if ((previous && array_find(previous, key, hash) != -1) || array_find(current, key, hash) != -1) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    // Proseguo lo spostamento in corso
+    hashtable_migrate(table, current, MIGRATE_GROUPS);
+
+    if (current->used + 1 > MAX_LOAD((current->mask + 1) * GROUP_SIZE)) {
+        // Per sicurezza completo lo spostamento in corso, quindi avvio il successivo
+        hashtable_migrate(table, current, SIZE_MAX);
+        // La nuova tabella ha spazio per il doppio degli elementi presenti e per gli inserimenti che avverranno
+        //  durante lo spostamento: una tabella piena di tombstones viene ricostruita senza crescere
+        size_t groups = current->mask + 1;
+        hashtable_array_t* next = array_create(array_groups(2 * (current->live + 1) + groups / MIGRATE_GROUPS + 1));
+        if (!next) return -1;
+        atomic_store_explicit(&next->previous, current, memory_order_relaxed);
+        atomic_store_explicit(&table->current, next, memory_order_release);
+        current = next;
+        hashtable_migrate(table, current, MIGRATE_GROUPS);
+    }
+
+    array_put(current, key, hash, value);
+    return 0;
+}
+
+void* hashtable_remove(hashtable_t* table, const char* key, uint64_t hash) {
+    if (!table || !key) return NULL;
+
+    hashtable_array_t* current = atomic_load_explicit(&table->current, memory_order_relaxed);
+    hashtable_array_t* arrays[2] = {atomic_load_explicit(&current->previous, memory_order_relaxed), current};
+    for (int i = 0; i < 2; i++) {
+        hashtable_array_t* array = arrays[i];
+        long index = array ? array_find(array, key, hash) : -1;
+        if (index == -1) continue;
+        // Lo slot non viene più riutilizzato, quindi chi lo sta leggendo vede ancora l'elemento completo
+        void* value = array->slots[index].value;
+        ctrl_store(array, (size_t)index, CTRL_DELETED);
+        array->live--;
+        return value;
+    }
+    return NULL;
+}
+
+void hashtable_foreach(hashtable_t* table, bool (*visit)(void* value, void* arg), void* arg) {
+    if (!table || !visit) return;
+
+    hashtable_array_t* current = atomic_load_explicit(&table->current, memory_order_acquire);
+    hashtable_array_t* previous = atomic_load_explicit(&current->previous, memory_order_acquire);
+    if (previous && !array_foreach(previous, visit, arg)) return;
+    array_foreach(current, visit, arg);
+}
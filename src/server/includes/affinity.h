@@ -0,0 +1,48 @@
+// @author Luca Cirillo (545480)
+
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// * Insieme di CPU, nell'ordine in cui sono elencate
+// I threads worker vengono distribuiti sulle CPU dell'insieme, uno per CPU a rotazione
+typedef struct CpuList {
+    int* cpus;     // Indici delle CPU
+    size_t count;  // Numero di CPU
+} cpu_list_t;
+
+// * Crea un insieme di CPU a partire da una lista nel formato di taskset e sysfs (es. "0-7,12,14-15")
+// Ritorna NULL, con errno a EINVAL, se la lista non è valida
+cpu_list_t* affinity_parse(const char* list);
+
+// * Crea l'insieme delle CPU del nodo NUMA <node>, leggendolo da sysfs
+// Ritorna NULL, con errno a ENOENT, se il nodo non esiste
+cpu_list_t* affinity_node_cpus(long node);
+
+// * Crea l'insieme delle CPU su cui il thread chiamante può attualmente eseguire
+cpu_list_t* affinity_current(void);
+
+// * Cancella un insieme creato con affinity_parse, affinity_node_cpus o affinity_current
+void affinity_destroy(cpu_list_t* list);
+
+// * Ritorna true se la CPU <cpu> appartiene all'insieme <list>
+bool affinity_contains(const cpu_list_t* list, int cpu);
+
+// * Vincola il thread chiamante ad eseguire solamente sulla CPU <cpu>
+int affinity_pin_cpu(int cpu);
+
+// * Vincola il thread chiamante ad eseguire solamente sulle CPU dell'insieme <list>
+int affinity_pin_list(const cpu_list_t* list);
+
+// * Imposta il nodo NUMA <node> come preferito per le allocazioni del thread chiamante,
+// *  e dei threads che crea successivamente, finché il nodo ha memoria libera
+// Senza un nodo preferito, le pagine vengono assegnate al nodo del thread che le scrive per primo
+int affinity_prefer_node(long node);
+
+// * Ripristina per il thread chiamante l'allocazione sul nodo della CPU su cui esegue (MPOL_LOCAL),
+// *  sostituendo il nodo preferito ereditato da affinity_prefer_node
+int affinity_local_node(void);
+
+#endif
@@ -6,18 +6,49 @@
 #include <constants.h>  // replacement_policy_t
 #include <stddef.h>     // size_t
 
+// Backend per l'invio delle risposte ai client
+typedef enum IOBackend {
+    IO_EPOLL,  // write non bloccanti, riprese su EPOLLOUT
+    IO_URING   // io_uring, se supportato dal kernel, altrimenti IO_EPOLL
+} io_backend_t;
+
 // Percorso del file di configurazione specificato come parametro
 char* CONFIG_PATH;
 // Percorso di default per il file di configurazione
 const char* DEFAULT_CONFIG_PATH = "./config.txt";
 
 // Parametri di configurazione del Server
-// Numero di threads worker
+// Numero di threads worker, ovvero il minimo numero di threads attivi
 size_t THREADS_WORKER;
+// Numero massimo di threads worker, aggiunti quando i tasks in coda superano POOL_SPAWN_DEPTH (opzionale)
+size_t THREADS_WORKER_MAX = 0;
+// Numero di tasks in coda oltre il quale viene aggiunto un thread worker (opzionale)
+size_t POOL_SPAWN_DEPTH = 4;
+// Millisecondi di inattività dopo i quali un thread worker in eccesso si ritira (opzionale)
+size_t POOL_IDLE_TIMEOUT = 5000;
+// Numero massimo di richieste consecutive di uno stesso client servite da un worker (opzionale)
+size_t PIPELINE_BUDGET = 16;
+// Backend per l'invio delle risposte ai client (opzionale)
+io_backend_t IO_BACKEND = IO_EPOLL;
+// Dimensione massima della memoria condivisa con un client, in Mb, 0 per non accettarla (opzionale)
+size_t SHARED_MEMORY_MAX = 64;
+// CPU su cui vincolare il dispatcher, -1 per nessun vincolo (opzionale)
+long DISPATCHER_CPU = -1;
+// CPU su cui distribuire i threads worker, uno per CPU, nel formato "0-7,12"; con NUMA_NODE devono appartenere al nodo (opzionale)
+char* WORKER_CPUS = NULL;
+// Nodo NUMA su cui eseguire ed allocare la memoria, -1 per nessun vincolo (opzionale)
+long NUMA_NODE = -1;
 // Numero massimo di file consentiti
 size_t STORAGE_MAX_FILES;
 // Dimensione massima dello Storage, in Mb
 size_t STORAGE_MAX_CAPACITY;
+// Numero di partizioni dello Storage, ognuna con il proprio lock, arrotondato ad una potenza di 2 (opzionale)
+// Con ARC, 2Q e W-TinyLFU le partizioni condividono un solo indice di rimpiazzo
+size_t STORAGE_SHARDS = 16;
+// Percentuale dei limiti dello Storage oltre la quale il reclaimer espelle file in background, 0 per disattivarlo (opzionale)
+size_t STORAGE_HIGH_WATERMARK = 0;
+// Percentuale dei limiti dello Storage a cui il reclaimer riporta lo storage, -1 per 10 punti sotto la soglia alta (opzionale)
+long STORAGE_LOW_WATERMARK = -1;
 // Politica di rimpiazzamento
 replacement_policy_t REPLACEMENT_POLICY;
 // Path al Socket file
@@ -0,0 +1,141 @@
+// @author Luca Cirillo (545480)
+
+#ifndef _CONNECTION_H_
+#define _CONNECTION_H_
+
+#include <constants.h>
+#include <protocol.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <uring.h>
+
+// * Stato di una connessione, rispetto alla richiesta in corso
+typedef enum ConnectionState {
+    CONNECTION_HEADER,  // In attesa del messaggio di richiesta (MESSAGE_LENGTH bytes, oppure un frame ed il pathname)
+    CONNECTION_BODY,    // In attesa del contenuto di un file (writeFile, appendToFile)
+    CONNECTION_SEND     // Invio della risposta in corso
+} connection_state_t;
+
+// * Segmento della risposta in attesa di essere inviato al client
+// Al termine dell'invio, oppure alla chiusura della connessione, viene chiamata <release> su <owner>
+typedef struct Segment {
+    const void* data;         // Dati da inviare
+    size_t size;              // Dimensione dei dati
+    size_t sent;              // Bytes già inviati
+    void (*release)(void*);   // Funzione che libera i dati, se necessario
+    void* owner;              // Argomento di <release>
+    struct Segment* next;     // Segmento successivo
+} segment_t;
+
+// * Struttura dati di una connessione
+// Una connessione è servita da un solo worker alla volta (EPOLLONESHOT),
+//  quindi il suo stato non necessita di sincronizzazione
+typedef struct Connection {
+    int fd;                            // Socket del client, in modalità non bloccante
+    int protocol;                      // Versione del protocollo, 0 finché il client non invia il primo messaggio
+    connection_state_t state;          // Stato della richiesta in corso
+    char header[MESSAGE_LENGTH + 1];   // Messaggio di richiesta, sempre terminato da '\0'
+    size_t header_size;                // Bytes attesi del messaggio di richiesta
+    size_t header_read;                // Bytes del messaggio di richiesta già ricevuti
+    bool input_empty;                  // La lettura anticipata dell'ultimo invio con io_uring ha trovato il socket vuoto
+    void* body;                        // Contenuto del file, se previsto dalla richiesta (NULL se viene scartato)
+    bool body_owned;                   // Il contenuto è stato allocato dalla connessione, che lo libera se non consegnato
+    size_t body_size;                  // Dimensione del contenuto del file
+    size_t body_read;                  // Bytes del contenuto del file già ricevuti
+    void* pending;                     // Stato della richiesta in attesa del contenuto, gestito da chi la serve
+    void (*pending_release)(void*);    // Funzione che libera <pending>, se la richiesta non viene eseguita
+    segment_t* output_head;            // Primo segmento della risposta da inviare
+    segment_t* output_tail;            // Ultimo segmento della risposta da inviare
+    int shared_fd;                     // Descrittore della memoria condivisa ricevuto durante la negoziazione, -1 se assente
+    char* shared;                      // Memoria condivisa con il client, NULL se assente
+    size_t shared_size;                // Dimensione della memoria condivisa
+    size_t shared_used;                // Bytes della memoria condivisa occupati dalla risposta in corso
+} connection_t;
+
+// * Tabella delle connessioni attive, indicizzata per file descriptor
+// La dimensione è pari al limite di descrittori aperti del processo (RLIMIT_NOFILE)
+typedef struct ConnectionTable {
+    connection_t** connections;  // Connessioni attive, NULL se il descrittore non è un client
+    size_t size;                 // Numero di descrittori gestibili
+} connection_table_t;
+
+// * Crea una tabella delle connessioni e ritorna un puntatore ad essa
+connection_table_t* connection_table_create(void);
+
+// * Cancella una tabella creata con connection_table_create, chiudendo le connessioni ancora attive
+void connection_table_destroy(connection_table_t* table);
+
+// * Registra una nuova connessione sul socket <fd>, impostandolo in modalità non bloccante
+connection_t* connection_open(connection_table_t* table, int fd);
+
+// * Ritorna la connessione registrata sul socket <fd>, NULL se non esiste
+connection_t* connection_get(connection_table_t* table, int fd);
+
+// * Libera le risorse della connessione registrata sul socket <fd>, quindi chiude il socket
+void connection_close(connection_table_t* table, int fd);
+
+// * Riceve dal client quanto disponibile della richiesta in corso, senza bloccarsi
+// Ritorna 1 se il messaggio di richiesta (CONNECTION_HEADER) o il contenuto del file (CONNECTION_BODY) è completo,
+//  0 se sono necessari altri dati, -1 se il client ha chiuso la connessione oppure in caso di errore
+// Dal primo messaggio ricevuto determina il protocollo: un frame FRAME_HELLO lascia <protocol> a 0,
+//  e la negoziazione è compito di chi serve la richiesta; qualsiasi altro messaggio è testuale (PROTOCOL_LEGACY)
+int connection_receive(connection_t* connection);
+
+// * Copia in <frame> l'intestazione del messaggio di richiesta ricevuto, che deve essere un frame binario
+void connection_frame(connection_t* connection, frame_t* frame);
+
+// * Prepara la ricezione di <size> bytes di contenuto del file, passando allo stato CONNECTION_BODY
+int connection_expect_body(connection_t* connection, size_t size);
+
+// * Prepara la ricezione di <size> bytes di contenuto direttamente in <destination>, che resta di chi la fornisce
+// Con <destination> NULL il contenuto viene scartato, ricevendolo a blocchi di CONNECTION_CHUNK bytes
+// Con <shared> il contenuto si trova all'inizio della memoria condivisa, e viene copiato subito
+int connection_expect_body_into(connection_t* connection, void* destination, size_t size, bool shared);
+
+// * Come connection_expect_body, ma il contenuto del file si trova all'inizio della memoria condivisa:
+// *  viene copiato subito, e la richiesta passa allo stato CONNECTION_BODY già completa
+int connection_expect_shared_body(connection_t* connection, size_t size);
+
+// * Mappa i primi <size> bytes del memfd ricevuto insieme al frame FRAME_HELLO, come memoria condivisa con il client
+// Il memfd deve essere sigillato con F_SEAL_SHRINK, e <size> non può superare <max_size>
+int connection_attach_shared(connection_t* connection, size_t size, size_t max_size);
+
+// * Riserva <size> bytes della memoria condivisa per la risposta in corso, in ordine di invio
+// Ritorna NULL se la memoria condivisa è assente oppure non ha abbastanza spazio libero
+// ! Lo spazio viene liberato con connection_reset: il client deve leggere la risposta prima della richiesta successiva
+void* connection_shared_reserve(connection_t* connection, size_t size);
+
+// * Prepara la connessione alla richiesta successiva, una volta eseguita quella in corso
+// Passa allo stato CONNECTION_SEND se c'è una risposta da inviare, altrimenti a CONNECTION_HEADER
+void connection_reset(connection_t* connection);
+
+// * Accoda alla risposta un messaggio di MESSAGE_LENGTH bytes, formattato come farebbe printf
+int connection_send_message(connection_t* connection, const char* format, ...);
+
+// * Accoda alla risposta il frame <frame>, seguito dal pathname <path> di frame->path_length bytes
+int connection_send_frame(connection_t* connection, const frame_t* frame, const char* path);
+
+// * Accoda alla risposta <size> bytes a partire da <data>, senza copiarli
+// Al termine dell'invio viene chiamata <release> su <owner>, se diversa da NULL
+int connection_send_data(connection_t* connection, const void* data, size_t size, void (*release)(void*), void* owner);
+
+// Numero massimo di segmenti inviati con una singola system call, o richiesta io_uring
+#define CONNECTION_IOV_MAX 64
+
+// Dimensione dei blocchi con cui viene ricevuto un contenuto da scartare
+#define CONNECTION_CHUNK 16384
+
+// * Invia al client quanto possibile della risposta accodata, senza bloccarsi
+// I segmenti vengono inviati a gruppi di CONNECTION_IOV_MAX con una sola sendmsg
+// Ritorna 1 se la risposta è stata inviata per intero, 0 se il socket non accetta altri dati,
+//  -1 in caso di errore
+// Al termine dell'invio passa allo stato CONNECTION_HEADER
+int connection_flush(connection_t* connection);
+
+// * Come connection_flush, ma tramite io_uring: tutti i segmenti della risposta vengono inviati con un'unica
+// *  richiesta, e nella stessa system call viene ricevuto quanto disponibile del messaggio di richiesta successivo
+// <staging> è un buffer di MESSAGE_LENGTH bytes registrato su <ring> con indice 0
+// Viene ricevuto al più quanto manca del messaggio di richiesta atteso, mai dati della richiesta successiva
+int connection_flush_uring(connection_t* connection, uring_t* ring, char* staging);
+
+#endif
@@ -0,0 +1,35 @@
+// @author Luca Cirillo (545480)
+
+// * Epoch-based reclamation
+// I lettori attraversano strutture condivise senza lock, all'interno di una sezione critica (epoch_enter, epoch_exit);
+//  chi rimuove un oggetto lo scollega dalla struttura e ne rimanda la cancellazione (epoch_retire) finché tutti i
+//  lettori che potrebbero ancora vederlo non hanno lasciato la propria sezione critica.
+// L'epoca globale avanza quando tutti i lettori attivi l'hanno osservata: un oggetto ritirato nell'epoca <e>
+//  viene cancellato una volta raggiunta l'epoca <e + 2>.
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+// La definizione della struttura è omessa dall'header
+typedef struct Epoch epoch_t;
+
+// * Crea un nuovo dominio di reclamation e restituisce un puntatore ad esso
+epoch_t* epoch_create(void);
+
+// * Cancella un dominio creato con epoch_create, cancellando tutti gli oggetti ritirati
+// Va chiamata quando nessun thread si trova più in una sezione critica
+void epoch_destroy(epoch_t* epoch);
+
+// * Entra in una sezione critica di lettura del thread chiamante; le sezioni possono essere annidate
+// Al primo utilizzo, il thread viene registrato nel dominio
+// Ritorna -1 se la registrazione fallisce, setta errno: il thread non deve allora accedere alla struttura condivisa
+int epoch_enter(epoch_t* epoch);
+
+// * Esce dalla sezione critica di lettura del thread chiamante
+void epoch_exit(epoch_t* epoch);
+
+// * Rimanda la cancellazione di <object>, già scollegato dalle strutture condivise, tramite <destroy>
+// Gli oggetti ritirati vengono cancellati dalle chiamate successive, una volta trascorso il periodo di grazia
+void epoch_retire(epoch_t* epoch, void* object, void (*destroy)(void*));
+
+#endif
@@ -0,0 +1,52 @@
+// @author Luca Cirillo (545480)
+
+// * Tabella hash ad indirizzamento aperto, nello stile delle Swiss tables
+// Gli elementi si trovano direttamente negli slots della tabella, con il loro hash completo, la chiave ed il valore.
+// Per ogni slot, un byte di controllo contiene 7 bits dell'hash: i bytes di un gruppo di 16 slots vengono confrontati
+//  tutti insieme (SSE2), quindi una ricerca legge di norma un gruppo di bytes di controllo ed un solo slot,
+//  indipendentemente dalle collisioni.
+// Le ricerche non acquisiscono alcun lock, ma vanno eseguite in una sezione critica dell'epoca della tabella:
+//  uno slot viene scritto una sola volta prima di pubblicarne il byte di controllo, e gli slots rimossi restano
+//  inutilizzati (tombstones) fino al ridimensionamento successivo; inserimenti e rimozioni vanno serializzati dal chiamante.
+// Il ridimensionamento è incrementale: la nuova tabella viene pubblicata subito, ed ogni inserimento vi sposta
+//  alcuni gruppi della precedente, che viene cancellata dall'epoca al termine dello spostamento.
+
+#ifndef _HASHTABLE_H_
+#define _HASHTABLE_H_
+
+#include <epoch.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Hashtable hashtable_t;
+
+// * Ritorna l'hash della stringa <key>, calcolato 8 bytes alla volta
+uint64_t hashtable_hash(const char* key);
+
+// * Crea una tabella vuota con spazio per almeno <capacity> elementi, le cui tabelle sostituite vengono cancellate da <epoch>
+hashtable_t* hashtable_create(size_t capacity, epoch_t* epoch);
+
+// * Cancella la tabella <table>, chiamando <destroy> (se non NULL) sul valore di ogni elemento
+// Nessun altro thread deve utilizzare la tabella
+void hashtable_destroy(hashtable_t* table, void (*destroy)(void*));
+
+// * Ritorna il valore della chiave <key>, di hash <hash>, oppure NULL
+void* hashtable_find(hashtable_t* table, const char* key, uint64_t hash);
+
+// * Inserisce la chiave <key>, di hash <hash>, con valore <value>
+// La chiave non viene copiata, e deve restare valida finché l'elemento non viene rimosso e cancellato dall'epoca
+// Ritorna -1 con errno pari ad EEXIST se la chiave è già presente, oppure ENOMEM
+int hashtable_insert(hashtable_t* table, const char* key, uint64_t hash, void* value);
+
+// * Rimuove la chiave <key>, di hash <hash>, e ne ritorna il valore, oppure NULL se non presente
+// Le ricerche in corso possono ancora trovare il valore, fino al termine della loro sezione critica
+void* hashtable_remove(hashtable_t* table, const char* key, uint64_t hash);
+
+// * Chiama <visit> sul valore di ogni elemento, finché non ritorna false
+// Senza lock, come una ricerca: durante un ridimensionamento un elemento spostato potrebbe essere visitato due volte,
+//  oppure non essere visitato se nel frattempo ne inizia un altro. Dato che gli elementi vengono spostati solamente
+//  dagli inserimenti, chi la chiama escludendo inserimenti e rimozioni visita ogni elemento esattamente una volta
+void hashtable_foreach(hashtable_t* table, bool (*visit)(void* value, void* arg), void* arg);
+
+#endif
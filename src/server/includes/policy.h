@@ -0,0 +1,138 @@
+// @author Luca Cirillo (545480)
+
+// * Indici dei file per l'algoritmo di rimpiazzo
+// Ogni politica mantiene i file nell'ordine in cui andrebbero espulsi, così che la vittima si trovi in testa alle sue code:
+//  FIFO: una coda in ordine di inserimento;
+//  LRU: una coda in ordine di utilizzo, dal meno recente;
+//  LFU: gruppi di file con la stessa frequenza di utilizzo, in ordine di frequenza crescente (LFU in O(1));
+//  ARC: file utilizzati una volta (T1) e più volte (T2), con la storia dei file espulsi da entrambe (B1, B2)
+//       che adatta la dimensione obiettivo di T1;
+//  2Q: file appena inseriti in una coda FIFO (A1in) e file già rivisti in una coda LRU (Am), con la storia
+//      dei file espulsi da A1in (A1out): un file passa in Am quando viene riutilizzato, oppure ricreato dopo essere stato espulso;
+//  W-TinyLFU: una piccola finestra LRU seguita da una SLRU (probation, protected), con un count-min sketch delle
+//             frequenze, dimezzato periodicamente, che decide se espellere il candidato della finestra o quello della SLRU;
+//  GDSF: un heap dei file per priorità H = L + utilizzi / dimensione, dove L è la priorità dell'ultimo file espulso:
+//        vengono espulsi per primi i file che valgono meno utilizzi per byte liberato, e L invecchia quelli non più utilizzati.
+// ARC, 2Q e W-TinyLFU resistono alle scansioni di file nuovi, che non svuotano i file più utilizzati;
+//  una readNFiles non viene registrata come utilizzo dei file letti, e non li promuove quindi tra i riutilizzati.
+// L'indice è intrusivo: il nodo si trova nella struttura dati del file, quindi inserimento, utilizzo e rimozione costano O(1).
+// Gli utilizzi non acquisiscono il lock dell'indice: vengono registrati in buffers con perdita, uno per gruppo di threads,
+//  ed applicati da chi riempie un buffer, se trova il lock libero, oppure prima di scegliere una vittima o di rimuovere un nodo.
+// Ogni politica implementa gli stessi hooks (inserimento, utilizzo, rimozione, scelta della vittima) in policy.c.
+
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#include <constants.h>  // replacement_policy_t
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct Policy;
+struct PolicyBucket;
+struct PolicyBuffer;
+struct PolicyOps;
+
+// * Nodo di un indice, contenuto nella struttura dati di ogni file
+// GDSF mantiene i nodi in un heap, mentre le altre politiche in code e gruppi: i campi delle due strutture si sovrappongono
+typedef struct PolicyNode {
+    struct Policy* policy;  // Indice a cui appartiene il nodo, NULL se non vi è inserito
+    unsigned int hash;      // Hash del nome del file, per la storia dei file espulsi e per lo sketch delle frequenze
+    int queue;              // Coda dell'indice a cui appartiene il nodo
+    union {
+        struct {
+            struct PolicyNode* prev;      // Nodo precedente nell'ordine di espulsione
+            struct PolicyNode* next;      // Nodo successivo nell'ordine di espulsione
+            struct PolicyBucket* bucket;  // LFU: gruppo a cui appartiene il nodo
+        };
+        struct {
+            unsigned int slot;  // GDSF: posizione del nodo nell'heap
+            unsigned int hits;  // GDSF: utilizzi del file da quando è nell'indice
+            size_t size;        // GDSF: dimensione del file
+            double priority;    // GDSF: priorità del file, viene espulso per primo quello con il valore più basso
+        };
+    };
+} policy_node_t;
+
+// * Coda di nodi, dal primo da espellere
+typedef struct PolicyQueue {
+    policy_node_t nodes;  // Sentinella della lista dei nodi
+    size_t size;          // Numero di nodi nella coda
+} policy_queue_t;
+
+// * Gruppo di nodi con la stessa frequenza di utilizzo (LFU)
+typedef struct PolicyBucket {
+    unsigned int frequency;     // Frequenza di utilizzo dei nodi del gruppo
+    policy_node_t nodes;        // Sentinella della lista dei nodi, dal meno recente
+    struct PolicyBucket* prev;  // Gruppo con frequenza minore
+    struct PolicyBucket* next;  // Gruppo con frequenza maggiore
+} policy_bucket_t;
+
+// * File espulso di recente, di cui viene ricordato solamente l'hash del nome (ARC, 2Q)
+typedef struct PolicyGhost {
+    unsigned int hash;          // Hash del nome del file
+    int queue;                  // Storia a cui appartiene
+    struct PolicyGhost* prev;   // Ghost precedente nella storia, dal meno recente
+    struct PolicyGhost* next;   // Ghost successivo nella storia
+    struct PolicyGhost* chain;  // Ghost successivo nello stesso bucket della tabella
+} policy_ghost_t;
+
+// * Storia dei file espulsi: fino a due liste di ghosts, con una tabella hash per cercarli
+typedef struct PolicyHistory {
+    policy_ghost_t** table;    // Tabella hash dei ghosts, con liste di trabocco
+    size_t mask;               // Numero di buckets della tabella - 1, potenza di 2
+    policy_ghost_t lists[2];   // Sentinelle delle liste di ghosts
+    size_t sizes[2];           // Numero di ghosts di ogni lista
+} policy_history_t;
+
+// * Count-min sketch delle frequenze di utilizzo (W-TinyLFU)
+typedef struct PolicySketch {
+    unsigned char* counters;  // Contatori saturanti, una riga per funzione hash
+    unsigned int bits;        // Logaritmo in base 2 della larghezza di una riga
+    size_t additions;         // Incrementi dall'ultimo dimezzamento
+    size_t period;            // Incrementi dopo i quali i contatori vengono dimezzati
+} policy_sketch_t;
+
+// * Indice dei file secondo una politica di rimpiazzo
+typedef struct Policy {
+    replacement_policy_t rp;      // Politica di rimpiazzo
+    const struct PolicyOps* ops;  // Hooks della politica
+    pthread_mutex_t lock;         // Protegge l'indice, i lettori dei file non lo attendono mai
+    struct PolicyBuffer* buffers; // Utilizzi non ancora applicati all'indice, NULL se gli utilizzi non lo modificano
+    size_t capacity;              // Numero di file atteso nell'indice, che dimensiona code, storia e sketch
+    policy_queue_t queues[3];     // Code dei nodi, in base alla politica
+    policy_bucket_t buckets;      // LFU: sentinella della lista dei gruppi
+    policy_history_t history;     // ARC, 2Q: storia dei file espulsi
+    size_t target;                // ARC: dimensione obiettivo di T1
+    policy_sketch_t sketch;       // W-TinyLFU: frequenze di utilizzo
+    policy_node_t** heap;         // GDSF: heap dei nodi, con la priorità minore in testa
+    size_t heap_size;             // GDSF: numero di nodi nell'heap
+    size_t heap_capacity;         // GDSF: nodi allocati per l'heap
+    double inflation;             // GDSF: priorità dell'ultimo file espulso (L)
+} policy_t;
+
+// * Inizializza un indice vuoto per la politica <rp>, dimensionato per <capacity> file
+int policy_init(policy_t* policy, replacement_policy_t rp, size_t capacity);
+
+// * Cancella un indice inizializzato con policy_init; i nodi appartengono ai file, e non vengono toccati
+void policy_destroy(policy_t* policy);
+
+// * Inserisce <node>, nodo del file appena creato <name>, nell'indice
+int policy_insert(policy_t* policy, policy_node_t* node, const char* name);
+
+// * Registra un utilizzo del file di <node>, se appartiene ad un indice, senza attendere il lock dell'indice
+// Va chiamata con un lock sul file: chi lo rimuove, con il lock in scrittura, applica gli utilizzi ancora registrati
+void policy_touch(policy_node_t* node);
+
+// * Registra che il file di <node> ha ora dimensione <size>, per le politiche che ne tengono conto
+void policy_resize(policy_node_t* node, size_t size);
+
+// * Rimuove <node> dall'indice a cui appartiene, se presente; se il file è stato espulso (<evicted>),
+// *  le politiche che lo prevedono lo ricordano nella storia
+void policy_remove(policy_node_t* node, bool evicted);
+
+// * Ritorna il nodo da espellere per primo tra quelli per cui <eligible> è vera, oppure NULL
+// <eligible> viene chiamata con il lock dell'indice, e non deve quindi modificarlo
+policy_node_t* policy_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg);
+
+#endif
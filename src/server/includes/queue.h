@@ -3,37 +3,57 @@
 #ifndef _QUEUE_H_
 #define _QUEUE_H_
 
-#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
 
-// * Struttura dati di un file descriptor pronto in coda
-typedef struct Node {
+// Dimensione di una linea di cache, usata per evitare il false sharing tra produttori e consumatori
+#define CACHE_LINE_SIZE 64
+
+// * Struttura dati di una cella del buffer circolare
+// <sequence> indica lo stato della cella rispetto alle posizioni di inserimento ed estrazione:
+//  vale <posizione> se la cella è libera, <posizione + 1> se contiene un fd pronto per essere estratto
+typedef struct Cell {
+    atomic_size_t sequence;
     int fd_ready;  // Indice di un descrittore pronto, oppure segnale di terminazione
-    struct Node* next;
-} node_t;
+} cell_t;
 
 // * Struttura dati della coda
+// Buffer circolare limitato, lock-free, con più produttori e più consumatori (MPMC, Vyukov)
+// Le posizioni di inserimento ed estrazione ed il contatore dei tasks in coda
+//  occupano linee di cache distinte, così che dispatcher e workers non si contendano la stessa linea
 typedef struct Queue {
-    node_t* head;           // Testa
-    node_t* tail;           // Coda
-    unsigned long length;   // Tasks in coda
-    pthread_mutex_t mutex;  // Accesso esclusivo
-    pthread_cond_t empty;   // Coda vuota
+    cell_t* buffer;  // Buffer circolare di celle
+    size_t mask;     // Capacità della coda - 1, la capacità è sempre una potenza di due
+
+    char pad0[CACHE_LINE_SIZE];
+    atomic_size_t enqueue_pos;  // Prossima posizione di inserimento
+    char pad1[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    atomic_size_t dequeue_pos;  // Prossima posizione di estrazione
+    char pad2[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    atomic_size_t length;      // Tasks in coda
+    atomic_size_t max_length;  // Massimo numero di tasks in coda raggiunto
+    char pad3[CACHE_LINE_SIZE - 2 * sizeof(atomic_size_t)];
 } queue_t;
 
-// * Inizializza la coda e ritorna un puntatore ad essa
-queue_t* queue_init();
+// * Inizializza una coda di capacità almeno pari a <capacity> e ritorna un puntatore ad essa
+queue_t* queue_init(size_t capacity);
 
 // * Cancella una coda creata con queue_init
 void queue_destroy(queue_t* queue);
 
-// * Inserisce un fd nella coda
+// * Inserisce un fd nella coda, senza mai bloccarsi
+// Ritorna 0 in caso di successo, -1 se la coda è piena (errno EAGAIN)
 int queue_push(queue_t* queue, int data);
 
-// * Estrae un fd dalla coda
-// ! File descriptors validi sono interi non-negativi
-// Il valore -1 viene interpretato dal thread worker come segnale di terminazione da parte del dispatcher
-// Il valore -2 viene interpretato come errore della funzione queue_pop
-// Qualsiasi altro valore negativo è interpretato dal thread worker come invalido
-int queue_pop(queue_t* queue);
+// * Estrae un fd dalla coda, senza mai bloccarsi, e lo salva in <data>
+// Ritorna 0 in caso di successo, -1 se la coda è vuota (errno EAGAIN)
+// ! L'attesa dei tasks da parte dei workers è gestita dallo scheduler
+int queue_pop(queue_t* queue, int* data);
+
+// * Ritorna il numero di tasks attualmente in coda, utile ai fini di monitoraggio
+size_t queue_length(queue_t* queue);
+
+// * Ritorna il massimo numero di tasks in coda raggiunto dalla creazione
+size_t queue_max_length(queue_t* queue);
 
 #endif
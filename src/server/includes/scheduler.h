@@ -0,0 +1,92 @@
+// @author Luca Cirillo (545480)
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <queue.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// * Coda di esecuzione di un singolo worker
+// Ogni worker ha la propria coda ed i propri contatori, su linee di cache distinte da quelle degli altri workers
+typedef struct RunQueue {
+    queue_t* queue;     // Descrittori assegnati al worker proprietario
+    sem_t wakeup;       // Il worker inattivo dorme qui (futex), finché un produttore non lo risveglia
+    atomic_int idle;    // Vale 1 se il worker sta per addormentarsi, o dorme, su <wakeup>
+    size_t local_hits;  // Tasks estratti dalla propria coda
+    size_t steals;      // Tasks rubati dalle code degli altri workers
+} run_queue_t;
+
+// Ogni coda di esecuzione occupa un numero intero di linee di cache
+#define RUN_QUEUE_SIZE (((sizeof(run_queue_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE)
+
+// * Struttura dati dello scheduler
+// Ogni connessione appartiene ad un worker, nella cui coda il dispatcher inserisce i suoi tasks:
+//  così buffer e metadati di una connessione restano nella cache dello stesso core.
+// Un worker senza tasks nella propria coda li ruba dalle code degli altri workers.
+// Un nuovo task risveglia il worker proprietario se inattivo, altrimenti un qualsiasi altro worker inattivo.
+// * Il numero di workers attivi varia tra <min_workers> e <workers>: le code sono allocate tutte all'avvio,
+// *  i workers attivi sono quelli di indice minore di <active>, e solo l'ultimo di essi può ritirarsi.
+typedef struct Scheduler {
+    size_t workers;         // Numero massimo di workers, ovvero di code di esecuzione
+    size_t min_workers;     // Numero minimo di workers attivi
+    long idle_timeout;      // Millisecondi di inattività dopo i quali l'ultimo worker attivo si ritira
+    char* slots;            // Code di esecuzione, una per worker, ognuna di RUN_QUEUE_SIZE bytes
+    atomic_size_t active;   // Numero di workers attivi
+
+    // Statistiche
+    atomic_size_t max_active;  // Massimo numero di workers attivi contemporaneamente
+    atomic_size_t spawned;     // Workers aggiunti dopo l'avvio
+    atomic_size_t retired;     // Workers ritirati per inattività
+} scheduler_t;
+
+// * Inizializza uno scheduler per un numero di workers compreso tra <min_workers> e <max_workers>,
+// *  con code di capacità almeno pari a <capacity>; inizialmente sono attivi <min_workers> workers
+// Un worker inattivo da più di <idle_timeout> millisecondi si ritira, se <idle_timeout> è positivo
+scheduler_t* scheduler_init(size_t min_workers, size_t max_workers, long idle_timeout, size_t capacity);
+
+// * Cancella uno scheduler creato con scheduler_init
+void scheduler_destroy(scheduler_t* scheduler);
+
+// * Ritorna il worker proprietario della connessione <fd>, tra quelli attualmente attivi
+size_t scheduler_owner(scheduler_t* scheduler, int fd);
+
+// * Inserisce un fd nella coda del worker <owner>
+// Se la coda è piena il task finisce nella prima coda con spazio libero, dove verrà comunque rubato;
+//  se sono tutte piene, il produttore cede il processore finché non si libera una cella
+// Non si blocca mai: dopo l'inserimento risveglia al più un worker inattivo
+int scheduler_push(scheduler_t* scheduler, size_t owner, int fd_ready);
+
+// * Estrae un fd per il worker <worker_id>, mettendosi in attesa se non ci sono tasks
+// Il worker estrae prima dalla propria coda, poi prova a rubare dalle code degli altri workers,
+//  e si addormenta solamente se tutte le code sono vuote
+// ! Ritorna il descrittore estratto, oppure -2 in caso di errore
+// Il valore -1 viene interpretato dal thread worker come segnale di terminazione da parte del dispatcher
+// Il valore -3 indica al worker di ritirarsi, perché inattivo da più di <idle_timeout> millisecondi
+// Qualsiasi altro valore negativo è interpretato dal thread worker come invalido
+int scheduler_pop(scheduler_t* scheduler, size_t worker_id);
+
+// * Attiva un nuovo worker, se la profondità delle code ha raggiunto <depth> tasks e non è stato raggiunto il massimo
+// Ritorna l'indice del worker da avviare, oppure -1 se non è necessario avviarne uno
+// ! Deve essere chiamata da un solo thread, il dispatcher
+long scheduler_grow(scheduler_t* scheduler, size_t depth);
+
+// * Ritorna il numero di workers attivi
+size_t scheduler_active(scheduler_t* scheduler);
+
+// * Ritorna il numero di tasks attualmente in coda, sommando tutte le code
+size_t scheduler_length(scheduler_t* scheduler);
+
+// * Ritorna il numero di tasks estratti dai workers dalla propria coda
+// ! Da chiamare dopo la terminazione dei workers
+size_t scheduler_local_hits(scheduler_t* scheduler);
+
+// * Ritorna il numero di tasks rubati dai workers dalle code altrui
+// ! Da chiamare dopo la terminazione dei workers
+size_t scheduler_steals(scheduler_t* scheduler);
+
+// * Ritorna il massimo numero di tasks raggiunto in una singola coda
+size_t scheduler_max_length(scheduler_t* scheduler);
+
+#endif
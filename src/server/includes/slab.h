@@ -0,0 +1,35 @@
+// @author Luca Cirillo (545480)
+
+// * Slab allocator per oggetti di dimensione fissa
+// Gli oggetti vengono ricavati da blocchi di memoria allineati alla propria dimensione, così che da un oggetto si
+//  risalga al suo blocco, e quindi al suo allocatore, senza ulteriori informazioni (slab_free).
+// Ogni thread mantiene una cache di oggetti liberi per allocatore: allocazioni e rilasci acquisiscono il lock
+//  dell'allocatore solamente per riempire o svuotare la cache, spostando metà degli oggetti alla volta.
+// Un oggetto può essere rilasciato da un thread diverso da quello che lo ha allocato.
+// Gli oggetti non vengono mai restituiti al sistema singolarmente: slab_destroy libera tutti i blocchi insieme.
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+
+// La definizione della struttura è omessa dall'header
+typedef struct Slab slab_t;
+
+// * Crea un allocatore di oggetti di <size> bytes e restituisce un puntatore ad esso
+// La dimensione viene arrotondata alla potenza di 2 successiva fino ad una linea di cache, oltre ad un multiplo
+//  della linea di cache: un oggetto non occupa mai più linee di cache del necessario
+slab_t* slab_create(size_t size);
+
+// * Cancella un allocatore creato con slab_create, liberando tutti i suoi blocchi in O(blocchi)
+// Gli oggetti non ancora rilasciati diventano invalidi; va chiamata quando nessun altro thread utilizza l'allocatore
+void slab_destroy(slab_t* slab);
+
+// * Alloca un oggetto, non inizializzato, da <slab>
+// Ritorna NULL in caso di fallimento, setta errno
+void* slab_alloc(slab_t* slab);
+
+// * Rilascia <object>, allocato con slab_alloc, all'allocatore a cui appartiene
+void slab_free(void* object);
+
+#endif
@@ -3,29 +3,75 @@
 #ifndef _STORAGE_H_
 #define _STORAGE_H_
 
-#include <icl_hash.h>
+#include <epoch.h>
+#include <hashtable.h>
 #include <linkedlist.h>
+#include <policy.h>
 #include <pthread.h>
 #include <rwlock.h>
+#include <slab.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// * Partizione dello storage: una porzione dei file, con il proprio lock
+// Un file appartiene sempre alla stessa partizione, scelta in base all'hash del suo nome
+typedef struct StorageShard {
+    hashtable_t* files;    // Tabella hash di StorageFile della partizione, consultata senza lock
+    pthread_mutex_t lock;  // Serializza inserimenti e rimozioni nella hashmap della partizione
+    policy_t* policy;      // Indice dei file della partizione secondo la politica di rimpiazzo, eventualmente condiviso
+} storage_shard_t;
+
+// Classi di lunghezza dei nomi dei file, da 32 a 256 bytes: i nomi più lunghi vengono allocati singolarmente
+#define STORAGE_NAME_CLASSES 4
 
 // * Struttura dati dello storage
 typedef struct Storage {
-    icl_hash_t* files;                        // Hashmap di StorageFile
+    storage_shard_t* shards;                  // Partizioni della hashmap dei file
+    size_t shards_no;                         // Numero di partizioni, potenza di 2
+    unsigned int shards_shift;                // Bits dell'hash scartati nella scelta della partizione
+    policy_t* policies;                       // Indici di rimpiazzo: uno per partizione, oppure uno solo per le politiche adattive e GDSF
+    size_t policies_no;                       // Numero di indici di rimpiazzo
     replacement_policy_t replacement_policy;  // Politica di rimpiazzo scelta
-    rwlock_t* rwlock;                         // Global Storage read-write-lock
-
-    size_t number_of_files;  // Numero di files attualmente memorizzati, parte da 0 fino a <max_files>
-    size_t max_files;        // Numero di files massimo memorizzabile, pari a STORAGE_MAX_FILES
-    size_t capacity;         // Spazio attualmente occupato dai files, parte da 0 fino a <max_capacity>
-    size_t max_capacity;     // Spazio massimo disponibile, pari a STORAGE_MAX_CAPACITY
+    pthread_mutex_t eviction_lock;            // Serializza l'algoritmo di rimpiazzo, che coinvolge tutte le partizioni
+    epoch_t* epoch;                           // Dominio delle ricerche senza lock, che rimanda la cancellazione dei file rimossi
+    slab_t* file_slab;                        // Allocatore delle strutture dati dei file
+    slab_t* name_slabs[STORAGE_NAME_CLASSES]; // Allocatori dei nomi dei file, per classe di lunghezza
+
+    atomic_size_t number_of_files;  // Numero di files attualmente memorizzati, parte da 0 fino a <max_files>
+    size_t max_files;               // Numero di files massimo memorizzabile, pari a STORAGE_MAX_FILES
+    atomic_size_t capacity;         // Spazio attualmente occupato dai files, parte da 0 fino a <max_capacity>
+    size_t max_capacity;            // Spazio massimo disponibile, pari a STORAGE_MAX_CAPACITY
+
+    // Reclaimer: espelle file in background quando lo storage supera la soglia alta, fino a quella bassa
+    size_t files_high;              // Numero di file oltre il quale viene svegliato il reclaimer
+    size_t files_low;               // Numero di file a cui il reclaimer riporta lo storage
+    size_t capacity_high;           // Spazio occupato oltre il quale viene svegliato il reclaimer
+    size_t capacity_low;            // Spazio occupato a cui il reclaimer riporta lo storage
+    pthread_mutex_t reclaim_lock;   // Protegge la richiesta di intervento del reclaimer
+    pthread_cond_t reclaim_cond;    // Segnala al reclaimer una nuova richiesta di intervento
+    bool reclaim_requested;         // Lo storage ha superato la soglia alta dall'ultimo intervento
+    bool reclaim_stopped;           // Il reclaimer deve terminare
 
     // Statistiche
-    time_t start_timestamp;       // Istante di tempo di inizio attività del server
-    size_t max_files_reached;     // Numero massimo di file memorizzati nello storage
-    size_t max_capacity_reached;  // Capienza massima raggiunta nello storage
-    size_t rp_algorithm_counter;  // Numero di esecuzioni dell'algoritmo di rimpiazzo
+    time_t start_timestamp;              // Istante di tempo di inizio attività del server
+    atomic_size_t max_files_reached;     // Numero massimo di file memorizzati nello storage
+    atomic_size_t max_capacity_reached;  // Capienza massima raggiunta nello storage
+    atomic_size_t rp_algorithm_counter;  // Numero di esecuzioni dell'algoritmo di rimpiazzo
+    atomic_size_t evicted_files;         // Numero di file espulsi dall'algoritmo di rimpiazzo
+    atomic_size_t evicted_bytes;         // Bytes liberati dall'algoritmo di rimpiazzo
+    atomic_size_t reclaimed_files;       // Numero di file espulsi in background dal reclaimer
 } storage_t;
 
+// * Contenuto di un file, condiviso tramite conteggio dei riferimenti
+// Una lettura acquisisce un riferimento ed invia direttamente il contenuto memorizzato; una sovrascrittura sostituisce
+//  il blob del file, mentre le letture in corso continuano ad utilizzare quello precedente.
+// I bytes visibili ai lettori non vengono più modificati: un'aggiunta in fondo scrive solamente oltre la dimensione del file.
+typedef struct StorageBlob {
+    atomic_size_t references;  // Riferimenti al blob: il file che lo contiene e le letture in corso
+    size_t capacity;           // Bytes allocati per il contenuto
+    char data[];               // Contenuto
+} storage_blob_t;
+
 // * Struttura dati di un generico file memorizzato nello storage
 /*  Su uno stesso file ci possono essere:
         1. più lettori attivi contemporaneamente, ma nessuno scrittore, oppure
@@ -46,25 +92,44 @@ typedef struct Storage {
     Gli scrittori hanno accesso prioritario al file, ma devono comunque aspettare che tutti i lettori lo chiudano, prima di operare.
 */
 typedef struct StorageFile {
+    // La struttura occupa 120 bytes, allocati da uno slab allineato alla linea di cache in due linee: i campi letti
+    //  da ricerche ed utilizzi, insieme al lock, si trovano nella prima; nodo di rimpiazzo e lettori seguono
+
     // File-related
-    char* name;      // Nome del file
-    void* contents;  // Contenuto del file
-    size_t size;     // Dimensione del file
+    char* name;                // Nome del file
+    storage_blob_t* contents;  // Contenuto del file, NULL se vuoto
+    size_t size;               // Dimensione del file
 
-    // Lock-related
-    rwlock_t* rwlock;        // Readers/Writers Lock
-    linked_list_t* readers;  // Lista di lettori attivi, ovvero di client che hanno aperto il file in lettura
     int writer;              // Client che al momento ha il lock in scrittura sul file
+    bool writing;            // Contenuto in ricezione (storage_write_begin): il file non può essere espulso
+    bool removed;            // Il file è stato scollegato dallo storage, ed è in attesa di essere cancellato
 
     // Replacement-related
-    time_t creation_time;    // Timestamp della creazione del file nello storage (FIFO)
-    time_t last_use_time;    // Timestamp dell'ultimo utilizzo del file (LRU)
-    unsigned int frequency;  // Numero di accessi al file (LFU)
+    // Le statistiche di utilizzo sono atomiche, così che i lettori le aggiornino con il solo lock in lettura
+    time_t creation_time;           // Timestamp della creazione del file nello storage (FIFO)
+    _Atomic(time_t) last_use_time;  // Timestamp dell'ultimo utilizzo del file (LRU)
+    atomic_uint frequency;          // Numero di accessi al file (LFU)
+
+    // Lock-related
+    rwlock_t rwlock;  // Readers/Writers Lock, di una sola parola
+
+    policy_node_t policy;   // Nodo del file nell'indice di rimpiazzo
+    linked_list_t readers;  // Lista di lettori attivi, ovvero di client che hanno aperto il file in lettura
 
 } storage_file_t;
 
-// * Inizializza uno storage e ritorna un puntatore ad esso
-storage_t* storage_create(size_t max_files, size_t max_capacity, replacement_policy_t rp);
+// * Scrittura di un file in corso, il cui contenuto viene ricevuto direttamente nella sua posizione finale
+typedef struct StorageWrite {
+    storage_file_t* file;      // File in scrittura, NULL una volta completata o annullata la scrittura
+    char* destination;         // Dove ricevere il contenuto
+    size_t size;               // Dimensione del contenuto da ricevere
+    size_t old_size;           // Dimensione del file prima della scrittura
+    storage_blob_t* contents;  // Nuovo contenuto del file (writeFile), NULL se il contenuto viene aggiunto in fondo
+} storage_write_t;
+
+// * Inizializza uno storage, suddiviso in <shards> partizioni (arrotondate alla potenza di 2 successiva),
+// *  e ritorna un puntatore ad esso
+storage_t* storage_create(size_t max_files, size_t max_capacity, replacement_policy_t rp, size_t shards);
 
 // * Cancella uno storage creato con storage_create
 void storage_destroy(storage_t* storage);
@@ -72,10 +137,21 @@ void storage_destroy(storage_t* storage);
 // * Visualizza i file contenuti nello storage
 void storage_print(storage_t* storage);
 
-// * Inizializza uno storage file e ritorna un puntatore ad esso
-storage_file_t* storage_file_create(const char* name, const void* contents, size_t size);
+// * Crea un blob di <capacity> bytes, con un solo riferimento
+storage_blob_t* storage_blob_create(size_t capacity);
+
+// * Acquisisce un nuovo riferimento a <blob>, e lo ritorna
+storage_blob_t* storage_blob_acquire(storage_blob_t* blob);
+
+// * Rilascia un riferimento a <blob>, cancellandolo se era l'ultimo
+void storage_blob_release(void* blob);
+
+// * Inizializza uno storage file, allocato dagli slab di <storage>, e ritorna un puntatore ad esso
+// Il file acquisisce un riferimento al contenuto <contents>, di cui sono visibili i primi <size> bytes
+storage_file_t* storage_file_create(storage_t* storage, const char* name, storage_blob_t* contents, size_t size);
 
 // * Cancella uno storage file creato con storage_file_create
+// Va chiamata prima di cancellare lo storage che lo ha allocato
 void storage_file_destroy(void* file);
 
 // ! APIs
@@ -83,19 +159,25 @@ void storage_file_destroy(void* file);
 int storage_open_file(storage_t* storage, const char* pathname, int flags,
                       int* victims_no, storage_file_t*** victims, int client);
 
-// * Legge il file <pathname> dallo storage, copiando il suo contenuto in <contents>
-int storage_read_file(storage_t* storage, const char* pathname, void** contents, size_t* size, int client);
+// * Legge il file <pathname> dallo storage, acquisendo in <contents> un riferimento al suo contenuto
+int storage_read_file(storage_t* storage, const char* pathname, storage_blob_t** contents, size_t* size, int client);
 
 // * Legge dallo storage <n> files e li invia al client
 int storage_read_n_files(storage_t* storage, int N, storage_file_t*** files_read, int client);
 
-// * Scrive nello storage il file <pathname> ed il suo contenuto <contents>
-int storage_write_file(storage_t* storage, const char* pathname, void* contents, size_t size,
-                       int* victims_no, storage_file_t*** victims, size_t* old_size, int client);
+// * Inizia la scrittura di <size> bytes nel file <pathname>, che ne sostituiscono il contenuto (writeFile)
+// *  oppure vengono aggiunti in fondo (<append>, appendToFile)
+// Prima che il contenuto venga ricevuto, controlla che <client> abbia il lock in scrittura sul file e riserva
+//  lo spazio necessario, espellendo eventualmente altri file; <write> indica dove ricevere il contenuto
+// Fino a storage_write_commit il file mantiene il contenuto precedente, e non può essere espulso
+int storage_write_begin(storage_t* storage, const char* pathname, size_t size, bool append,
+                        int* victims_no, storage_file_t*** victims, storage_write_t* write, int client);
+
+// * Completa la scrittura <write>, rendendo visibile il contenuto ricevuto
+int storage_write_commit(storage_t* storage, storage_write_t* write);
 
-// * Aggiunge <contents>, di dimensione <size>, in fondo al file <pathname>
-int storage_append_to_file(storage_t* storage, const char* pathname, const void* contents, size_t size,
-                           int* victims_no, storage_file_t*** victims, int client);
+// * Annulla la scrittura <write>, rilasciando lo spazio riservato da storage_write_begin
+void storage_write_abort(storage_t* storage, storage_write_t* write);
 
 // * Imposta il lock in scrittura sul file <pathname> per <client>
 int storage_lock_file(storage_t* storage, const char* pathname, int client);
@@ -109,4 +191,20 @@ int storage_close_file(storage_t* storage, const char* pathname, int client);
 // * Cancella il file <pathname> dallo storage, se è stato aperto in scrittura da <client>
 int storage_remove_file(storage_t* storage, const char* pathname, size_t* size, int client);
 
+// ! Reclaimer
+// * Imposta le soglie del reclaimer, in percentuale dei limiti dello storage: superata la soglia <high>,
+// *  sul numero di file oppure sullo spazio occupato, il reclaimer espelle file finché entrambi non scendono a <low>
+// Con <high> pari a 0 il reclaimer non viene mai svegliato, ed i file vengono espulsi solamente dalle richieste dei client
+int storage_set_watermarks(storage_t* storage, size_t high, size_t low);
+
+// * Attende che lo storage superi la soglia alta; ritorna false quando il reclaimer deve terminare
+bool storage_reclaim_wait(storage_t* storage);
+
+// * Espelle file finché lo storage non scende alla soglia bassa, restituendoli in <victims>
+// Ritorna il numero di file espulsi, oppure -1 in caso di errore; i file già espulsi vengono comunque restituiti
+int storage_reclaim(storage_t* storage, int* victims_no, storage_file_t*** victims);
+
+// * Risveglia il reclaimer affinché termini
+void storage_reclaim_stop(storage_t* storage);
+
 #endif
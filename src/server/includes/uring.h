@@ -0,0 +1,62 @@
+// @author Luca Cirillo (545480)
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+// * Struttura dati di un'istanza io_uring
+// Interfaccia minimale alle system call io_uring_setup, io_uring_enter e io_uring_register,
+//  senza dipendere da liburing. Un'istanza è usata da un solo thread alla volta.
+typedef struct Uring {
+    int fd;  // Descrittore dell'istanza
+
+    // Submission queue, condivisa con il kernel
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned sq_pending;  // Richieste preparate e non ancora sottomesse
+
+    // Completion queue, condivisa con il kernel
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    // Regioni di memoria mappate, da rilasciare alla chiusura
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} uring_t;
+
+// * Crea un'istanza io_uring con almeno <entries> richieste e ritorna un puntatore ad essa
+// Ritorna NULL se il kernel non supporta io_uring, oppure ne nega l'uso (ENOSYS, EPERM)
+uring_t* uring_create(unsigned entries);
+
+// * Cancella un'istanza creata con uring_create
+void uring_destroy(uring_t* ring);
+
+// * Registra <count> buffers presso il kernel, utilizzabili dalle operazioni *_FIXED
+int uring_register_buffers(uring_t* ring, const struct iovec* buffers, unsigned count);
+
+// * Ritorna la prossima richiesta libera nella submission queue, azzerata, oppure NULL se la coda è piena
+struct io_uring_sqe* uring_get_sqe(uring_t* ring);
+
+// * Sottomette le richieste preparate ed attende almeno <wait> completamenti, con una sola system call
+int uring_submit_and_wait(uring_t* ring, unsigned wait);
+
+// * Estrae il prossimo completamento disponibile in <cqe>, ritorna -1 se non ce ne sono
+int uring_pop_cqe(uring_t* ring, struct io_uring_cqe* cqe);
+
+// * Ritira le richieste preparate o sottomesse che il kernel non ha ancora consumato, e ritorna quante sono
+// Senza SQPOLL il kernel consuma le richieste solamente durante uring_submit_and_wait, quindi al ritorno di questa
+//  le richieste ritirate non verranno mai eseguite
+unsigned uring_withdraw(uring_t* ring);
+
+#endif
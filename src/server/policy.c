@@ -0,0 +1,683 @@
+// @author Luca Cirillo (545480)
+
+#include <errno.h>
+#include <policy.h>
+#include <pthread.h>
+#include <queue.h>  // CACHE_LINE_SIZE
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils.h>
+
+// * Hooks di una politica di rimpiazzo
+// Vengono chiamati con il lock dell'indice; <access> e <resize> NULL indicano che utilizzi e dimensioni non modificano l'indice
+typedef struct PolicyOps {
+    int (*insert)(policy_t* policy, policy_node_t* node);
+    void (*access)(policy_t* policy, policy_node_t* node);
+    void (*remove)(policy_t* policy, policy_node_t* node, bool evicted);
+    policy_node_t* (*victim)(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg);
+    void (*resize)(policy_t* policy, policy_node_t* node);
+} policy_ops_t;
+
+// Code e storie delle politiche
+#define ARC_T1 0          // ARC: file utilizzati una sola volta
+#define ARC_T2 1          // ARC: file utilizzati più volte
+#define ARC_B1 0          // ARC: storia dei file espulsi da T1
+#define ARC_B2 1          // ARC: storia dei file espulsi da T2
+#define TWOQ_A1IN 0       // 2Q: file appena inseriti
+#define TWOQ_AM 1         // 2Q: file riutilizzati, oppure ricreati dopo essere stati espulsi da A1in
+#define TWOQ_A1OUT 0      // 2Q: storia dei file espulsi da A1in
+#define TINY_WINDOW 0     // W-TinyLFU: finestra dei file appena inseriti
+#define TINY_PROBATION 1  // W-TinyLFU: file in attesa di essere riutilizzati
+#define TINY_PROTECTED 2  // W-TinyLFU: file riutilizzati
+
+// Righe dello sketch e valore massimo dei contatori, a 4 bits come in TinyLFU
+#define SKETCH_ROWS 4
+#define SKETCH_MAX 15
+
+// Buffers degli utilizzi di un indice, ed utilizzi registrati da ognuno prima di tentare di applicarli
+#define POLICY_BUFFERS 16
+#define POLICY_BUFFER_SLOTS 16
+
+// * Utilizzi registrati da un gruppo di threads e non ancora applicati all'indice
+// Un utilizzo sovrascrive il più vecchio del buffer, se questo non è stato applicato: l'ordine resta approssimato
+typedef struct PolicyBuffer {
+    _Atomic(policy_node_t*) slots[POLICY_BUFFER_SLOTS];  // Nodi utilizzati, NULL se già applicati
+    atomic_uint tail;                                    // Utilizzi registrati nel buffer
+    char pad[CACHE_LINE_SIZE - sizeof(atomic_uint)];     // Un buffer non condivide linee di cache con gli altri
+} policy_buffer_t;
+
+// Threads che hanno registrato almeno un utilizzo, ed indice (+ 1) del buffer del thread corrente
+static atomic_uint policy_threads = 0;
+static __thread unsigned int policy_thread = 0;
+
+// Semi delle funzioni hash delle righe dello sketch
+static const uint32_t SKETCH_SEEDS[SKETCH_ROWS] = {0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu};
+
+// Hash FNV-1a del nome <name>
+static unsigned int policy_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return hash;
+}
+
+// ! Liste e code
+
+// Inizializza la sentinella <sentinel> di una lista circolare vuota
+static void list_init(policy_node_t* sentinel) {
+    sentinel->prev = sentinel;
+    sentinel->next = sentinel;
+}
+
+// Aggiunge <node> in fondo alla lista di sentinella <sentinel>
+static void list_append(policy_node_t* sentinel, policy_node_t* node) {
+    node->prev = sentinel->prev;
+    node->next = sentinel;
+    sentinel->prev->next = node;
+    sentinel->prev = node;
+}
+
+// Scollega <node> dalla lista a cui appartiene
+static void list_unlink(policy_node_t* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+}
+
+// Aggiunge <node> in fondo (come il più recente) alla coda <queue>
+static void queue_append(policy_t* policy, int queue, policy_node_t* node) {
+    list_append(&policy->queues[queue].nodes, node);
+    policy->queues[queue].size++;
+    node->queue = queue;
+}
+
+// Rimuove <node> dalla sua coda
+static void queue_unlink(policy_t* policy, policy_node_t* node) {
+    list_unlink(node);
+    policy->queues[node->queue].size--;
+}
+
+// Sposta <node> in fondo alla coda <queue>, se non si trova già lì
+static void queue_move(policy_t* policy, int queue, policy_node_t* node) {
+    if (node->queue == queue && node->next == &policy->queues[queue].nodes) return;
+    queue_unlink(policy, node);
+    queue_append(policy, queue, node);
+}
+
+// Ritorna il primo nodo della coda <queue> per cui <eligible> è vera, oppure NULL
+static policy_node_t* queue_first(policy_t* policy, int queue, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    policy_node_t* sentinel = &policy->queues[queue].nodes;
+    for (policy_node_t* node = sentinel->next; node != sentinel; node = node->next)
+        if (eligible(node, arg)) return node;
+    return NULL;
+}
+
+// Ritorna il primo nodo idoneo della coda <first>, oppure, se non ce ne sono, della coda <second>
+static policy_node_t* queue_first_of(policy_t* policy, int first, int second, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    policy_node_t* victim = queue_first(policy, first, eligible, arg);
+    return victim ? victim : queue_first(policy, second, eligible, arg);
+}
+
+// ! Storia dei file espulsi
+
+static int history_init(policy_history_t* history, size_t capacity) {
+    // Almeno due buckets per ogni ghost che la storia può contenere
+    size_t buckets = 16;
+    while (buckets < 2 * capacity) buckets *= 2;
+    if ((history->table = calloc(buckets, sizeof(policy_ghost_t*))) == NULL) return -1;
+    history->mask = buckets - 1;
+    for (int i = 0; i < 2; i++) {
+        history->lists[i].prev = history->lists[i].next = &history->lists[i];
+        history->sizes[i] = 0;
+    }
+    return 0;
+}
+
+static void history_destroy(policy_history_t* history) {
+    if (!history->table) return;
+    for (int i = 0; i < 2; i++) {
+        policy_ghost_t* ghost = history->lists[i].next;
+        while (ghost != &history->lists[i]) {
+            policy_ghost_t* next = ghost->next;
+            free(ghost);
+            ghost = next;
+        }
+    }
+    free(history->table);
+    history->table = NULL;
+}
+
+// Ritorna il ghost del file di hash <hash>, oppure NULL
+static policy_ghost_t* history_find(policy_history_t* history, unsigned int hash) {
+    for (policy_ghost_t* ghost = history->table[hash & history->mask]; ghost; ghost = ghost->chain)
+        if (ghost->hash == hash) return ghost;
+    return NULL;
+}
+
+// Rimuove e cancella il ghost <ghost>
+static void history_remove(policy_history_t* history, policy_ghost_t* ghost) {
+    policy_ghost_t** cursor = &history->table[ghost->hash & history->mask];
+    while (*cursor != ghost) cursor = &(*cursor)->chain;
+    *cursor = ghost->chain;
+    ghost->prev->next = ghost->next;
+    ghost->next->prev = ghost->prev;
+    history->sizes[ghost->queue]--;
+    free(ghost);
+}
+
+// Ricorda il file di hash <hash> come il più recente della storia <queue>
+// Senza memoria per un nuovo ghost il file viene semplicemente dimenticato
+static void history_add(policy_history_t* history, int queue, unsigned int hash) {
+    policy_ghost_t* ghost = history_find(history, hash);
+    if (ghost) history_remove(history, ghost);
+    if ((ghost = malloc(sizeof(policy_ghost_t))) == NULL) return;
+    ghost->hash = hash;
+    ghost->queue = queue;
+    ghost->chain = history->table[hash & history->mask];
+    history->table[hash & history->mask] = ghost;
+    ghost->prev = history->lists[queue].prev;
+    ghost->next = &history->lists[queue];
+    history->lists[queue].prev->next = ghost;
+    history->lists[queue].prev = ghost;
+    history->sizes[queue]++;
+}
+
+// Dimentica i file meno recenti della storia <queue> finché non ne restano al più <limit>
+static void history_trim(policy_history_t* history, int queue, size_t limit) {
+    while (history->sizes[queue] > limit) history_remove(history, history->lists[queue].next);
+}
+
+// ! Count-min sketch
+
+static int sketch_init(policy_sketch_t* sketch, size_t capacity) {
+    // Una riga ha almeno un contatore per ogni file atteso
+    sketch->bits = 6;
+    while (((size_t)1 << sketch->bits) < capacity && sketch->bits < 30) sketch->bits++;
+    if ((sketch->counters = calloc(SKETCH_ROWS, (size_t)1 << sketch->bits)) == NULL) return -1;
+    sketch->additions = 0;
+    // Le frequenze invecchiano dopo un numero di utilizzi pari a 10 volte la larghezza di una riga
+    sketch->period = ((size_t)1 << sketch->bits) * 10;
+    return 0;
+}
+
+// Contatore della riga <row> per il file di hash <hash>
+static unsigned char* sketch_counter(policy_sketch_t* sketch, int row, unsigned int hash) {
+    uint32_t index = ((uint32_t)hash * SKETCH_SEEDS[row]) >> (32 - sketch->bits);
+    return &sketch->counters[((size_t)row << sketch->bits) + index];
+}
+
+// Stima la frequenza di utilizzo del file di hash <hash>
+static unsigned int sketch_estimate(policy_sketch_t* sketch, unsigned int hash) {
+    unsigned int frequency = SKETCH_MAX;
+    for (int row = 0; row < SKETCH_ROWS; row++) frequency = MIN(frequency, *sketch_counter(sketch, row, hash));
+    return frequency;
+}
+
+// Registra un utilizzo del file di hash <hash>, dimezzando tutti i contatori al termine di ogni periodo
+static void sketch_increment(policy_sketch_t* sketch, unsigned int hash) {
+    for (int row = 0; row < SKETCH_ROWS; row++) {
+        unsigned char* counter = sketch_counter(sketch, row, hash);
+        if (*counter < SKETCH_MAX) (*counter)++;
+    }
+    if (++sketch->additions < sketch->period) return;
+    // I file molto utilizzati in passato, ma non più, perdono gradualmente la loro frequenza
+    size_t counters = (size_t)SKETCH_ROWS << sketch->bits;
+    for (size_t i = 0; i < counters; i++) sketch->counters[i] >>= 1;
+    sketch->additions /= 2;
+}
+
+// ! FIFO
+
+static int fifo_insert(policy_t* policy, policy_node_t* node) {
+    queue_append(policy, 0, node);
+    return 0;
+}
+
+static void fifo_remove(policy_t* policy, policy_node_t* node, bool evicted) {
+    queue_unlink(policy, node);
+}
+
+static policy_node_t* fifo_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    return queue_first(policy, 0, eligible, arg);
+}
+
+// ! LRU
+
+static void lru_access(policy_t* policy, policy_node_t* node) {
+    // Il file diventa il più recente; se lo è già, come per un file molto letto, non c'è niente da fare
+    queue_move(policy, 0, node);
+}
+
+// ! LFU
+
+// Crea un gruppo vuoto di frequenza <frequency>, subito dopo il gruppo <prev>
+static policy_bucket_t* bucket_create(policy_bucket_t* prev, unsigned int frequency) {
+    policy_bucket_t* bucket = malloc(sizeof(policy_bucket_t));
+    if (!bucket) return NULL;
+    bucket->frequency = frequency;
+    list_init(&bucket->nodes);
+    bucket->prev = prev;
+    bucket->next = prev->next;
+    prev->next->prev = bucket;
+    prev->next = bucket;
+    return bucket;
+}
+
+// Scollega <node> dal suo gruppo, cancellando il gruppo se resta vuoto
+static void bucket_unlink(policy_node_t* node) {
+    policy_bucket_t* bucket = node->bucket;
+    list_unlink(node);
+    node->bucket = NULL;
+    if (bucket->nodes.next != &bucket->nodes) return;
+    bucket->prev->next = bucket->next;
+    bucket->next->prev = bucket->prev;
+    free(bucket);
+}
+
+static int lfu_insert(policy_t* policy, policy_node_t* node) {
+    // Un file appena creato non è mai stato utilizzato, quindi appartiene al gruppo di frequenza 0
+    policy_bucket_t* bucket = policy->buckets.next;
+    if (bucket == &policy->buckets || bucket->frequency != 0) bucket = bucket_create(&policy->buckets, 0);
+    if (!bucket) return -1;
+    list_append(&bucket->nodes, node);
+    node->bucket = bucket;
+    return 0;
+}
+
+static void lfu_access(policy_t* policy, policy_node_t* node) {
+    // Il file passa al gruppo di frequenza successiva, creandolo se non esiste
+    policy_bucket_t* bucket = node->bucket;
+    policy_bucket_t* next = bucket->next;
+    if (next == &policy->buckets || next->frequency != bucket->frequency + 1) next = bucket_create(bucket, bucket->frequency + 1);
+    if (next) {
+        bucket_unlink(node);
+        list_append(&next->nodes, node);
+        node->bucket = next;
+    } else {
+        // Senza memoria per un nuovo gruppo, il file resta in quello attuale come il più recente
+        list_unlink(node);
+        list_append(&bucket->nodes, node);
+    }
+}
+
+static void lfu_remove(policy_t* policy, policy_node_t* node, bool evicted) {
+    bucket_unlink(node);
+}
+
+static policy_node_t* lfu_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    // Scorro i gruppi dalla frequenza minore, ed ognuno dal file meno recente
+    for (policy_bucket_t* bucket = policy->buckets.next; bucket != &policy->buckets; bucket = bucket->next)
+        for (policy_node_t* node = bucket->nodes.next; node != &bucket->nodes; node = node->next)
+            if (eligible(node, arg)) return node;
+    return NULL;
+}
+
+// ! ARC
+
+// Mantiene la storia entro i limiti di ARC: |T1| + |B1| <= c e |T1| + |T2| + |B1| + |B2| <= 2c
+static void arc_trim(policy_t* policy) {
+    policy_history_t* history = &policy->history;
+    size_t t1 = policy->queues[ARC_T1].size, t2 = policy->queues[ARC_T2].size;
+    history_trim(history, ARC_B1, t1 < policy->capacity ? policy->capacity - t1 : 0);
+    size_t cached = t1 + t2 + history->sizes[ARC_B1];
+    history_trim(history, ARC_B2, cached < 2 * policy->capacity ? 2 * policy->capacity - cached : 0);
+}
+
+static int arc_insert(policy_t* policy, policy_node_t* node) {
+    policy_history_t* history = &policy->history;
+    policy_ghost_t* ghost = history_find(history, node->hash);
+    if (!ghost) {
+        // Un file nuovo entra in T1
+        queue_append(policy, ARC_T1, node);
+    } else {
+        // Un file espulso di recente rientra in T2: la storia in cui si trovava indica quale coda andava ingrandita
+        size_t b1 = history->sizes[ARC_B1], b2 = history->sizes[ARC_B2];
+        if (ghost->queue == ARC_B1)
+            policy->target = MIN(policy->capacity, policy->target + MAX(b2 / b1, 1));
+        else
+            policy->target -= MIN(policy->target, MAX(b1 / b2, 1));
+        history_remove(history, ghost);
+        queue_append(policy, ARC_T2, node);
+    }
+    arc_trim(policy);
+    return 0;
+}
+
+static void arc_access(policy_t* policy, policy_node_t* node) {
+    // Un file utilizzato di nuovo diventa il più recente di T2
+    queue_move(policy, ARC_T2, node);
+}
+
+static void arc_remove(policy_t* policy, policy_node_t* node, bool evicted) {
+    int queue = node->queue;
+    queue_unlink(policy, node);
+    if (!evicted) return;
+    history_add(&policy->history, queue == ARC_T1 ? ARC_B1 : ARC_B2, node->hash);
+    arc_trim(policy);
+}
+
+static policy_node_t* arc_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    // Si espelle da T1 quando ha superato la sua dimensione obiettivo, altrimenti da T2
+    size_t t1 = policy->queues[ARC_T1].size;
+    if (t1 > 0 && (t1 > policy->target || policy->queues[ARC_T2].size == 0))
+        return queue_first_of(policy, ARC_T1, ARC_T2, eligible, arg);
+    return queue_first_of(policy, ARC_T2, ARC_T1, eligible, arg);
+}
+
+// ! 2Q
+
+// Dimensioni di A1in e della storia A1out suggerite da Johnson e Shasha: 25% e 50% della capienza
+#define TWOQ_KIN(policy) MAX((policy)->capacity / 4, 1)
+#define TWOQ_KOUT(policy) MAX((policy)->capacity / 2, 1)
+
+static int twoq_insert(policy_t* policy, policy_node_t* node) {
+    policy_ghost_t* ghost = history_find(&policy->history, node->hash);
+    if (ghost) {
+        // Il file era stato espulso da A1in di recente: è davvero riutilizzato, ed entra in Am
+        history_remove(&policy->history, ghost);
+        queue_append(policy, TWOQ_AM, node);
+    } else {
+        queue_append(policy, TWOQ_A1IN, node);
+    }
+    return 0;
+}
+
+static void twoq_access(policy_t* policy, policy_node_t* node) {
+    // Un file riutilizzato diventa il più recente di Am, anche se si trova ancora in A1in (2Q semplificato):
+    //  un file espulso non può essere riletto, ma solamente ricreato, quindi A1out da sola non lo riconoscerebbe mai
+    queue_move(policy, TWOQ_AM, node);
+}
+
+static void twoq_remove(policy_t* policy, policy_node_t* node, bool evicted) {
+    int queue = node->queue;
+    queue_unlink(policy, node);
+    if (!evicted || queue != TWOQ_A1IN) return;
+    history_add(&policy->history, TWOQ_A1OUT, node->hash);
+    history_trim(&policy->history, TWOQ_A1OUT, TWOQ_KOUT(policy));
+}
+
+static policy_node_t* twoq_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    // Si espelle da A1in quando ha superato la sua dimensione, altrimenti da Am
+    if (policy->queues[TWOQ_A1IN].size > TWOQ_KIN(policy) || policy->queues[TWOQ_AM].size == 0)
+        return queue_first_of(policy, TWOQ_A1IN, TWOQ_AM, eligible, arg);
+    return queue_first_of(policy, TWOQ_AM, TWOQ_A1IN, eligible, arg);
+}
+
+// ! W-TinyLFU
+
+// Dimensioni della finestra (1% della capienza) e della coda protected (80% del resto)
+#define TINY_WINDOW_MAX(policy) MAX((policy)->capacity / 100, 1)
+#define TINY_PROTECTED_MAX(policy) MAX(((policy)->capacity - MIN((policy)->capacity, TINY_WINDOW_MAX(policy))) * 8 / 10, 1)
+
+static int tiny_insert(policy_t* policy, policy_node_t* node) {
+    sketch_increment(&policy->sketch, node->hash);
+    queue_append(policy, TINY_WINDOW, node);
+    // Il file meno recente di una finestra piena passa alla SLRU, in prova
+    if (policy->queues[TINY_WINDOW].size > TINY_WINDOW_MAX(policy))
+        queue_move(policy, TINY_PROBATION, policy->queues[TINY_WINDOW].nodes.next);
+    return 0;
+}
+
+static void tiny_access(policy_t* policy, policy_node_t* node) {
+    sketch_increment(&policy->sketch, node->hash);
+    if (node->queue == TINY_PROBATION) {
+        // Un file in prova riutilizzato diventa protetto; il protetto meno recente di una coda piena torna in prova
+        queue_move(policy, TINY_PROTECTED, node);
+        if (policy->queues[TINY_PROTECTED].size > TINY_PROTECTED_MAX(policy))
+            queue_move(policy, TINY_PROBATION, policy->queues[TINY_PROTECTED].nodes.next);
+    } else {
+        queue_move(policy, node->queue, node);
+    }
+}
+
+static void tiny_remove(policy_t* policy, policy_node_t* node, bool evicted) {
+    queue_unlink(policy, node);
+}
+
+static policy_node_t* tiny_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    // Il candidato della finestra sfida la vittima della SLRU: viene espulso il meno frequente dei due
+    policy_node_t* candidate = queue_first(policy, TINY_WINDOW, eligible, arg);
+    policy_node_t* victim = queue_first_of(policy, TINY_PROBATION, TINY_PROTECTED, eligible, arg);
+    if (!candidate || !victim) return candidate ? candidate : victim;
+    return sketch_estimate(&policy->sketch, candidate->hash) > sketch_estimate(&policy->sketch, victim->hash) ? victim : candidate;
+}
+
+// ! GDSF
+
+// Scambia i nodi nelle posizioni <i> e <j> dell'heap
+static void heap_swap(policy_t* policy, size_t i, size_t j) {
+    policy_node_t* node = policy->heap[i];
+    policy->heap[i] = policy->heap[j];
+    policy->heap[j] = node;
+    policy->heap[i]->slot = i;
+    policy->heap[j]->slot = j;
+}
+
+// Riporta nella posizione corretta il nodo in posizione <slot>, la cui priorità è cambiata
+static void heap_fix(policy_t* policy, size_t slot) {
+    // Verso la radice, finché il padre ha priorità maggiore
+    while (slot > 0 && policy->heap[(slot - 1) / 2]->priority > policy->heap[slot]->priority) {
+        heap_swap(policy, slot, (slot - 1) / 2);
+        slot = (slot - 1) / 2;
+    }
+    // Verso le foglie, finché un figlio ha priorità minore
+    while (true) {
+        size_t smallest = slot, left = 2 * slot + 1, right = 2 * slot + 2;
+        if (left < policy->heap_size && policy->heap[left]->priority < policy->heap[smallest]->priority) smallest = left;
+        if (right < policy->heap_size && policy->heap[right]->priority < policy->heap[smallest]->priority) smallest = right;
+        if (smallest == slot) return;
+        heap_swap(policy, slot, smallest);
+        slot = smallest;
+    }
+}
+
+// Aggiorna la priorità di <node>: gli utilizzi valgono tanto più quanto il file è piccolo, perché ne occupano meno spazio
+// Un file vuoto conta come un byte, così da non avere priorità infinita
+static void gdsf_prioritize(policy_t* policy, policy_node_t* node) {
+    node->priority = policy->inflation + (double)node->hits / (double)MAX(node->size, 1);
+    heap_fix(policy, node->slot);
+}
+
+static int gdsf_insert(policy_t* policy, policy_node_t* node) {
+    if (policy->heap_size == policy->heap_capacity) {
+        size_t capacity = policy->heap_capacity > 0 ? policy->heap_capacity * 2 : policy->capacity;
+        policy_node_t** heap = realloc(policy->heap, capacity * sizeof(policy_node_t*));
+        if (!heap) return -1;
+        policy->heap = heap;
+        policy->heap_capacity = capacity;
+    }
+    node->slot = policy->heap_size++;
+    policy->heap[node->slot] = node;
+    node->size = 0;
+    node->hits = 1;
+    gdsf_prioritize(policy, node);
+    return 0;
+}
+
+static void gdsf_access(policy_t* policy, policy_node_t* node) {
+    node->hits++;
+    gdsf_prioritize(policy, node);
+}
+
+static void gdsf_remove(policy_t* policy, policy_node_t* node, bool evicted) {
+    // L'inflazione sale alla priorità del file espulso: i file non più utilizzati restano indietro rispetto ai nuovi
+    if (evicted) policy->inflation = MAX(policy->inflation, node->priority);
+    size_t slot = node->slot;
+    heap_swap(policy, slot, --policy->heap_size);
+    if (slot < policy->heap_size) heap_fix(policy, slot);
+}
+
+static policy_node_t* gdsf_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    if (policy->heap_size == 0) return NULL;
+    if (eligible(policy->heap[0], arg)) return policy->heap[0];
+    // La radice non è espellibile (ad esempio è in scrittura), caso raro: cerco il nodo idoneo di priorità minore
+    policy_node_t* victim = NULL;
+    for (size_t i = 1; i < policy->heap_size; i++)
+        if ((!victim || policy->heap[i]->priority < victim->priority) && eligible(policy->heap[i], arg)) victim = policy->heap[i];
+    return victim;
+}
+
+// ! Buffers degli utilizzi
+
+// Buffer degli utilizzi del thread corrente: threads diversi usano buffers diversi, finché non sono più di POLICY_BUFFERS
+static policy_buffer_t* buffer_of_thread(policy_t* policy) {
+    if (policy_thread == 0) policy_thread = atomic_fetch_add_explicit(&policy_threads, 1, memory_order_relaxed) + 1;
+    return &policy->buffers[(policy_thread - 1) % POLICY_BUFFERS];
+}
+
+// Applica all'indice gli utilizzi registrati nei buffers; va chiamata con il lock dell'indice
+// Un nodo nei buffers appartiene sempre all'indice: chi lo rimuove applica prima i suoi utilizzi
+static void buffers_drain(policy_t* policy) {
+    if (!policy->buffers) return;
+    for (size_t i = 0; i < POLICY_BUFFERS; i++) {
+        for (size_t j = 0; j < POLICY_BUFFER_SLOTS; j++) {
+            policy_node_t* node = atomic_exchange_explicit(&policy->buffers[i].slots[j], NULL, memory_order_acquire);
+            if (node && node->policy == policy) policy->ops->access(policy, node);
+        }
+    }
+}
+
+// ! Politiche disponibili, indicizzate per replacement_policy_t
+
+static const policy_ops_t POLICIES[] = {
+    [FIFO] = {fifo_insert, NULL, fifo_remove, fifo_victim, NULL},
+    [LRU] = {fifo_insert, lru_access, fifo_remove, fifo_victim, NULL},
+    [LFU] = {lfu_insert, lfu_access, lfu_remove, lfu_victim, NULL},
+    [ARC] = {arc_insert, arc_access, arc_remove, arc_victim, NULL},
+    [TWO_QUEUE] = {twoq_insert, twoq_access, twoq_remove, twoq_victim, NULL},
+    [W_TINYLFU] = {tiny_insert, tiny_access, tiny_remove, tiny_victim, NULL},
+    [GDSF] = {gdsf_insert, gdsf_access, gdsf_remove, gdsf_victim, gdsf_prioritize},
+};
+
+// ! APIs
+
+int policy_init(policy_t* policy, replacement_policy_t rp, size_t capacity) {
+    if (!policy || (size_t)rp >= sizeof(POLICIES) / sizeof(POLICIES[0])) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(policy, 0, sizeof(policy_t));
+    policy->rp = rp;
+    policy->ops = &POLICIES[rp];
+    policy->capacity = MAX(capacity, 1);
+    for (int i = 0; i < 3; i++) {
+        list_init(&policy->queues[i].nodes);
+        policy->queues[i].size = 0;
+    }
+    // La sentinella dei gruppi non contiene nodi
+    list_init(&policy->buckets.nodes);
+    policy->buckets.prev = policy->buckets.next = &policy->buckets;
+
+    // Solamente alcune politiche hanno bisogno della storia o dello sketch
+    if ((rp == ARC || rp == TWO_QUEUE) && history_init(&policy->history, policy->capacity) == -1) return -1;
+    if (rp == W_TINYLFU && sketch_init(&policy->sketch, policy->capacity) == -1) {
+        history_destroy(&policy->history);
+        return -1;
+    }
+
+    // I buffers servono solamente se gli utilizzi modificano l'indice
+    int error = 0;
+    if (policy->ops->access) {
+        if (posix_memalign((void**)&policy->buffers, CACHE_LINE_SIZE, POLICY_BUFFERS * sizeof(policy_buffer_t)) != 0) {
+            policy->buffers = NULL;
+            error = ENOMEM;
+        } else {
+            for (size_t i = 0; i < POLICY_BUFFERS; i++) {
+                atomic_init(&policy->buffers[i].tail, 0);
+                for (size_t j = 0; j < POLICY_BUFFER_SLOTS; j++) atomic_init(&policy->buffers[i].slots[j], NULL);
+            }
+        }
+    }
+    if (error == 0) error = pthread_mutex_init(&policy->lock, NULL);
+    if (error != 0) {
+        history_destroy(&policy->history);
+        free(policy->sketch.counters);
+        free(policy->buffers);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void policy_destroy(policy_t* policy) {
+    if (!policy) return;
+    policy_bucket_t* bucket = policy->buckets.next;
+    while (bucket != &policy->buckets) {
+        policy_bucket_t* next = bucket->next;
+        free(bucket);
+        bucket = next;
+    }
+    history_destroy(&policy->history);
+    free(policy->sketch.counters);
+    free(policy->heap);
+    free(policy->buffers);
+    pthread_mutex_destroy(&policy->lock);
+}
+
+int policy_insert(policy_t* policy, policy_node_t* node, const char* name) {
+    if (!policy || !node || !name) {
+        errno = EINVAL;
+        return -1;
+    }
+    node->hash = policy_hash(name);
+    node->bucket = NULL;
+
+    LOCK(&policy->lock);
+    int result = policy->ops->insert(policy, node);
+    if (result == 0) node->policy = policy;
+    UNLOCK(&policy->lock);
+    return result;
+}
+
+void policy_touch(policy_node_t* node) {
+    if (!node || !node->policy) return;
+    policy_t* policy = node->policy;
+    // Se gli utilizzi non modificano l'indice, non c'è niente da registrare
+    if (!policy->ops->access) return;
+
+    policy_buffer_t* buffer = buffer_of_thread(policy);
+    unsigned int tail = atomic_fetch_add_explicit(&buffer->tail, 1, memory_order_relaxed);
+    atomic_store_explicit(&buffer->slots[tail % POLICY_BUFFER_SLOTS], node, memory_order_release);
+    // Riempito il buffer, applico gli utilizzi registrati solamente se nessun altro sta aggiornando l'indice
+    if ((tail + 1) % POLICY_BUFFER_SLOTS == 0 && pthread_mutex_trylock(&policy->lock) == 0) {
+        buffers_drain(policy);
+        UNLOCK(&policy->lock);
+    }
+}
+
+void policy_resize(policy_node_t* node, size_t size) {
+    if (!node || !node->policy) return;
+    policy_t* policy = node->policy;
+    // Se la dimensione non modifica l'indice, evito di acquisire il lock
+    if (!policy->ops->resize) return;
+
+    LOCK(&policy->lock);
+    node->size = size;
+    policy->ops->resize(policy, node);
+    UNLOCK(&policy->lock);
+}
+
+void policy_remove(policy_node_t* node, bool evicted) {
+    if (!node || !node->policy) return;
+    policy_t* policy = node->policy;
+
+    LOCK(&policy->lock);
+    // Nessuno registra utilizzi del nodo, di cui viene detenuto il lock in scrittura: applico quelli già registrati
+    buffers_drain(policy);
+    policy->ops->remove(policy, node, evicted);
+    node->policy = NULL;
+    UNLOCK(&policy->lock);
+}
+
+policy_node_t* policy_victim(policy_t* policy, bool (*eligible)(policy_node_t*, void*), void* arg) {
+    if (!policy || !eligible) return NULL;
+
+    LOCK(&policy->lock);
+    buffers_drain(policy);
+    policy_node_t* victim = policy->ops->victim(policy, eligible, arg);
+    UNLOCK(&policy->lock);
+    return victim;
+}
+
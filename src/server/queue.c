@@ -1,49 +1,55 @@
 // @author Luca Cirillo (545480)
 
 #include <errno.h>
-#include <pthread.h>
 #include <queue.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <utils.h>
 
-queue_t* queue_init() {
-    // Alloco memoria per la coda
-    queue_t* queue = malloc(sizeof(queue_t));
-    if (!queue) {
-        //perror("Error: failed to allocate memory for queue");
+// * Buffer circolare MPMC di Dmitry Vyukov:
+//  ogni cella ha un numero di sequenza che i produttori ed i consumatori confrontano con la propria posizione.
+//  Produttori (e consumatori) si contendono la posizione di inserimento (estrazione) con una compare-and-swap,
+//  quindi lavorano sulla cella ottenuta senza alcun lock; la pubblicazione avviene aggiornando la sequenza.
+// Le operazioni non si bloccano mai: l'attesa dei workers inattivi è compito dello scheduler.
+
+queue_t* queue_init(size_t capacity) {
+    // Controllo la validità degli argomenti
+    if (capacity < 2) {
+        errno = EINVAL;
         return NULL;
     }
 
-    // Creo il nodo di testa
-    if (!(queue->head = malloc(sizeof(node_t)))) {
-        free(queue);
+    // Arrotondo la capacità alla potenza di due successiva, così da calcolare l'indice con una maschera
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    // Alloco memoria per la coda, allineata alla linea di cache
+    queue_t* queue = NULL;
+    if (posix_memalign((void**)&queue, CACHE_LINE_SIZE, sizeof(queue_t)) != 0) {
+        //perror("Error: failed to allocate memory for queue");
         return NULL;
     }
 
-    // Inizializzo il nodo di testa
-    queue->head->next = NULL;
-    // Imposto il nodo in coda uguale a quello di testa, la coda è vuota
-    queue->tail = queue->head;
-    // Imposto la lunghezza della coda a zero, attualmente è vuota
-    queue->length = 0;
-
-    // Inizializzo l'accesso mutualmente esclusivo
-    if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
-        //perror("Error: unable to init Queue mutex");
-        free(queue->head);
+    // Alloco il buffer circolare
+    if (posix_memalign((void**)&queue->buffer, CACHE_LINE_SIZE, sizeof(cell_t) * size) != 0) {
         free(queue);
         return NULL;
     }
 
-    // Inizializzo la variabile di condizione 'Coda vuota'
-    if (pthread_cond_init(&queue->empty, NULL) != 0) {
-        //perror("Error: unable to init Queue empty condition variable");
-        pthread_mutex_destroy(&queue->mutex);
-        free(queue->head);
-        free(queue);
-        return NULL;
+    // Inizializzo le celle: la cella i-esima è libera per l'inserimento in posizione i
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->buffer[i].sequence, i);
+        queue->buffer[i].fd_ready = 0;
     }
+    queue->mask = size - 1;
+
+    // La coda è inizialmente vuota
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    atomic_init(&queue->length, 0);
+    atomic_init(&queue->max_length, 0);
 
     // Finalmente, restituisco la coda pronta all'uso
     return queue;
@@ -51,17 +57,7 @@ queue_t* queue_init() {
 
 void queue_destroy(queue_t* queue) {
     if (!queue) return;
-    // Scorro la coda per cancellare tutti i nodi
-    while (queue->head != queue->tail) {
-        node_t* node = (node_t*)queue->head;
-        queue->head = queue->head->next;
-        free(node);
-    }
-    if (queue->head) free(queue->head);
-    // Il compilatore qui consiglia di non controllare mutex ed empty, perché
-    // "address of 'queue->mutex' (lo stesso per queue->empty) will always evaluate to 'true'"
-    pthread_mutex_destroy(&queue->mutex);
-    pthread_cond_destroy(&queue->empty);
+    free(queue->buffer);
     free(queue);
 }
 
@@ -71,53 +67,88 @@ int queue_push(queue_t* queue, int fd_ready) {
         errno = EINVAL;
         return -1;
     }
-    // Creo un nuovo nodo
-    node_t* new_node = malloc(sizeof(node_t));
-    if (!new_node) return -1;
-    // Imposto il suo contenuto
-    new_node->fd_ready = fd_ready;
-    new_node->next = NULL;
-
-    // Accedo alla coda in maniera esclusiva
-    LOCK(&queue->mutex);
-    // Aggiungo il nuovo nodo in coda
-    queue->tail->next = new_node;
-    queue->tail = new_node;
-    queue->length++;
-    // Rilascio l'esclusività sulla coda
-    // e risveglio eventuali consumatori in attesa
-    SIGNAL(&queue->empty);
-    UNLOCK(&queue->mutex);
+
+    cell_t* cell;
+    size_t position = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    while (1) {
+        cell = &queue->buffer[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if (difference == 0) {
+            // La cella è libera, provo a riservarla spostando in avanti la posizione di inserimento
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+            // In caso di fallimento, <position> contiene già la posizione aggiornata
+        } else if (difference < 0) {
+            // La coda è piena
+            errno = EAGAIN;
+            return -1;
+        } else {
+            // Un altro produttore mi ha preceduto, rileggo la posizione
+            position = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    // Scrivo il task nella cella riservata e lo pubblico ai consumatori
+    cell->fd_ready = fd_ready;
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+
+    // Aggiorno la profondità della coda, ed eventualmente il suo massimo
+    size_t length = atomic_fetch_add_explicit(&queue->length, 1, memory_order_relaxed) + 1;
+    size_t max_length = atomic_load_explicit(&queue->max_length, memory_order_relaxed);
+    while (length > max_length &&
+           !atomic_compare_exchange_weak_explicit(&queue->max_length, &max_length, length,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+
     return 0;
 }
 
-int queue_pop(queue_t* queue) {
+int queue_pop(queue_t* queue, int* fd_ready) {
     // Controllo la validità degli argomenti
-    if (!queue) {
+    if (!queue || !fd_ready) {
         errno = EINVAL;
-        return -2;
+        return -1;
     }
 
-    // Accedo alla coda in maniera esclusiva
-    LOCK(&queue->mutex);
-    // Se la coda è vuota, mi metto in attesa
-    while (queue->head == queue->tail) {
-        WAIT(&queue->empty, &queue->mutex);
+    cell_t* cell;
+    size_t position = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    while (1) {
+        cell = &queue->buffer[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+        if (difference == 0) {
+            // La cella contiene un task, provo a riservarla spostando in avanti la posizione di estrazione
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (difference < 0) {
+            // La coda è vuota, oppure la cella non è ancora stata pubblicata dal produttore
+            errno = EAGAIN;
+            return -1;
+        } else {
+            // Un altro consumatore mi ha preceduto, rileggo la posizione
+            position = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
     }
 
-    // * A questo punto ho riacquisito la lock sulla coda
-    // Tuttavia, è buona prassi controllare che sia effettivamente
-    // stato aggiunto un nuovo nodo, altrimenti ritorno
-    if (!queue->head->next) return -2;
+    // Leggo il task e libero la cella per il giro successivo del buffer circolare
+    *fd_ready = cell->fd_ready;
+    atomic_store_explicit(&cell->sequence, position + queue->mask + 1, memory_order_release);
+    atomic_fetch_sub_explicit(&queue->length, 1, memory_order_relaxed);
 
-    // Preparo l'occorrente per estrarre il nodo dalla coda
-    node_t* node = (node_t*)queue->head;
-    int fd_ready = (queue->head->next)->fd_ready;
-    queue->head = queue->head->next;
-    queue->length--;
+    return 0;
+}
 
-    UNLOCK(&queue->mutex);
-    free(node);
+size_t queue_length(queue_t* queue) {
+    if (!queue) return 0;
+    return atomic_load_explicit(&queue->length, memory_order_relaxed);
+}
 
-    return fd_ready;
+size_t queue_max_length(queue_t* queue) {
+    if (!queue) return 0;
+    return atomic_load_explicit(&queue->max_length, memory_order_relaxed);
 }
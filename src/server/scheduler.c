@@ -0,0 +1,245 @@
+// @author Luca Cirillo (545480)
+
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <scheduler.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Ritorna la coda di esecuzione del worker <i>
+#define RUN_QUEUE(scheduler, i) ((run_queue_t*)((scheduler)->slots + (i) * RUN_QUEUE_SIZE))
+
+scheduler_t* scheduler_init(size_t min_workers, size_t workers, long idle_timeout, size_t capacity) {
+    // Controllo la validità degli argomenti
+    if (min_workers == 0 || workers < min_workers) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Alloco memoria per lo scheduler
+    scheduler_t* scheduler = (scheduler_t*)malloc(sizeof(scheduler_t));
+    if (!scheduler) return NULL;
+
+    // Alloco le code di esecuzione, allineate alla linea di cache
+    if (posix_memalign((void**)&scheduler->slots, CACHE_LINE_SIZE, RUN_QUEUE_SIZE * workers) != 0) {
+        free(scheduler);
+        return NULL;
+    }
+    scheduler->workers = workers;
+    scheduler->min_workers = min_workers;
+    scheduler->idle_timeout = idle_timeout;
+    atomic_init(&scheduler->active, min_workers);
+    atomic_init(&scheduler->max_active, min_workers);
+    atomic_init(&scheduler->spawned, 0);
+    atomic_init(&scheduler->retired, 0);
+
+    // Inizializzo una coda per ogni worker, anche per quelli non ancora attivi
+    for (size_t i = 0; i < workers; i++) {
+        run_queue_t* run_queue = RUN_QUEUE(scheduler, i);
+        run_queue->local_hits = 0;
+        run_queue->steals = 0;
+        atomic_init(&run_queue->idle, 0);
+        if ((run_queue->queue = queue_init(capacity)) == NULL) {
+            scheduler->workers = i;
+            scheduler_destroy(scheduler);
+            return NULL;
+        }
+        if (sem_init(&run_queue->wakeup, 0, 0) != 0) {
+            queue_destroy(run_queue->queue);
+            scheduler->workers = i;
+            scheduler_destroy(scheduler);
+            return NULL;
+        }
+    }
+
+    return scheduler;
+}
+
+void scheduler_destroy(scheduler_t* scheduler) {
+    if (!scheduler) return;
+    for (size_t i = 0; i < scheduler->workers; i++) {
+        sem_destroy(&RUN_QUEUE(scheduler, i)->wakeup);
+        queue_destroy(RUN_QUEUE(scheduler, i)->queue);
+    }
+    free(scheduler->slots);
+    free(scheduler);
+}
+
+// Risveglia il worker <i> se inattivo, ritorna true se il worker è stato risvegliato
+// Solamente chi riesce a riportare <idle> da 1 a 0 effettua la sem_post, quindi ogni attesa riceve al più un risveglio
+static bool wake(scheduler_t* scheduler, size_t i) {
+    run_queue_t* run_queue = RUN_QUEUE(scheduler, i);
+    int idle = 1;
+    if (atomic_load(&run_queue->idle) == 0 || !atomic_compare_exchange_strong(&run_queue->idle, &idle, 0)) return false;
+    sem_post(&run_queue->wakeup);
+    return true;
+}
+
+size_t scheduler_owner(scheduler_t* scheduler, int fd) {
+    return (size_t)fd % atomic_load(&scheduler->active);
+}
+
+int scheduler_push(scheduler_t* scheduler, size_t owner, int fd_ready) {
+    // Controllo la validità degli argomenti
+    if (!scheduler || owner >= scheduler->workers) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Provo ad inserire il task nella coda del proprietario, altrimenti nella prima coda con spazio libero
+    size_t i = 0;
+    while (queue_push(RUN_QUEUE(scheduler, (owner + i) % scheduler->workers)->queue, fd_ready) == -1) {
+        // Se tutte le code sono piene, cedo il processore ai workers e ricomincio dal proprietario
+        if (++i == scheduler->workers) {
+            i = 0;
+            sched_yield();
+        }
+    }
+
+    // Risveglio il proprietario, oppure, se è occupato, un altro worker inattivo che possa rubare il task
+    // Se nessun worker è inattivo, il task verrà estratto al termine di quello in corso
+    for (i = 0; i < scheduler->workers; i++) {
+        if (wake(scheduler, (owner + i) % scheduler->workers)) break;
+    }
+
+    return 0;
+}
+
+// Cerca un task nella coda del worker <worker_id>, poi in quelle degli altri workers
+// Anche le code dei workers ritirati vengono controllate, perché potrebbero contenere tasks inseriti prima del ritiro
+// Ritorna 0 ed il task in <fd_ready> se lo trova, -1 altrimenti
+static int find_task(scheduler_t* scheduler, size_t worker_id, int* fd_ready) {
+    run_queue_t* own = RUN_QUEUE(scheduler, worker_id);
+
+    // Prima controllo la mia coda
+    if (queue_pop(own->queue, fd_ready) == 0) {
+        own->local_hits++;
+        return 0;
+    }
+    // Poi provo a rubare dalle code degli altri workers, a partire dal successivo
+    for (size_t i = 1; i < scheduler->workers; i++) {
+        if (queue_pop(RUN_QUEUE(scheduler, (worker_id + i) % scheduler->workers)->queue, fd_ready) == 0) {
+            own->steals++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Attende un risveglio sul semaforo di <own>, al più per <idle_timeout> millisecondi se positivo
+// Ritorna 0 se il worker è stato risvegliato, -1 con errno ETIMEDOUT se il tempo è scaduto
+static int idle_wait(scheduler_t* scheduler, run_queue_t* own) {
+    if (scheduler->idle_timeout <= 0) {
+        while (sem_wait(&own->wakeup) != 0) {
+            if (errno != EINTR) return -1;
+        }
+        return 0;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += scheduler->idle_timeout / 1000;
+    deadline.tv_nsec += (scheduler->idle_timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(&own->wakeup, &deadline) != 0) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+int scheduler_pop(scheduler_t* scheduler, size_t worker_id) {
+    // Controllo la validità degli argomenti
+    if (!scheduler || worker_id >= scheduler->workers) {
+        errno = EINVAL;
+        return -2;
+    }
+
+    run_queue_t* own = RUN_QUEUE(scheduler, worker_id);
+    int fd_ready;
+    while (1) {
+        if (find_task(scheduler, worker_id, &fd_ready) == 0) return fd_ready;
+
+        // * Nessun task disponibile: mi dichiaro inattivo, quindi ricontrollo le code prima di addormentarmi,
+        // *  così che un task inserito nel frattempo non resti in coda senza nessuno che lo estragga
+        atomic_store(&own->idle, 1);
+        if (find_task(scheduler, worker_id, &fd_ready) == 0) {
+            // Se un produttore mi ha già dichiarato attivo, consumo il risveglio che mi ha inviato
+            int idle = 1;
+            if (!atomic_compare_exchange_strong(&own->idle, &idle, 0)) {
+                while (sem_wait(&own->wakeup) != 0 && errno == EINTR);
+            }
+            return fd_ready;
+        }
+
+        // Dormo finché un produttore non mi risveglia, oppure fino allo scadere del tempo di inattività
+        if (idle_wait(scheduler, own) == 0) continue;
+        if (errno != ETIMEDOUT) return -2;
+
+        // * Tempo di inattività scaduto: mi dichiaro attivo, così che nessun produttore possa più risvegliarmi
+        int idle = 1;
+        if (!atomic_compare_exchange_strong(&own->idle, &idle, 0)) {
+            // Un produttore mi ha già risvegliato, consumo il risveglio e cerco il task
+            while (sem_wait(&own->wakeup) != 0 && errno == EINTR);
+            continue;
+        }
+        // Mi ritiro solamente se sono l'ultimo worker attivo, e non si scende sotto il minimo
+        size_t active = worker_id + 1;
+        if (worker_id >= scheduler->min_workers && atomic_compare_exchange_strong(&scheduler->active, &active, worker_id)) {
+            atomic_fetch_add(&scheduler->retired, 1);
+            return -3;
+        }
+    }
+}
+
+long scheduler_grow(scheduler_t* scheduler, size_t depth) {
+    size_t active = atomic_load(&scheduler->active);
+    if (active >= scheduler->workers || scheduler_length(scheduler) < depth) return -1;
+
+    // Solamente il dispatcher aumenta il numero di workers attivi, mentre solo l'ultimo worker può diminuirlo:
+    //  se nel frattempo si è ritirato, ritento con il nuovo valore
+    while (!atomic_compare_exchange_strong(&scheduler->active, &active, active + 1));
+
+    atomic_fetch_add(&scheduler->spawned, 1);
+    if (active + 1 > atomic_load(&scheduler->max_active)) atomic_store(&scheduler->max_active, active + 1);
+    return (long)active;
+}
+
+size_t scheduler_active(scheduler_t* scheduler) {
+    if (!scheduler) return 0;
+    return atomic_load(&scheduler->active);
+}
+
+size_t scheduler_length(scheduler_t* scheduler) {
+    size_t length = 0;
+    if (!scheduler) return 0;
+    for (size_t i = 0; i < scheduler->workers; i++) length += queue_length(RUN_QUEUE(scheduler, i)->queue);
+    return length;
+}
+
+size_t scheduler_local_hits(scheduler_t* scheduler) {
+    size_t local_hits = 0;
+    if (!scheduler) return 0;
+    for (size_t i = 0; i < scheduler->workers; i++) local_hits += RUN_QUEUE(scheduler, i)->local_hits;
+    return local_hits;
+}
+
+size_t scheduler_steals(scheduler_t* scheduler) {
+    size_t steals = 0;
+    if (!scheduler) return 0;
+    for (size_t i = 0; i < scheduler->workers; i++) steals += RUN_QUEUE(scheduler, i)->steals;
+    return steals;
+}
+
+size_t scheduler_max_length(scheduler_t* scheduler) {
+    size_t max_length = 0;
+    if (!scheduler) return 0;
+    for (size_t i = 0; i < scheduler->workers; i++) {
+        size_t length = queue_max_length(RUN_QUEUE(scheduler, i)->queue);
+        if (length > max_length) max_length = length;
+    }
+    return max_length;
+}
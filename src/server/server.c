@@ -1,21 +1,26 @@
 // @author Luca Cirillo (545480)
 
+#include <affinity.h>
 #include <config.h>
+#include <connection.h>
 #include <constants.h>
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
-#include <queue.h>
+#include <scheduler.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <storage.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <uring.h>
 #include <utils.h>
 
 // File di log
@@ -62,16 +67,15 @@ void log_event(const char* level, const char* message, ...) {
 
 sig_atomic_t stop = 0;        // SIGHUP
 sig_atomic_t force_stop = 0;  // SIGINT e SIGQUIT
-static void* signals_handler(void* sigset) {
-    int error;
-    int signal;
-    // Aspetto l'arrivo di un segnale tra SIGINT, SIGQUIT e SIGHUP
-    if ((error = sigwait((sigset_t*)sigset, &signal)) != 0) {
-        log_event("ERROR", "Something wrong happened while waiting for signals: %d", error);
-        exit(error);
+static void signals_handler(int signal_fd) {
+    // Leggo dal signalfd il segnale arrivato tra SIGINT, SIGQUIT e SIGHUP
+    struct signalfd_siginfo siginfo;
+    if (readn((long)signal_fd, (void*)&siginfo, sizeof(siginfo)) <= 0) {
+        log_event("ERROR", "Something wrong happened while reading from signalfd: (%d) ", errno);
+        return;
     }
 
-    switch (signal) {
+    switch (siginfo.ssi_signo) {
         /* 
             ! SIGINT, SIGQUIT: il server termina il prima possibile:
                 non accetta nuove richieste da parte dei client connessi
@@ -102,550 +106,838 @@ static void* signals_handler(void* sigset) {
         default:
             break;
     }
-
-    return NULL;
 }
 
 // Struttura dati per passare più argomenti ai threads worker
 typedef struct worker_args {
-    storage_t* storage;   // Riferimento allo storage in uso
-    queue_t* task_queue;  // Coda dei task che arrivano e vengono smistati dal dispatcher
-    int pipe_output;      // Pipe di comunicazione worker(s) <-> dispatcher
+    storage_t* storage;               // Riferimento allo storage in uso
+    scheduler_t* scheduler;           // Code dei task che arrivano e vengono smistati dal dispatcher
+    size_t worker_id;                 // Indice del worker, ovvero della sua coda di esecuzione
+    io_backend_t io_backend;          // Backend utilizzato per l'invio delle risposte
+    int epoll_fd;                     // Istanza epoll del dispatcher, su cui i workers riabilitano i descrittori serviti
+    int clients_left_fd;              // Eventfd su cui i workers contano i client disconnessi
+    connection_table_t* connections;  // Stato delle connessioni attive, indicizzato per descrittore
+    size_t pipeline_budget;           // Numero massimo di richieste consecutive servite per lo stesso client
+    size_t shared_memory_max;         // Dimensione massima in bytes della memoria condivisa con un client
+    int cpu;                          // CPU su cui vincolare il worker, -1 per usare l'insieme <cpus>
+    const cpu_list_t* cpus;           // CPU su cui il worker può eseguire, NULL per nessun vincolo
 } worker_args_t;
 
-static void* worker(void* args) {
-    // Argomenti passati al thread worker
-    worker_args_t* worker_args = (worker_args_t*)args;
+// Riabilita il descrittore <fd> sull'istanza epoll per gli eventi <events>,
+//  così che il worker che lo riceverà possa riprendere la richiesta da dove è rimasta
+// epoll_ctl è thread-safe: il worker restituisce il descrittore senza passare dal dispatcher
+static void client_rearm(worker_args_t* worker_args, int fd, uint32_t events) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(worker_args->epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        log_event("ERROR", "failed to re-arm client socket: (%d) ", errno);
+    }
+}
 
-    int fd_ready;                         // fd del client servito al momento
-    int api_exit_code = 0;                // Codice di uscita di una API call
-    char* strtok_status;                  // Stato per le chiamate alla syscall strtok_r
-    char request[MESSAGE_LENGTH];         // Messaggio richiesta del client
-    char response[MESSAGE_LENGTH];        // Messaggio risposta del server
-    char pathname[MESSAGE_LENGTH];        // Quasi ogni API call prevede un pathname
-    int thread_id = (int)pthread_self();  // ID del thread worker
+// Restituisce il descrittore di <connection> dopo che il worker ha esaurito il budget di richieste consecutive
+// Se parte della richiesta successiva è già stata ricevuta, il socket potrebbe non avere altri dati
+//  e quindi non generare alcun evento: in questo caso reinserisco direttamente il descrittore in coda
+static void client_yield(worker_args_t* worker_args, connection_t* connection) {
+    if (connection->header_read == 0) {
+        client_rearm(worker_args, connection->fd, EPOLLIN);
+        return;
+    }
+    if (scheduler_push(worker_args->scheduler, scheduler_owner(worker_args->scheduler, connection->fd), connection->fd) == -1) {
+        log_event("ERROR", "failed to push a task: (%d) ", errno);
+    }
+}
+
+// Comunica al dispatcher che il client connesso su <fd> ha chiuso la connessione, quindi chiude il descrittore
+// Il descrittore non viene riabilitato: la close lo rimuove automaticamente dall'istanza epoll
+static void client_left(worker_args_t* worker_args, int fd, int thread_id) {
+    // Incremento il contatore dell'eventfd, che il dispatcher sottrae ai client attivi
+    uint64_t left = 1;
+    if (writen((long)worker_args->clients_left_fd, (void*)&left, sizeof(left)) == -1) {
+        log_event("ERROR", "writen in disconnect failed: (%d) ", errno);
+    }
+    log_event("INFO", "[%d] CLIENT: %d has left", thread_id, fd);
+    connection_close(worker_args->connections, fd);
+}
+
+// Richiesta ricevuta per intero, indipendentemente dal protocollo
+typedef struct Request {
+    int command;                    // Codice della richiesta
+    uint32_t id;                    // Identificativo della richiesta, ripetuto nella risposta (PROTOCOL_BINARY)
+    char pathname[MESSAGE_LENGTH];  // Quasi ogni API call prevede un pathname
+    int argument;                   // Flags di openFile, N di readNFiles
+} request_t;
+
+// Parsa il messaggio di richiesta ricevuto su <connection> in <request>
+// Ritorna -1 se mancano i parametri previsti dal codice della richiesta
+static int request_parse(connection_t* connection, request_t* request) {
+    memset(request, 0, sizeof(request_t));
+
+    // * Protocollo binario: i parametri sono nel frame, seguito dal pathname
+    if (connection->protocol == PROTOCOL_BINARY) {
+        frame_t frame;
+        connection_frame(connection, &frame);
+        request->command = frame.opcode;
+        request->id = frame.request_id;
+        request->argument = frame.opcode == READN || frame.opcode == MULTI ? frame.value : frame.flags;
+        memcpy(request->pathname, connection->header + sizeof(frame_t), frame.path_length);
+        return 0;
+    }
+
+    // * Protocollo testuale
+    // Il formato atteso è: <int:codice_richiesta> <string:parametri>[,<string:parametri>]
+    // Uso lo spazio come delimitatore, su una copia della richiesta che strtok_r modifica durante il parsing
+    char message[MESSAGE_LENGTH + 1];
+    char* strtok_status;
+    memcpy(message, connection->header, sizeof(message));
+
+    // Recupero dalla richiesta il comando che deve essere eseguito
+    char* token = strtok_r(message, " ", &strtok_status);
+    if (!token || sscanf(token, "%d", &request->command) != 1) return -1;
+
+    switch (request->command) {
+        case READN:  // READN <int:n>
+            token = strtok_r(NULL, " ", &strtok_status);
+            return token && sscanf(token, "%d", &request->argument) == 1 ? 0 : -1;
+
+        case DISCONNECT:
+            return 0;
+
+        case MULTI:  // Prevista solamente dal protocollo binario
+            return -1;
+
+        default:  // <str:pathname> [<int:flags>|<int:file_size>]
+            token = strtok_r(NULL, " ", &strtok_status);
+            if (!token || sscanf(token, "%s", request->pathname) != 1) return -1;
+            if (request->command != OPEN) return 0;
+            // openFile prevede anche i flags
+            token = strtok_r(NULL, " ", &strtok_status);
+            return token && sscanf(token, "%d", &request->argument) == 1 ? 0 : -1;
+    }
+}
+
+// Accoda la risposta con l'esito <value> alla richiesta <request>
+static int reply_value(connection_t* connection, const request_t* request, int value) {
+    if (connection->protocol != PROTOCOL_BINARY) return connection_send_message(connection, "%d", value);
+    frame_t frame = {.opcode = (uint8_t)request->command, .request_id = request->id, .value = value};
+    return connection_send_frame(connection, &frame, NULL);
+}
+
+// Copia <size> bytes di <contents> nella memoria condivisa con il client, se presente e con abbastanza spazio
+// Ritorna FRAME_SHARED se il contenuto non deve più essere inviato sul socket, 0 altrimenti
+static uint8_t reply_shared(connection_t* connection, const void* contents, size_t size) {
+    if (size == 0) return 0;
+    void* region = connection_shared_reserve(connection, size);
+    if (!region) return 0;
+    memcpy(region, contents, size);
+    return FRAME_SHARED;
+}
+
+// Accoda la risposta con l'esito <value> alla richiesta <request>, seguita dai primi <size> bytes di <contents>
+// Il riferimento al contenuto viene rilasciato una volta inviato al client
+static int reply_contents(connection_t* connection, const request_t* request, int value, storage_blob_t* contents, size_t size) {
+    int result;
+    if (connection->protocol != PROTOCOL_BINARY) {
+        result = connection_send_message(connection, "%d %zu", value, size);
+    } else {
+        frame_t frame = {.opcode = (uint8_t)request->command, .request_id = request->id, .payload_length = size, .value = value};
+        if (contents) frame.flags = reply_shared(connection, contents->data, size);
+        result = connection_send_frame(connection, &frame, NULL);
+        // Il contenuto è già nella memoria condivisa
+        if (frame.flags & FRAME_SHARED) {
+            storage_blob_release(contents);
+            return result;
+        }
+    }
+    if (result == -1 || !contents) {
+        storage_blob_release(contents);
+        return result;
+    }
+    return connection_send_data(connection, contents->data, size, storage_blob_release, contents);
+}
+
+// Accoda il nome e la dimensione del file <file>, seguiti dal suo contenuto
+// La copia del file, che condivide il contenuto con lo storage, viene liberata una volta inviata al client
+static int reply_file(connection_t* connection, const request_t* request, storage_file_t* file) {
+    int result;
+    if (connection->protocol != PROTOCOL_BINARY) {
+        result = connection_send_message(connection, "%s %zu", file->name, file->size);
+    } else {
+        frame_t frame = {.opcode = (uint8_t)request->command,
+                         .flags = FRAME_FILE,
+                         .path_length = (uint16_t)strlen(file->name),
+                         .request_id = request->id,
+                         .payload_length = file->size};
+        if (file->contents) frame.flags |= reply_shared(connection, file->contents->data, file->size);
+        result = connection_send_frame(connection, &frame, file->name);
+        // Il contenuto è già nella memoria condivisa
+        if (frame.flags & FRAME_SHARED) {
+            storage_file_destroy(file);
+            return result;
+        }
+    }
+    if (result == -1) {
+        storage_file_destroy(file);
+        return -1;
+    }
+    return connection_send_data(connection, file->contents ? file->contents->data : NULL, file->size, storage_file_destroy, file);
+}
+
+// Accoda alla risposta il numero di file espulsi <victims_no> e, per ognuno, il nome, la dimensione ed il contenuto
+// I file espulsi vengono liberati una volta inviati al client, l'array <victims> subito
+static void send_victims(connection_t* connection, const request_t* request, int victims_no, storage_file_t** victims, const char* operation, int thread_id) {
+    if (reply_value(connection, request, victims_no) == -1) {
+        log_event("ERROR", "failed to queue %s response: (%d) ", operation, errno);
+    }
+
+    if (victims_no > 0) log_event("INFO", "[%d] REPLACEMENT: %d", thread_id, victims_no);
+    for (int i = 0; i < victims_no; i++) {
+        //printf("Sending n.%d: %s %zu\n", i+1, victims[i]->name, victims[i]->size);
+        // Loggo prima di accodare il file, che potrebbe essere liberato subito in caso di errore
+        log_event("INFO", "[%d] VICTIM: %s %zu bytes => O", thread_id, victims[i]->name, victims[i]->size);
+        if (reply_file(connection, request, victims[i]) == -1) {
+            log_event("ERROR", "failed to queue %s response: (%d) ", operation, errno);
+        }
+    }
+
+    if (victims) free(victims);
+}
 
-    // openFile
+// Determina la dimensione <size> del contenuto che segue la richiesta <command> ricevuta su <connection>
+// <shared> indica se il client ha scritto il contenuto nella memoria condivisa invece che sul socket
+// Ritorna 1 se la richiesta prevede l'invio di un file (writeFile, appendToFile) o di operazioni (MULTI), 0 altrimenti,
+//  oppure -1 se la dimensione dichiarata non è valida: il contenuto non può essere né ricevuto né scartato,
+//  e la connessione va chiusa
+static int request_body_size(connection_t* connection, int* command, bool* shared, size_t* size) {
+    *shared = false;
+    if (connection->protocol == PROTOCOL_BINARY) {
+        frame_t frame;
+        connection_frame(connection, &frame);
+        *command = frame.opcode;
+        *shared = (frame.flags & FRAME_SHARED) != 0;
+        if (*command != WRITE && *command != APPEND && *command != MULTI) return 0;
+        if (frame.payload_length > LONG_MAX) return -1;
+        *size = (size_t)frame.payload_length;
+        return 1;
+    }
+    // Nel protocollo testuale la dimensione è il terzo campo del messaggio; una richiesta malformata non ha contenuto,
+    //  e viene rifiutata durante l'esecuzione
+    long length;
+    if (sscanf(connection->header, "%d %*s %ld", command, &length) != 2 || (*command != WRITE && *command != APPEND)) return 0;
+    if (length < 0 || length == LONG_MAX) return -1;
+    *size = (size_t)length;
+    return 1;
+}
+
+// Scrittura (writeFile, appendToFile) il cui contenuto viene ricevuto direttamente nello storage
+typedef struct Ingest {
+    storage_t* storage;         // Storage in cui è in corso la scrittura
+    storage_write_t write;      // Destinazione del contenuto, riservata da storage_write_begin
+    size_t size;                // Dimensione del contenuto
+    int result;                 // Esito di storage_write_begin: se -1, il contenuto viene scartato
+    int error;                  // Valore di errno in caso di esito negativo
+    int victims_no;             // Numero di file espulsi per fare spazio al contenuto
+    storage_file_t** victims;   // File espulsi, da inviare al client
+} ingest_t;
+
+// Inizia la scrittura di <size> bytes nel file <pathname> da parte di <client>, prima di riceverne il contenuto
+// Ritorna NULL solamente in caso di errore di allocazione: una scrittura non consentita viene comunque
+//  rappresentata, così che il suo esito possa essere inviato al client
+static ingest_t* ingest_begin(storage_t* storage, int command, const char* pathname, size_t size, int client) {
+    ingest_t* ingest = (ingest_t*)calloc(1, sizeof(ingest_t));
+    if (!ingest) return NULL;
+    ingest->storage = storage;
+    ingest->size = size;
+    ingest->result = storage_write_begin(storage, pathname, size, command == APPEND, &ingest->victims_no, &ingest->victims, &ingest->write, client);
+    ingest->error = errno;
+    return ingest;
+}
+
+// Completa la scrittura <ingest>, il cui contenuto è stato ricevuto per intero
+static int ingest_commit(ingest_t* ingest) {
+    if (!ingest) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (ingest->result == -1) {
+        errno = ingest->error;
+        return -1;
+    }
+    return storage_write_commit(ingest->storage, &ingest->write);
+}
+
+// Libera <ingest>, annullando la scrittura se non è stata completata
+static void ingest_destroy(void* ingest) {
+    ingest_t* i = (ingest_t*)ingest;
+    storage_write_abort(i->storage, &i->write);
+    for (int j = 0; j < i->victims_no; j++) storage_file_destroy(i->victims[j]);
+    if (i->victims) free(i->victims);
+    free(i);
+}
+
+// Prepara la ricezione del contenuto della scrittura <command> di <size> bytes richiesta su <connection>
+// Permessi e spazio vengono controllati prima di ricevere il contenuto, che viene scritto direttamente
+//  nella sua posizione finale, oppure scartato se la scrittura non è consentita
+static int ingest_prepare(worker_args_t* worker_args, connection_t* connection, int command, size_t size, bool shared) {
+    request_t request;
+    ingest_t* ingest = NULL;
+    // Una richiesta malformata viene rifiutata durante l'esecuzione, dopo averne scartato il contenuto
+    if (request_parse(connection, &request) == 0) {
+        if (!(ingest = ingest_begin(worker_args->storage, command, request.pathname, size, connection->fd))) return -1;
+        connection->pending = ingest;
+        connection->pending_release = ingest_destroy;
+    }
+    return connection_expect_body_into(connection, ingest && ingest->result == 0 ? ingest->write.destination : NULL, size, shared);
+}
+
+// Risponde al frame FRAME_HELLO ricevuto su <connection>, con la versione più alta supportata da entrambi
+// Se il client ha offerto una memoria condivisa, la accetta quando la dimensione rientra in <shared_memory_max>
+static void negotiate(connection_t* connection, size_t shared_memory_max, int thread_id) {
+    frame_t frame;
+    connection_frame(connection, &frame);
+    int version = frame.value >= PROTOCOL_BINARY ? PROTOCOL_BINARY : PROTOCOL_LEGACY;
+
+    // La memoria condivisa trasporta solamente i contenuti dei frames
+    bool shared = false;
+    if (version == PROTOCOL_BINARY && (frame.flags & FRAME_SHARED)) {
+        if (connection_attach_shared(connection, (size_t)frame.payload_length, shared_memory_max) == 0)
+            shared = true;
+        else
+            log_event("WARN", "[%d] CLIENT: %d shared memory refused: (%d) ", thread_id, connection->fd, errno);
+    }
+
+    // La risposta è sempre un frame, dato che il client l'ha richiesta con un frame
+    memset(&frame, 0, sizeof(frame));
+    frame.opcode = FRAME_HELLO;
+    frame.flags = shared ? FRAME_SHARED : 0;
+    frame.value = version;
+    if (connection_send_frame(connection, &frame, NULL) == -1) {
+        log_event("ERROR", "failed to queue hello response: (%d) ", errno);
+    }
+    connection->protocol = version;
+    log_event("INFO", "[%d] CLIENT: %d negotiated protocol v%d%s", thread_id, connection->fd, version, shared ? " with shared memory" : "");
+}
+
+// Esegue la richiesta <request>, accodando la risposta da inviare al client
+// <ingest> è la scrittura il cui contenuto è stato ricevuto insieme alla richiesta (writeFile, appendToFile),
+//  oppure NULL; in ogni caso viene liberata
+// Ritorna false se il client ha chiuso la connessione
+static bool perform(worker_args_t* worker_args, connection_t* connection, const request_t* request, ingest_t* ingest, int thread_id) {
+    int fd_ready = connection->fd;  // fd del client servito al momento
+    int api_exit_code = 0;          // Codice di uscita di una API call
+    const char* pathname = request->pathname;
+
+    // openFile, readNFiles
     int flags = 0;
+    int N = 0;
     // writeFile
     size_t old_size = 0;
     // readFile, writeFile, appendToFile, removeFile
     size_t file_size = 0;
-    void* contents = NULL;
+    storage_blob_t* contents = NULL;
     // readNFiles
-    int N = 0;
     storage_file_t** files_read = NULL;
     // Algoritmo di rimpiazzo
     int victims_no = 0;
     storage_file_t** victims = NULL;
 
-    // ! MAIN WORKER LOOP
-    while (1) {  // Esco dal while quando viene inserito un coda il valore WORKER_EXIT
-        // Recupero un file descriptor pronto dalla queue
-        fd_ready = queue_pop(worker_args->task_queue);
+    // * Eseguo le operazioni relative al comando ricevuto
+    // Le risposte vengono accodate sulla connessione, ed inviate al client non appena il socket lo consente
+    switch (request->command) {
+        case OPEN:  // ! openFile: OPEN <str:pathname> <int:flags>
+            flags = request->argument;
 
-        // Controllo che la pop non abbia ritornato un codice di errore (-2)
-        if (fd_ready == -2) {
-            log_event("ERROR", "failed to pop an element from task queue: (%d) ", errno);
-            break;
-        }
+            //printf("OPEN: %s %d\n", pathname, flags);
 
-        // Controllo che non sia un segnale di terminazine dal dispatcher (-1)
-        if (fd_ready == -1) break;
-
-        // Controllo che in coda non sia finito un qualsiasi altro valore negativo
-        if (fd_ready < 0) {
-            log_event("ERROR", "negative file descriptor in task queue: %d", fd_ready);
-            continue;
-        }
+            victims_no = 0;
+            victims = NULL;
+            // Eseguo la API call
+            api_exit_code = storage_open_file(worker_args->storage, pathname, flags, &victims_no, &victims, fd_ready);
 
-        // A questo punto sono sicuro di avere un fd valido
-        // Pulisco tracce di eventuali richieste precedenti
-        memset(request, 0, MESSAGE_LENGTH);
-        // Leggo il contenuto della richiesta del client
-        if (readn((long)fd_ready, (void*)request, MESSAGE_LENGTH) == -1) {
-            log_event("ERROR", "readn failed to read client request: (%d) ", errno);
-            continue;
-        }
+            // Invio al client eventuali file espulsi
+            send_victims(connection, request, victims_no, victims, "open", thread_id);
 
-        // * Faccio il parsing della richiesta
-        // Il formato atteso è: <int:codice_richiesta> <string:parametri>[,<string:parametri>]
-        // Uso lo spazio come delimitatore
-        char* token = strtok_r(request, " ", &strtok_status);
-        // Se scopro essere una stringa vuota, non vado oltre
-        if (!token) continue;
-        // Recupero dalla richiesta il comando che deve essere eseguito
-        int command;
-        if (sscanf(token, "%d", &command) != 1) {
-            log_event("ERROR", "invalid command in request: %s", request);
-            continue;
-        }
+            // Preparo la risposta
+            if (reply_value(connection, request, api_exit_code) == -1) {
+                log_event("ERROR", "failed to queue open response: (%d) ", errno);
+                break;
+            }
 
-        // * Eseguo le operazioni relative al comando ricevuto
-        switch (command) {
-            case OPEN:  // ! openFile: OPEN <str:pathname> <int:flags>
-                // Parso il pathname dalla richiesta
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad open request: (%d) ", errno);
-                    break;
-                }
-                // Parso i flags dalla richiesta
-                flags = 0;
-                token = strtok_r(NULL, " ", &strtok_status);
-                if (!token || sscanf(token, "%d", &flags) != 1) {
-                    log_event("ERROR", "bad open request: (%d) ", errno);
-                    break;
-                }
+            log_event("INFO", "[%d] OPEN: %s %d => %c", thread_id, pathname, flags, api_exit_code == 0 ? 'O' : 'X');
+            break;
 
-                //printf("OPEN: %s %d\n", pathname, flags);
+        case READ:  // ! readFile: READ <str:pathname>
+            //printf("READ: %s\n", pathname);
 
-                victims_no = 0;
-                victims = NULL;
-                // Eseguo la API call
-                api_exit_code = storage_open_file(worker_args->storage, pathname, flags, &victims_no, &victims, fd_ready);
+            // Eseguo la API call
+            contents = NULL;
+            file_size = 0;
+            api_exit_code = storage_read_file(worker_args->storage, pathname, &contents, &file_size, fd_ready);
 
-                // Invio al client eventuali file espulsi
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", victims_no);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in open failed: (%d) ", errno);
-                    break;
-                }
+            int code = 1;
+            if (api_exit_code == -1) {
+                if (errno == ENOENT)
+                    code = 0;
+                else if (errno == EPERM)
+                    code = -1;
+            }
 
-                if (victims_no > 0) {
-                    log_event("INFO", "[%d] REPLACEMENT: %d", thread_id, victims_no);
-                    // Invio al client i file espulsi
-                    for (int i = 0; i < victims_no; i++) {
-                        //printf("Sending n.%d: %s %zu\n", i+1, victims[i]->name, victims[i]->size);
-                        // Invio al client il nome e la dimensione del file
-                        memset(response, 0, MESSAGE_LENGTH);
-                        snprintf(response, MESSAGE_LENGTH, "%s %zu", victims[i]->name, victims[i]->size);
-                        if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                            log_event("ERROR", "writen in open failed: (%d) ", errno);
-                            break;
-                        }
-
-                        // Invio al client il contenuto del file
-                        if (writen((long)fd_ready, victims[i]->contents, victims[i]->size) == -1) {
-                            log_event("ERROR", "writen in open failed: (%d) ", errno);
-                            break;
-                        }
-
-                        log_event("INFO", "[%d] VICTIM: %s %zu bytes => O", thread_id, victims[i]->name, victims[i]->size);
-
-                        // Libero la memoria dal file appena inviato
-                        storage_file_destroy((void*)victims[i]);
-                    }
-                }
+            // Invio al client il codice di ritorno e, eventualmente, la dimensione del file
+            // Il riferimento al contenuto letto viene rilasciato una volta inviato al client
+            if (reply_contents(connection, request, code, contents, code == 1 ? file_size : 0) == -1) {
+                log_event("ERROR", "failed to queue read response: (%d) ", errno);
+                break;
+            }
+            if (api_exit_code == -1) break;
 
-                // Preparo il buffer per la risposta
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in open failed: (%d) ", errno);
-                    break;
-                }
+            log_event("INFO", "[%d] READ: %s %zu bytes => %c", thread_id, pathname, file_size, api_exit_code == 0 ? 'O' : 'X');
+            break;
 
-                log_event("INFO", "[%d] OPEN: %s %d => %c", thread_id, pathname, flags, api_exit_code == 0 ? 'O' : 'X');
-                break;
+        case READN:  // ! readNFiles: READN <int:n>
+            N = request->argument;
 
-            case READ:  // ! readFile: READ <str:pathname>
-                // Parso il pathname dalla richiesta
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad read request: (%d) ", errno);
-                    break;
-                }
+            //printf("READN: %d\n", N);
 
-                //printf("READ: %s\n", pathname);
+            files_read = NULL;
+            // Il codice di uscita di storage_read_n_files indica
+            //  quanti file sono stati effettivamente letti (-1 indica errore)
+            api_exit_code = storage_read_n_files(worker_args->storage, N, &files_read, fd_ready);
 
-                // Eseguo la API call
-                contents = NULL;
-                file_size = 0;
-                api_exit_code = storage_read_file(worker_args->storage, pathname, &contents, &file_size, fd_ready);
+            // Invio al client il numero di files letti
+            if (reply_value(connection, request, api_exit_code) == -1) {
+                log_event("ERROR", "failed to queue readn response: (%d) ", errno);
+            }
 
-                int code = 1;
-                if (api_exit_code == -1) {
-                    if (errno == ENOENT)
-                        code = 0;
-                    else if (errno == EPERM)
-                        code = -1;
-                }
+            // Se presenti, invio al client i files letti
+            for (int i = 0; i < api_exit_code; i++) {
+                //printf("Sending n.%d: %s %zu\n", i + 1, files_read[i]->name, files_read[i]->size);
 
-                // Invio al client il codice di ritorno e, eventualmente, la dimensione del file
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d %zu", code, code == 1 ? file_size : 0);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in read failed: (%d) ", errno);
-                    break;
+                // Invio al client il nome e la dimensione del file, quindi il suo contenuto
+                log_event("INFO", "[%d] READN: %d %s %zu bytes => O", thread_id, i + 1, files_read[i]->name, files_read[i]->size);
+                if (reply_file(connection, request, files_read[i]) == -1) {
+                    log_event("ERROR", "failed to queue readn response: (%d) ", errno);
                 }
+            }
 
-                if (api_exit_code == -1) break;
-                if (writen((long)fd_ready, contents, file_size) == -1) {
-                    log_event("ERROR", "writen in read failed: (%d) ", errno);
-                    break;
-                }
+            if (files_read) free(files_read);
 
-                // Libero la memoria occupata per leggere il file
-                free(contents);
+            log_event("INFO", "[%d] READN: %d => %c", thread_id, N, api_exit_code >= 0 ? 'O' : 'X');
+            break;
 
-                log_event("INFO", "[%d] READ: %s %zu bytes => %c", thread_id, pathname, file_size, api_exit_code == 0 ? 'O' : 'X');
-                break;
+        case WRITE:  // ! writeFile: WRITE <str:pathname> <int:file_size>
+        case APPEND:  // ! appendToFile: APPEND <str:pathname> <int:size>
+            // Il contenuto è già stato ricevuto per intero direttamente nello storage, che ha riservato lo spazio
+            //  ed espulso eventuali file prima della ricezione: resta da renderlo visibile
+            file_size = ingest ? ingest->size : 0;
+            old_size = ingest ? ingest->write.old_size : 0;  // Utilizzata per loggare la dimensione del file eventualmente sovrascritto
 
-            case READN:  // ! readNFiles: READN <int:n>
-                // Parso il numero di files dalla richiesta
-                token = strtok_r(NULL, " ", &strtok_status);
-                if (!token || sscanf(token, "%d", &N) != 1) {
-                    log_event("ERROR", "bad readn request: (%d) ", errno);
-                    break;
-                }
+            //printf("%s: %s %zu\n", request->command == WRITE ? "WRITE" : "APPEND", pathname, file_size);
 
-                //printf("READN: %d\n", N);
+            api_exit_code = ingest_commit(ingest);
 
-                files_read = NULL;
-                // Il codice di uscita di storage_read_n_files indica
-                //  quanti file sono stati effettivamente letti (-1 indica errore)
-                api_exit_code = storage_read_n_files(worker_args->storage, N, &files_read, fd_ready);
+            // Invio al client eventuali file espulsi, che passano in carico alla risposta
+            victims_no = ingest ? ingest->victims_no : 0;
+            victims = ingest ? ingest->victims : NULL;
+            if (ingest) {
+                ingest->victims_no = 0;
+                ingest->victims = NULL;
+            }
+            send_victims(connection, request, victims_no, victims, request->command == WRITE ? "write" : "append", thread_id);
 
-                // Invio al client il numero di files letti
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in readn failed: (%d) ", errno);
+            if (request->command == APPEND) {
+                // Preparo la risposta
+                if (reply_value(connection, request, api_exit_code) == -1) {
+                    log_event("ERROR", "failed to queue append response: (%d) ", errno);
                     break;
                 }
 
-                // Se presenti, invio al client i files letti
-                if (api_exit_code > 0) {
-                    for (int i = 0; i < api_exit_code; i++) {
-                        //printf("Sending n.%d: %s %zu\n", i + 1, files_read[i]->name, files_read[i]->size);
-
-                        // Invio al client il nome e la dimensione del file
-                        memset(response, 0, MESSAGE_LENGTH);
-                        snprintf(response, MESSAGE_LENGTH, "%s %zu", files_read[i]->name, files_read[i]->size);
-                        if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                            log_event("ERROR", "writen in readn failed: (%d) ", errno);
-                            break;
-                        }
-
-                        // Invio al client il contenuto del file
-                        if (writen((long)fd_ready, files_read[i]->contents, files_read[i]->size) == -1) {
-                            log_event("ERROR", "writen in readn failed: (%d) ", errno);
-                            break;
-                        }
-
-                        log_event("INFO", "[%d] READN: %d %s %zu bytes => O", thread_id, i + 1, files_read[i]->name, files_read[i]->size);
-
-                        // Libero la memoria dal file appena inviato
-                        storage_file_destroy((void*)files_read[i]);
-                    }
-                }
-
-                if (files_read) free(files_read);
-
-                log_event("INFO", "[%d] READN: %d => %c", thread_id, N, api_exit_code >= 0 ? 'O' : 'X');
+                log_event("INFO", "[%d] APPEND: %s %zu bytes => %c", thread_id, pathname, file_size, api_exit_code == 0 ? 'O' : 'X');
                 break;
+            }
 
-            case WRITE:  // ! writeFile: WRITE <str:pathname> <int:file_size>
-                // Parso il pathname del file
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad write request: (%d) ", errno);
-                    break;
-                }
+            // Preparo la risposta
+            if (reply_value(connection, request, api_exit_code) == -1) {
+                log_event("ERROR", "failed to queue write response: (%d) ", errno);
+                break;
+            }
 
-                // Parso la dimensione del file
-                file_size = 0;
-                token = strtok_r(NULL, " ", &strtok_status);
-                if (!token || sscanf(token, "%zu", &file_size) != 1) {
-                    log_event("ERROR", "bad write request: (%d) ", errno);
-                    break;
-                }
+            log_event("INFO", "[%d] WRITE: %s %zu bytes (overwritten %zu bytes) => %c", thread_id, pathname, file_size, old_size, api_exit_code == 0 ? 'O' : 'X');
+            break;
 
-                //printf("WRITE: %s %zu\n", pathname, file_size);
+        case LOCK:  // ! lockFile: LOCK <str:pathname>
+            //printf("LOCK %s\n", pathname);
 
-                // Conosco la dimensione del file, posso allocare lo spazio necessario
-                contents = malloc(file_size);  // Liberare questa memoria è compito di storage_file_destroy
-                if (!contents) {
-                    log_event("ERROR", "failed to allocate memory for contents in write: (%d) ", errno);
-                    break;
-                }
-                memset(contents, 0, file_size);
-                // Ricevo dal client il contenuto del file
-                if (readn((long)fd_ready, contents, file_size) == -1) {
-                    log_event("ERROR", "readn in write failed: (%d) ", errno);
-                    free(contents);
-                    break;
-                }
+            // Eseguo la API call
+            api_exit_code = storage_lock_file(worker_args->storage, pathname, fd_ready);
 
-                // Scrivo il contenuto del file all'intero dello storage
-                old_size = 0;  // Utilizzata per loggare la dimensione del file eventualmente sovrascritto
-                victims_no = 0;
-                victims = NULL;
-                api_exit_code = storage_write_file(worker_args->storage, pathname, contents, file_size, &victims_no, &victims, &old_size, fd_ready);
-
-                // Invio al client eventuali file espulsi
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", victims_no);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in write failed: (%d) ", errno);
-                    if (victims) free(victims);
-                    break;
-                }
+            // Preparo la risposta
+            if (reply_value(connection, request, api_exit_code) == -1) {
+                log_event("ERROR", "failed to queue lock response: (%d) ", errno);
+                break;
+            }
 
-                if (victims_no > 0) {
-                    log_event("INFO", "[%d] REPLACEMENT: %d", thread_id, victims_no);
-                    // Invio al client i file espulsi
-                    for (int i = 0; i < victims_no; i++) {
-                        //printf("Sending n.%d: %s %zu\n", i+1, victims[i]->name, victims[i]->size);
-                        // Invio al client il nome e la dimensione del file
-                        memset(response, 0, MESSAGE_LENGTH);
-                        snprintf(response, MESSAGE_LENGTH, "%s %zu", victims[i]->name, victims[i]->size);
-                        if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                            log_event("ERROR", "writen in write failed: (%d) ", errno);
-                            break;
-                        }
-
-                        // Invio al client il contenuto del file
-                        if (writen((long)fd_ready, victims[i]->contents, victims[i]->size) == -1) {
-                            log_event("ERROR", "writen in write failed: (%d) ", errno);
-                            break;
-                        }
-
-                        log_event("INFO", "[%d] VICTIM: %s %zu bytes => O", thread_id, victims[i]->name, victims[i]->size);
-
-                        // Libero la memoria dal file appena inviato
-                        storage_file_destroy((void*)victims[i]);
-                    }
-                }
+            log_event("INFO", "[%d] LOCK: %s => %c", thread_id, pathname, api_exit_code == 0 ? 'O' : 'X');
+            break;
 
-                if (victims) free(victims);
+        case UNLOCK:  // ! unlockFile: UNLOCK <str:pathname>
+            //printf("UNLOCK %s\n", pathname);
 
-                // Preparo il buffer per la risposta
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in write failed: (%d) ", errno);
-                    break;
-                }
+            // Eseguo la API call
+            api_exit_code = storage_unlock_file(worker_args->storage, pathname, fd_ready);
 
-                log_event("INFO", "[%d] WRITE: %s %zu bytes (overwritten %zu bytes) => %c", thread_id, pathname, file_size, old_size, api_exit_code == 0 ? 'O' : 'X');
+            // Preparo la risposta
+            if (reply_value(connection, request, api_exit_code) == -1) {
+                log_event("ERROR", "failed to queue unlock response: (%d) ", errno);
                 break;
+            }
 
-            case APPEND:  // ! appendToFile: APPEND <str:pathname> <int:size>
-                // Parso il pathname del file
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad append request: (%d) ", errno);
-                    break;
-                }
+            log_event("INFO", "[%d] UNLOCK: %s => %c", thread_id, pathname, api_exit_code == 0 ? 'O' : 'X');
+            break;
 
-                // Parso la dimensione del file
-                file_size = 0;
-                token = strtok_r(NULL, " ", &strtok_status);
-                if (!token || sscanf(token, "%zu", &file_size) != 1) {
-                    log_event("ERROR", "bad append request: (%d) ", errno);
-                    break;
-                }
+        case CLOSE:  // ! closeFile: CLOSE <str:pathname>
+            //printf("CLOSE: %s\n", pathname);
 
-                //printf("APPEND: %s %zu\n", pathname, file_size);
+            // Eseguo la API call
+            api_exit_code = storage_close_file(worker_args->storage, pathname, fd_ready);
+            // Preparo la risposta
+            if (reply_value(connection, request, api_exit_code) == -1) {
+                log_event("ERROR", "failed to queue close response: (%d) ", errno);
+                break;
+            }
 
-                // Conosco la dimensione del file, posso allocare lo spazio necessario
-                contents = malloc(file_size);  // Questa memoria viene liberata poco più in basso dal server
-                if (!contents) {
-                    log_event("ERROR", "failed to allocate memory for contents in append: (%d) ", errno);
-                    break;
-                }
-                memset(contents, 0, file_size);
-                // Ricevo dal client il contenuto del file
-                if (readn((long)fd_ready, contents, file_size) == -1) {
-                    log_event("ERROR", "readn in append failed: (%d) ", errno);
-                    free(contents);
-                    break;
-                }
+            log_event("INFO", "[%d] CLOSE: %s => %c", thread_id, pathname, api_exit_code == 0 ? 'O' : 'X');
+            break;
 
-                // Scrivo il contenuto del file all'intero dello storage
-                victims_no = 0;
-                victims = NULL;
-                api_exit_code = storage_append_to_file(worker_args->storage, pathname, contents, file_size, &victims_no, &victims, fd_ready);
+        case REMOVE:  // ! removeFile: REMOVE <str:pathname>
+            //printf("REMOVE: %s\n", pathname);
+            file_size = 0;
+            // Eseguo la API call
+            api_exit_code = storage_remove_file(worker_args->storage, pathname, &file_size, fd_ready);
+            // Preparo la risposta
+            if (reply_value(connection, request, api_exit_code) == -1) {
+                log_event("ERROR", "failed to queue remove response: (%d) ", errno);
+                break;
+            }
 
-                // Libero la memoria
-                free(contents);
+            log_event("INFO", "[%d] REMOVE: %s %zu bytes => %c", thread_id, pathname, file_size, api_exit_code == 0 ? 'O' : 'X');
+            break;
 
-                // Invio al client eventuali file espulsi
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", victims_no);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in append failed: (%d) ", errno);
-                    break;
-                }
+        case DISCONNECT:  // ! closeConnection
+            // Un client ha richiesto la chiusura della connessione
+            // Lo comunico al thread dispatcher tramite l'eventfd, e non riabilito il descrittore
+            if (ingest) ingest_destroy(ingest);
+            client_left(worker_args, fd_ready, thread_id);
+            return false;
 
-                if (victims_no > 0) {
-                    log_event("INFO", "[%d] REPLACEMENT: %d", thread_id, victims_no);
-                    // Invio al client i file espulsi
-                    for (int i = 0; i < victims_no; i++) {
-                        //printf("Sending n.%d: %s %zu\n", i+1, victims[i]->name, victims[i]->size);
-                        // Invio al client il nome e la dimensione del file
-                        memset(response, 0, MESSAGE_LENGTH);
-                        snprintf(response, MESSAGE_LENGTH, "%s %zu", victims[i]->name, victims[i]->size);
-                        if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                            log_event("ERROR", "writen in append failed: (%d) ", errno);
-                            break;
-                        }
-
-                        // Invio al client il contenuto del file
-                        if (writen((long)fd_ready, victims[i]->contents, victims[i]->size) == -1) {
-                            log_event("ERROR", "writen in append failed: (%d) ", errno);
-                            break;
-                        }
-
-                        log_event("INFO", "[%d] VICTIM: %s %zu bytes => O", thread_id, victims[i]->name, victims[i]->size);
-
-                        // Libero la memoria dal file appena inviato
-                        storage_file_destroy((void*)victims[i]);
-                    }
-                }
+        default:
+            log_event("INFO", "[%d] CLIENT: %d sent an unknown command: %d", thread_id, fd_ready, request->command);
+            break;
+    }
 
-                // Preparo il buffer per la risposta
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in append failed: (%d) ", errno);
-                    break;
-                }
+    // Annullo la scrittura, se la richiesta non l'ha completata
+    if (ingest) ingest_destroy(ingest);
+    return true;
+}
 
-                log_event("INFO", "[%d] APPEND: %s %zu bytes => %c", thread_id, pathname, file_size, api_exit_code == 0 ? 'O' : 'X');
+// Controlla che <size> bytes di <body> contengano esattamente <count> operazioni di una richiesta MULTI
+// Ritorna il numero di operazioni, oppure -1 se il contenuto non è valido
+static int batch_validate(const char* body, size_t size, int count) {
+    if (count <= 0) return -1;
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        frame_t operation;
+        if (size - offset < sizeof(frame_t)) return -1;
+        memcpy(&operation, body + offset, sizeof(frame_t));
+        offset += sizeof(frame_t);
+
+        // Sono ammesse solamente le operazioni su un singolo file, e solo le scritture hanno un contenuto
+        switch (operation.opcode) {
+            case WRITE:
+            case APPEND:
+                break;
+            case OPEN:
+            case READ:
+            case LOCK:
+            case UNLOCK:
+            case CLOSE:
+            case REMOVE:
+                if (operation.payload_length > 0) return -1;
                 break;
+            default:
+                return -1;
+        }
+        if (operation.path_length == 0 || operation.path_length >= MESSAGE_LENGTH) return -1;
+        if (size - offset < operation.path_length || size - offset - operation.path_length < operation.payload_length) return -1;
+        offset += operation.path_length + (size_t)operation.payload_length;
+    }
+    return offset == size ? count : -1;
+}
 
-            case LOCK:  // ! lockFile: LOCK <str:pathname>
-                // Parso il pathname del file
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad lock request: (%d) ", errno);
-                    break;
-                }
+// Esegue in ordine le operazioni della richiesta MULTI <request>, codificate in <body> di <size> bytes
+// La risposta riporta il numero di operazioni accettate, oppure -1 se la richiesta non è valida,
+//  seguito dalle risposte che ciascuna operazione avrebbe ricevuto come richiesta singola
+static void perform_batch(worker_args_t* worker_args, connection_t* connection, const request_t* request, const char* body, size_t size, int thread_id) {
+    int count = batch_validate(body, size, request->argument);
+    if (reply_value(connection, request, count) == -1) {
+        log_event("ERROR", "failed to queue multi response: (%d) ", errno);
+    }
+    log_event("INFO", "[%d] MULTI: %d => %c", thread_id, request->argument, count > 0 ? 'O' : 'X');
+    if (count <= 0) return;
+
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        frame_t operation;
+        memcpy(&operation, body + offset, sizeof(frame_t));
+        offset += sizeof(frame_t);
+
+        // Le risposte delle operazioni ripetono l'identificativo della richiesta MULTI
+        request_t single = {.command = operation.opcode, .id = request->id, .argument = operation.flags};
+        memcpy(single.pathname, body + offset, operation.path_length);
+        offset += operation.path_length;
+
+        // Il contenuto di una scrittura viene copiato direttamente nello storage, dopo averne controllato permessi e spazio
+        ingest_t* ingest = NULL;
+        size_t contents_size = (size_t)operation.payload_length;
+        if (operation.opcode == WRITE || operation.opcode == APPEND) {
+            ingest = ingest_begin(worker_args->storage, operation.opcode, single.pathname, contents_size, connection->fd);
+            if (ingest && ingest->result == 0) memcpy(ingest->write.destination, body + offset, contents_size);
+        }
+        offset += contents_size;
 
-                //printf("LOCK %s\n", pathname);
+        perform(worker_args, connection, &single, ingest, thread_id);
+    }
+}
 
-                // Eseguo la API call
-                api_exit_code = storage_lock_file(worker_args->storage, pathname, fd_ready);
+// Esegue la richiesta ricevuta per intero su <connection>, accodando la risposta da inviare al client
+// Ritorna false se il client ha chiuso la connessione
+static bool execute(worker_args_t* worker_args, connection_t* connection, int thread_id) {
+    request_t request;  // Richiesta del client
 
-                // Preparo il buffer per la risposta
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in lock failed: (%d) ", errno);
-                    break;
-                }
+    // Il primo messaggio di un client che supporta il protocollo binario ne negozia la versione
+    if (connection->protocol == 0) {
+        negotiate(connection, worker_args->shared_memory_max, thread_id);
+        return true;
+    }
 
-                log_event("INFO", "[%d] LOCK: %s => %c", thread_id, pathname, api_exit_code == 0 ? 'O' : 'X');
-                break;
+    // Il contenuto ricevuto in un buffer della connessione (MULTI) passa in carico alla richiesta,
+    //  così come la scrittura il cui contenuto è stato ricevuto direttamente nello storage
+    void* body = connection->body_owned ? connection->body : NULL;
+    size_t body_size = connection->body_size;
+    ingest_t* ingest = (ingest_t*)connection->pending;
+    connection->body = NULL;
+    connection->pending = NULL;
+
+    // * Faccio il parsing della richiesta
+    if (request_parse(connection, &request) == -1) {
+        log_event("ERROR", "bad request from client %d", connection->fd);
+        if (body) free(body);
+        if (ingest) ingest_destroy(ingest);
+        return true;
+    }
 
-            case UNLOCK:  // ! unlockFile: UNLOCK <str:pathname>
-                // Parso il pathname del file
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad unlock request: (%d) ", errno);
-                    break;
-                }
+    // * Una richiesta MULTI esegue più operazioni in un unico passaggio
+    if (request.command == MULTI) {
+        perform_batch(worker_args, connection, &request, (const char*)body, body ? body_size : 0, thread_id);
+        if (body) free(body);
+        return true;
+    }
 
-                //printf("UNLOCK %s\n", pathname);
+    if (body) free(body);
+    return perform(worker_args, connection, &request, ingest, thread_id);
+}
 
-                // Eseguo la API call
-                api_exit_code = storage_unlock_file(worker_args->storage, pathname, fd_ready);
+// Porta avanti le richieste del client connesso su <connection> finché il socket lo consente, senza mai bloccarsi
+// * Quando il socket non ha altri dati da ricevere, o non accetta altri dati da inviare, il descrittore
+// *  viene riabilitato per l'evento atteso: la richiesta riprenderà dallo stesso punto, anche su un altro worker.
+// *  Così un client lento non occupa un worker per tutta la durata del trasferimento.
+static void serve(worker_args_t* worker_args, connection_t* connection, uring_t* ring, char* staging, int thread_id) {
+    int fd = connection->fd;
+    // Servo al più <pipeline_budget> richieste consecutive, così che un client che invia più richieste
+    //  di seguito non paghi un intero ciclo di dispatch per ognuna, senza però monopolizzare il worker
+    size_t budget = worker_args->pipeline_budget;
+
+    while (1) {
+        // * Invio della risposta
+        if (connection->state == CONNECTION_SEND) {
+            // Con io_uring, la risposta e l'eventuale richiesta successiva viaggiano in un'unica system call
+            int sent = ring ? connection_flush_uring(connection, ring, staging) : connection_flush(connection);
+            if (sent == -1) {
+                log_event("ERROR", "failed to send response to client %d: (%d) ", fd, errno);
+                client_left(worker_args, fd, thread_id);
+                return;
+            }
+            if (sent == 0) {
+                // Il client non sta leggendo: riprendo l'invio quando il socket torna scrivibile
+                client_rearm(worker_args, fd, EPOLLOUT);
+                return;
+            }
+            if (budget == 0) {
+                client_yield(worker_args, connection);
+                return;
+            }
+            // La lettura anticipata con io_uring ha già trovato il socket vuoto: attendo la richiesta successiva
+            if (connection->input_empty) {
+                client_rearm(worker_args, fd, EPOLLIN);
+                return;
+            }
+        }
 
-                // Preparo il buffer per la risposta
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in unlock failed: (%d) ", errno);
-                    break;
+        // * Ricezione della richiesta
+        // Se il client ha chiuso la connessione senza closeConnection (EOF), oppure la lettura fallisce,
+        //  considero il client disconnesso, così da mantenere corretto il conteggio dei client attivi
+        int received = connection_receive(connection);
+        if (received == -1) {
+            client_left(worker_args, fd, thread_id);
+            return;
+        }
+        if (received == 0) {
+            // Richiesta incompleta: riprendo la ricezione quando arrivano altri dati
+            client_rearm(worker_args, fd, EPOLLIN);
+            return;
+        }
+
+        // Messaggio di richiesta completo: se prevede l'invio di un file, passo alla ricezione del contenuto
+        if (connection->state == CONNECTION_HEADER) {
+            int command;
+            bool shared;
+            size_t body_size;
+            int body = request_body_size(connection, &command, &shared, &body_size);
+            if (body == -1) {
+                log_event("ERROR", "invalid contents size from client %d", fd);
+                client_left(worker_args, fd, thread_id);
+                return;
+            }
+            if (body == 1) {
+                // Le operazioni di MULTI vengono ricevute per intero, il contenuto di un file direttamente nello storage
+                // Una MULTI troppo grande per essere ricevuta in memoria viene scartata a blocchi, e rifiutata dall'esecuzione
+                int expected;
+                if (command == MULTI && !shared && body_size > MULTI_MAX_SIZE) {
+                    log_event("WARN", "[%d] MULTI: %zu bytes from client %d exceed the limit, discarding", thread_id, body_size, fd);
+                    expected = connection_expect_body_into(connection, NULL, body_size, false);
+                } else if (command == MULTI)
+                    expected = shared ? connection_expect_shared_body(connection, body_size)
+                                      : connection_expect_body(connection, body_size);
+                else
+                    expected = ingest_prepare(worker_args, connection, command, body_size, shared);
+                if (expected == -1) {
+                    log_event("ERROR", "failed to receive contents: (%d) ", errno);
+                    client_left(worker_args, fd, thread_id);
+                    return;
                 }
+                continue;
+            }
+        }
 
-                log_event("INFO", "[%d] UNLOCK: %s => %c", thread_id, pathname, api_exit_code == 0 ? 'O' : 'X');
-                break;
+        // * Esecuzione della richiesta, ricevuta per intero
+        if (!execute(worker_args, connection, thread_id)) return;
+        budget--;
+        connection_reset(connection);
 
-            case CLOSE:  // ! closeFile: CLOSE <str:pathname>
-                // Parso il pathname dalla richiesta
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad close request: (%d) ", errno);
-                    break;
-                }
+        // Se la richiesta non prevede risposta, passo direttamente alla successiva
+        if (connection->state != CONNECTION_SEND && budget == 0) {
+            client_yield(worker_args, connection);
+            return;
+        }
+    }
+}
 
-                //printf("CLOSE: %s\n", pathname);
+static void* worker(void* args) {
+    // Argomenti passati al thread worker
+    worker_args_t* worker_args = (worker_args_t*)args;
 
-                // Eseguo la API call
-                api_exit_code = storage_close_file(worker_args->storage, pathname, fd_ready);
-                // Preparo il buffer per la risposta
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in close failed: (%d) ", errno);
-                    break;
-                }
+    int fd_ready;                         // fd del client servito al momento
+    int thread_id = (int)pthread_self();  // ID del thread worker
 
-                log_event("INFO", "[%d] CLOSE: %s => %c", thread_id, pathname, api_exit_code == 0 ? 'O' : 'X');
-                break;
+    // * Vincolo il worker alle CPU configurate, così che la memoria che scrive per prima resti sul suo nodo
+    // Il vincolo ereditato dal dispatcher viene comunque sostituito
+    if ((worker_args->cpu >= 0 && affinity_pin_cpu(worker_args->cpu) == -1) ||
+        (worker_args->cpu < 0 && worker_args->cpus && affinity_pin_list(worker_args->cpus) == -1)) {
+        log_event("WARN", "[%d] failed to set worker affinity: (%d) ", thread_id, errno);
+    }
+    // Il nodo preferito impostato dal thread principale viene ereditato: lo sostituisco con il nodo locale,
+    //  così che i contenuti ricevuti dal worker vengano allocati sul nodo della CPU che li scrive
+    if (NUMA_NODE >= 0 && affinity_local_node() == -1) {
+        log_event("WARN", "[%d] failed to set worker NUMA memory policy: (%d) ", thread_id, errno);
+    }
 
-            case REMOVE:  // ! removeFile: REMOVE <str:pathname>
-                // Parso il pathname dalla richiesta
-                token = strtok_r(NULL, " ", &strtok_status);
-                memset(pathname, 0, MESSAGE_LENGTH);
-                if (!token || sscanf(token, "%s", pathname) != 1) {
-                    log_event("ERROR", "bad remove request: (%d) ", errno);
-                    break;
-                }
+    // * Istanza io_uring del worker, con il buffer registrato in cui ricevere in anticipo le richieste
+    // Se non è possibile crearla, il worker ripiega sull'invio tramite write
+    uring_t* ring = NULL;
+    char* staging = NULL;
+    if (worker_args->io_backend == IO_URING) {
+        struct iovec buffer;
+        if ((ring = uring_create(URING_ENTRIES)) == NULL ||
+            (staging = (char*)malloc(MESSAGE_LENGTH)) == NULL ||
+            (buffer.iov_base = staging, buffer.iov_len = MESSAGE_LENGTH, uring_register_buffers(ring, &buffer, 1)) == -1) {
+            log_event("ERROR", "[%d] io_uring unavailable, falling back to epoll: (%d) ", thread_id, errno);
+            uring_destroy(ring);
+            free(staging);
+            ring = NULL;
+            staging = NULL;
+        }
+    }
 
-                //printf("REMOVE: %s\n", pathname);
-                file_size = 0;
-                // Eseguo la API call
-                api_exit_code = storage_remove_file(worker_args->storage, pathname, &file_size, fd_ready);
-                // Preparo il buffer per la risposta
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", api_exit_code);
-                if (writen((long)fd_ready, (void*)response, MESSAGE_LENGTH) == -1) {
-                    log_event("ERROR", "writen in remove failed: (%d) ", errno);
-                    break;
-                }
+    // ! MAIN WORKER LOOP
+    while (1) {  // Esco dal while quando viene inserito un coda il valore WORKER_EXIT
+        // Recupero un file descriptor pronto dalla mia coda, oppure da quella di un altro worker
+        fd_ready = scheduler_pop(worker_args->scheduler, worker_args->worker_id);
 
-                log_event("INFO", "[%d] REMOVE: %s %zu bytes => %c", thread_id, pathname, file_size, api_exit_code == 0 ? 'O' : 'X');
-                break;
+        // Controllo che la pop non abbia ritornato un codice di errore (-2)
+        if (fd_ready == -2) {
+            log_event("ERROR", "failed to pop an element from task queue: (%d) ", errno);
+            break;
+        }
 
-            case DISCONNECT:  // ! closeConnection
-                // Un client ha richiesto la chiusura della connessione
-                // Lo comunico al thread dispatcher tramite la pipe
-                memset(response, 0, MESSAGE_LENGTH);
-                snprintf(response, MESSAGE_LENGTH, "%d", CLIENT_LEFT);
-                if (writen((long)worker_args->pipe_output, (void*)response, PIPE_LEN) == -1) {
-                    log_event("ERROR", "writen in disconnect failed: (%d) ", errno);
-                    break;
-                }
-                log_event("INFO", "[%d] CLIENT: %d has left", thread_id, fd_ready);
-                break;
+        // Controllo che non sia un segnale di terminazine dal dispatcher (-1)
+        if (fd_ready == -1) break;
 
-            default:
-                log_event("INFO", "[%d] CLIENT: %d sent an unknown command: %d", thread_id, fd_ready, command);
-                break;
+        // Controllo che lo scheduler non mi abbia chiesto di ritirarmi per inattività (-3)
+        if (fd_ready == -3) {
+            log_event("INFO", "[%d] POOL: worker %zu retired (%zu active)", thread_id, worker_args->worker_id, scheduler_active(worker_args->scheduler));
+            break;
         }
 
-        // Informo il dispatcher che il worker ha terminato con la richiesta di fd_ready
-        memset(response, 0, MESSAGE_LENGTH);
-        snprintf(response, MESSAGE_LENGTH, "%d", fd_ready);
-        if (writen((long)worker_args->pipe_output, (void*)response, PIPE_LEN) == -1) {
-            log_event("ERROR", "writen in worker failed: (%d) ", errno);
+        // Controllo che in coda non sia finito un qualsiasi altro valore negativo
+        if (fd_ready < 0) {
+            log_event("ERROR", "negative file descriptor in task queue: %d", fd_ready);
             continue;
         }
+
+        // A questo punto sono sicuro di avere un fd valido, recupero lo stato della sua connessione
+        connection_t* connection = connection_get(worker_args->connections, fd_ready);
+        if (!connection) {
+            log_event("ERROR", "no connection for file descriptor: %d", fd_ready);
+            continue;
+        }
+
+        // Riprendo la richiesta in corso dal punto in cui era rimasta
+        serve(worker_args, connection, ring, staging, thread_id);
     }
 
+    uring_destroy(ring);
+    free(staging);
+    return NULL;
+}
+
+// * Thread reclaimer: quando lo storage supera la soglia alta, espelle file in background fino alla soglia bassa,
+// *  così che le scritture dei client trovino già lo spazio libero
+// I file espulsi in background non appartengono ad alcuna richiesta, quindi non vengono inviati a nessun client
+static void* reclaimer(void* args) {
+    storage_t* storage = (storage_t*)args;
+    int thread_id = (int)pthread_self();  // ID del thread reclaimer
+
+    while (storage_reclaim_wait(storage)) {
+        int victims_no = 0;
+        storage_file_t** victims = NULL;
+        if (storage_reclaim(storage, &victims_no, &victims) == -1)
+            log_event("ERROR", "[%d] RECLAIM: failed after %d victims: (%d) ", thread_id, victims_no, errno);
+        for (int i = 0; i < victims_no; i++) {
+            log_event("INFO", "[%d] VICTIM: %s %zu bytes => O (reclaimed)", thread_id, victims[i]->name, victims[i]->size);
+            storage_file_destroy(victims[i]);
+        }
+        if (victims) free(victims);
+    }
     return NULL;
 }
 
@@ -740,14 +1032,38 @@ int main(int argc, char* argv[]) {
                 }
                 STORAGE_MAX_CAPACITY = (size_t)(numeric_value * MEGABYTES);
 
-            } else if (strcmp(key, "STORAGE_MAX_FILES") == 0 || numeric_value <= 0) {
+            } else if (strcmp(key, "STORAGE_MAX_FILES") == 0) {
                 // * STORAGE_MAX_FILES
-                if (is_number(value, &numeric_value) == 0) {
+                if (is_number(value, &numeric_value) == 0 || numeric_value <= 0) {
                     fprintf(stderr, "Error: %s has an invalid value\n", key);
                     return EINVAL;
                 }
                 STORAGE_MAX_FILES = (size_t)numeric_value;
 
+            } else if (strcmp(key, "STORAGE_SHARDS") == 0) {
+                // * STORAGE_SHARDS
+                if (is_number(value, &numeric_value) == 0 || numeric_value <= 0 || numeric_value > 65536) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                STORAGE_SHARDS = (size_t)numeric_value;
+
+            } else if (strcmp(key, "STORAGE_HIGH_WATERMARK") == 0) {
+                // * STORAGE_HIGH_WATERMARK
+                if (is_number(value, &numeric_value) == 0 || numeric_value < 0 || numeric_value > 100) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                STORAGE_HIGH_WATERMARK = (size_t)numeric_value;
+
+            } else if (strcmp(key, "STORAGE_LOW_WATERMARK") == 0) {
+                // * STORAGE_LOW_WATERMARK, validato insieme alla soglia alta
+                if (is_number(value, &numeric_value) == 0 || numeric_value < 0 || numeric_value > 100) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                STORAGE_LOW_WATERMARK = numeric_value;
+
             } else if (strcmp(key, "REPLACEMENT_POLICY") == 0) {
                 // * REPLACEMENT_POLICY
                 if (strcmp(value, "fifo") == 0)
@@ -756,11 +1072,96 @@ int main(int argc, char* argv[]) {
                     REPLACEMENT_POLICY = LRU;
                 else if (strcmp(value, "lfu") == 0)
                     REPLACEMENT_POLICY = LFU;
+                else if (strcmp(value, "arc") == 0)
+                    REPLACEMENT_POLICY = ARC;
+                else if (strcmp(value, "2q") == 0)
+                    REPLACEMENT_POLICY = TWO_QUEUE;
+                else if (strcmp(value, "w-tinylfu") == 0)
+                    REPLACEMENT_POLICY = W_TINYLFU;
+                else if (strcmp(value, "gdsf") == 0)
+                    REPLACEMENT_POLICY = GDSF;
+                else {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+
+            } else if (strcmp(key, "PIPELINE_BUDGET") == 0) {
+                // * PIPELINE_BUDGET
+                if (is_number(value, &numeric_value) == 0 || numeric_value <= 0) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                PIPELINE_BUDGET = (size_t)numeric_value;
+
+            } else if (strcmp(key, "THREADS_WORKER_MAX") == 0) {
+                // * THREADS_WORKER_MAX
+                if (is_number(value, &numeric_value) == 0 || numeric_value <= 0) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                THREADS_WORKER_MAX = (size_t)numeric_value;
+
+            } else if (strcmp(key, "POOL_SPAWN_DEPTH") == 0) {
+                // * POOL_SPAWN_DEPTH
+                if (is_number(value, &numeric_value) == 0 || numeric_value <= 0) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                POOL_SPAWN_DEPTH = (size_t)numeric_value;
+
+            } else if (strcmp(key, "POOL_IDLE_TIMEOUT") == 0) {
+                // * POOL_IDLE_TIMEOUT
+                if (is_number(value, &numeric_value) == 0 || numeric_value <= 0) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                POOL_IDLE_TIMEOUT = (size_t)numeric_value;
+
+            } else if (strcmp(key, "IO_BACKEND") == 0) {
+                // * IO_BACKEND
+                if (strcmp(value, "epoll") == 0)
+                    IO_BACKEND = IO_EPOLL;
+                else if (strcmp(value, "io_uring") == 0)
+                    IO_BACKEND = IO_URING;
                 else {
                     fprintf(stderr, "Error: %s has an invalid value\n", key);
                     return EINVAL;
                 }
 
+            } else if (strcmp(key, "SHARED_MEMORY_MAX") == 0) {
+                // * SHARED_MEMORY_MAX
+                if (is_number(value, &numeric_value) == 0 || numeric_value < 0) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                SHARED_MEMORY_MAX = (size_t)numeric_value;
+
+            } else if (strcmp(key, "DISPATCHER_CPU") == 0) {
+                // * DISPATCHER_CPU
+                if (is_number(value, &numeric_value) == 0 || numeric_value < 0) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                DISPATCHER_CPU = numeric_value;
+
+            } else if (strcmp(key, "WORKER_CPUS") == 0) {
+                // * WORKER_CPUS, validato durante l'impostazione delle affinità
+                // <value_length> non comprende il terminatore se il valore non era seguito da un '\n'
+                if ((WORKER_CPUS = malloc(value_length + 1)) == NULL) {
+                    perror("Error: unable to allocate memory using malloc for WORKER_CPUS");
+                    return errno;
+                }
+                strncpy(WORKER_CPUS, value, value_length);
+                WORKER_CPUS[value_length] = '\0';
+
+            } else if (strcmp(key, "NUMA_NODE") == 0) {
+                // * NUMA_NODE
+                if (is_number(value, &numeric_value) == 0 || numeric_value < 0) {
+                    fprintf(stderr, "Error: %s has an invalid value\n", key);
+                    return EINVAL;
+                }
+                NUMA_NODE = numeric_value;
+
             } else if (strcmp(key, "SOCKET_PATH") == 0) {
                 // * SOCKET_PATH
                 if ((SOCKET_PATH = malloc(value_length)) == NULL) {
@@ -786,7 +1187,11 @@ int main(int argc, char* argv[]) {
         return errno;
     }
 
+    // Senza THREADS_WORKER_MAX, la thread pool ha dimensione fissa
+    if (THREADS_WORKER_MAX < THREADS_WORKER) THREADS_WORKER_MAX = THREADS_WORKER;
+
     printf("Info: configuration loaded successfully!\n");
+    if (IO_BACKEND == IO_URING) printf("Info: responses will be sent through io_uring\n");
 
     // ! LOG FILE
     if ((log_file = fopen(LOG_PATH, "w")) == NULL) {
@@ -797,12 +1202,64 @@ int main(int argc, char* argv[]) {
     // Avvio del server
     log_event("INFO", "Server bootstrap");
 
+    // ! AFFINITÀ
+    // Insieme di CPU di partenza del processo, a cui riportare i workers se solo il dispatcher è vincolato
+    cpu_list_t* process_cpus = affinity_current();
+    if (!process_cpus) {
+        perror("Error: failed to get process affinity");
+        return errno;
+    }
+    // CPU del nodo NUMA configurato, su cui eseguono tutti i threads
+    cpu_list_t* node_cpus = NULL;
+    if (NUMA_NODE >= 0) {
+        if ((node_cpus = affinity_node_cpus(NUMA_NODE)) == NULL) {
+            fprintf(stderr, "Error: NUMA_NODE has an invalid value (%ld)\n", NUMA_NODE);
+            return EINVAL;
+        }
+        // Da qui in poi, storage compreso, la memoria viene allocata preferibilmente sul nodo configurato
+        if (affinity_prefer_node(NUMA_NODE) == -1) {
+            perror("Warning: failed to set NUMA memory policy");
+        } else {
+            printf("Info: memory will be allocated on NUMA node %ld\n", NUMA_NODE);
+        }
+    }
+    // CPU su cui distribuire i workers
+    cpu_list_t* worker_cpus = NULL;
+    if (WORKER_CPUS && (worker_cpus = affinity_parse(WORKER_CPUS)) == NULL) {
+        fprintf(stderr, "Error: WORKER_CPUS has an invalid value (%s)\n", WORKER_CPUS);
+        return EINVAL;
+    }
+    // Con un nodo NUMA configurato, anche dispatcher e workers devono eseguire sulle sue CPU
+    if (node_cpus) {
+        long outside = DISPATCHER_CPU >= 0 && !affinity_contains(node_cpus, (int)DISPATCHER_CPU) ? DISPATCHER_CPU : -1;
+        for (size_t i = 0; worker_cpus && outside < 0 && i < worker_cpus->count; i++)
+            if (!affinity_contains(node_cpus, worker_cpus->cpus[i])) outside = worker_cpus->cpus[i];
+        if (outside >= 0) {
+            fprintf(stderr, "Error: CPU %ld of DISPATCHER_CPU or WORKER_CPUS is not on NUMA_NODE %ld\n", outside, NUMA_NODE);
+            return EINVAL;
+        }
+    }
+    // Vincolo il dispatcher, e di conseguenza l'event loop e la gestione dei segnali
+    if ((DISPATCHER_CPU >= 0 && affinity_pin_cpu((int)DISPATCHER_CPU) == -1) ||
+        (DISPATCHER_CPU < 0 && node_cpus && affinity_pin_list(node_cpus) == -1)) {
+        perror("Error: failed to set dispatcher affinity");
+        return errno;
+    }
+    if (DISPATCHER_CPU >= 0) printf("Info: dispatcher will run on CPU %ld\n", DISPATCHER_CPU);
+    if (worker_cpus) printf("Info: workers will run on CPUs %s\n", WORKER_CPUS);
+
     // ! STORAGE
-    storage_t* storage = storage_create(STORAGE_MAX_FILES, STORAGE_MAX_CAPACITY, REPLACEMENT_POLICY);
+    storage_t* storage = storage_create(STORAGE_MAX_FILES, STORAGE_MAX_CAPACITY, REPLACEMENT_POLICY, STORAGE_SHARDS);
     if (!storage) {
         perror("Error: storage creation failed");
         return errno;
     }
+    // Soglie del reclaimer; senza una soglia bassa, il reclaimer libera il 10% dei limiti
+    size_t low_watermark = STORAGE_LOW_WATERMARK >= 0 ? (size_t)STORAGE_LOW_WATERMARK : MAX(STORAGE_HIGH_WATERMARK, 10) - 10;
+    if (storage_set_watermarks(storage, STORAGE_HIGH_WATERMARK, low_watermark) == -1) {
+        fprintf(stderr, "Error: STORAGE_LOW_WATERMARK must be lower than STORAGE_HIGH_WATERMARK\n");
+        return EINVAL;
+    }
 
     // ! SEGNALI
     // Segnali da mascherare durante l'esecuzione dell'handler
@@ -830,19 +1287,21 @@ int main(int argc, char* argv[]) {
         return errno;
     }
 
-    // Per la gestione dei segnali indicati in sigset, utilizzo un thread specializzato
+    // Blocco i segnali indicati in sigset, così che non vengano gestiti in maniera asincrona:
+    //  la maschera viene ereditata da tutti i threads creati successivamente
     if (pthread_sigmask(SIG_BLOCK, &sigset, NULL) != 0) {
-        perror("Error: failed to set signal mask for signals handler thread");
+        perror("Error: failed to set signal mask");
         return errno;
     }
-    // Eseguo il therad specializzato nella gestione dei segnali
-    pthread_t thread_signal_handler;
-    if (pthread_create(&thread_signal_handler, NULL, &signals_handler, (void*)&sigset) != 0) {
-        perror("Error: failed to launch signals handler thread");
+    // I segnali vengono invece consegnati come eventi sul signalfd,
+    //  che il dispatcher gestisce nello stesso event loop delle connessioni
+    int signal_fd = signalfd(-1, &sigset, 0);
+    if (signal_fd == -1) {
+        perror("Error: failed to create signalfd");
         return errno;
     }
 
-    printf("Info: started signals handler thread\n");
+    printf("Info: signals will be handled by the dispatcher\n");
 
     // ! CONNESSIONE
     struct sockaddr_un socket_address;
@@ -871,63 +1330,129 @@ int main(int argc, char* argv[]) {
         return errno;
     }
 
-    // ! TASKS QUEUE
-    queue_t* task_queue = queue_init();
-    if (!task_queue) {
-        fprintf(stderr, "Error: failed to create a task queue");
+    // ! TASKS QUEUES
+    // Una coda per ogni worker: i workers inattivi rubano i tasks dalle code degli altri
+    // Le code sono allocate per il numero massimo di workers, mentre inizialmente ne sono attivi THREADS_WORKER
+    // Con un numero di workers fisso, nessun worker si ritira per inattività
+    scheduler_t* scheduler = scheduler_init(THREADS_WORKER, THREADS_WORKER_MAX,
+                                            THREADS_WORKER_MAX > THREADS_WORKER ? (long)POOL_IDLE_TIMEOUT : 0,
+                                            TASK_QUEUE_CAPACITY);
+    if (!scheduler) {
+        fprintf(stderr, "Error: failed to create task queues");
         return EXIT_FAILURE;
     }
 
-    // ! PIPE
-    int pipe_workers[2];  // [0]: lettura, [1]: scrittura
-    if (pipe(pipe_workers) == -1) {
-        perror("Error: failed to create pipe");
+    // ! CONNECTIONS
+    // Stato delle richieste in corso di ogni client, così che un worker possa sospenderle e riprenderle
+    connection_table_t* connections = connection_table_create();
+    if (!connections) {
+        perror("Error: failed to create connection table");
         return errno;
     }
 
-    // Buffer per lavorare con i dati trasmessi sulla pipe dai workers
-    char pipe_buffer[PIPE_LEN];
-    int pipe_message;
+    // ! EVENTFD
+    // I workers incrementano il contatore ad ogni client disconnesso,
+    //  il dispatcher lo legge (azzerandolo) per aggiornare il conteggio dei client attivi
+    int clients_left_fd = eventfd(0, 0);
+    if (clients_left_fd == -1) {
+        perror("Error: failed to create eventfd");
+        return errno;
+    }
+    // Valore letto dall'eventfd: numero di client disconnessi dall'ultima lettura
+    uint64_t clients_left;
+
+    // ! PREPARAZIONE EPOLL
+    // Istanza epoll, il cui costo per evento non dipende dal numero di descrittori registrati
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        perror("Error: failed to create epoll instance");
+        return errno;
+    }
+
+    // Registro il socket server, il signalfd e l'eventfd dei client disconnessi
+    // * Questi descrittori sono level-triggered: restano registrati finché il server è attivo
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = server_socket;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &event) == -1) {
+        perror("Error: failed to register server socket");
+        return errno;
+    }
+    event.data.fd = signal_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event) == -1) {
+        perror("Error: failed to register signalfd");
+        return errno;
+    }
+    event.data.fd = clients_left_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients_left_fd, &event) == -1) {
+        perror("Error: failed to register clients eventfd");
+        return errno;
+    }
 
     // ! THREAD POOL
-    // Creo la thread pool
+    // Creo la thread pool, dimensionata per il numero massimo di workers
     pthread_t* thread_pool;
-    if ((thread_pool = (pthread_t*)malloc(sizeof(pthread_t) * THREADS_WORKER)) == NULL) {
+    if ((thread_pool = (pthread_t*)malloc(sizeof(pthread_t) * THREADS_WORKER_MAX)) == NULL) {
+        perror("Error: failed to allocate memory for thread pool");
+        return errno;
+    }
+    // Tiene traccia dei threads avviati almeno una volta, da attendere prima di riusarne l'indice e all'arresto
+    bool* worker_started;
+    if ((worker_started = (bool*)calloc(THREADS_WORKER_MAX, sizeof(bool))) == NULL) {
         perror("Error: failed to allocate memory for thread pool");
         return errno;
     }
 
-    // Parametri dei threads worker
-    worker_args_t* worker_args = (worker_args_t*)malloc(sizeof(worker_args_t));
-    worker_args->storage = storage;
-    worker_args->task_queue = task_queue;
-    worker_args->pipe_output = pipe_workers[1];
+    // Parametri dei threads worker, uno per worker così che ognuno conosca la propria coda
+    worker_args_t* worker_args = (worker_args_t*)malloc(sizeof(worker_args_t) * THREADS_WORKER_MAX);
+    if (!worker_args) {
+        perror("Error: failed to allocate memory for worker arguments");
+        return errno;
+    }
 
-    // Inizializzo e lancio i threads worker
+    // Inizializzo i parametri di tutti i workers, quindi lancio i primi THREADS_WORKER
+    for (int i = 0; i < THREADS_WORKER_MAX; i++) {
+        worker_args[i].storage = storage;
+        worker_args[i].scheduler = scheduler;
+        worker_args[i].worker_id = (size_t)i;
+        worker_args[i].io_backend = IO_BACKEND;
+        worker_args[i].epoll_fd = epoll_fd;
+        worker_args[i].clients_left_fd = clients_left_fd;
+        worker_args[i].connections = connections;
+        worker_args[i].pipeline_budget = PIPELINE_BUDGET;
+        worker_args[i].shared_memory_max = SHARED_MEMORY_MAX * 1024 * 1024;
+        // Senza WORKER_CPUS, i workers eseguono sulle CPU del nodo NUMA oppure su quelle di partenza,
+        //  ma solo se il dispatcher è vincolato, altrimenti ne erediterebbero il vincolo
+        worker_args[i].cpu = worker_cpus ? worker_cpus->cpus[i % worker_cpus->count] : -1;
+        worker_args[i].cpus = node_cpus ? node_cpus : (DISPATCHER_CPU >= 0 ? process_cpus : NULL);
+    }
     for (int i = 0; i < THREADS_WORKER; i++) {
-        if (pthread_create(&thread_pool[i], NULL, &worker, (void*)worker_args) != 0) {
+        if (pthread_create(&thread_pool[i], NULL, &worker, (void*)&worker_args[i]) != 0) {
             fprintf(stderr, "Error: failed to start worker thread (%d)\n", i);
             return EXIT_FAILURE;
         }
+        worker_started[i] = true;
         //printf("Info: worker thread (%d) started\n", i);
     }
 
     printf("Info: thread pool initialized\n");
 
-    // ! PREPARAZIONE SELECT
-    // Insieme dei file descriptor attivi
-    fd_set set;
-    // Insieme dei file descriptor pronti in lettura
-    fd_set ready_set;
-    // Mantengo il massimo indice di descrittore attivo,
-    // inizialmente pari allo stesso server socket
-    int fd_num = server_socket;
-    // Inizializzo la maschera
-    FD_ZERO(&set);
-    // Aggiungo il descrittore del socket server
-    FD_SET(server_socket, &set);
-    // Aggiungo anche la pipe tra dispatcher e workers
-    FD_SET(pipe_workers[0], &set);
+    // ! RECLAIMER
+    pthread_t reclaimer_thread;
+    bool reclaimer_started = false;
+    if (STORAGE_HIGH_WATERMARK > 0) {
+        if (pthread_create(&reclaimer_thread, NULL, &reclaimer, (void*)storage) != 0) {
+            fprintf(stderr, "Error: failed to start reclaimer thread\n");
+            return EXIT_FAILURE;
+        }
+        reclaimer_started = true;
+        printf("Info: reclaimer started (watermarks %zu%% -> %zu%%)\n", STORAGE_HIGH_WATERMARK, low_watermark);
+    }
+
+    // Eventi restituiti da una singola epoll_wait
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int events_no;
 
     // Descrittore del socket client
     int client_socket;
@@ -935,73 +1460,85 @@ int main(int argc, char* argv[]) {
     // Conteggio dei clients attivi, per gestire la terminazione "soft" del segnale SIGHUP
     int active_clients = 0;
 
-    // Timeout di 100ms, dopo il quale uscire dalla select
-    struct timeval timeout = {0, 100000};
-    // Copia del timeout, che viene modificato dalla select ad ogni iterazione
-    struct timeval current_timeout;
-
     // ! MAIN LOOP (DISPATCHER)
     // Rimango attivo finché arriva un segnale di SIGINT|SIGQUIT (force_stop)
     // oppure arriva un segnale di SIGHUP e non ci sono più client connessi
     // * Termino quando: force_stop OR (stop AND active_clients == 0)
     while (!(force_stop || (stop && (active_clients == 0)))) {
-        // Reimposto l'insieme dei descrittori su quello iniziale,
-        // in quanto la select lo modifica ad ogni iterazione
-        ready_set = set;
-        // Faccio lo stesso con il timeout
-        current_timeout = timeout;
-
-        // ! SELECT
-        if (select(fd_num + 1, &ready_set, NULL, NULL, &current_timeout) == -1) {
-            continue;
+        // ! EPOLL
+        // Nessun timeout: anche i segnali arrivano come eventi, tramite il signalfd
+        if ((events_no = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, -1)) == -1) {
+            if (errno == EINTR) continue;
+            log_event("ERROR", "epoll_wait failed: (%d) ", errno);
+            break;
         }
 
-        // Itero sui selettori per processare tutti quelli pronti
-        // Il massimo numero di descrittori è indicato da fd_num
-        for (int fd = 0; fd < fd_num + 1; fd++) {
-            // fd è pronto?
-            if (FD_ISSET(fd, &ready_set)) {
-                // Il server socket è pronto && non è arrivato SIGHUP
-                if (fd == server_socket && !stop) {
-                    // * Nuovo connessione in entrata
-                    // Accetto la connessione in entrata e controllo eventuali errori
-                    if ((client_socket = accept(server_socket, NULL, 0)) == -1) {
-                        log_event("ERROR", "failed to accept an incoming connection: (%d) ", errno);
-                        continue;
-                    }
-                    // Aggiungo il nuovo descrittore nella maschera di partenza
-                    FD_SET(client_socket, &set);
-                    // Aggiorno il contatore del massimo indice
-                    if (client_socket > fd_num) fd_num = client_socket;
-                    // Aggiorno il contatore dei clients attivi
-                    active_clients++;
-                    log_event("INFO", "[000000000] CLIENT: %d connected", client_socket);
-
-                } else if (fd == pipe_workers[0]) {
-                    // * Nuova comunicazione da un thread worker
-                    memset(pipe_buffer, 0, PIPE_LEN);
-                    if (readn((long)fd, (void*)pipe_buffer, PIPE_LEN) == -1) {
-                        log_event("ERROR", "readn failed on pipe: (%d) ", errno);
-                        continue;
-                    }
-                    if (sscanf(pipe_buffer, "%d", &pipe_message) != 1) {
-                        log_event("ERROR", "sscanf failed: (%d) ", errno);
-                        continue;
-                    }
-                    if (pipe_message == CLIENT_LEFT) {
-                        active_clients--;
+        // Itero solamente sui descrittori effettivamente pronti
+        for (int i = 0; i < events_no; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == server_socket) {
+                // * Nuovo connessione in entrata
+                // Accetto la connessione in entrata e controllo eventuali errori
+                if ((client_socket = accept(server_socket, NULL, 0)) == -1) {
+                    log_event("ERROR", "failed to accept an incoming connection: (%d) ", errno);
+                    continue;
+                }
+                // Registro la connessione, il cui socket diventa non bloccante
+                if (!connection_open(connections, client_socket)) {
+                    log_event("ERROR", "failed to open connection: (%d) ", errno);
+                    close(client_socket);
+                    continue;
+                }
+                // Registro il nuovo descrittore in modalità one-shot: dopo la prima notifica
+                //  viene disabilitato, finché un worker non restituisce il descrittore al dispatcher
+                event.events = EPOLLIN | EPOLLONESHOT;
+                event.data.fd = client_socket;
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1) {
+                    log_event("ERROR", "failed to register client socket: (%d) ", errno);
+                    connection_close(connections, client_socket);
+                    continue;
+                }
+                // Aggiorno il contatore dei clients attivi
+                active_clients++;
+                log_event("INFO", "[000000000] CLIENT: %d connected", client_socket);
+
+            } else if (fd == signal_fd) {
+                // * Nuovo segnale
+                signals_handler(signal_fd);
+                // Dopo SIGHUP non accetto nuove connessioni, smetto quindi di monitorare il socket server
+                if (stop && epoll_ctl(epoll_fd, EPOLL_CTL_DEL, server_socket, NULL) == -1 && errno != ENOENT) {
+                    log_event("ERROR", "failed to unregister server socket: (%d) ", errno);
+                }
+
+            } else if (fd == clients_left_fd) {
+                // * Uno o più client hanno chiuso la connessione
+                if (readn((long)fd, (void*)&clients_left, sizeof(clients_left)) == -1) {
+                    log_event("ERROR", "readn failed on eventfd: (%d) ", errno);
+                    continue;
+                }
+                active_clients -= (int)clients_left;
+
+            } else {
+                // * Nuovo task da parte di un client connesso
+                // Inserisco il descrittore nella coda del worker a cui appartiene la connessione
+                // Non è necessario rimuoverlo da epoll: essendo one-shot, è già stato disabilitato,
+                //  e sarà il worker stesso a riabilitarlo una volta servita la richiesta
+                if (scheduler_push(scheduler, scheduler_owner(scheduler, fd), fd) == -1) {
+                    log_event("ERROR", "failed to push a task: (%d) ", errno);
+                }
+
+                // * Se i tasks in coda superano la soglia, aggiungo un worker alla thread pool
+                long spawn = scheduler_grow(scheduler, POOL_SPAWN_DEPTH);
+                if (spawn >= 0) {
+                    // L'indice potrebbe appartenere ad un worker ritirato, di cui attendo la terminazione
+                    if (worker_started[spawn]) pthread_join(thread_pool[spawn], NULL);
+                    worker_started[spawn] = pthread_create(&thread_pool[spawn], NULL, &worker, (void*)&worker_args[spawn]) == 0;
+                    if (worker_started[spawn]) {
+                        log_event("INFO", "[000000000] POOL: worker %ld started (%zu active)", spawn, scheduler_active(scheduler));
                     } else {
-                        FD_SET(pipe_message, &set);
-                        if (pipe_message > fd_num) fd_num = pipe_message;
+                        log_event("ERROR", "failed to start worker thread (%ld)", spawn);
                     }
-
-                } else {
-                    // * Nuovo task da parte di un client connesso
-                    // Inserisco il descrittore nella coda dei tasks
-                    queue_push(task_queue, fd);
-                    // Rimuovo il descrittore dal ready set
-                    FD_CLR(fd, &set);
-                    //if(fd == fd_num) fd_num--;
                 }
             }
         }
@@ -1020,8 +1557,12 @@ int main(int argc, char* argv[]) {
     tm_info = localtime(&timer);
     strftime(shutdown_time, sizeof(shutdown_time), "%d-%m-%Y %H:%M:%S", tm_info);
 
-    // Converto la dimensione massima raggiunta in MBytes
-    char* human_readable_max_space_used = calculate_size(storage->max_capacity_reached);
+    // Converto la dimensione massima raggiunta e lo spazio liberato dal rimpiazzo in MBytes
+    char* human_readable_max_space_used = calculate_size(atomic_load(&storage->max_capacity_reached));
+    size_t evicted_files = atomic_load(&storage->evicted_files);
+    size_t evicted_bytes = atomic_load(&storage->evicted_bytes);
+    char* human_readable_evicted = calculate_size(evicted_bytes);
+    char* human_readable_evicted_per_file = calculate_size(evicted_files > 0 ? evicted_bytes / evicted_files : 0);
 
     // Stampo un sommario delle operazioni effettuate
     printf(
@@ -1030,43 +1571,82 @@ int main(int argc, char* argv[]) {
         "+ Server shutdown @ %s\n"
         "+ Max files stored: %zu\n"
         "+ Max space used: %s\n"
-        "+ Replacement algorithm executed %zu times\n\n"
+        "+ Replacement algorithm executed %zu times\n"
+        "+ Files evicted: %zu (%zu in background), freeing %s (%s per file)\n\n"
         "+ At shutdown, these files are inside the storage:\n",
         start_time, shutdown_time,
-        storage->max_files_reached, human_readable_max_space_used,
-        storage->rp_algorithm_counter);
+        atomic_load(&storage->max_files_reached), human_readable_max_space_used,
+        atomic_load(&storage->rp_algorithm_counter),
+        evicted_files, atomic_load(&storage->reclaimed_files), human_readable_evicted, human_readable_evicted_per_file);
 
     // Libero subito la memoria
     free(human_readable_max_space_used);
+    free(human_readable_evicted);
+    free(human_readable_evicted_per_file);
 
     // Visualizzo i file presenti nello storage al momento dell'arresto
     storage_print(storage);
 
+    // Stato della thread pool al momento dell'arresto
+    size_t active_workers = scheduler_active(scheduler);
+    size_t queued_tasks = scheduler_length(scheduler);
+
     // Mi assicuro che tutti i threads spawnati siano terminati
-    // Prima il signal handler thread, che è il primo a terminare
-    pthread_join(thread_signal_handler, NULL);
-    // Poi inserisco un valore di "chiusura" per tutti i thread workers
-    for (int i = 0; i < THREADS_WORKER; i++) queue_push(task_queue, -1);
-    // Quindi aspetto la loro imminente chiusura
-    for (int i = 0; i < THREADS_WORKER; i++) pthread_join(thread_pool[i], NULL);
+    // Inserisco un valore di "chiusura" per tutti i thread workers attivi
+    // I workers si ritirano ma non vengono più aggiunti, quindi i valori di chiusura sono sufficienti
+    for (size_t i = 0; i < active_workers; i++) scheduler_push(scheduler, i, -1);
+    // Quindi aspetto la loro imminente chiusura, insieme a quella dei workers già ritirati
+    for (int i = 0; i < THREADS_WORKER_MAX; i++) {
+        if (worker_started[i]) pthread_join(thread_pool[i], NULL);
+    }
     // Libero la memoria della threadpool
     free(thread_pool);
-    // Libero la memoria della coda dei tasks
-    queue_destroy(task_queue);
+    free(worker_started);
 
-    // Chiudo i socket
+    // Termino il reclaimer, che potrebbe ancora espellere file
+    storage_reclaim_stop(storage);
+    if (reclaimer_started) pthread_join(reclaimer_thread, NULL);
+
+    // Stampo le statistiche dello scheduler, ora che i workers sono terminati
+    // Il conteggio include i segnali di terminazione, uno per worker
+    size_t local_hits = scheduler_local_hits(scheduler);
+    size_t steals = scheduler_steals(scheduler);
+    printf(
+        "\nSome scheduler statistics:\n"
+        "+ Tasks served from own queue: %zu (%.1f%%)\n"
+        "+ Tasks stolen from other queues: %zu (%.1f%%)\n"
+        "+ Max tasks queued on a worker: %zu\n"
+        "+ Tasks queued at shutdown: %zu\n"
+        "+ Workers: %zu active at shutdown, %zu max active (min %zu, max %zu)\n"
+        "+ Workers started on demand: %zu, retired when idle: %zu\n",
+        local_hits, local_hits + steals ? 100.0 * local_hits / (local_hits + steals) : 0.0,
+        steals, local_hits + steals ? 100.0 * steals / (local_hits + steals) : 0.0,
+        scheduler_max_length(scheduler), queued_tasks,
+        active_workers, atomic_load(&scheduler->max_active), THREADS_WORKER, THREADS_WORKER_MAX,
+        atomic_load(&scheduler->spawned), atomic_load(&scheduler->retired));
+
+    // Libero la memoria delle code dei tasks
+    scheduler_destroy(scheduler);
+    // Chiudo le connessioni eventualmente ancora attive
+    connection_table_destroy(connections);
+
+    // Chiudo il socket server, l'istanza epoll ed il signalfd
     close(server_socket);
-    close(client_socket);
+    close(epoll_fd);
+    close(signal_fd);
 
-    // Chiudo la pipe dispatcher <-> workers
-    close(pipe_workers[0]);
-    close(pipe_workers[1]);
+    // Chiudo l'eventfd dei client disconnessi
+    close(clients_left_fd);
 
     // Cancello lo storage
     storage_destroy(storage);
 
     // E glie argomenti dei threads
     free(worker_args);
+    // Insiemi di CPU delle affinità
+    affinity_destroy(process_cpus);
+    affinity_destroy(node_cpus);
+    affinity_destroy(worker_cpus);
 
     // Elimino il socket file
     unlink(SOCKET_PATH);
@@ -1084,6 +1664,7 @@ int main(int argc, char* argv[]) {
     free(CONFIG_PATH);
     free(SOCKET_PATH);
     free(LOG_PATH);
+    free(WORKER_CPUS);
 
     return EXIT_SUCCESS;
 }
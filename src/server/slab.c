@@ -0,0 +1,238 @@
+// @author Luca Cirillo (545480)
+
+#include <errno.h>
+#include <pthread.h>
+#include <queue.h>  // CACHE_LINE_SIZE
+#include <slab.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils.h>
+
+// Dimensione di un blocco, potenza di 2: ogni blocco è allineato alla propria dimensione
+#define SLAB_BLOCK_SIZE (64 * 1024)
+// Oggetti liberi nella cache di un thread; la cache viene riempita o svuotata di metà degli oggetti alla volta
+#define SLAB_CACHE_SIZE 64
+
+// * Intestazione di un blocco, all'inizio della sua memoria
+typedef struct SlabBlock {
+    struct Slab* slab;       // Allocatore a cui appartiene il blocco
+    struct SlabBlock* next;  // Blocco allocato in precedenza
+} slab_block_t;
+
+// Il primo oggetto di un blocco inizia sulla linea di cache successiva all'intestazione
+#define SLAB_BLOCK_HEADER (((sizeof(slab_block_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE)
+
+// * Oggetto libero, nella lista dell'allocatore
+typedef struct SlabObject {
+    struct SlabObject* next;  // Oggetto liberato in precedenza
+} slab_object_t;
+
+// * Cache di oggetti liberi di un thread; la cache di un thread terminato viene riutilizzata
+typedef struct SlabCache {
+    void* objects[SLAB_CACHE_SIZE];  // Oggetti liberi, dal meno recente
+    size_t count;                    // Numero di oggetti liberi nella cache
+    bool used;                       // La cache appartiene ad un thread
+    struct Slab* slab;               // Allocatore della cache
+    struct SlabCache* next;          // Cache successiva nella lista dell'allocatore
+} slab_cache_t;
+
+struct Slab {
+    size_t size;             // Dimensione di un oggetto
+    pthread_key_t key;       // Cache del thread chiamante
+    pthread_mutex_t lock;    // Protegge oggetti liberi, blocchi e caches
+    slab_object_t* objects;  // Oggetti rilasciati dalle caches, dal più recente
+    char* unused;            // Primo oggetto mai allocato del blocco più recente
+    char* unused_end;        // Fine degli oggetti del blocco più recente
+    slab_block_t* blocks;    // Blocchi allocati, dal più recente
+    slab_cache_t* caches;    // Caches dei threads
+};
+
+// Restituisce all'allocatore <slab> gli oggetti <objects>; va chiamata con il lock dell'allocatore
+static void slab_release(slab_t* slab, void** objects, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        slab_object_t* object = (slab_object_t*)objects[i];
+        object->next = slab->objects;
+        slab->objects = object;
+    }
+}
+
+// Preleva fino a <count> oggetti dall'allocatore <slab>, allocando un nuovo blocco se necessario
+// Ritorna il numero di oggetti prelevati; va chiamata con il lock dell'allocatore
+static size_t slab_refill(slab_t* slab, void** objects, size_t count) {
+    size_t taken = 0;
+    // Prima gli oggetti già rilasciati, i più recenti probabilmente ancora in cache
+    while (taken < count && slab->objects) {
+        objects[taken++] = slab->objects;
+        slab->objects = slab->objects->next;
+    }
+    while (taken < count) {
+        if (slab->unused == slab->unused_end) {
+            void* memory = NULL;
+            if (posix_memalign(&memory, SLAB_BLOCK_SIZE, SLAB_BLOCK_SIZE) != 0) break;
+            slab_block_t* block = (slab_block_t*)memory;
+            block->slab = slab;
+            block->next = slab->blocks;
+            slab->blocks = block;
+            // Gli oggetti del blocco vengono ricavati solamente quando servono
+            slab->unused = (char*)memory + SLAB_BLOCK_HEADER;
+            slab->unused_end = slab->unused + ((SLAB_BLOCK_SIZE - SLAB_BLOCK_HEADER) / slab->size) * slab->size;
+        }
+        objects[taken++] = slab->unused;
+        slab->unused += slab->size;
+    }
+    return taken;
+}
+
+// Alla terminazione di un thread, gli oggetti della sua cache tornano all'allocatore e la cache torna disponibile
+static void slab_thread_exit(void* data) {
+    slab_cache_t* cache = (slab_cache_t*)data;
+    slab_t* slab = cache->slab;
+    LOCK(&slab->lock);
+    slab_release(slab, cache->objects, cache->count);
+    cache->count = 0;
+    cache->used = false;
+    UNLOCK(&slab->lock);
+}
+
+// Ritorna la cache del thread chiamante, registrandola al primo utilizzo, oppure NULL
+static slab_cache_t* slab_cache(slab_t* slab) {
+    slab_cache_t* cache = (slab_cache_t*)pthread_getspecific(slab->key);
+    if (cache) return cache;
+
+    // Riutilizzo la cache di un thread terminato, se presente, altrimenti ne aggiungo una nuova
+    LOCK(&slab->lock);
+    for (cache = slab->caches; cache && cache->used; cache = cache->next)
+        ;
+    if (!cache) {
+        void* memory = NULL;
+        if (posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(slab_cache_t)) == 0) {
+            cache = (slab_cache_t*)memory;
+            cache->count = 0;
+            cache->slab = slab;
+            cache->next = slab->caches;
+            slab->caches = cache;
+        }
+    }
+    if (cache) cache->used = true;
+    UNLOCK(&slab->lock);
+    if (!cache) return NULL;
+
+    if (pthread_setspecific(slab->key, cache) != 0) {
+        LOCK(&slab->lock);
+        cache->used = false;
+        UNLOCK(&slab->lock);
+        return NULL;
+    }
+    return cache;
+}
+
+slab_t* slab_create(size_t size) {
+    // Un oggetto libero deve poter contenere il collegamento al successivo
+    size = MAX(size, sizeof(slab_object_t));
+    if (size <= CACHE_LINE_SIZE) {
+        size_t rounded = sizeof(slab_object_t);
+        while (rounded < size) rounded *= 2;
+        size = rounded;
+    } else {
+        size = ((size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
+    }
+    // Un blocco deve contenere almeno una cache piena di oggetti
+    if (size * SLAB_CACHE_SIZE > SLAB_BLOCK_SIZE - SLAB_BLOCK_HEADER) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    slab_t* slab = (slab_t*)malloc(sizeof(slab_t));
+    if (!slab) return NULL;
+    int error = pthread_key_create(&slab->key, slab_thread_exit);
+    if (error != 0) {
+        free(slab);
+        errno = error;
+        return NULL;
+    }
+    if ((error = pthread_mutex_init(&slab->lock, NULL)) != 0) {
+        pthread_key_delete(slab->key);
+        free(slab);
+        errno = error;
+        return NULL;
+    }
+
+    slab->size = size;
+    slab->objects = NULL;
+    slab->unused = slab->unused_end = NULL;
+    slab->blocks = NULL;
+    slab->caches = NULL;
+    return slab;
+}
+
+void slab_destroy(slab_t* slab) {
+    if (!slab) return;
+
+    // Da qui in poi, la terminazione di un thread non tocca più le caches
+    pthread_key_delete(slab->key);
+    while (slab->caches) {
+        slab_cache_t* next = slab->caches->next;
+        free(slab->caches);
+        slab->caches = next;
+    }
+    // Gli oggetti, liberi o meno, si trovano tutti nei blocchi
+    while (slab->blocks) {
+        slab_block_t* next = slab->blocks->next;
+        free(slab->blocks);
+        slab->blocks = next;
+    }
+    pthread_mutex_destroy(&slab->lock);
+    free(slab);
+}
+
+void* slab_alloc(slab_t* slab) {
+    if (!slab) {
+        errno = EINVAL;
+        return NULL;
+    }
+    slab_cache_t* cache = slab_cache(slab);
+    if (cache && cache->count > 0) return cache->objects[--cache->count];
+
+    // Cache vuota: la riempio per metà, così che i rilasci successivi non la svuotino subito
+    // Senza una cache, prelevo un solo oggetto
+    void* object = NULL;
+    LOCK(&slab->lock);
+    if (cache) {
+        cache->count = slab_refill(slab, cache->objects, SLAB_CACHE_SIZE / 2);
+        if (cache->count > 0) object = cache->objects[--cache->count];
+    } else {
+        slab_refill(slab, &object, 1);
+    }
+    UNLOCK(&slab->lock);
+
+    if (!object) errno = ENOMEM;
+    return object;
+}
+
+void slab_free(void* object) {
+    if (!object) return;
+    // L'intestazione del blocco si trova all'inizio della memoria allineata che contiene l'oggetto
+    slab_block_t* block = (slab_block_t*)((uintptr_t)object & ~(uintptr_t)(SLAB_BLOCK_SIZE - 1));
+    slab_t* slab = block->slab;
+
+    slab_cache_t* cache = slab_cache(slab);
+    if (cache && cache->count < SLAB_CACHE_SIZE) {
+        cache->objects[cache->count++] = object;
+        return;
+    }
+
+    // Cache piena: restituisco all'allocatore la metà meno recente, mantenendo gli oggetti rilasciati per ultimi
+    LOCK(&slab->lock);
+    if (cache) {
+        slab_release(slab, cache->objects, SLAB_CACHE_SIZE / 2);
+        memmove(cache->objects, cache->objects + SLAB_CACHE_SIZE / 2, (SLAB_CACHE_SIZE / 2) * sizeof(void*));
+        cache->count = SLAB_CACHE_SIZE / 2;
+        cache->objects[cache->count++] = object;
+    } else {
+        slab_release(slab, &object, 1);
+    }
+    UNLOCK(&slab->lock);
+}
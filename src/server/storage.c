@@ -1,19 +1,66 @@
 // @author Luca Cirillo (545480)
 
 #include <constants.h>
+#include <epoch.h>
 #include <errno.h>
-#include <icl_hash.h>
+#include <hashtable.h>
+#include <policy.h>
+#include <pthread.h>
 #include <rwlock.h>
+#include <slab.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <storage.h>
 #include <string.h>
 #include <time.h>
 #include <utils.h>
 
-storage_t* storage_create(size_t max_files, size_t max_capacity, replacement_policy_t rp) {
+// * Sincronizzazione
+// Le ricerche nelle hashmap non acquisiscono alcun lock: ogni API si svolge in una sezione critica dell'epoca dello storage.
+// Il lock di una partizione serializza solamente le modifiche della sua hashmap (inserimento e rimozione di un file);
+//  un file rimosso o espulso viene prima scollegato dalla hashmap e marcato come <removed>, con il proprio lock in scrittura,
+//  e viene cancellato solamente quando nessuna sezione critica può più vederlo (epoch_retire).
+// Trovato un file, il suo lock ne protegge il contenuto: chi lo acquisisce controlla che il file non sia stato rimosso nel frattempo.
+// Numero di file e spazio occupato sono contatori atomici, riservati prima di inserire un file o di scriverne il contenuto:
+//  l'unica operazione che coinvolge più partizioni è l'algoritmo di rimpiazzo, eseguito senza tenere altri lock.
+// Un file in scrittura (writing) non viene né espulso né rimosso, e resta quindi valido anche fuori da una sezione critica.
+// L'indice di rimpiazzo di ogni partizione ha il proprio lock, acquisito sempre per ultimo: l'algoritmo di rimpiazzo
+//  sceglie il candidato dalla testa degli indici, senza scorrere le hashmap.
+
+// Capienza iniziale massima della tabella hash di una partizione, che cresce poi insieme ai file
+#define STORAGE_TABLE_CAPACITY 1024
+
+// Lunghezza della classe più piccola dei nomi dei file, terminatore compreso
+#define STORAGE_NAME_MIN 32
+
+// File a cui appartiene il nodo <node> dell'indice di rimpiazzo
+#define STORAGE_FILE_OF(node) ((storage_file_t*)((char*)(node) - offsetof(storage_file_t, policy)))
+
+// Ritorna la classe di lunghezza di un nome di <length> bytes, terminatore compreso, oppure STORAGE_NAME_CLASSES se troppo lungo
+static size_t storage_name_class(size_t length) {
+    size_t class = 0;
+    for (size_t limit = STORAGE_NAME_MIN; class < STORAGE_NAME_CLASSES && length > limit; limit *= 2) class++;
+    return class;
+}
+
+// Libera le risorse del file <file> che non si trovano negli slab dello storage: contenuto, lettori e nome se troppo lungo
+static void storage_file_release(void* file) {
+    storage_file_t* f = (storage_file_t*)file;
+    storage_blob_release(f->contents);
+    linked_list_clear(&f->readers);
+    if (storage_name_class(strlen(f->name) + 1) == STORAGE_NAME_CLASSES) {
+        free(f->name);
+        f->name = NULL;
+    }
+}
+
+storage_t* storage_create(size_t max_files, size_t max_capacity, replacement_policy_t rp, size_t shards) {
     // Controllo la validità degli argomenti
-    if (max_files == 0 || max_capacity == 0) {
+    if (max_files == 0 || max_capacity == 0 || shards == 0 || shards > (1U << 16)) {
         errno = EINVAL;
         return NULL;
     }
@@ -21,34 +68,126 @@ storage_t* storage_create(size_t max_files, size_t max_capacity, replacement_pol
     // Alloco la memoria per lo storage
     storage_t* storage = malloc(sizeof(storage_t));
     if (!storage) return NULL;
-
-    // Inizializzo la struttura relativa al lock globale dello storage
-    storage->rwlock = rwlock_create();
-    if (!storage->rwlock) {
+    if (pthread_mutex_init(&storage->eviction_lock, NULL) != 0) {
+        free(storage);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (pthread_mutex_init(&storage->reclaim_lock, NULL) != 0) {
+        pthread_mutex_destroy(&storage->eviction_lock);
+        free(storage);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (pthread_cond_init(&storage->reclaim_cond, NULL) != 0) {
+        pthread_mutex_destroy(&storage->reclaim_lock);
+        pthread_mutex_destroy(&storage->eviction_lock);
         free(storage);
+        errno = ENOMEM;
         return NULL;
     }
 
-    // Creo la hashmap per memorizzare i files
-    storage->files = icl_hash_create(max_files, NULL, NULL);
-    if (!storage->files) {
-        rwlock_destroy(storage->rwlock);
+    // Creo il dominio di reclamation dei file rimossi
+    if ((storage->epoch = epoch_create()) == NULL) {
+        pthread_cond_destroy(&storage->reclaim_cond);
+        pthread_mutex_destroy(&storage->reclaim_lock);
+        pthread_mutex_destroy(&storage->eviction_lock);
         free(storage);
         return NULL;
     }
 
+    // Creo gli allocatori delle strutture dati e dei nomi dei file, annullati così che storage_destroy li riconosca
+    storage->file_slab = NULL;
+    for (size_t i = 0; i < STORAGE_NAME_CLASSES; i++) storage->name_slabs[i] = NULL;
+    storage->shards = NULL;
+    storage->shards_no = 0;
+    storage->policies = NULL;
+    storage->policies_no = 0;
+    bool slabs_created = (storage->file_slab = slab_create(sizeof(storage_file_t))) != NULL;
+    for (size_t i = 0; slabs_created && i < STORAGE_NAME_CLASSES; i++)
+        slabs_created = (storage->name_slabs[i] = slab_create(STORAGE_NAME_MIN << i)) != NULL;
+    if (!slabs_created) {
+        storage_destroy(storage);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Il numero di partizioni è una potenza di 2, così che la partizione sia data dai bits alti dell'hash
+    storage->shards_no = 1;
+    storage->shards_shift = 64;
+    while (storage->shards_no < shards) {
+        storage->shards_no *= 2;
+        storage->shards_shift--;
+    }
+
+    // Creo gli indici di rimpiazzo, uno per partizione: le vittime delle partizioni si confrontano con un ordine globale
+    // ARC, 2Q e W-TinyLFU adattano invece le proprie code alla storia dei file espulsi, che non ha senso confrontare
+    //  tra partizioni: usano un solo indice, dimensionato per tutti i file, così che una scansione non svuoti i più utilizzati
+    // Anche GDSF usa un solo indice, perché le priorità dipendono dall'inflazione L, che deve essere una per tutto lo storage
+    bool global = rp == ARC || rp == TWO_QUEUE || rp == W_TINYLFU || rp == GDSF;
+    size_t policies_no = global ? 1 : storage->shards_no;
+    storage->policies = calloc(policies_no, sizeof(policy_t));
+    if (!storage->policies) {
+        storage_destroy(storage);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (; storage->policies_no < policies_no; storage->policies_no++) {
+        if (policy_init(&storage->policies[storage->policies_no], rp, max_files / policies_no) == -1) {
+            storage_destroy(storage);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    // Creo le partizioni, ognuna con la propria hashmap ed il proprio lock
+    storage->shards = calloc(storage->shards_no, sizeof(storage_shard_t));
+    if (!storage->shards) {
+        storage->shards_no = 0;
+        storage_destroy(storage);
+        errno = ENOMEM;
+        return NULL;
+    }
+    // Le tabelle crescono con i file, quindi non serve dimensionarle subito per il numero massimo di file
+    size_t table_capacity = MIN(max_files / storage->shards_no + 1, STORAGE_TABLE_CAPACITY);
+    for (size_t i = 0; i < storage->shards_no; i++) {
+        // Il lock di una partizione è inizializzato se e solo se lo è la sua hashmap
+        storage_shard_t* shard = &storage->shards[i];
+        shard->policy = &storage->policies[i % storage->policies_no];
+        bool created = pthread_mutex_init(&shard->lock, NULL) == 0;
+        if (created && (shard->files = hashtable_create(table_capacity, storage->epoch)) == NULL) {
+            pthread_mutex_destroy(&shard->lock);
+            created = false;
+        }
+        if (!created) {
+            storage->shards_no = i;
+            storage_destroy(storage);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
     // Inizializzo o salvo gli altri parametri
     storage->replacement_policy = rp;
-    storage->number_of_files = 0;
+    atomic_init(&storage->number_of_files, 0);
     storage->max_files = max_files;
-    storage->capacity = 0;
+    atomic_init(&storage->capacity, 0);
     storage->max_capacity = max_capacity;
 
+    // Il reclaimer resta inattivo finché non vengono impostate le sue soglie
+    storage->files_high = storage->files_low = SIZE_MAX;
+    storage->capacity_high = storage->capacity_low = SIZE_MAX;
+    storage->reclaim_requested = false;
+    storage->reclaim_stopped = false;
+
     // Inizializzo le statistiche
     storage->start_timestamp = time(NULL);
-    storage->max_files_reached = 0;
-    storage->max_capacity_reached = 0;
-    storage->rp_algorithm_counter = 0;
+    atomic_init(&storage->max_files_reached, 0);
+    atomic_init(&storage->max_capacity_reached, 0);
+    atomic_init(&storage->rp_algorithm_counter, 0);
+    atomic_init(&storage->evicted_files, 0);
+    atomic_init(&storage->evicted_bytes, 0);
+    atomic_init(&storage->reclaimed_files, 0);
 
     // Ritorno un puntatore allo storage
     return storage;
@@ -57,66 +196,116 @@ storage_t* storage_create(size_t max_files, size_t max_capacity, replacement_pol
 void storage_destroy(storage_t* storage) {
     // Controllo la validità degli argomenti
     if (!storage) return;
-    // Cancello la hashmap
-    icl_hash_destroy(storage->files, NULL, storage_file_destroy);
-    // Cancello il RWLock
-    rwlock_destroy(storage->rwlock);
+    // Cancello le partizioni, con le loro hashmap ed i loro lock
+    // Dei file memorizzati libero solamente le risorse esterne agli slab, le cui strutture dati vengono cancellate tutte insieme
+    for (size_t i = 0; i < storage->shards_no; i++) {
+        if (!storage->shards[i].files) continue;
+        hashtable_destroy(storage->shards[i].files, storage_file_release);
+        pthread_mutex_destroy(&storage->shards[i].lock);
+    }
+    free(storage->shards);
+    for (size_t i = 0; i < storage->policies_no; i++) policy_destroy(&storage->policies[i]);
+    free(storage->policies);
+    // Cancello i file rimossi in attesa del periodo di grazia, restituendoli agli slab
+    epoch_destroy(storage->epoch);
+    // Cancello gli slab, in O(blocchi) anziché in O(file)
+    slab_destroy(storage->file_slab);
+    for (size_t i = 0; i < STORAGE_NAME_CLASSES; i++) slab_destroy(storage->name_slabs[i]);
+    pthread_cond_destroy(&storage->reclaim_cond);
+    pthread_mutex_destroy(&storage->reclaim_lock);
+    pthread_mutex_destroy(&storage->eviction_lock);
     // Libero la memoria dello storage
     free(storage);
 }
 
-storage_file_t* storage_file_create(const char* name, const void* contents, size_t size) {
+storage_blob_t* storage_blob_create(size_t capacity) {
+    storage_blob_t* blob = malloc(sizeof(storage_blob_t) + capacity);
+    if (!blob) return NULL;
+    atomic_init(&blob->references, 1);
+    blob->capacity = capacity;
+    return blob;
+}
+
+storage_blob_t* storage_blob_acquire(storage_blob_t* blob) {
+    if (blob) atomic_fetch_add_explicit(&blob->references, 1, memory_order_relaxed);
+    return blob;
+}
+
+void storage_blob_release(void* blob) {
+    if (!blob) return;
+    // L'ultimo riferimento rilasciato deve vedere tutte le scritture di chi lo ha preceduto
+    if (atomic_fetch_sub_explicit(&((storage_blob_t*)blob)->references, 1, memory_order_acq_rel) == 1) free(blob);
+}
+
+// * Ritorna un blob di almeno <capacity> bytes, i cui primi <size> coincidono con quelli di <blob>, che viene sostituito
+// Un blob condiviso con letture in corso non può essere spostato: in quel caso ne viene creato uno nuovo
+// Va chiamata con il lock in scrittura sul file che contiene <blob>, così che nessuno possa acquisirne altri riferimenti
+static storage_blob_t* storage_blob_grow(storage_blob_t* blob, size_t size, size_t capacity) {
+    if (blob && blob->capacity >= capacity) return blob;
+    if (blob && atomic_load(&blob->references) == 1) {
+        storage_blob_t* grown = realloc(blob, sizeof(storage_blob_t) + capacity);
+        if (!grown) return NULL;
+        grown->capacity = capacity;
+        return grown;
+    }
+    storage_blob_t* grown = storage_blob_create(capacity);
+    if (!grown) return NULL;
+    if (size > 0) memcpy(grown->data, blob->data, size);
+    storage_blob_release(blob);
+    return grown;
+}
+
+storage_file_t* storage_file_create(storage_t* storage, const char* name, storage_blob_t* contents, size_t size) {
     // Controllo la validità degli argomenti
-    if (!name) {
+    if (!storage || !name) {
         errno = EINVAL;
         return NULL;
     }
     // Alloco la memoria per un file
-    storage_file_t* file = malloc(sizeof(storage_file_t));
+    storage_file_t* file = slab_alloc(storage->file_slab);
     if (!file) return NULL;
 
-    // Salvo il nome del file
-    size_t length = strlen(name);
-    if ((file->name = malloc(length + 1)) == NULL) {
-        free(file);
+    // Salvo il nome del file, da uno slab se abbastanza corto
+    size_t length = strlen(name) + 1;
+    size_t class = storage_name_class(length);
+    file->name = class < STORAGE_NAME_CLASSES ? slab_alloc(storage->name_slabs[class]) : malloc(length);
+    if (!file->name) {
+        slab_free(file);
+        return NULL;
+    }
+    memcpy(file->name, name, length);
+
+    // Inizializzo il lock prima di condividere il contenuto, così da non doverne rilasciare il riferimento in caso di errore
+    if (!rwlock_init(&file->rwlock)) {
+        if (class < STORAGE_NAME_CLASSES) slab_free(file->name);
+        else free(file->name);
+        slab_free(file);
+        errno = ENOMEM;
         return NULL;
     }
-    memset(file->name, 0, length + 1);
-    strncpy(file->name, name, length);
 
-    // Salvo il contenuto del file
+    // Condivido il contenuto del file, se specificato, senza copiarlo
     if (contents && size > 0) {
-        if ((file->contents = malloc(size)) == NULL) {
-            free(file->name);
-            free(file);
-            return NULL;
-        }
-        memcpy(file->contents, contents, size);
+        file->contents = storage_blob_acquire(contents);
         file->size = size;
     } else {
-        // Se il contenuto non è specificato, inizializzo i campi di contenuto e dimensione
         file->contents = NULL;
         file->size = 0;
     }
 
-    // Inizializzo la struttura relativa al lock del file
-    file->rwlock = rwlock_create();
-    if (!file->rwlock) {
-        free(file->contents);
-        free(file->name);
-        free(file);
-        return NULL;
-    }
-
     // Lettori che hanno aperto il file
-    file->readers = linked_list_create();
+    linked_list_init(&file->readers);
     // Scrittore che ha la lock sul file
     file->writer = 0;
+    file->writing = false;
+    file->removed = false;
+    // Il file entra nell'indice di rimpiazzo solamente quando viene inserito nello storage
+    memset(&file->policy, 0, sizeof(policy_node_t));
 
     // Dati utili alla politica di rimpiazzo scelta
     file->creation_time = time(NULL);           // Timestamp corrente
-    file->last_use_time = file->creation_time;  // Inizialmente, coincide con il tempo di creazione
-    file->frequency = 0;                        // Si suppone che la creazione del file non conti come utilizzo dello stesso
+    atomic_init(&file->last_use_time, file->creation_time);  // Inizialmente, coincide con il tempo di creazione
+    atomic_init(&file->frequency, 0);                        // Si suppone che la creazione del file non conti come utilizzo dello stesso
 
     // Nota: non ha senso impostare inizialmente <last_use_time> a 0 in quanto un file appena creato è vuoto,
     // e da li a poco seguirà, tipicamente, una writeFile. Dal punto di vista della politica di rimpiazzo,
@@ -130,86 +319,248 @@ void storage_file_destroy(void* file) {
     // Controllo la validità degli argomenti
     if (!file) return;
     storage_file_t* f = (storage_file_t*)file;
-    // Libero la memoria occupata dal file
-    if (f->name) free(f->name);
-    if (f->contents) free(f->contents);
-    if (f->readers) linked_list_destroy(f->readers);
-    rwlock_destroy(f->rwlock);
-    free(f);
+    // Libero la memoria occupata dal file, restituendo nome e struttura dati ai loro slab
+    rwlock_deinit(&f->rwlock);
+    storage_file_release(f);
+    if (f->name) slab_free(f->name);
+    slab_free(f);
+}
+
+// Visualizza il file <value>, numerandolo con <counter>
+static bool storage_print_file(void* value, void* counter) {
+    storage_file_t* file = (storage_file_t*)value;
+    char* human_readable_size = calculate_size(file->size);
+    fprintf(stdout, "[%d] (%s) %s\n", (*(int*)counter)++, human_readable_size, file->name);
+    free(human_readable_size);
+    return true;
 }
 
 void storage_print(storage_t* storage) {
     if (!storage) return;
-    if (storage->number_of_files == 0)
+    if (atomic_load(&storage->number_of_files) == 0) {
         printf("Storage is empty!\n");
-    else
-        icl_hash_print(storage->files);
+        return;
+    }
+    int counter = 1;
+    for (size_t i = 0; i < storage->shards_no; i++) hashtable_foreach(storage->shards[i].files, storage_print_file, &counter);
 }
 
 void storage_file_print(storage_file_t* file) {
     if (!file) return;
     printf("%s (%zd Bytes)\nWriter: [%d], Readers: ", file->name, file->size, file->writer);
-    linked_list_print(file->readers);
+    linked_list_print(&file->readers);
     printf("Creation time: %ld\n", file->creation_time);
-    printf("Last use time: %ld\n", file->last_use_time);
-    printf("Frequency: %u\n", file->frequency);
+    printf("Last use time: %ld\n", (long)atomic_load(&file->last_use_time));
+    printf("Frequency: %u\n", atomic_load(&file->frequency));
 }
 
-// ! APIs
+// Ritorna la partizione a cui appartiene il file di hash <hash>
+static storage_shard_t* storage_shard(storage_t* storage, uint64_t hash) {
+    if (storage->shards_no == 1) return storage->shards;
+    // Uso i bits alti dell'hash, indipendenti dai bits bassi con cui la tabella della partizione sceglie il gruppo
+    return &storage->shards[hash >> storage->shards_shift];
+}
 
-int storage_open_file(storage_t* storage, const char* pathname, int flags, int* victims_no, storage_file_t*** victims, int client) {
-    // Controllo la validità degli argomenti
-    if (!storage || !pathname || flags < 0) {
-        errno = EINVAL;
-        return -1;
+// Aggiorna il massimo <max> con <value>, se maggiore
+static void storage_update_max(atomic_size_t* max, size_t value) {
+    size_t current = atomic_load_explicit(max, memory_order_relaxed);
+    while (value > current && !atomic_compare_exchange_weak_explicit(max, &current, value, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+// * Aggiorna le statistiche del file <file>; se si tratta di un utilizzo (<use>), lo registra anche nell'indice di rimpiazzo
+// Sono utilizzi l'apertura di un file esistente e la lettura del suo contenuto: scrittura, lock e chiusura appartengono
+//  alla stessa sessione, e contarli promuoverebbe ogni file appena scritto tra i riutilizzati (ARC, 2Q)
+// Le statistiche sono atomiche e l'utilizzo viene registrato senza il lock dell'indice, quindi basta il lock in lettura sul file
+static void storage_file_touch(storage_file_t* file, bool use) {
+    time_t now = time(NULL);
+    // Scrivo il timestamp solamente se è cambiato, così che i lettori di un file molto letto non si contendano la sua linea di cache
+    if (atomic_load_explicit(&file->last_use_time, memory_order_relaxed) != now)
+        atomic_store_explicit(&file->last_use_time, now, memory_order_relaxed);
+    if (!use) return;
+    atomic_fetch_add_explicit(&file->frequency, 1, memory_order_relaxed);
+    policy_touch(&file->policy);
+}
+
+// Priorità di espulsione del file <file> secondo la politica <rp>: viene espulso il file con il valore più basso
+// Confronta i candidati di indici diversi; le politiche con un solo indice (adattive e GDSF) non vengono mai confrontate
+static long long storage_victim_key(replacement_policy_t rp, const storage_file_t* file) {
+    switch (rp) {
+        case FIFO:
+            return (long long)file->creation_time;
+        case LFU:
+            return (long long)atomic_load_explicit(&file->frequency, memory_order_relaxed);
+        default:
+            return (long long)atomic_load_explicit(&file->last_use_time, memory_order_relaxed);
     }
+}
 
-    // Controllo se i flags O_CREATE e O_LOCK sono settati
-    bool create_flag = IS_O_CREATE(flags);
-    bool lock_flag = IS_O_LOCK(flags);
+// * Scollega il file <file> dalla partizione <shard> e ne rimanda la cancellazione; <evicted> se espulso dal rimpiazzo
+// Va chiamata con il lock della partizione ed il lock in scrittura sul file
+static void storage_unlink(storage_t* storage, storage_shard_t* shard, storage_file_t* file, bool evicted) {
+    bool unlinked = hashtable_remove(shard->files, file->name, hashtable_hash(file->name)) != NULL;
+    policy_remove(&file->policy, evicted);
+    file->removed = true;
+    // Chi ha trovato il file prima che venisse scollegato può ancora accedervi, fino al termine della propria sezione critica
+    if (unlinked) epoch_retire(storage->epoch, file, storage_file_destroy);
+}
+
+// * Cerca il file <pathname> ed acquisisce il suo lock, in scrittura se <exclusive> ed altrimenti in lettura
+// Va chiamata in una sezione critica dell'epoca; ritorna NULL, con errno pari a ENOENT, se il file non esiste
+static storage_file_t* storage_acquire(storage_t* storage, const char* pathname, bool exclusive) {
+    uint64_t hash = hashtable_hash(pathname);
+    storage_file_t* file = hashtable_find(storage_shard(storage, hash)->files, pathname, hash);
+    if (file) {
+        if (exclusive)
+            rwlock_start_write(&file->rwlock);
+        else
+            rwlock_start_read(&file->rwlock);
+        // Il file potrebbe essere stato rimosso tra la ricerca e l'acquisizione del lock
+        if (!file->removed) return file;
+        if (exclusive)
+            rwlock_done_write(&file->rwlock);
+        else
+            rwlock_done_read(&file->rwlock);
+    }
+    errno = ENOENT;
+    return NULL;
+}
 
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
+// Un file può essere espulso se il suo contenuto non è in ricezione, e se non è il file <pathname> che richiede lo spazio
+static bool storage_evictable(policy_node_t* node, void* pathname) {
+    const storage_file_t* file = STORAGE_FILE_OF(node);
+    return !file->writing && (!pathname || strcmp(file->name, (const char*)pathname) != 0);
+}
 
-    // Controllo se il file esiste all'interno dello storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
-    // Mantengo separata l'informazione sull'esistenza del file per leggibilità
-    bool already_exists = (bool)file;
+// * Espelle dallo storage un file diverso da <pathname> (se non NULL), secondo la politica di rimpiazzo, e lo aggiunge a <victims>
+// Va chiamata in una sezione critica dell'epoca e senza alcun lock di partizione, perché li acquisisce uno alla volta
+static int storage_evict(storage_t* storage, const char* pathname, int* victims_no, storage_file_t*** victims) {
+    // Preparo lo spazio per la nuova vittima
+    storage_file_t** grown = realloc(*victims, sizeof(storage_file_t*) * (*victims_no + 1));
+    if (!grown) return -1;
+    *victims = grown;
+
+    // Un solo algoritmo di rimpiazzo alla volta, così che più client non espellano file per lo stesso spazio libero
+    LOCK(&storage->eviction_lock);
+    while (true) {
+        // Il candidato di ogni indice è in testa alle sue code: mantengo il migliore
+        // Nella sezione critica i candidati restano validi anche se vengono rimossi nel frattempo
+        storage_file_t* best = NULL;
+        long long best_key = 0;
+        for (size_t i = 0; i < storage->policies_no; i++) {
+            policy_node_t* node = policy_victim(&storage->policies[i], storage_evictable, (void*)pathname);
+            if (!node) continue;
+            storage_file_t* candidate = STORAGE_FILE_OF(node);
+            long long key = storage_victim_key(storage->replacement_policy, candidate);
+            if (!best || key < best_key) {
+                best = candidate;
+                best_key = key;
+            }
+        }
 
-    // Gestisco prima tutte le possibili situazioni di errore
-    // Flag O_CREATE settato e file già esistente
-    if (create_flag && already_exists) {
-        rwlock_done_read(storage->rwlock);
-        errno = EEXIST;
-        return -1;
+        if (!best) {
+            // Non è possibile espellere alcun file
+            UNLOCK(&storage->eviction_lock);
+            errno = ECANCELED;
+            return -1;
+        }
+
+        // Il client riceve un nuovo file a cui passa il contenuto della vittima, mentre il file originale viene ritirato
+        storage_file_t* victim = storage_file_create(storage, best->name, NULL, 0);
+        if (!victim) {
+            UNLOCK(&storage->eviction_lock);
+            return -1;
+        }
+
+        // Rimuovo il candidato, a meno che nel frattempo non sia stato rimosso oppure non sia entrato in scrittura
+        storage_shard_t* best_shard = storage_shard(storage, hashtable_hash(best->name));
+        LOCK(&best_shard->lock);
+        rwlock_start_write(&best->rwlock);
+        bool evicted = !best->removed && !best->writing;
+        if (evicted) {
+            victim->contents = best->contents;
+            victim->size = best->size;
+            best->contents = NULL;
+            best->size = 0;
+            storage_unlink(storage, best_shard, best, true);
+        }
+        rwlock_done_write(&best->rwlock);
+        UNLOCK(&best_shard->lock);
+        if (!evicted) {
+            storage_file_destroy(victim);
+            continue;
+        }
+
+        atomic_fetch_sub(&storage->number_of_files, 1);
+        atomic_fetch_sub(&storage->capacity, victim->size);
+        atomic_fetch_add_explicit(&storage->evicted_files, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&storage->evicted_bytes, victim->size, memory_order_relaxed);
+        (*victims)[(*victims_no)++] = victim;
+        UNLOCK(&storage->eviction_lock);
+        return 0;
     }
-    // Flag O_CREATE non settato e file non esistente
-    if (!create_flag && !already_exists) {
-        rwlock_done_read(storage->rwlock);
-        errno = ENOENT;
-        return -1;
+}
+
+// * Sveglia il reclaimer se lo storage ha superato una delle soglie alte
+static void storage_reclaim_notify(storage_t* storage) {
+    if (atomic_load_explicit(&storage->number_of_files, memory_order_relaxed) <= storage->files_high &&
+        atomic_load_explicit(&storage->capacity, memory_order_relaxed) <= storage->capacity_high)
+        return;
+    LOCK(&storage->reclaim_lock);
+    storage->reclaim_requested = true;
+    pthread_cond_signal(&storage->reclaim_cond);
+    UNLOCK(&storage->reclaim_lock);
+}
+
+// * Riserva <amount> unità del contatore <counter>, che non può superare <limit>, espellendo file finché necessario
+// Se il reclaimer è attivo, di norma lo spazio è già stato liberato in background e non serve espellere alcun file
+static int storage_reserve(storage_t* storage, atomic_size_t* counter, size_t limit, size_t amount, const char* pathname,
+                           int* victims_no, storage_file_t*** victims) {
+    size_t current = atomic_load(counter);
+    while (true) {
+        if (current + amount <= limit) {
+            if (!atomic_compare_exchange_weak(counter, &current, current + amount)) continue;
+            storage_reclaim_notify(storage);
+            return 0;
+        }
+        if (storage_evict(storage, pathname, victims_no, victims) == -1) return -1;
+        current = atomic_load(counter);
     }
+}
+
+// * Annulla la prenotazione di una scrittura sul file <file>, restituendo i <size> bytes riservati
+// *  e recuperando i <released> bytes liberati, e riammette il file al rimpiazzo
+static void storage_write_release(storage_t* storage, storage_file_t* file, size_t size, size_t released) {
+    atomic_fetch_sub(&storage->capacity, size);
+    atomic_fetch_add(&storage->capacity, released);
+    rwlock_start_write(&file->rwlock);
+    file->writing = false;
+    rwlock_done_write(&file->rwlock);
+}
+
+// Corpo delle APIs, eseguito in una sezione critica dell'epoca con argomenti già validati
 
-    // I flags sono coerenti con lo stato dello storage, posso procedere
-    // Distinguo il caso in cui il file esiste già da quello in cui non esiste ancora
-    if (already_exists) {  // && !O_CREATE
-        // * Il file esiste già nello storage
+static int open_file(storage_t* storage, const char* pathname, int flags, int* victims_no, storage_file_t*** victims, int client) {
+    // Controllo se i flags O_CREATE e O_LOCK sono settati
+    bool create_flag = IS_O_CREATE(flags);
+    bool lock_flag = IS_O_LOCK(flags);
 
-        // Acquisisco l'accesso in lettura sul file
-        rwlock_start_read(file->rwlock);
+    if (!create_flag) {
+        // * Il file deve esistere già nello storage
+        // Recupero il file ed acquisisco l'accesso in scrittura su di esso
+        storage_file_t* file = storage_acquire(storage, pathname, true);
+        if (!file) return -1;
 
         // Controllo che il file non sia già stato aperto dal client
         //  in lettura, oppure anche in scrittura se O_LOCK è stato specificato
-        if ((linked_list_find(file->readers, client) && !lock_flag) || (file->writer == client && lock_flag)) {
-            rwlock_done_read(file->rwlock);
-            rwlock_done_read(storage->rwlock);
+        if ((linked_list_find(&file->readers, client) && !lock_flag) || (file->writer == client && lock_flag)) {
+            rwlock_done_write(&file->rwlock);
             return 0;
         }
 
         // Controllo che il file non sia aperto in scrittura (locked) da un altro client
         if (file->writer != 0 && file->writer != client) {
-            rwlock_done_read(file->rwlock);
-            rwlock_done_read(storage->rwlock);
+            rwlock_done_write(&file->rwlock);
             errno = EACCES;
             return -1;
         }
@@ -217,23 +568,16 @@ int storage_open_file(storage_t* storage, const char* pathname, int flags, int*
         // Controllo che il client non abbia già aperto il file (almeno in lettura)
         // Qualora fosse già stato aperto in lettura e venisse chiesto l'accesso in scrittura,
         //  questo deve essere richiesto dal client tramite la API lockFile
-        if (linked_list_find(file->readers, client) && lock_flag) {
-            rwlock_done_read(file->rwlock);
-            rwlock_done_read(storage->rwlock);
+        if (linked_list_find(&file->readers, client) && lock_flag) {
+            rwlock_done_write(&file->rwlock);
             errno = EEXIST;
             return -1;
         }
 
-        // Rilascio l'accesso in lettura sul file
-        rwlock_done_read(file->rwlock);
-        // Acquisisco l'accesso in scrittura sul file
-        rwlock_start_write(file->rwlock);
-
         // Apro il file in lettura per il client
-        if (!linked_list_insert(file->readers, client)) {
+        if (!linked_list_insert(&file->readers, client)) {
             // Errore di inserimento in lista
-            rwlock_done_write(file->rwlock);
-            rwlock_done_read(storage->rwlock);
+            rwlock_done_write(&file->rwlock);
             // Errno è settato da linked_list_insert
             return -1;
         }
@@ -242,661 +586,604 @@ int storage_open_file(storage_t* storage, const char* pathname, int flags, int*
         if (lock_flag) file->writer = client;
 
         // Aggioro le statistiche del file
-        file->last_use_time = time(NULL);
-        file->frequency++;
-
-        // Ho terminato, rilascio le lock acquisite
-        rwlock_done_write(file->rwlock);
-        rwlock_done_read(storage->rwlock);
-
-    } else {  // && O_CREATE
-        // * Il file non esiste ancora nello storage, lo creo
-
-        // Se è stato raggiunto il numero massimo di file consentiti, faccio partire l'algoritmo di rimpiazzo
-        if (storage->number_of_files == storage->max_files) {
-            // Algoritmo di rimpiazzo
-            *victims_no = 0;
-            *victims = malloc(sizeof(storage_file_t*) * storage->number_of_files);  // Al più, rimuovo tutti i file presenti
-            // Nonostante serva espellere un solo file, utilizzo un while
-            while (storage->number_of_files == storage->max_files) {
-                // Seleziono il file da espellere
-                storage_file_t* victim = (storage_file_t*)icl_hash_get_victim(storage->files, storage->replacement_policy, pathname);
-
-                if (!victim) {
-                    // Non è stato possibile espelle alcun file, scrittura annullata
-                    rwlock_done_read(storage->rwlock);
-                    errno = ECANCELED;
-                    return -1;
-                }
-
-                // Effettuo una copia del file per poterlo inviare al client
-                (*victims)[*victims_no] = storage_file_create(victim->name, victim->contents, victim->size);
-
-                // Elimino il file dallo storage
-                if (icl_hash_delete(storage->files, victim->name, NULL, storage_file_destroy) == -1) {
-                    // Errore nella cancellazione del file
-                    // Annullo la selezione della vittima, e riprovo
-                    storage_file_destroy(((*victims)[*victims_no]));
-                    continue;
-                }
-
-                // Aggiorno le informazioni dello storage
-                storage->number_of_files--;                          // Decremento il numero di file nello storage
-                storage->capacity -= (*victims)[*victims_no]->size;  // Libero lo spazio occupato dal file rimosso
-
-                // Incremento il numero dei file espulsi
-                (*victims_no)++;
-            }
-        }
-
-        // Rilascio l'accesso in lettura sullo storage
-        rwlock_done_read(storage->rwlock);
-        // Acquisisco l'accesso in scrittura sullo storage
-        rwlock_start_write(storage->rwlock);
-
-        // Creo un nuovo file vuoto
-        file = storage_file_create(pathname, NULL, 0);
-
-        // * Non è necessario richiedere l'accesso in scrittura sul file
-        // *  perché non può essere ancora utilizzato da altri client
-
-        // Lo apro in lettura per il client
-        if (!linked_list_insert(file->readers, client)) {
-            // Errore di inserimento in lista
-            storage_file_destroy((void*)file);
-            rwlock_done_write(storage->rwlock);
-            // Errno viene settato da linked_list_insert
-            return -1;
-        }
-
-        // Se il flag O_LOCK è stato settato, apro il file anche in scrittura per il client
-        if (lock_flag) file->writer = client;
-
-        // Inserisco il file nello storage
-        if (!icl_hash_insert(storage->files, file->name, file)) {
-            // Se l'inserimento nello storage fallisce, libero la memoria e ritorno errore
-            storage_file_destroy((void*)file);
-            rwlock_done_write(storage->rwlock);
-            // Errno viene settato da icl_hash_insert
-            return -1;
-        }
+        storage_file_touch(file, true);
 
-        // Aggiorno le informazioni dello storage
-        storage->number_of_files++;  // Incremento il numero di file presenti nello storage
-        storage->max_files_reached = MAX(storage->max_files_reached, storage->number_of_files);
-        if (*victims_no > 0) storage->rp_algorithm_counter++;
-
-        // Rilascio l'accesso in scrittura sullo storage
-        rwlock_done_write(storage->rwlock);
+        // Ho terminato, rilascio il lock acquisito
+        rwlock_done_write(&file->rwlock);
+        return 0;
     }
 
-    return 0;
-}
-
-int storage_read_file(storage_t* storage, const char* pathname, void** contents, size_t* size, int client) {
-    // Controllo la validità degli argomenti
-    if (!storage || !pathname || !contents || !size) {
-        errno = EINVAL;
+    // * Il file non deve esistere ancora nello storage, lo creo
+    uint64_t hash = hashtable_hash(pathname);
+    storage_shard_t* shard = storage_shard(storage, hash);
+    if (hashtable_find(shard->files, pathname, hash)) {
+        errno = EEXIST;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
-
-    // Recupero il file dallo storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
+    // Riservo il posto per il nuovo file: se è stato raggiunto il numero massimo di file consentiti,
+    //  l'algoritmo di rimpiazzo ne espelle uno
+    if (storage_reserve(storage, &storage->number_of_files, storage->max_files, 1, pathname, victims_no, victims) == -1) {
+        // Non è stato possibile espelle alcun file, creazione annullata
+        return -1;
+    }
+    if (*victims_no > 0) atomic_fetch_add(&storage->rp_algorithm_counter, 1);
+
+    // Creo un nuovo file vuoto
+    // * Non è necessario richiedere l'accesso in scrittura sul file
+    // *  perché non può essere ancora utilizzato da altri client
+    storage_file_t* file = storage_file_create(storage, pathname, NULL, 0);
+
+    // Lo apro in lettura per il client
+    if (!file || !linked_list_insert(&file->readers, client)) {
+        // Errore di creazione del file o di inserimento in lista
+        storage_file_destroy((void*)file);
+        atomic_fetch_sub(&storage->number_of_files, 1);
+        // Errno viene settato da storage_file_create o linked_list_insert
+        return -1;
+    }
 
-    // Controllo se il file esiste all'interno dello storage
-    if (!file) {
-        rwlock_done_read(storage->rwlock);
-        errno = ENOENT;
+    // Se il flag O_LOCK è stato settato, apro il file anche in scrittura per il client
+    if (lock_flag) file->writer = client;
+
+    // Inserisco il file nella partizione e nel suo indice di rimpiazzo, con il lock in scrittura sul file:
+    //  chi lo trova nella hashmap attende che sia anche nell'indice
+    LOCK(&shard->lock);
+    rwlock_start_write(&file->rwlock);
+    // Un altro client potrebbe aver creato lo stesso file nel frattempo (EEXIST)
+    bool inserted = hashtable_insert(shard->files, file->name, hash, file) == 0;
+    int error = errno;
+    bool indexed = inserted && policy_insert(shard->policy, &file->policy, file->name) == 0;
+    // Un file fuori dall'indice non potrebbe essere espulso: lo scollego, ed altri potrebbero già averlo trovato
+    if (inserted && !indexed) storage_unlink(storage, shard, file, false);
+    rwlock_done_write(&file->rwlock);
+    UNLOCK(&shard->lock);
+
+    if (!indexed) {
+        // Se l'inserimento nello storage fallisce, libero la memoria ed il posto riservato, e ritorno errore
+        if (!inserted) storage_file_destroy((void*)file);
+        atomic_fetch_sub(&storage->number_of_files, 1);
+        errno = inserted ? ENOMEM : error;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sul file
-    rwlock_start_read(file->rwlock);
+    // Aggiorno le statistiche dello storage
+    storage_update_max(&storage->max_files_reached, atomic_load(&storage->number_of_files));
+
+    return 0;
+}
+
+static int read_file(storage_t* storage, const char* pathname, storage_blob_t** contents, size_t* size, int client) {
+    // Recupero il file ed acquisisco l'accesso in lettura su di esso: più client possono leggerlo contemporaneamente
+    storage_file_t* file = storage_acquire(storage, pathname, false);
+    if (!file) return -1;
 
     // Controllo che il client abbia aperto il file in lettura
-    if (!linked_list_find(file->readers, client)) {
-        rwlock_done_read(file->rwlock);
-        rwlock_done_read(storage->rwlock);
+    if (!linked_list_find(&file->readers, client)) {
+        rwlock_done_read(&file->rwlock);
         errno = EPERM;
         return -1;
     }
 
-    // Rilascio l'accesso in lettura sul file
-    rwlock_done_read(file->rwlock);
-    // Acquisisco l'accesso in scrittura sul file
-    rwlock_start_write(file->rwlock);
-
-    // Copio il contenuto e la dimensione del file
+    // Acquisisco un riferimento al contenuto del file, senza copiarlo
+    // Rilasciare il riferimento è compito del server; una sovrascrittura nel frattempo non lo modifica
     *size = file->size;
-    *contents = malloc(file->size);  // Chiamare la free di questa memoria è compito del server
-    memcpy(*contents, file->contents, file->size);
+    *contents = file->size > 0 ? storage_blob_acquire(file->contents) : NULL;
 
     // Aggioro le statistiche del file
-    file->last_use_time = time(NULL);
-    file->frequency++;
+    storage_file_touch(file, true);
 
-    // Rilascio l'accesso in scrittura sul file
-    rwlock_done_write(file->rwlock);
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
+    // Rilascio l'accesso in lettura sul file
+    rwlock_done_read(&file->rwlock);
 
     return 0;
 }
 
-int storage_read_n_files(storage_t* storage, int N, storage_file_t*** read_files, int client) {
-    // Controllo la validità degli argomenti
-    if (!storage || !read_files) {
-        errno = EINVAL;
-        return -1;
-    }
-
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
-
-    // Controllo i possibili valori di n
-    int actual_N = N;
-    // Se n <= 0 oppure è maggior del numero di files attualmente memorizzati, li leggo tutti
-    if (N <= 0 || N >= storage->number_of_files) actual_N = storage->number_of_files;
-
-    // Alloco la memoria necessaria
-    *read_files = malloc(sizeof(storage_file_t*) * actual_N);
-    int files_no = icl_hash_get_n_files(storage->files, actual_N, (void***)read_files);
-
-    if (files_no < 0) {
-        // L'operazione è fallita, ritorno errore
-        free(*read_files);
-        rwlock_done_read(storage->rwlock);
-        return -1;
+// * File di una partizione, raccolti da una lettura di più file
+typedef struct StorageScan {
+    storage_file_t** files;  // File raccolti
+    size_t files_no;         // Numero di file raccolti
+    size_t capacity;         // Numero di file allocati
+} storage_scan_t;
+
+// Aggiunge il file <value> alla raccolta <scan>; ritorna false se non c'è memoria per raccoglierne altri
+static bool storage_scan_file(void* value, void* scan) {
+    storage_scan_t* s = (storage_scan_t*)scan;
+    if (s->files_no == s->capacity) {
+        size_t capacity = s->capacity > 0 ? 2 * s->capacity : 64;
+        storage_file_t** files = realloc(s->files, capacity * sizeof(storage_file_t*));
+        if (!files) return false;
+        s->files = files;
+        s->capacity = capacity;
     }
+    s->files[s->files_no++] = (storage_file_t*)value;
+    return true;
+}
 
-    for (int i = 0; i < files_no; i++) {
-        if ((*read_files)[i]) {
-            storage_file_t* current_file = icl_hash_find(storage->files, (void*)(*read_files)[i]->name);
-            // Acquisisco l'accesso in scrittura sul file
-            rwlock_start_write(current_file->rwlock);
-            // Aggiorno le informazioni di utilizzo
-            current_file->last_use_time = time(NULL);
-            current_file->frequency++;
-            // Rilascio l'accesso in scrittura sul file
-            rwlock_done_write(current_file->rwlock);
+// * Legge al più <N> file non vuoti, una partizione alla volta, e ne salva una copia in <read_files>
+// I file di una partizione vengono raccolti con il suo lock: senza inserimenti la tabella non viene ridimensionata,
+//  quindi ogni file presente in quel momento viene raccolto esattamente una volta (hashtable_foreach).
+// Le copie vengono create dopo aver rilasciato il lock, che precede sempre quello dei file: la sezione critica
+//  dell'epoca mantiene validi i file raccolti, e quelli rimossi nel frattempo vengono saltati.
+// Una scansione non è un utilizzo dei file letti: altrimenti ARC e 2Q promuoverebbero tutti i file come riutilizzati.
+static int read_n_files(storage_t* storage, int N, storage_file_t** read_files) {
+    storage_scan_t scan = {NULL, 0, 0};
+    int files_no = 0;
+    for (size_t i = 0; i < storage->shards_no && files_no < N; i++) {
+        storage_shard_t* shard = &storage->shards[i];
+        scan.files_no = 0;
+        LOCK(&shard->lock);
+        hashtable_foreach(shard->files, storage_scan_file, &scan);
+        UNLOCK(&shard->lock);
+
+        for (size_t j = 0; j < scan.files_no && files_no < N; j++) {
+            storage_file_t* file = scan.files[j];
+            // Acquisisco l'accesso in lettura sul file
+            rwlock_start_read(&file->rwlock);
+            // Salto i file vuoti e quelli rimossi dopo la raccolta
+            // La copia del file condivide il contenuto di quello memorizzato
+            storage_file_t* copy = NULL;
+            if (!file->removed && file->size > 0 && (copy = storage_file_create(storage, file->name, file->contents, file->size)) != NULL)
+                read_files[files_no++] = copy;
+            // Rilascio l'accesso in lettura sul file
+            rwlock_done_read(&file->rwlock);
         }
     }
-
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
+    free(scan.files);
 
     // Ritorno il numero di file letti
     return files_no;
 }
 
-int storage_write_file(storage_t* storage, const char* pathname, void* contents, size_t size, int* victims_no, storage_file_t*** victims, size_t* old_size, int client) {
-    // Controllo la validità degli argomenti
-    if (!storage || !pathname || !contents || size == 0 || !victims_no || !victims) {
-        errno = EINVAL;
+static int write_begin(storage_t* storage, const char* pathname, size_t size, bool append, int* victims_no, storage_file_t*** victims, storage_write_t* write, int client) {
+    // Recupero il file ed acquisisco l'accesso in scrittura su di esso
+    storage_file_t* file = storage_acquire(storage, pathname, true);
+    if (!file) return -1;
+
+    // Controllo che il file sia stato aperto in scrittura dal client
+    if (file->writer != client || file->writing) {
+        rwlock_done_write(&file->rwlock);
+        errno = EPERM;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
-
-    // Prima di fare qualsiasi cosa, controllo che la dimensione del file che si vuole scrivere
-    //  non sia maggiore della capienza massima dello storage
-    if (size > storage->max_capacity) {
-        rwlock_done_read(storage->rwlock);
+    // Controllo che la dimensione (totale) del file non sia maggiore della capienza massima dello storage
+    // Sovrascrivendo il file, lo spazio occupato dal contenuto precedente viene liberato
+    size_t released = append ? 0 : file->size;
+    if ((append ? file->size : 0) + size > storage->max_capacity) {
+        rwlock_done_write(&file->rwlock);
         errno = ENOSPC;
         return -1;
     }
 
-    // Recupero il file dallo storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
-
-    // Controllo che il file che si vuole scrivere esista nello storage
-    if (!file) {
-        rwlock_done_read(storage->rwlock);
-        errno = ENOENT;
-        return -1;
+    // Escludo il file da rimpiazzo e rimozione fino al termine della scrittura:
+    //  da qui in poi resta valido anche fuori dalla sezione critica
+    file->writing = true;
+    write->old_size = file->size;
+    rwlock_done_write(&file->rwlock);
+
+    // Riservo lo spazio per il nuovo contenuto: se lo storage ha esaurito lo spazio libero,
+    //  l'algoritmo di rimpiazzo espelle altri file finché non c'è spazio sufficiente
+    if (size >= released) {
+        if (storage_reserve(storage, &storage->capacity, storage->max_capacity, size - released, pathname, victims_no, victims) == -1) {
+            // Non è stato possibile espelle alcun file, scrittura annullata
+            // I file già espulsi vengono comunque inviati al client
+            if (*victims_no > 0) atomic_fetch_add(&storage->rp_algorithm_counter, 1);
+            storage_write_release(storage, file, 0, 0);
+            return -1;
+        }
+    } else {
+        atomic_fetch_sub(&storage->capacity, released - size);
     }
-
-    // Acquisisco l'accesso in lettura sul file
-    rwlock_start_read(file->rwlock);
-
-    // Controllo nuovamente che il file sia stato aperto in scrittura dal client
-    if (file->writer != client) {
-        rwlock_done_read(file->rwlock);
-        rwlock_done_read(storage->rwlock);
-        errno = EPERM;
-        return -1;
+    if (*victims_no > 0) atomic_fetch_add(&storage->rp_algorithm_counter, 1);
+    storage_update_max(&storage->max_capacity_reached, atomic_load(&storage->capacity));
+
+    // Preparo la destinazione del contenuto
+    write->size = size;
+    if (append) {
+        // Amplio il contenuto del file: i lettori, anche quelli che ne hanno già acquisito un riferimento,
+        //  vedono solamente i primi <file->size> bytes, che non vengono più modificati
+        rwlock_start_write(&file->rwlock);
+        storage_blob_t* updated_contents = storage_blob_grow(file->contents, file->size, file->size + size);
+        if (updated_contents) file->contents = updated_contents;
+        rwlock_done_write(&file->rwlock);
+        if (!updated_contents) {
+            storage_write_release(storage, file, size, released);
+            return -1;
+        }
+        write->destination = updated_contents->data + file->size;
+    } else {
+        // Il nuovo contenuto viene ricevuto in un blob separato, che sostituirà quello attuale
+        if ((write->contents = storage_blob_create(size)) == NULL) {
+            storage_write_release(storage, file, size, released);
+            return -1;
+        }
+        write->destination = write->contents->data;
     }
+    write->file = file;
 
-    // Se lo storage ha esaurito lo spazio libero, faccio partire l'algoritmo di rimpiazzo
-    if ((storage->capacity - file->size) + size > storage->max_capacity) {
-        // Algoritmo di rimpiazzo
-        *victims_no = 0;
-        *victims = malloc(sizeof(storage_file_t*) * storage->number_of_files);  // Al più, rimuovo tutti i file presenti
+    return 0;
+}
 
-        // Finché non c'è spazio sufficiente a contenere il nuovo file, seleziono file da rimuovere
-        while ((storage->capacity - file->size) + size > storage->max_capacity) {
-            // Seleziono il file da espellere
-            storage_file_t* victim = (storage_file_t*)icl_hash_get_victim(storage->files, storage->replacement_policy, pathname);
+static int lock_file(storage_t* storage, const char* pathname, int client) {
+    // Recupero il file ed acquisisco l'accesso in scrittura su di esso
+    storage_file_t* file = storage_acquire(storage, pathname, true);
+    if (!file) return -1;
 
-            if (!victim) {
-                // Non è stato possibile espelle alcun file, scrittura annullata
-                rwlock_done_read(file->rwlock);
-                rwlock_done_read(storage->rwlock);
-                errno = ECANCELED;
-                return -1;
-            }
+    int result = 0;
+    if (file->writer == client) {
+        // Il file è gia aperto in scrittura per il client che ha effettuato la richiesta
+    } else if (!linked_list_find(&file->readers, client)) {
+        // Se il file non è stato precedentemente aperto, almeno in lettura, dal client, non posso aprirlo in scrittura
+        errno = ENOLCK;
+        result = -1;
+    } else if (file->writer != 0) {
+        // Se il file è aperto in scrittura da un altro client, ritorno errore
+        errno = EACCES;
+        result = -1;
+    } else {
+        // Il file non è stato aperto in scrittura da nessun client (= non è bloccato in scrittura)
+        // Imposto il lock in scrittura sul file per il client
+        file->writer = client;
+        // Aggioro le statistiche del file
+        storage_file_touch(file, false);
+    }
 
-            // Effettuo una copia del file per poterlo inviare al client
-            (*victims)[*victims_no] = storage_file_create(victim->name, victim->contents, victim->size);
+    // Rilascio l'accesso in scrittura sul file
+    rwlock_done_write(&file->rwlock);
 
-            // Elimino il file dallo storage
-            if (icl_hash_delete(storage->files, victim->name, NULL, storage_file_destroy) == -1) {
-                // Errore nella cancellazione del file
-                // Annullo la selezione della vittima, e riprovo
-                storage_file_destroy(((*victims)[*victims_no]));
-                continue;
-            }
+    return result;
+}
 
-            // Aggiorno le informazioni dello storage
-            storage->number_of_files--;                          // Decremento il numero di file nello storage
-            storage->capacity -= (*victims)[*victims_no]->size;  // Libero lo spazio occupato dal file rimosso
+static int unlock_file(storage_t* storage, const char* pathname, int client) {
+    // Recupero il file ed acquisisco l'accesso in scrittura su di esso
+    storage_file_t* file = storage_acquire(storage, pathname, true);
+    if (!file) return -1;
 
-            // Incremento il numero dei file espulsi
-            (*victims_no)++;
-        }
+    if (file->writer == 0 || file->writer != client) {
+        // Il file non è attualmente lockato in scrittura, oppure
+        // la lock è detenuta da un client diverso
+        rwlock_done_write(&file->rwlock);
+        errno = ENOLCK;
+        return -1;
     }
 
-    // Rilascio l'accesso in lettura sul file
-    rwlock_done_read(file->rwlock);
-    // Acquisisco l'accesso in scrittura sul file
-    rwlock_start_write(file->rwlock);
-
-    // Rimuovo le tracce di un eventuale file precedentemente scritto
-    if (file->contents) free(file->contents);
-    *old_size = file->size;  // Usata in fondo per aggiornare le informazioni dello storage
-
-    // Aggiorno il contenuto del file
-    file->contents = contents;
-    file->size = size;
+    // A questo punto, file->writer sarà pari a client, per costruzione,
+    // ovvero client ha in precedenza aperto il file in scrittura
+    // Rilascio quindi la lock
+    file->writer = 0;
+    // Il file rimarrà aperto in lettura
 
     // Aggioro le statistiche del file
-    file->last_use_time = time(NULL);
-    file->frequency++;
+    storage_file_touch(file, false);
 
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
-    // Acquisisco l'accesso in scrittura sullo storage
-    rwlock_start_write(storage->rwlock);
     // Rilascio l'accesso in scrittura sul file
-    rwlock_done_write(file->rwlock);
-
-    // Aggiorno le informazioni dello storage
-    // Sottraggo alla capacità dello storage quella occupata dal file che eventualmente ho sovrascritto,
-    // quindi sommo la dimensione del nuovo file caricato
-    storage->capacity = (storage->capacity - (*old_size)) + size;
-    storage->max_capacity_reached = MAX(storage->max_capacity_reached, storage->capacity);
-    if (*victims_no > 0) storage->rp_algorithm_counter++;
-
-    // Rilascio l'accesso in scrittura sullo storage
-    rwlock_done_write(storage->rwlock);
+    rwlock_done_write(&file->rwlock);
 
     return 0;
 }
 
-int storage_append_to_file(storage_t* storage, const char* pathname, const void* contents, size_t size, int* victims_no, storage_file_t*** victims, int client) {
-    // Controllo la validità degli argomenti
-    if (!storage || !pathname || !contents || size == 0 || !victims_no || !victims) {
-        errno = EINVAL;
-        return -1;
-    }
-
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
+static int close_file(storage_t* storage, const char* pathname, int client) {
+    // Recupero il file ed acquisisco l'accesso in scrittura su di esso
+    storage_file_t* file = storage_acquire(storage, pathname, true);
+    if (!file) return -1;
 
-    // Recupero il file dallo storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
-
-    // Controllo che il file che si vuole scrivere esista nello storage
-    if (!file) {
-        errno = ENOENT;
+    // Controllo che <client> abbia precedentemente eseguito la openFile
+    if (!linked_list_find(&file->readers, client)) {
+        rwlock_done_write(&file->rwlock);
+        errno = ENOLCK;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sul file
-    rwlock_start_read(file->rwlock);
-
-    // Controllo che la dimensione (totale) del file non sia maggiore della capienza massima dello storage
-    if (file->size + size > storage->max_capacity) {
-        rwlock_done_read(file->rwlock);
-        rwlock_done_read(storage->rwlock);
-        errno = ENOSPC;
-        return -1;
-    }
+    // Chiudo il file in scrittura per il client, se era stato aperto con questa modalità
+    if (file->writer != 0 && file->writer == client) file->writer = 0;
 
-    // Controllo che il file sia stato aperto in scrittura dal client
-    if (file->writer != client) {
-        rwlock_done_read(file->rwlock);
-        rwlock_done_read(storage->rwlock);
-        errno = EPERM;
+    // Chiudo il file in lettura per il client
+    if (!linked_list_remove(&file->readers, client)) {
+        rwlock_done_write(&file->rwlock);
+        // Errno è settato da linked_list_remove
         return -1;
     }
 
-    // Se lo storage ha esaurito lo spazio libero, faccio partire l'algoritmo di rimpiazzo
-    if (storage->capacity + size > storage->max_capacity) {
-        // Algoritmo di rimpiazzo
-        *victims_no = 0;
-        *victims = malloc(sizeof(storage_file_t*) * storage->number_of_files);  // Al più, rimuovo tutti i file presenti
+    // Aggioro le statistiche del file
+    storage_file_touch(file, false);
 
-        // Finché non c'è spazio sufficiente a contenere il nuovo file, seleziono file da rimuovere
-        while (storage->capacity + size > storage->max_capacity) {
-            // Seleziono il file da espellere
-            storage_file_t* victim = (storage_file_t*)icl_hash_get_victim(storage->files, storage->replacement_policy, pathname);
+    // Rilascio l'accesso in scrittura sul file
+    rwlock_done_write(&file->rwlock);
 
-            if (!victim) {
-                // Non è stato possibile espelle alcun file, scrittura annullata
-                rwlock_done_read(file->rwlock);
-                rwlock_done_read(storage->rwlock);
-                errno = ECANCELED;
-                return -1;
-            }
+    return 0;
+}
 
-            // Effettuo una copia del file per poterlo inviare al client
-            (*victims)[*victims_no] = storage_file_create(victim->name, victim->contents, victim->size);
+static int remove_file(storage_t* storage, const char* pathname, size_t* size, int client) {
+    uint64_t hash = hashtable_hash(pathname);
+    storage_shard_t* shard = storage_shard(storage, hash);
 
-            // Elimino il file dallo storage
-            if (icl_hash_delete(storage->files, victim->name, NULL, storage_file_destroy) == -1) {
-                // Errore nella cancellazione del file
-                // Annullo la selezione della vittima, e riprovo
-                storage_file_destroy(((*victims)[*victims_no]));
-                continue;
-            }
+    // La rimozione modifica la hashmap, quindi acquisisco il lock della partizione:
+    //  con esso, il file trovato non può essere rimosso da altri
+    LOCK(&shard->lock);
 
-            // Aggiorno le informazioni dello storage
-            storage->number_of_files--;                          // Decremento il numero di file nello storage
-            storage->capacity -= (*victims)[*victims_no]->size;  // Libero lo spazio occupato dal file rimosso
+    // Recupero il file dallo storage
+    storage_file_t* file = hashtable_find(shard->files, pathname, hash);
 
-            // Incremento il numero dei file espulsi
-            (*victims_no)++;
-        }
+    // Controllo che il file esista
+    if (!file) {
+        UNLOCK(&shard->lock);
+        errno = ENOENT;
+        return -1;
     }
 
-    // Rilascio l'accesso in lettura sul file
-    rwlock_done_read(file->rwlock);
     // Acquisisco l'accesso in scrittura sul file
-    rwlock_start_write(file->rwlock);
+    rwlock_start_write(&file->rwlock);
 
-    // Amplio la memoria allocata per il file
-    void* updated_contents = realloc(file->contents, file->size + size);
-    if (!updated_contents) return -1;
-    file->contents = updated_contents;
-    // Aggiungo <contents> partendo dalla fine di <file->contents>
-    memcpy(file->contents + file->size, contents, size);
+    if (file->writer == 0 || file->writer != client || file->writing) {
+        // Il file non è attualmente lockato in scrittura, la lock è detenuta da un client diverso,
+        //  oppure il suo contenuto è ancora in ricezione
+        rwlock_done_write(&file->rwlock);
+        UNLOCK(&shard->lock);
+        errno = ENOLCK;
+        return -1;
+    }
 
-    // Aggiorno la dimensione del file
-    file->size += size;
-    // Aggioro le statistiche del file
-    file->last_use_time = time(NULL);
-    file->frequency++;
+    // Usata in fondo per aggiornare le informazioni dello storage
+    size_t old_size = file->size;
+    // Utilizzata dal server ai fini di logging
+    *size = old_size;
 
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
-    // Acquisisco l'accesso in scrittura sullo storage
-    rwlock_start_write(storage->rwlock);
-    // Rilascio l'accesso in scrittura sul file
-    rwlock_done_write(file->rwlock);
+    // A questo punto, file->writer sarà pari a client, per costruzione,
+    // ovvero client ha in precedenza aperto il file in scrittura
+    // Scollego quindi il file dallo storage: verrà cancellato al termine del periodo di grazia
+    storage_unlink(storage, shard, file, false);
 
-    // Aggiorno le informazioni dello storage
-    storage->capacity += size;  // Sommo la dimensione del contenuto aggiunto
-    storage->max_capacity_reached = MAX(storage->max_capacity_reached, storage->capacity);
-    if (*victims_no > 0) storage->rp_algorithm_counter++;
+    // Rilascio l'accesso in scrittura sul file ed il lock della partizione
+    rwlock_done_write(&file->rwlock);
+    UNLOCK(&shard->lock);
 
-    // Rilascio l'accesso in scrittura sullo storage
-    rwlock_done_write(storage->rwlock);
+    // Aggiorno le informazioni dello storage
+    atomic_fetch_sub(&storage->number_of_files, 1);  // Decremento il numero di file nello storage
+    atomic_fetch_sub(&storage->capacity, old_size);  // Libero lo spazio occupato dal file rimosso
 
     return 0;
 }
 
-int storage_lock_file(storage_t* storage, const char* pathname, int client) {
+// ! APIs
+// Ogni API valida gli argomenti ed esegue il proprio corpo in una sezione critica dell'epoca
+
+int storage_open_file(storage_t* storage, const char* pathname, int flags, int* victims_no, storage_file_t*** victims, int client) {
     // Controllo la validità degli argomenti
-    if (!storage || !pathname) {
+    if (!storage || !pathname || flags < 0 || !victims_no || !victims) {
         errno = EINVAL;
         return -1;
     }
+    *victims_no = 0;
+    *victims = NULL;
 
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
-
-    // Recupero il file dallo storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = open_file(storage, pathname, flags, victims_no, victims, client);
+    epoch_exit(storage->epoch);
+    return result;
+}
 
-    // Controllo che il file esista
-    if (!file) {
-        rwlock_done_read(storage->rwlock);
-        errno = ENOENT;
+int storage_read_file(storage_t* storage, const char* pathname, storage_blob_t** contents, size_t* size, int client) {
+    // Controllo la validità degli argomenti
+    if (!storage || !pathname || !contents || !size) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sul file
-    rwlock_start_read(file->rwlock);
-
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
-
-    // Se il file è gia aperto in scrittura per il client che ha effettuato la richiesta, ritorno immediatamente
-    if (file->writer == client) {
-        rwlock_done_read(file->rwlock);
-        return 0;
-    }
-
-    // Se il file non è stato precedentemente aperto, almeno in lettura, dal client, non posso aprirlo in scrittura
-    if (!linked_list_find(file->readers, client)) {
-        rwlock_done_read(file->rwlock);
-        errno = ENOLCK;
-        return -1;
-    }
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = read_file(storage, pathname, contents, size, client);
+    epoch_exit(storage->epoch);
+    return result;
+}
 
-    // Se il file non è stato aperto in scrittura da nessun client (= non è bloccato in scrittura)
-    if (file->writer == 0) {
-        // Rilascio l'accesso in lettura sul file
-        rwlock_done_read(file->rwlock);
-        // Acquisisco l'accesso in scrittura sul file
-        rwlock_start_write(file->rwlock);
-        // Imposto il lock in scrittura sul file per il client
-        file->writer = client;
-    } else {
-        // Se il file è aperto in scrittura da un altro client, ritorno errore
-        // Rilascio l'accesso in lettura sul file
-        rwlock_done_read(file->rwlock);
-        errno = EACCES;
+int storage_read_n_files(storage_t* storage, int N, storage_file_t*** read_files, int client) {
+    // Controllo la validità degli argomenti
+    if (!storage || !read_files) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Aggioro le statistiche del file
-    file->last_use_time = time(NULL);
-    file->frequency++;
+    // Controllo i possibili valori di n
+    // Se n <= 0 oppure è maggior del numero di files attualmente memorizzati, li leggo tutti
+    size_t stored = atomic_load(&storage->number_of_files);
+    int actual_N = (N <= 0 || (size_t)N >= stored) ? (int)stored : N;
 
-    // Rilascio l'accesso in scrittura sul file
-    rwlock_done_write(file->rwlock);
+    // Alloco la memoria necessaria
+    *read_files = malloc(sizeof(storage_file_t*) * (actual_N > 0 ? actual_N : 1));
+    if (!*read_files) return -1;
 
-    return 0;
+    if (epoch_enter(storage->epoch) == -1) {
+        free(*read_files);
+        *read_files = NULL;
+        return -1;
+    }
+    int result = read_n_files(storage, actual_N, *read_files);
+    epoch_exit(storage->epoch);
+    return result;
 }
 
-int storage_unlock_file(storage_t* storage, const char* pathname, int client) {
+int storage_write_begin(storage_t* storage, const char* pathname, size_t size, bool append, int* victims_no, storage_file_t*** victims, storage_write_t* write, int client) {
     // Controllo la validità degli argomenti
-    if (!storage || !pathname) {
+    if (!storage || !pathname || size == 0 || !victims_no || !victims || !write) {
         errno = EINVAL;
         return -1;
     }
+    memset(write, 0, sizeof(storage_write_t));
+    *victims_no = 0;
+    *victims = NULL;
+
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = write_begin(storage, pathname, size, append, victims_no, victims, write, client);
+    epoch_exit(storage->epoch);
+    return result;
+}
 
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
-
-    // Recupero il file dallo storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
-
-    // Controllo che il file esista
-    if (!file) {
-        rwlock_done_read(storage->rwlock);
-        errno = ENOENT;
+int storage_write_commit(storage_t* storage, storage_write_t* write) {
+    // Controllo la validità degli argomenti
+    if (!storage || !write || !write->file) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sul file
-    rwlock_start_read(file->rwlock);
-
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
+    // Il file non può essere stato espulso durante la ricezione, quindi non serve cercarlo nuovamente
+    storage_file_t* file = write->file;
+    storage_blob_t* old_contents = NULL;
+    rwlock_start_write(&file->rwlock);
 
-    if (file->writer == 0 || file->writer != client) {
-        // Il file non è attualmente lockato in scrittura, oppure
-        // la lock è detenuta da un client diverso
-        rwlock_done_read(file->rwlock);
-        errno = ENOLCK;
-        return -1;
+    if (write->contents) {
+        // Sostituisco il contenuto precedente, che resta valido per le letture ancora in corso
+        old_contents = file->contents;
+        file->contents = write->contents;
+        file->size = write->size;
+    } else {
+        // Il contenuto aggiunto si trova già in fondo al file
+        file->size += write->size;
     }
 
-    // Rilascio l'accesso in lettura sul file
-    rwlock_done_read(file->rwlock);
-    // Acquisisco l'accesso in scrittura sul file
-    rwlock_start_write(file->rwlock);
-
-    // A questo punto, file->writer sarà pari a client, per costruzione,
-    // ovvero client ha in precedenza aperto il file in scrittura
-    // Rilascio quindi la lock
-    file->writer = 0;
-    // Il file rimarrà aperto in lettura
-
-    // Aggioro le statistiche del file
-    file->last_use_time = time(NULL);
-    file->frequency++;
+    // Aggioro le statistiche del file: la sua nuova dimensione conta per le politiche che ne tengono conto
+    policy_resize(&file->policy, file->size);
+    storage_file_touch(file, false);
+    file->writing = false;
 
     // Rilascio l'accesso in scrittura sul file
-    rwlock_done_write(file->rwlock);
+    rwlock_done_write(&file->rwlock);
+    storage_blob_release(old_contents);
 
+    write->file = NULL;
+    write->contents = NULL;
     return 0;
 }
 
-int storage_close_file(storage_t* storage, const char* pathname, int client) {
-    // Controllo la validità degli argomenti
-    if (!storage || !pathname) {
-        errno = EINVAL;
-        return -1;
-    }
+void storage_write_abort(storage_t* storage, storage_write_t* write) {
+    if (!storage || !write || !write->file) return;
 
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
+    // Restituisco lo spazio riservato; sovrascrivendo il file, torna ad occupare quello del contenuto precedente
+    storage_write_release(storage, write->file, write->size, write->contents ? write->old_size : 0);
 
-    // Controllo se il file esiste all'interno dello storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
+    storage_blob_release(write->contents);
+    write->file = NULL;
+    write->contents = NULL;
+}
 
-    // Se non esiste, ritorno subito errore
-    if (!file) {
-        rwlock_done_read(storage->rwlock);
-        errno = ENOENT;
+int storage_lock_file(storage_t* storage, const char* pathname, int client) {
+    // Controllo la validità degli argomenti
+    if (!storage || !pathname) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sul file
-    rwlock_start_read(file->rwlock);
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = lock_file(storage, pathname, client);
+    epoch_exit(storage->epoch);
+    return result;
+}
 
-    // Controllo che <client> abbia precedentemente eseguito la openFile
-    if (!linked_list_find(file->readers, client)) {
-        rwlock_done_read(file->rwlock);
-        rwlock_done_read(storage->rwlock);
-        errno = ENOLCK;
+int storage_unlock_file(storage_t* storage, const char* pathname, int client) {
+    // Controllo la validità degli argomenti
+    if (!storage || !pathname) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(file->rwlock);
-    // Acquisisco l'accesso in scrittura sullo storage
-    rwlock_start_write(file->rwlock);
-
-    // Chiudo il file in scrittura per il client, se era stato aperto con questa modalità
-    if (file->writer != 0 && file->writer == client) file->writer = 0;
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = unlock_file(storage, pathname, client);
+    epoch_exit(storage->epoch);
+    return result;
+}
 
-    // Chiudo il file in lettura per il client
-    if (!linked_list_remove(file->readers, client)) {
-        rwlock_done_write(file->rwlock);
-        rwlock_done_read(storage->rwlock);
-        // Errno è settato da linked_list_remove
+int storage_close_file(storage_t* storage, const char* pathname, int client) {
+    // Controllo la validità degli argomenti
+    if (!storage || !pathname) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Aggioro le statistiche del file
-    file->last_use_time = time(NULL);
-    file->frequency++;
-
-    // Rilascio l'accesso in scrittura sul file
-    rwlock_done_write(file->rwlock);
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
-
-    return 0;
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = close_file(storage, pathname, client);
+    epoch_exit(storage->epoch);
+    return result;
 }
 
 int storage_remove_file(storage_t* storage, const char* pathname, size_t* size, int client) {
     // Controllo la validità degli argomenti
-    if (!storage || !pathname) {
+    if (!storage || !pathname || !size) {
         errno = EINVAL;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sullo storage
-    rwlock_start_read(storage->rwlock);
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = remove_file(storage, pathname, size, client);
+    epoch_exit(storage->epoch);
+    return result;
+}
 
-    // Recupero il file dallo storage
-    storage_file_t* file = icl_hash_find(storage->files, (void*)pathname);
+// ! Reclaimer
 
-    // Controllo che il file esista
-    if (!file) {
-        rwlock_done_read(storage->rwlock);
-        errno = ENOENT;
+int storage_set_watermarks(storage_t* storage, size_t high, size_t low) {
+    // Controllo la validità degli argomenti: la soglia bassa deve lasciare spazio al reclaimer per intervenire
+    if (!storage || high > 100 || (high > 0 && low >= high)) {
+        errno = EINVAL;
         return -1;
     }
 
-    // Acquisisco l'accesso in lettura sul file
-    rwlock_start_read(file->rwlock);
-
-    if (file->writer == 0 || file->writer != client) {
-        // Il file non è attualmente lockato in scrittura, oppure
-        // la lock è detenuta da un client diverso
-        rwlock_done_read(file->rwlock);
-        rwlock_done_read(storage->rwlock);
-        errno = ENOLCK;
-        return -1;
+    if (high == 0) {
+        storage->files_high = storage->files_low = SIZE_MAX;
+        storage->capacity_high = storage->capacity_low = SIZE_MAX;
+    } else {
+        storage->files_high = storage->max_files * high / 100;
+        storage->files_low = storage->max_files * low / 100;
+        storage->capacity_high = storage->max_capacity / 100 * high;
+        storage->capacity_low = storage->max_capacity / 100 * low;
     }
+    return 0;
+}
 
-    // Usata in fondo per aggiornare le informazioni dello storage
-    size_t old_size = file->size;
-    // Utilizzata dal server ai fini di logging
-    *size = old_size;
-
-    // Rilascio l'accesso in lettura sullo storage
-    rwlock_done_read(storage->rwlock);
-    // Acquisisco l'accesso in scrittura sullo storage
-    rwlock_start_write(storage->rwlock);
-    // Rilascio l'accesso in lettura sul file
-    rwlock_done_read(file->rwlock);
+bool storage_reclaim_wait(storage_t* storage) {
+    if (!storage) return false;
+
+    LOCK(&storage->reclaim_lock);
+    while (!storage->reclaim_requested && !storage->reclaim_stopped) pthread_cond_wait(&storage->reclaim_cond, &storage->reclaim_lock);
+    // La richiesta viene consumata: se il reclaimer non riesce a scendere alla soglia bassa,
+    //  riprova solamente alla prossima riserva oltre la soglia alta, senza girare a vuoto
+    storage->reclaim_requested = false;
+    bool running = !storage->reclaim_stopped;
+    UNLOCK(&storage->reclaim_lock);
+    return running;
+}
 
-    // A questo punto, file->writer sarà pari a client, per costruzione,
-    // ovvero client ha in precedenza aperto il file in scrittura
-    // Cancello quindi il file dallo storage
-    if (icl_hash_delete(storage->files, (void*)pathname, NULL, storage_file_destroy) == -1) {
-        rwlock_done_write(storage->rwlock);
+int storage_reclaim(storage_t* storage, int* victims_no, storage_file_t*** victims) {
+    // Controllo la validità degli argomenti
+    if (!storage || !victims_no || !victims) {
+        errno = EINVAL;
         return -1;
     }
+    *victims_no = 0;
+    *victims = NULL;
+
+    // L'espulsione procede una vittima alla volta, così che i client in attesa di storage_evict si alternino al reclaimer
+    if (epoch_enter(storage->epoch) == -1) return -1;
+    int result = 0;
+    while (atomic_load(&storage->number_of_files) > storage->files_low || atomic_load(&storage->capacity) > storage->capacity_low) {
+        if (storage_evict(storage, NULL, victims_no, victims) == -1) {
+            // Nessun file espellibile non è un errore: i file in scrittura verranno espulsi in seguito
+            if (errno != ECANCELED) result = -1;
+            break;
+        }
+    }
+    epoch_exit(storage->epoch);
 
-    // Aggiorno le informazioni dello storage
-    storage->number_of_files--;     // Decremento il numero di file nello storage
-    storage->capacity -= old_size;  // Libero lo spazio occupato dal file rimosso
+    if (*victims_no > 0) {
+        atomic_fetch_add(&storage->rp_algorithm_counter, 1);
+        atomic_fetch_add(&storage->reclaimed_files, *victims_no);
+    }
+    return result == 0 ? *victims_no : -1;
+}
 
-    // Rilascio l'accesso in scrittura sul file
-    rwlock_done_write(storage->rwlock);
+void storage_reclaim_stop(storage_t* storage) {
+    if (!storage) return;
 
-    return 0;
+    LOCK(&storage->reclaim_lock);
+    storage->reclaim_stopped = true;
+    pthread_cond_broadcast(&storage->reclaim_cond);
+    UNLOCK(&storage->reclaim_lock);
 }
@@ -0,0 +1,149 @@
+// @author Luca Cirillo (545480)
+
+// syscall e MAP_POPULATE non fanno parte di POSIX
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <uring.h>
+
+// Head e tail delle code sono condivisi con il kernel: letture con acquire e scritture con release
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+uring_t* uring_create(unsigned entries) {
+    // Controllo la validità degli argomenti
+    if (entries == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uring_t* ring = (uring_t*)calloc(1, sizeof(uring_t));
+    if (!ring) return NULL;
+
+    // Creo l'istanza io_uring
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if ((ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params)) == -1) {
+        free(ring);
+        return NULL;
+    }
+
+    // Mappo submission queue, completion queue ed array delle richieste
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // Dal kernel 5.4 le due code condividono un'unica regione di memoria
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            free(ring);
+            return NULL;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+
+    // Recupero i puntatori ai campi delle code
+    char* sq = (char*)ring->sq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+
+    char* cq = (char*)ring->cq_ring;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return ring;
+}
+
+void uring_destroy(uring_t* ring) {
+    if (!ring) return;
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    free(ring);
+}
+
+int uring_register_buffers(uring_t* ring, const struct iovec* buffers, unsigned count) {
+    if (!ring || !buffers || count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, buffers, count) == -1 ? -1 : 0;
+}
+
+struct io_uring_sqe* uring_get_sqe(uring_t* ring) {
+    // Solamente questo thread scrive il tail, mentre il kernel avanza l'head
+    unsigned head = LOAD_ACQUIRE(ring->sq_head);
+    unsigned tail = *ring->sq_tail + ring->sq_pending;
+    if (tail - head > *ring->sq_mask) return NULL;  // Coda piena
+
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_pending++;
+    return sqe;
+}
+
+int uring_submit_and_wait(uring_t* ring, unsigned wait) {
+    // Rendo visibili al kernel le richieste preparate
+    STORE_RELEASE(ring->sq_tail, *ring->sq_tail + ring->sq_pending);
+    ring->sq_pending = 0;
+
+    while (1) {
+        // Sottometto tutte le richieste che il kernel non ha ancora consumato
+        unsigned submit = *ring->sq_tail - LOAD_ACQUIRE(ring->sq_head);
+        int r = (int)syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (r == -1 && errno == EINTR) continue;
+        return r;
+    }
+}
+
+int uring_pop_cqe(uring_t* ring, struct io_uring_cqe* cqe) {
+    unsigned head = *ring->cq_head;
+    if (head == LOAD_ACQUIRE(ring->cq_tail)) return -1;  // Nessun completamento
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    STORE_RELEASE(ring->cq_head, head + 1);
+    return 0;
+}
+
+unsigned uring_withdraw(uring_t* ring) {
+    unsigned head = LOAD_ACQUIRE(ring->sq_head);
+    unsigned withdrawn = *ring->sq_tail - head + ring->sq_pending;
+    STORE_RELEASE(ring->sq_tail, head);
+    ring->sq_pending = 0;
+    return withdrawn;
+}